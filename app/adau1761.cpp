@@ -1,10 +1,17 @@
 #include "adau1761.h"
 
+#include <algorithm>
 #include <csignal>
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <system_error>
 #include <utility>
+#include <vector>
+
+#include "resampler.h"
+
+// completions reaped at once when draining the completion fd of a stopped stream
+#define MAX_REAPED_COMPLETIONS 4
 
 const std::unordered_map<int, std::array<int, 4>> adau1761::_pll_divisors = {
         //  see: https://www.analog.com/media/en/technical-documentation/data-sheets/ADAU1761.pdf p. 28.
@@ -46,6 +53,16 @@ uint8_t adau1761::_spi_command(int fifo_fd, uint16_t addr, size_t data_len, cons
     return (uint8_t)(rx_val & 0xFF);
 }
 
+int adau1761::playback_rate(int sample_rate) {
+    std::vector<int> rates;
+
+    for (const auto &divisors : _pll_divisors)
+        rates.push_back(divisors.first);
+    std::sort(rates.begin(), rates.end());
+
+    return resampler::output_rate(sample_rate, rates);
+}
+
 int adau1761::_set_sample_rate(int fifo_fd, int sample_rate) {
     uint16_t tx_data_long[3];
 
@@ -89,7 +106,11 @@ int adau1761::_set_volume(int fifo_fd, uint8_t volume) {
     return 0;
 }
 
-int adau1761::_init_codec(int fifo_fd, int sample_rate, uint8_t volume) {
+float adau1761::_volume_gain(uint8_t volume) {
+    return gain_stage::db_to_gain((float)(volume - MAX_VOLUME) * VOLUME_STEP_DB);
+}
+
+int adau1761::_init_codec(int fifo_fd, int sample_rate) {
     uint8_t tx_data;
 
     // switch from I2C to SPI (3 consecutive reads at address 0x4000)
@@ -138,8 +159,8 @@ int adau1761::_init_codec(int fifo_fd, int sample_rate, uint8_t volume) {
     _spi_command(fifo_fd, ADAU1761_REG_PLAYBACK_HEADPHONE_LEFT_VOL_CONTROL, sizeof(tx_data), &tx_data);
     _spi_command(fifo_fd, ADAU1761_REG_PLAYBACK_HEADPHONE_RIGHT_VOL_CONTROL, sizeof(tx_data), &tx_data);
 
-    // set volume
-    _set_volume(fifo_fd, volume);
+    // the headphone volume stays at its headroom, the volume is applied to the samples
+    _set_volume(fifo_fd, HEADPHONE_VOLUME);
 
     return 0;
 }
@@ -167,99 +188,129 @@ void adau1761::init() {
     else
         _i2s_dma_state.tx_channel = channel_info->data[0];
 
-    _init_codec(_i2s_dma_state.cmd_fifo_fd, _i2s_dma_state.sample_rate, _i2s_dma_state.volume);
+    // the end of playback is handled by the player thread, not in the signal handler
+    // (-1 with a driver not supporting it, the callback is used then)
+    _i2s_dma_state.completion_fd = axidma_get_completion_fd(_i2s_dma_state.dev, _i2s_dma_state.tx_channel);
+
+    _i2s_dma_state.stream = std::make_unique<i2s_stream>(_i2s_dma_state.dev, _i2s_dma_state.tx_channel,
+                                                         *_i2s_dma_state.budget, BUFFER_RESERVE_TIMEOUT_MS);
+    _i2s_dma_state.stream->set_gain(_volume_gain(_i2s_dma_state.volume) * _i2s_dma_state.track_gain, 0);
+
+    _init_codec(_i2s_dma_state.cmd_fifo_fd, _i2s_dma_state.sample_rate);
 }
 
 void adau1761::destroy() {
-    // free driver allocated continuous memories
-    for (const auto& dma_memory_info : _i2s_dma_state.dma_memories) {
-        // if there is an ongoing transfer of the memory to be freed, stop the transfer
-        if (_i2s_dma_state.is_busy && _i2s_dma_state.current_transfer.tx_buffer == dma_memory_info.second)
-            axidma_stop_transfer(_i2s_dma_state.dev, _i2s_dma_state.tx_channel);
-
-        axidma_free(_i2s_dma_state.dev, dma_memory_info.second, dma_memory_info.first);
-    }
+    // the ring of the stream is freed with it
+    _i2s_dma_state.stream.reset();
+    _i2s_dma_state.is_busy = false;
 
-    // destroy DMA character device
+    // destroy DMA character device (closes the completion fd as well)
     axidma_destroy(_i2s_dma_state.dev);
+    _i2s_dma_state.completion_fd = -1;
 }
 
-size_t adau1761::lookup_buffer(void *buffer) const {
-    auto it = std::find_if(_i2s_dma_state.dma_memories.cbegin(),
-                           _i2s_dma_state.dma_memories.cend(),
-                           [buffer](const auto & e){ return e.second == buffer; });
+int adau1761::play_stream(int sample_rate, i2s_stream::source_t source, std::function<void(void *)> callback,
+                          void *callback_param) {
+    if (!_i2s_dma_state.stream)
+        return -1;
+
+    // change sample rate if needed
+    if (_i2s_dma_state.sample_rate != sample_rate) {
+        if (_set_sample_rate(_i2s_dma_state.cmd_fifo_fd, sample_rate) != 0) {
+            return -1;
+        }
+
+        _i2s_dma_state.sample_rate = sample_rate;
+    }
+
+    // stop any ongoing playback, the periods are refilled by the player
+    stop();
 
-    if (it != _i2s_dma_state.dma_memories.cend())
-        return it->first;
+    if (_i2s_dma_state.stream->start(std::move(source)) != 0)
+        return -1;
+
+    _i2s_dma_state.is_busy = true;
+    _i2s_dma_state.current_transfer.user_callback = std::move(callback);
+    _i2s_dma_state.current_transfer.callback_param = callback_param;
 
     return 0;
 }
 
-void *adau1761::request_buffer(size_t buffer_size) {
-    if (buffer_size == 0)
-        return nullptr;
-
-    void * buff = axidma_malloc(_i2s_dma_state.dev, buffer_size);
-    if (buff)
-        _i2s_dma_state.dma_memories.emplace_back(buffer_size, buff);
+int adau1761::enqueue_stream(int sample_rate, i2s_stream::source_t source) {
+    if (!_i2s_dma_state.stream || !_i2s_dma_state.stream->is_running() || _i2s_dma_state.sample_rate != sample_rate)
+        return -1;
 
-    return buff;
+    return _i2s_dma_state.stream->enqueue(std::move(source)) ? 0 : -1;
 }
 
-int adau1761::release_buffer(void *buffer) {
-    // lookup buffer and size in the dma_memories vector
-    auto it = std::find_if(_i2s_dma_state.dma_memories.cbegin(),
-                              _i2s_dma_state.dma_memories.cend(),
-                              [buffer](const auto & e){ return e.second == buffer; });
+int adau1761::crossfade_stream(int sample_rate, i2s_stream::source_t source, size_t overlap_frames,
+                               float track_gain) {
+    if (!_i2s_dma_state.stream || !_i2s_dma_state.stream->is_running() || _i2s_dma_state.sample_rate != sample_rate ||
+        _i2s_dma_state.track_gain <= 0)
+        return -1;
 
-    // if not found, return error
-    if (it == _i2s_dma_state.dma_memories.cend())
+    // half of a period for the two decoders and the mixing, the refill keeps ahead of the DMA
+    double budget_us = _i2s_dma_state.stream->period_ms(sample_rate) * 1000.0 * I2S_CROSSFADE_BUDGET;
+    if (!_i2s_dma_state.stream->crossfade(std::move(source), overlap_frames, track_gain / _i2s_dma_state.track_gain,
+                                          budget_us))
         return -1;
 
-    // if there is an ongoing transfer of the memory to be released, stop the transfer
-    if (_i2s_dma_state.is_busy && _i2s_dma_state.current_transfer.tx_buffer == buffer)
-        axidma_stop_transfer(_i2s_dma_state.dev, _i2s_dma_state.tx_channel);
+    _i2s_dma_state.track_gain = track_gain;
+    return 0;
+}
 
-    // free continuous memory and remove
-    axidma_free(_i2s_dma_state.dev, it->second, it->first);
-    _i2s_dma_state.dma_memories.erase(it);
+bool adau1761::is_crossfading() const {
+    return _i2s_dma_state.stream && _i2s_dma_state.stream->is_crossfading();
+}
 
-    return 0;
+size_t adau1761::clear_stream_queue() {
+    return _i2s_dma_state.stream ? _i2s_dma_state.stream->clear_queue() : 0;
+}
+
+int adau1761::restart_stream(i2s_stream::source_t source) {
+    if (!_i2s_dma_state.stream || !_i2s_dma_state.stream->is_running())
+        return -1;
+
+    return _i2s_dma_state.stream->restart(std::move(source));
 }
 
-int adau1761::play(void *buffer, int sample_rate, std::function<void(void *)> callback, void *callback_param) {
-    // lookup buffer size in the dma_memories vector
-    size_t buffer_size = lookup_buffer(buffer);
+size_t adau1761::buffered_stream_frames() const {
+    return _i2s_dma_state.stream ? _i2s_dma_state.stream->buffered_frames() : 0;
+}
 
-    // if not found, return error
-    if (buffer_size == 0)
+int adau1761::pause_stream() {
+    if (!_i2s_dma_state.stream || !_i2s_dma_state.stream->pause())
         return -1;
 
-    // change sample rate if needed
-    if (_i2s_dma_state.sample_rate != sample_rate) {
-        if (_set_sample_rate(_i2s_dma_state.cmd_fifo_fd, sample_rate) != 0) {
-            return -1;
-        }
+    return 0;
+}
 
-        _i2s_dma_state.sample_rate = sample_rate;
-    }
+int adau1761::resume_stream() {
+    if (!_i2s_dma_state.stream)
+        return -1;
 
-    // stop any ongoing transfer
-    axidma_stop_transfer(_i2s_dma_state.dev, _i2s_dma_state.tx_channel);
+    return _i2s_dma_state.stream->resume();
+}
 
-    // setup callback
-    axidma_set_callback(_i2s_dma_state.dev, _i2s_dma_state.tx_channel, adau1761::_dma_callback, &_i2s_dma_state);
+bool adau1761::is_stream_paused() const {
+    return _i2s_dma_state.stream && _i2s_dma_state.stream->is_paused();
+}
 
-    // setup current transfer details
-    _i2s_dma_state.is_busy = true;
-    _i2s_dma_state.current_transfer.tx_buffer = buffer;
-    _i2s_dma_state.current_transfer.user_callback = std::move(callback);
-    _i2s_dma_state.current_transfer.callback_param = callback_param;
+size_t adau1761::stream_memory_size() const {
+    return _i2s_dma_state.stream ? _i2s_dma_state.stream->memory_size() : 0;
+}
 
-    // start
-    axidma_oneway_transfer(_i2s_dma_state.dev, _i2s_dma_state.tx_channel, buffer, buffer_size, false);
+size_t adau1761::take_started_streams() {
+    return _i2s_dma_state.stream ? _i2s_dma_state.stream->take_started() : 0;
+}
 
-    return 0;
+int adau1761::refill_interval_ms() const {
+    if (_i2s_dma_state.completion_fd >= 0 || !_i2s_dma_state.stream || !_i2s_dma_state.stream->is_running() ||
+        _i2s_dma_state.stream->is_parked())
+        return -1;
+
+    // twice per period, so a period is refilled at most half a period late
+    return std::max(1, _i2s_dma_state.stream->period_ms(_i2s_dma_state.sample_rate) / 2);
 }
 
 uint8_t adau1761::set_relative_volume(int delta) {
@@ -274,46 +325,51 @@ uint8_t adau1761::set_relative_volume(int delta) {
         vol += delta;
     }
 
-    _set_volume(_i2s_dma_state.cmd_fifo_fd, vol);
+    // no SPI round trips, the periods filled ahead are scaled again
     _i2s_dma_state.volume = vol;
+    if (_i2s_dma_state.stream) {
+        size_t ramp_frames = (size_t)_i2s_dma_state.sample_rate * GAIN_STAGE_RAMP_MS / 1000;
+        _i2s_dma_state.stream->set_gain(_volume_gain(vol) * _i2s_dma_state.track_gain, ramp_frames);
+    }
 
     return vol;
 }
 
-void adau1761::stop() {
-    if (_i2s_dma_state.is_busy) {
-        axidma_stop_transfer(_i2s_dma_state.dev, _i2s_dma_state.tx_channel);
-        size_t size = lookup_buffer(_i2s_dma_state.current_transfer.tx_buffer);
-        if (size > 0)
-            axidma_free(_i2s_dma_state.dev, _i2s_dma_state.current_transfer.tx_buffer, size);
-        _i2s_dma_state.is_busy = false;
+void adau1761::set_track_gain(float gain) {
+    _i2s_dma_state.track_gain = gain;
+    if (_i2s_dma_state.stream) {
+        bool is_playing = _i2s_dma_state.stream->is_running() && !_i2s_dma_state.stream->is_paused();
+        size_t ramp_frames = is_playing ? (size_t)_i2s_dma_state.sample_rate * GAIN_STAGE_RAMP_MS / 1000 : 0;
+        _i2s_dma_state.stream->set_gain(_volume_gain(_i2s_dma_state.volume) * gain, ramp_frames);
     }
 }
 
-void adau1761::_dma_callback(int channel_id, void *data) {
-    (void) channel_id;
-    auto *dma_state = (adau1761::_dma_state_t *)data;
-    void *tx_buff = nullptr;
-    size_t tx_buff_size;
-
-    // lookup tx buffer and size of the finished transfer in the dma_memories vector
-    auto tx_it = std::find_if(dma_state->dma_memories.cbegin(),
-                              dma_state->dma_memories.cend(),
-                              [&dma_state](const auto & e){ return e.second == dma_state->current_transfer.tx_buffer; });
-    if (tx_it != dma_state->dma_memories.cend()) {
-        tx_buff_size = tx_it->first;
-        tx_buff = tx_it->second;
-    }
+void adau1761::stop() {
+    if (_i2s_dma_state.stream && _i2s_dma_state.stream->is_running())
+        _i2s_dma_state.stream->stop();
+    _i2s_dma_state.is_busy = false;
+}
 
-    // cleanup
-    if (tx_buff) {
-        axidma_free(dma_state->dev, tx_buff, tx_buff_size);
-        dma_state->dma_memories.erase(tx_it);
-    }
+void adau1761::dump_dma_stats(FILE *stream, bool reset) const {
+    if (_i2s_dma_state.dev)
+        axidma_dump_stats(_i2s_dma_state.dev, "i2s", stream, reset);
+}
 
-    dma_state->is_busy = false;
+void adau1761::process_completions() {
+    struct axidma_completion completions[MAX_REAPED_COMPLETIONS];
 
-    // call user callback function
-    if (dma_state->current_transfer.user_callback)
-        std::invoke(dma_state->current_transfer.user_callback, dma_state->current_transfer.callback_param);
+    // the periods of a stream are counted, not reaped
+    if (_i2s_dma_state.stream && _i2s_dma_state.stream->is_running()) {
+        if (_i2s_dma_state.stream->refill() && _i2s_dma_state.is_busy) {
+            _i2s_dma_state.is_busy = false;
+            if (_i2s_dma_state.current_transfer.user_callback)
+                std::invoke(_i2s_dma_state.current_transfer.user_callback, _i2s_dma_state.current_transfer.callback_param);
+        }
+        return;
+    }
+
+    // periods signalled after the stream stopped, the player polls the fd
+    if (_i2s_dma_state.completion_fd >= 0) {
+        while (axidma_reap(_i2s_dma_state.dev, _i2s_dma_state.tx_channel, completions, MAX_REAPED_COMPLETIONS) > 0) {}
+    }
 }
@@ -3,15 +3,26 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 
 #include "libaxidma.h"
+#include "cma_budget.h"
+#include "i2s_stream.h"
 
 #define CMD_FIFO_DEV_NAME "axis_fifo_0x43c10000"
 #define I2S_DMA_INDEX 3
 
 #define DEFAULT_SAMPLE_RATE 48000
-#define DEFAULT_VOLUME 32
-#define MAX_VOLUME 63
+// the volume is a gain of the stream in steps of 0.5 dB (see gain_stage), MAX_VOLUME is unity: from -57 dB to +6 dB
+// with the headphone output at its fixed +6 dB
+#define DEFAULT_VOLUME 64
+#define MAX_VOLUME 126
+#define VOLUME_STEP_DB 0.5f
+// headphone volume register: 57 is 0 dB, in 1 dB steps; the gain stage scales down from the headroom it leaves
+#define HEADPHONE_VOLUME 63
+
+// how long playback waits for continuous memory used up by AES transfers
+#define BUFFER_RESERVE_TIMEOUT_MS 5000
 
 // ADAU1761 registers
 #define ADAU1761_REG_CLOCK_CONTROL	                      UINT16_C(0x4000)
@@ -33,16 +44,58 @@
 
 class adau1761 {
 public:
+    explicit adau1761(cma_budget &budget) { _i2s_dma_state.budget = &budget; }
     ~adau1761() { destroy(); }
 
+    // the rate a source of the sample rate is played at: itself if the codec runs at it, else the one it is resampled
+    // to (see resampler::output_rate())
+    static int playback_rate(int sample_rate);
+
     void init();
     void destroy();
-    void *request_buffer(size_t buffer_size);
-    int release_buffer(void *buffer);
-    int play(void *buffer, int sample_rate, std::function<void(void*)> callback, void *callback_param);
+    // plays the source through a ring of DMA periods refilled by process_completions(), the callback is invoked
+    // from there once the source played out
+    int play_stream(int sample_rate, i2s_stream::source_t source, std::function<void(void*)> callback,
+                    void *callback_param);
+    // plays the source right after the one of the stream without a gap, only at the same sample rate (-1 otherwise)
+    int enqueue_stream(int sample_rate, i2s_stream::source_t source);
+    // plays the source in place of the one of the stream, crossfading over overlap_frames frames (see
+    // i2s_stream::crossfade()); the track gain becomes the one of the source. Only at the same sample rate, -1 if it
+    // cannot fade (not playing, paused, fading already)
+    int crossfade_stream(int sample_rate, i2s_stream::source_t source, size_t overlap_frames, float track_gain);
+    bool is_crossfading() const;
+    // drops the enqueued sources not started yet, returns their number
+    size_t clear_stream_queue();
+    // plays the source in place of the periods of the stream filled ahead (after a seek), returns the number of
+    // enqueued sources dropped (see i2s_stream::restart()), -1 on error
+    int restart_stream(i2s_stream::source_t source);
+    // frames of the stream filled ahead of the DMA
+    size_t buffered_stream_frames() const;
+    // parks the stream at the end of the period playing, keeping the source and the periods filled (see
+    // i2s_stream::pause()), resume_stream() plays on from there; -1 if not playing (not paused)
+    int pause_stream();
+    int resume_stream();
+    bool is_stream_paused() const;
+    // DMA and staging memory of the stream
+    size_t stream_memory_size() const;
+    // enqueued sources started to play since the last call
+    size_t take_started_streams();
+    // interval process_completions() has to be called at while streaming without a completion fd (-1: not needed)
+    int refill_interval_ms() const;
+    // ramps the gain of the stream to the volume within a period, no codec register is written
     uint8_t set_relative_volume(int delta);
+    // the gain of the track playing on top of the volume (its loudness normalised), folded into the gain of the
+    // stream: right away if it is not playing, ramped within a period if it is (a track following without a gap)
+    void set_track_gain(float gain);
     void stop();
-    size_t lookup_buffer(void *buffer) const;
+    // readable when a period of the stream played, process_completions() has to be called then
+    // (-1 with a driver not supporting it, see refill_interval_ms())
+    int get_completion_fd() const { return _i2s_dma_state.completion_fd; }
+    // refills the periods of the stream in the calling thread, the callback of play_stream() is invoked from here
+    // once its source played out
+    void process_completions();
+    // writes the statistics the driver keeps of the DMA channel to the stream
+    void dump_dma_stats(FILE *stream, bool reset = false) const;
 
 private:
     struct _dma_state_t {
@@ -52,29 +105,34 @@ private:
         // pointer to the DMA character device
         axidma_dev_t dev;
 
+        // budget the continuous memories are reserved from
+        cma_budget *budget;
+
         // command FIFO fd
         int cmd_fifo_fd;
 
         // tx channel number
         int tx_channel;
 
+        // eventfd of the tx channel signalled for each period (-1: the stream is refilled at an interval)
+        int completion_fd = -1;
+
         // is the device busy
         bool is_busy = false;
 
         // current sample rate
         int sample_rate = DEFAULT_SAMPLE_RATE;
 
-        // current volume (only the 6 LSBs are used)
+        // current volume and gain of the track (applied by the gain stage of the stream)
         uint8_t volume = DEFAULT_VOLUME;
+        float track_gain = 1.0f;
 
-        // list of continuous memory chunks allocated
-        std::vector<std::pair<size_t, void *>> dma_memories;
+        // streaming playback (created with the DMA device)
+        std::unique_ptr<i2s_stream> stream;
 
-        // details of the current ongoing transfer (if no ongoing transfer current_transfer.is_busy == false)
+        // details of the current ongoing playback (if no ongoing playback is_busy == false)
         struct {
-            // tx buffer pointer of current transfer
-            void *tx_buffer;
-            // function to call on transfer completion
+            // function to call once the source played out
             std::function<void(void *)> user_callback;
             // parameter to pass to the user callback function
             void *callback_param;
@@ -83,11 +141,11 @@ private:
 
     static const std::unordered_map<int, std::array<int, 4>> _pll_divisors;
 
-    static int _init_codec(int fifo_fd, int sample_rate, uint8_t volume);
+    static int _init_codec(int fifo_fd, int sample_rate);
     static int _set_sample_rate(int fifo_fd, int sample_rate);
     static int _set_volume(int fifo_fd, uint8_t volume);
+    static float _volume_gain(uint8_t volume);
     static uint8_t _spi_command(int fifo_fd, uint16_t addr, size_t data_len, const uint8_t *data = nullptr, int chip_addr = 0);
-    static void _dma_callback(int channel_id, void *data);
 };
 
 
@@ -5,12 +5,139 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
+#include <cstdlib>
 #include <sys/mman.h>
 #include <fstream>
+#include <csignal>
+#include <ctime>
+#include <poll.h>
 
 #include "util.h"
+#include "aes_soft.h"
+#include "dma_copy.h"
+
+// blocks of a known-answer transfer, more than one so the back to back capture of the core is covered
+#define SELF_TEST_KAT_BLOCKS 4
+// interval of polling for the completion of a self-test transfer (the completion signal interrupts the sleep)
+#define SELF_TEST_POLL_NS 20000
+// completions reaped at once, only one transfer is in flight on a channel
+#define MAX_REAPED_COMPLETIONS 4
+
+namespace {
+    // FIPS-197 appendix B and C.1, in the byte order of the specification
+    struct known_answer_t {
+        uint8_t key[AES_KEY_WIDTH];
+        uint8_t plain[AES_TEXT_WIDTH];
+        uint8_t cipher[AES_TEXT_WIDTH];
+    };
+
+    const known_answer_t known_answers[] = {
+            {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+             {0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34},
+             {0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32}},
+            {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+             {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+             {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}}
+    };
+
+    // payload sizes of the calibration transfers (after the single block latency measurement)
+    const size_t calibration_sizes[] = {4096, 65536};
+    const size_t max_calibration_size = 65536;
+
+    // a transfer through an engine: tx holds the key and size bytes of input, the output is written into rx
+    typedef std::function<bool(bool is_encrypt, size_t size, const struct timespec &deadline)> engine_transfer_t;
+
+    // the cores take each block (and the key) byte reversed, see aes_soft
+    void reverse_block(const uint8_t *in, uint8_t *out) {
+        for (int i = 0; i < AES_TEXT_WIDTH; ++i)
+            out[i] = in[AES_TEXT_WIDTH - 1 - i];
+    }
+
+    struct timespec time_after(const struct timespec &time, long ms) {
+        struct timespec result = time;
+
+        result.tv_sec += ms / 1000;
+        result.tv_nsec += (ms % 1000) * 1000000;
+        if (result.tv_nsec >= 1000000000) {
+            result.tv_sec += 1;
+            result.tv_nsec -= 1000000000;
+        }
+
+        return result;
+    }
+
+    double elapsed_us(const struct timespec &from, const struct timespec &to) {
+        return (double)(to.tv_sec - from.tv_sec) * 1e6 + (double)(to.tv_nsec - from.tv_nsec) / 1e3;
+    }
+
+    bool is_expired(const struct timespec &deadline) {
+        struct timespec now{};
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return elapsed_us(deadline, now) >= 0;
+    }
+
+    // Known-answer tests in the supported directions, then the latency and throughput measurement if they passed.
+    // Every known-answer transfer gets AES_SELF_TEST_TRANSFER_TIMEOUT_MS, calibration stops at the deadline.
+    void test_engine(aes::engine_info_t &info, uint8_t *tx, uint8_t *rx, bool can_encrypt, bool can_decrypt,
+                     const struct timespec &deadline, const engine_transfer_t &transfer) {
+        const size_t kat_size = SELF_TEST_KAT_BLOCKS * AES_TEXT_WIDTH;
+        uint8_t expected[AES_TEXT_WIDTH];
+        struct timespec start{}, end{};
+
+        info = {};
+        info.is_tested = true;
+        info.is_passed = true;
+
+        for (const auto &kat : known_answers) {
+            for (bool is_encrypt : {true, false}) {
+                if ((is_encrypt && !can_encrypt) || (!is_encrypt && !can_decrypt))
+                    continue;
+
+                reverse_block(kat.key, tx);
+                for (size_t i = 0; i < SELF_TEST_KAT_BLOCKS; ++i)
+                    reverse_block(is_encrypt ? kat.plain : kat.cipher, tx + AES_KEY_WIDTH + i * AES_TEXT_WIDTH);
+                reverse_block(is_encrypt ? kat.cipher : kat.plain, expected);
+                memset(rx, 0, kat_size);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                if (!transfer(is_encrypt, kat_size, time_after(start, AES_SELF_TEST_TRANSFER_TIMEOUT_MS))) {
+                    info.is_passed = false;
+                    return;
+                }
+
+                for (size_t i = 0; i < SELF_TEST_KAT_BLOCKS; ++i) {
+                    if (memcmp(rx + i * AES_TEXT_WIDTH, expected, AES_TEXT_WIDTH) != 0) {
+                        info.is_passed = false;
+                        return;
+                    }
+                }
+            }
+        }
+
+        // calibration in the first supported direction, the content of the buffers does not matter any more
+        bool is_encrypt = can_encrypt;
+        size_t sizes[1 + sizeof(calibration_sizes) / sizeof(calibration_sizes[0])] = {AES_TEXT_WIDTH};
 
-void aes::init() {
+        std::copy(std::begin(calibration_sizes), std::end(calibration_sizes), sizes + 1);
+        for (size_t size : sizes) {
+            if (is_expired(deadline))
+                break;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (!transfer(is_encrypt, size, deadline))
+                break;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double duration_us = elapsed_us(start, end);
+            if (size == AES_TEXT_WIDTH)
+                info.latency_us = duration_us;
+            info.calibration.push_back({size, duration_us > 0 ? (double)size * 1e6 / duration_us : 0, duration_us});
+        }
+    }
+}
+
+void aes::init(bool run_self_test) {
     _dma_state_t* dev_states[] = {&_cipher_dma_state, &_decipher_dma_state};
     const array_t *channel_info;
     unsigned page_addr, page_offset;
@@ -57,25 +184,153 @@ void aes::init() {
                                     "Failed to get RX channel for DMA device");
         else
             dev_state->rx_channel = channel_info->data[0];
+
+        // completions are handled by the thread waiting for them, not in the signal handler
+        // (-1 with a driver not supporting it, the callback is used then)
+        dev_state->completion_fd = axidma_get_completion_fd(dev_state->dev, dev_state->rx_channel);
+
+        // the key is transmitted from its own block, the data buffers hold the file only
+        if (!dev_state->budget->reserve(dev_state->budget_client, AES_KEY_WIDTH, 0))
+            throw std::system_error(ENOMEM, std::generic_category(),
+                                    "Failed to reserve key block for DMA device");
+        if (!(dev_state->key_block = axidma_malloc(dev_state->dev, AES_KEY_WIDTH))) {
+            dev_state->budget->release(dev_state->budget_client, AES_KEY_WIDTH);
+            throw std::system_error(ENOMEM, std::generic_category(),
+                                    "Failed to allocate key block for DMA device");
+        }
     }
+
+    if (run_self_test)
+        self_test();
+}
+
+void aes::init(aes_core_backend &core, bool run_self_test) {
+    _dma_state_t* dev_states[] = {&_cipher_dma_state, &_decipher_dma_state};
+
+    for (auto &dev_state : dev_states) {
+        // initialize mutexes
+        pthread_mutex_init(&dev_state->state_mutex, nullptr);
+
+        // the channels of the simulated core have fixed numbers
+        dev_state->sim_core = &core;
+        dev_state->tx_channel = 0;
+        dev_state->rx_channel = 1;
+    }
+
+    if (run_self_test)
+        self_test();
 }
 
 void aes::destroy() {
     _dma_state_t* dev_states[] = {&_cipher_dma_state, &_decipher_dma_state};
 
     // unmap AES peripheral memory area
-    unsigned page_size = sysconf(_SC_PAGESIZE);
-    munmap(_aes_mem_ptr, page_size);
+    if (_aes_mem_ptr) {
+        unsigned page_size = sysconf(_SC_PAGESIZE);
+        munmap(_aes_mem_ptr, page_size);
+        _aes_mem_ptr = nullptr;
+    }
 
     for (auto &dev_state : dev_states) {
         // free driver allocated continuous memories
         for (const auto& dma_memory_info : dev_state->dma_memories) {
-            axidma_free(dev_state->dev, dma_memory_info.second, dma_memory_info.first);
+            _free_memory(*dev_state, dma_memory_info.second, dma_memory_info.first);
+            dev_state->budget->release(dev_state->budget_client, dma_memory_info.first);
+        }
+        dev_state->dma_memories.clear();
+
+        if (dev_state->key_block) {
+            axidma_free(dev_state->dev, dev_state->key_block, AES_KEY_WIDTH);
+            dev_state->budget->release(dev_state->budget_client, AES_KEY_WIDTH);
+            dev_state->key_block = nullptr;
         }
 
-        // destroy DMA character device
-        axidma_destroy(dev_state->dev);
+        // destroy DMA character device (closes the completion fd as well)
+        if (dev_state->dev) {
+            axidma_destroy(dev_state->dev);
+            dev_state->dev = nullptr;
+        }
+        dev_state->completion_fd = -1;
+        dev_state->sim_core = nullptr;
+        dev_state->is_self_test_failed = false;
     }
+
+    for (auto &engine : _engines)
+        engine = {};
+}
+
+bool aes::self_test() {
+    _dma_state_t* dev_states[] = {&_cipher_dma_state, &_decipher_dma_state};
+    const size_t tx_buff_size = AES_KEY_WIDTH + max_calibration_size, rx_buff_size = max_calibration_size;
+    struct timespec deadline{};
+    bool is_all_passed = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline = time_after(deadline, AES_SELF_TEST_TIME_LIMIT_MS);
+
+    // hardware cores (or their simulation)
+    for (auto &dev_state : dev_states) {
+        engine_info_t &info = _engines[dev_state == &_cipher_dma_state ? CIPHER_ENGINE : DECIPHER_ENGINE];
+        bool is_cipher = dev_state == &_cipher_dma_state;
+        uint8_t *tx_buff = nullptr, *rx_buff = nullptr;
+
+        info = {};
+        if (!dev_state->dev && !dev_state->sim_core)
+            continue;
+
+        // the buffers are reused by every transfer of the test, so only the core is measured
+        if (!dev_state->budget->reserve(dev_state->budget_client, tx_buff_size + rx_buff_size, 0))
+            continue;
+
+        pthread_mutex_lock(&dev_state->state_mutex);
+        if (dev_state->is_busy) {
+            pthread_mutex_unlock(&dev_state->state_mutex);
+            dev_state->budget->release(dev_state->budget_client, tx_buff_size + rx_buff_size);
+            continue;
+        }
+        dev_state->is_busy = true;
+        pthread_mutex_unlock(&dev_state->state_mutex);
+
+        tx_buff = (uint8_t *)_alloc_memory(*dev_state, tx_buff_size);
+        rx_buff = (uint8_t *)_alloc_memory(*dev_state, rx_buff_size);
+
+        if (tx_buff && rx_buff) {
+            test_engine(info, tx_buff, rx_buff, is_cipher, !is_cipher, deadline,
+                        [&](bool, size_t size, const struct timespec &transfer_deadline) {
+                            return _self_test_transfer(*dev_state, tx_buff, AES_KEY_WIDTH + size, rx_buff, size,
+                                                       transfer_deadline);
+                        });
+            dev_state->is_self_test_failed = !info.is_passed;
+        }
+
+        if (tx_buff)
+            _free_memory(*dev_state, tx_buff, tx_buff_size);
+        if (rx_buff)
+            _free_memory(*dev_state, rx_buff, rx_buff_size);
+        dev_state->budget->release(dev_state->budget_client, tx_buff_size + rx_buff_size);
+
+        pthread_mutex_lock(&dev_state->state_mutex);
+        dev_state->is_busy = false;
+        pthread_mutex_unlock(&dev_state->state_mutex);
+
+        is_all_passed = is_all_passed && (!info.is_tested || info.is_passed);
+    }
+
+    // software implementation
+    std::vector<uint8_t> tx(tx_buff_size), rx(rx_buff_size);
+    aes_soft soft;
+
+    test_engine(_engines[SOFTWARE_ENGINE], tx.data(), rx.data(), true, true, deadline,
+                [&](bool is_encrypt, size_t size, const struct timespec &) {
+                    soft.set_stream_key(tx.data());
+                    if (is_encrypt)
+                        soft.encrypt_stream(tx.data() + AES_KEY_WIDTH, rx.data(), size);
+                    else
+                        soft.decrypt_stream(tx.data() + AES_KEY_WIDTH, rx.data(), size);
+                    return true;
+                });
+
+    return is_all_passed && _engines[SOFTWARE_ENGINE].is_passed;
 }
 
 void aes::encrypt_file(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], const std::string& input_path,
@@ -98,10 +353,65 @@ void aes::decrypt_file(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
     _do_transfer(key, input_path, "", output_buffer, output_buffer_size, callback, callback_param, _decipher_dma_state);
 }
 
+int aes::get_completion_fd(engine_t engine) const {
+    switch (engine) {
+        case CIPHER_ENGINE:
+            return _cipher_dma_state.completion_fd;
+        case DECIPHER_ENGINE:
+            return _decipher_dma_state.completion_fd;
+        default:
+            return -1;
+    }
+}
+
+void aes::process_completions(engine_t engine) {
+    _dma_state_t &dma_state = engine == CIPHER_ENGINE ? _cipher_dma_state : _decipher_dma_state;
+    unsigned int transaction_id;
+    bool is_busy;
+
+    if (dma_state.completion_fd < 0 || (engine != CIPHER_ENGINE && engine != DECIPHER_ENGINE))
+        return;
+
+    pthread_mutex_lock(&dma_state.state_mutex);
+    is_busy = dma_state.is_busy;
+    transaction_id = dma_state.current_transfer.transaction_id;
+    pthread_mutex_unlock(&dma_state.state_mutex);
+
+    // completions of earlier (stopped or timed out) transfers are dropped
+    if (_reap(dma_state, transaction_id) && is_busy)
+        _dma_callback(dma_state.rx_channel, &dma_state);
+}
+
+void aes::dump_dma_stats(FILE *stream, bool reset) const {
+    // a simulated core has no DMA
+    if (_cipher_dma_state.dev)
+        axidma_dump_stats(_cipher_dma_state.dev, "aes cipher", stream, reset);
+    if (_decipher_dma_state.dev)
+        axidma_dump_stats(_decipher_dma_state.dev, "aes decipher", stream, reset);
+}
+
+bool aes::_reap(aes::_dma_state_t &dma_state, unsigned int transaction_id) {
+    struct axidma_completion completions[MAX_REAPED_COMPLETIONS];
+    bool is_found = false;
+    int nr_completions;
+
+    while ((nr_completions = axidma_reap(dma_state.dev, dma_state.rx_channel, completions, MAX_REAPED_COMPLETIONS)) > 0) {
+        for (int i = 0; i < nr_completions; ++i) {
+            if (completions[i].transaction_id == transaction_id) {
+                is_found = true;
+                if (completions[i].status != 0)
+                    dma_state.current_transfer.is_failed = true;
+            }
+        }
+    }
+
+    return is_found;
+}
+
 void aes::_dma_callback(int channel_id, void *data) {
     (void) channel_id;
     auto *dma_state = (aes::_dma_state_t *)data;
-    bool is_success = true;
+    bool is_success = !dma_state->current_transfer.is_failed;
     void *rx_buff = nullptr, *tx_buff = nullptr;
     size_t rx_buff_size, tx_buff_size;
 
@@ -133,20 +443,28 @@ void aes::_dma_callback(int channel_id, void *data) {
             is_success = false;
         }
     } else if (dma_state->current_transfer.output_buffer) {
-        memcpy(dma_state->current_transfer.output_buffer, rx_buff, rx_buff_size);
+        // the rx buffer is uncached DMA memory on the device, reading it takes kernels loading whole lines
+        dma_copy::kernels(dma_state->sim_core ? nullptr : dma_state->dev, rx_buff, rx_buff_size).copy(
+                dma_state->current_transfer.output_buffer, rx_buff, rx_buff_size);
     }
 
     // cleanup
     pthread_mutex_lock(&dma_state->state_mutex);
 
     if (rx_buff) {
-        axidma_free(dma_state->dev, rx_buff, rx_buff_size);
-        dma_state->dma_memories.erase(rx_it);
+        _free_memory(*dma_state, rx_buff, rx_buff_size);
+        dma_state->budget->release(dma_state->budget_client, rx_buff_size);
     }
     if (tx_buff) {
-        axidma_free(dma_state->dev, tx_buff, tx_buff_size);
-        dma_state->dma_memories.erase(tx_it);
+        _free_memory(*dma_state, tx_buff, tx_buff_size);
+        dma_state->budget->release(dma_state->budget_client, tx_buff_size);
     }
+    if (rx_buff || tx_buff)
+        dma_state->dma_memories.erase(std::remove_if(
+                dma_state->dma_memories.begin(), dma_state->dma_memories.end(),
+                [&rx_buff, &tx_buff](const std::pair<size_t, void *>& e) {
+                    return e.second == tx_buff || e.second == rx_buff;
+                }), dma_state->dma_memories.end());
 
     dma_state->is_busy = false;
 
@@ -162,11 +480,26 @@ void aes::_do_transfer(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
                        const std::function<void(bool, void *)> *callback, void *callback_param,
                        aes::_dma_state_t &dma_state) {
     void *rx_buff = nullptr, *tx_buff = nullptr;
-    size_t rx_buff_size, tx_buff_size;
+    size_t rx_buff_size, tx_buff_size, key_offset;
     std::streamsize aligned_file_size;
 
-    if (!dma_state.dev)
+    if (!dma_state.dev && !dma_state.sim_core)
         throw std::runtime_error("DMA device is not initialized.");
+    if (dma_state.is_self_test_failed)
+        throw std::runtime_error("AES core failed the self-test.");
+
+    aligned_file_size = (std::streamsize)aligned_size(get_file_size(input_path), AES_TEXT_WIDTH);
+    // the simulated core streams from a single buffer, the key is kept in front of the data there
+    key_offset = dma_state.sim_core ? AES_KEY_WIDTH : 0;
+    rx_buff_size = aligned_file_size;
+    tx_buff_size = key_offset + aligned_file_size;
+
+    if (output_buffer != nullptr && (std::streamsize)output_buffer_size < aligned_file_size)
+        throw std::runtime_error("Output buffer size too small.");
+
+    // reserve continuous memory for both buffers at once, waits while other transfers or playback use it up
+    if (!dma_state.budget->reserve(dma_state.budget_client, tx_buff_size + rx_buff_size))
+        throw std::runtime_error("File is too large for the continuous memory budget.");
 
     pthread_mutex_lock(&dma_state.state_mutex);
 
@@ -174,32 +507,25 @@ void aes::_do_transfer(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
         if (dma_state.is_busy)
             throw std::runtime_error("DMA device is BUSY.");
 
-        aligned_file_size = (std::streamsize)aligned_size(get_file_size(input_path), AES_TEXT_WIDTH);
-        rx_buff_size = aligned_file_size;
-        tx_buff_size = AES_KEY_WIDTH + aligned_file_size;
-
-        if (output_buffer != nullptr && (std::streamsize)output_buffer_size < aligned_file_size)
-            throw std::runtime_error("Output buffer size too small.");
-
         // allocate tx buffer
-        tx_buff = axidma_malloc(dma_state.dev, tx_buff_size);
+        tx_buff = _alloc_memory(dma_state, tx_buff_size);
         if (!tx_buff)
             throw std::runtime_error("Unable to allocate continuous memory for transfer.");
         dma_state.current_transfer.tx_buffer = tx_buff;
         dma_state.dma_memories.emplace_back(tx_buff_size, tx_buff);
 
         // allocate rx buffer
-        rx_buff = axidma_malloc(dma_state.dev, rx_buff_size);
+        rx_buff = _alloc_memory(dma_state, rx_buff_size);
         if (!rx_buff)
             throw std::runtime_error("Unable to allocate continuous memory for transfer.");
         dma_state.current_transfer.rx_buffer = rx_buff;
         dma_state.dma_memories.emplace_back(rx_buff_size, rx_buff);
 
-        // copy key into buffer
-        memcpy(tx_buff, key, AES_KEY_WIDTH);
+        // copy key into its block, it is sent as the first entry of the scatter-gather list
+        memcpy(dma_state.sim_core ? tx_buff : dma_state.key_block, key, AES_KEY_WIDTH);
         // set config register of the AES peripheral to key loading
         // this will load the first AES_KEY_WIDTH bytes as key for the following values
-        *dma_state.current_transfer.config_reg = 0xFFFFFFFF;
+        _write_config_reg(dma_state, 0xFFFFFFFF);
 
         // read input file into tx buffer
         std::ifstream in_file;
@@ -210,13 +536,14 @@ void aes::_do_transfer(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
             throw std::runtime_error("Unable to open input file.");
 
         in_file.seekg(0, std::ios::beg);
-        in_file.read((char *)tx_buff + AES_KEY_WIDTH, aligned_file_size);
+        in_file.read((char *)tx_buff + key_offset, aligned_file_size);
         bytes_read = in_file.gcount();
 
         in_file.close();
 
         // zero-pad remaining buffer area
-        memset((char *)tx_buff + AES_KEY_WIDTH + bytes_read, 0, aligned_file_size - bytes_read);
+        dma_copy::kernels(dma_state.sim_core ? nullptr : dma_state.dev, tx_buff, tx_buff_size).fill(
+                (char *)tx_buff + key_offset + bytes_read, 0, aligned_file_size - bytes_read);
 
         // setup current transfer details
         dma_state.is_busy = true;
@@ -225,29 +552,54 @@ void aes::_do_transfer(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
         dma_state.current_transfer.output_buffer_size = output_buffer_size;
         dma_state.current_transfer.user_callback = callback;
         dma_state.current_transfer.callback_param = callback_param;
+        dma_state.current_transfer.is_failed = false;
+
+        if (dma_state.sim_core) {
+            // turn of key loading into the AES peripheral
+            _write_config_reg(dma_state, 0x00000000);
+            pthread_mutex_unlock(&dma_state.state_mutex);
+
+            // the simulated core runs the transfer synchronously, completion is signalled the same way as by the driver
+            dma_state.current_transfer.is_failed = !dma_state.sim_core->stream(
+                    dma_state.dev_index == CIPHER_DMA_INDEX ? aes_core_backend::CIPHER : aes_core_backend::DECIPHER,
+                    tx_buff, tx_buff_size, rx_buff, rx_buff_size);
+            _dma_callback(dma_state.rx_channel, &dma_state);
+            return;
+        }
 
-        // setup callback
-        axidma_set_callback(dma_state.dev, dma_state.rx_channel, aes::_dma_callback, &dma_state);
+        // setup callback (without a completion fd the completion is signalled)
+        if (dma_state.completion_fd < 0)
+            axidma_set_callback(dma_state.dev, dma_state.rx_channel, aes::_dma_callback, &dma_state);
 
         // turn of key loading into the AES peripheral
-        *dma_state.current_transfer.config_reg = 0x00000000;
+        _write_config_reg(dma_state, 0x00000000);
 
         // stop any ongoing transfers
         axidma_stop_transfer(dma_state.dev, dma_state.tx_channel);
         axidma_stop_transfer(dma_state.dev, dma_state.rx_channel);
         pthread_mutex_unlock(&dma_state.state_mutex);
 
-        // start transfer
-        int ret = axidma_twoway_transfer(dma_state.dev, dma_state.tx_channel, tx_buff, tx_buff_size, nullptr,
-                                         dma_state.rx_channel, rx_buff, rx_buff_size, nullptr, false);
+        // start transfer, the key block and the file are gathered by the DMA
+        struct axidma_iovec tx_iov[] = {{dma_state.key_block, AES_KEY_WIDTH}, {tx_buff, tx_buff_size}};
+        struct axidma_iovec rx_iov[] = {{rx_buff, rx_buff_size}};
+        int ret = axidma_twoway_transfer_iov(dma_state.dev, dma_state.tx_channel, tx_iov, 2,
+                                             dma_state.rx_channel, rx_iov, 1, false);
         if (ret < 0)
             throw std::runtime_error("Failed to start transfer.");
+
+        // its completion is reported with the returned id (the signal handler never takes the mutex in this mode)
+        if (dma_state.completion_fd >= 0) {
+            pthread_mutex_lock(&dma_state.state_mutex);
+            dma_state.current_transfer.transaction_id = (unsigned int)ret;
+            pthread_mutex_unlock(&dma_state.state_mutex);
+        }
     } catch(...) {
         // cleanup
         if (tx_buff)
-            axidma_free(dma_state.dev, tx_buff, tx_buff_size);
+            _free_memory(dma_state, tx_buff, tx_buff_size);
         if (rx_buff)
-            axidma_free(dma_state.dev, rx_buff, rx_buff_size);
+            _free_memory(dma_state, rx_buff, rx_buff_size);
+        dma_state.budget->release(dma_state.budget_client, tx_buff_size + rx_buff_size);
         if (rx_buff || tx_buff)
             dma_state.dma_memories.erase(std::remove_if(
                     dma_state.dma_memories.begin(), dma_state.dma_memories.end(),
@@ -264,3 +616,95 @@ void aes::_do_transfer(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], con
 
     pthread_mutex_unlock(&dma_state.state_mutex);
 }
+
+void *aes::_alloc_memory(aes::_dma_state_t &dma_state, size_t size) {
+    // the simulated core works on regular memory
+    if (dma_state.sim_core)
+        return malloc(size);
+
+    return axidma_malloc(dma_state.dev, size);
+}
+
+void aes::_free_memory(aes::_dma_state_t &dma_state, void *ptr, size_t size) {
+    if (dma_state.sim_core)
+        free(ptr);
+    else
+        axidma_free(dma_state.dev, ptr, size);
+}
+
+void aes::_write_config_reg(aes::_dma_state_t &dma_state, uint32_t value) {
+    if (dma_state.sim_core)
+        dma_state.sim_core->write_reg(dma_state.dev_index == CIPHER_DMA_INDEX ?
+                                        aes_core_backend::CIPHER_CFG_REG : aes_core_backend::DECIPHER_CFG_REG, value);
+    else
+        *dma_state.current_transfer.config_reg = value;
+}
+
+bool aes::_self_test_wait(aes::_dma_state_t &dma_state, unsigned int transaction_id, const struct timespec &deadline) {
+    struct pollfd poll_fd = {dma_state.completion_fd, POLLIN, 0};
+    struct timespec now{}, timeout{};
+
+    while (true) {
+        if (_reap(dma_state, transaction_id))
+            return true;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_us(deadline, now) >= 0)
+            return false;
+
+        // wake up on the completion, not on a poll interval
+        timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (timeout.tv_nsec < 0) {
+            timeout.tv_sec -= 1;
+            timeout.tv_nsec += 1000000000;
+        }
+        ppoll(&poll_fd, 1, &timeout, nullptr);
+    }
+}
+
+void aes::_self_test_callback(int channel_id, void *data) {
+    (void) channel_id;
+    *(volatile sig_atomic_t *)data = 1;
+}
+
+bool aes::_self_test_transfer(aes::_dma_state_t &dma_state, void *tx_buff, size_t tx_buff_size, void *rx_buff,
+                              size_t rx_buff_size, const struct timespec &deadline) {
+    volatile sig_atomic_t is_done = 0;
+
+    // load the key from the first beat
+    _write_config_reg(dma_state, 0xFFFFFFFF);
+    _write_config_reg(dma_state, 0x00000000);
+
+    if (dma_state.sim_core)
+        return dma_state.sim_core->stream(
+                dma_state.dev_index == CIPHER_DMA_INDEX ? aes_core_backend::CIPHER : aes_core_backend::DECIPHER,
+                tx_buff, tx_buff_size, rx_buff, rx_buff_size);
+
+    // the completion signal only sets a flag, as it may interrupt this thread anywhere
+    if (dma_state.completion_fd < 0)
+        axidma_set_callback(dma_state.dev, dma_state.rx_channel, aes::_self_test_callback, (void *)&is_done);
+    axidma_stop_transfer(dma_state.dev, dma_state.tx_channel);
+    axidma_stop_transfer(dma_state.dev, dma_state.rx_channel);
+
+    int ret = axidma_twoway_transfer(dma_state.dev, dma_state.tx_channel, tx_buff, tx_buff_size, nullptr,
+                                     dma_state.rx_channel, rx_buff, rx_buff_size, nullptr, false);
+    if (ret >= 0 && dma_state.completion_fd >= 0) {
+        is_done = _self_test_wait(dma_state, (unsigned int)ret, deadline);
+    } else if (ret >= 0) {
+        struct timespec poll_interval = {0, SELF_TEST_POLL_NS};
+
+        while (!is_done && !is_expired(deadline))
+            nanosleep(&poll_interval, nullptr);
+    }
+
+    // a hung core (e.g. wrong bitstream) never completes the rx transfer
+    if (!is_done) {
+        axidma_stop_transfer(dma_state.dev, dma_state.tx_channel);
+        axidma_stop_transfer(dma_state.dev, dma_state.rx_channel);
+    }
+    if (dma_state.completion_fd < 0)
+        axidma_set_callback(dma_state.dev, dma_state.rx_channel, nullptr, nullptr);
+
+    return is_done;
+}
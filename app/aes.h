@@ -3,9 +3,12 @@
 
 
 #include <string>
+#include <vector>
 #include <functional>
 
 #include "libaxidma.h"
+#include "cma_budget.h"
+#include "aes_core_backend.h"
 
 #define CIPHER_DMA_INDEX 1
 #define DECIPHER_DMA_INDEX 2
@@ -17,12 +20,57 @@
 #define AES_CIPHER_CFG_REG_OFFSET 0
 #define AES_DECIPHER_CFG_REG_OFFSET 4
 
+// the whole self-test (known-answer tests and calibration of every engine) has to fit into this
+#define AES_SELF_TEST_TIME_LIMIT_MS 100
+// a known-answer transfer taking longer than this is considered hung
+#define AES_SELF_TEST_TRANSFER_TIMEOUT_MS 10
+
 class aes {
 public:
+    enum engine_t {CIPHER_ENGINE, DECIPHER_ENGINE, SOFTWARE_ENGINE, NR_ENGINES};
+
+    // measured speed of an engine for one transfer size
+    struct calibration_point_t {
+        size_t size;
+        // payload throughput in bytes/s
+        double throughput;
+        // time of the transfer in microseconds
+        double duration_us;
+    };
+
+    // results of the last self-test of an engine
+    struct engine_info_t {
+        bool is_tested = false;
+        // the engine produced the FIPS-197 known answers
+        bool is_passed = false;
+        // time of a single block transfer in microseconds
+        double latency_us = 0;
+        // calibration transfers in increasing size (sizes not fitting into the time limit are missing)
+        std::vector<calibration_point_t> calibration;
+    };
+
+    explicit aes(cma_budget &budget) {
+        _cipher_dma_state.budget = &budget;
+        _decipher_dma_state.budget = &budget;
+    }
     ~aes() { destroy(); }
 
-    void init();
+    // the engines are verified and calibrated by self_test() if run_self_test is set
+    void init(bool run_self_test = false);
+    // runs the transfers on a simulated core (model or RTL simulation) instead of the DMAs and the hardware
+    void init(aes_core_backend &core, bool run_self_test = false);
     void destroy();
+    // Runs known-answer tests on the cores and the software implementation, then times a few transfer sizes on the
+    // ones that passed. Transfers on a core failing the test are refused. Returns true if every engine passed.
+    bool self_test();
+    const engine_info_t &get_engine_info(engine_t engine) const { return _engines[engine]; }
+    // Readable when a transfer of the (hardware) engine completed, process_completions() has to be called then.
+    // -1 if there is none: the completion is handled in the DMA signal handler, or synchronously by a simulated core.
+    int get_completion_fd(engine_t engine) const;
+    // handles the completed transfers of the engine in the calling thread, the user callbacks are invoked from here
+    void process_completions(engine_t engine);
+    // writes the statistics the driver keeps of the DMA channels of the (hardware) engines to the stream
+    void dump_dma_stats(FILE *stream, bool reset = false) const;
     void encrypt_file(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], const std::string& input_path, const std::string& output_path,
                       const std::function<void(bool, void*)>* callback, void *callback_param);
     void encrypt_file(const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], const std::string& input_path, void *output_buffer, size_t output_buffer_size,
@@ -37,16 +85,32 @@ private:
         // index of the DMA character device (specified in the device tree)
         int dev_index;
 
+        // budget the continuous memories are reserved from
+        cma_budget *budget;
+        cma_budget::client_t budget_client;
+
         // pointer to the DMA character device
         axidma_dev_t dev;
 
+        // simulated core the transfers are run on instead of the device (nullptr if the hardware is used)
+        aes_core_backend *sim_core;
+
         // rx, tx channel numbers
         int tx_channel, rx_channel;
 
+        // eventfd of the rx channel signalled on completion (-1: completion is signalled by the callback)
+        int completion_fd = -1;
+
+        // continuous memory the key is sent from, in front of the data of every transfer (nullptr for a simulated core)
+        void *key_block = nullptr;
+
+        // the core failed the known-answer test of the self-test
+        bool is_self_test_failed = false;
+
         // is the device busy
-        // As the scatter-gather descriptor ring is normally larger than needed to describe a transfer of a regular-sized
-        // file, it would be possible to extend this with support of multiple ongoing transfers, but for this
-        // the driver needs to be extended.
+        // The driver can queue several transfers on a channel, but the core takes the key of a transfer only after a
+        // setup pulse on the config register, which has to be written between two transfers. So only one of them is
+        // in flight on an engine.
         bool is_busy = false;
 
         // list of continuous memory chunks allocated
@@ -68,6 +132,10 @@ private:
             const std::function<void(bool, void *)>* user_callback;
             // parameter to pass to the user callback function
             void *callback_param;
+            // the transfer completed with an error
+            bool is_failed;
+            // id of the rx transaction, reported by the driver when it completes
+            unsigned int transaction_id;
             // virtual address of the config register of the device (mmap-ped during init)
             volatile uint32_t *config_reg;
         } current_transfer;
@@ -75,14 +143,24 @@ private:
         pthread_mutex_t state_mutex;
     };
 
-    _dma_state_t _cipher_dma_state {.dev_index = CIPHER_DMA_INDEX, .dev{}, .tx_channel{}, .rx_channel{}, .dma_memories{}, .current_transfer{}, .state_mutex{}};
-    _dma_state_t _decipher_dma_state {.dev_index = DECIPHER_DMA_INDEX, .dev{}, .tx_channel{}, .rx_channel{}, .dma_memories{}, .current_transfer{}, .state_mutex{}};
+    _dma_state_t _cipher_dma_state {.dev_index = CIPHER_DMA_INDEX, .budget{}, .budget_client = cma_budget::CIPHER, .dev{}, .sim_core{}, .tx_channel{}, .rx_channel{}, .dma_memories{}, .current_transfer{}, .state_mutex{}};
+    _dma_state_t _decipher_dma_state {.dev_index = DECIPHER_DMA_INDEX, .budget{}, .budget_client = cma_budget::DECIPHER, .dev{}, .sim_core{}, .tx_channel{}, .rx_channel{}, .dma_memories{}, .current_transfer{}, .state_mutex{}};
 
     void *_aes_mem_ptr{};
 
+    engine_info_t _engines[NR_ENGINES];
+
     static void _do_transfer(const uint32_t key[4], const std::string& input_path, const std::string& output_path, void *output_buffer, size_t output_buffer_size,
                              const std::function<void(bool, void*)>* callback, void *callback_param, _dma_state_t &dma_state);
     static void _dma_callback(int channel_id, void *data);
+    static bool _reap(_dma_state_t &dma_state, unsigned int transaction_id);
+    static void *_alloc_memory(_dma_state_t &dma_state, size_t size);
+    static void _free_memory(_dma_state_t &dma_state, void *ptr, size_t size);
+    static void _write_config_reg(_dma_state_t &dma_state, uint32_t value);
+    static bool _self_test_transfer(_dma_state_t &dma_state, void *tx_buff, size_t tx_buff_size, void *rx_buff,
+                                    size_t rx_buff_size, const struct timespec &deadline);
+    static void _self_test_callback(int channel_id, void *data);
+    static bool _self_test_wait(_dma_state_t &dma_state, unsigned int transaction_id, const struct timespec &deadline);
 };
 
 
@@ -0,0 +1,127 @@
+#include "aes_core_backend.h"
+
+#include <cstring>
+
+aes_core_backend::aes_core_backend() {
+    pthread_mutex_init(&_mutex, nullptr);
+}
+
+aes_core_backend::~aes_core_backend() {
+    pthread_mutex_destroy(&_mutex);
+}
+
+void aes_core_backend::write_reg(uint32_t offset, uint32_t value) {
+    pthread_mutex_lock(&_mutex);
+    _write_reg(offset, value);
+    pthread_mutex_unlock(&_mutex);
+}
+
+uint32_t aes_core_backend::read_reg(uint32_t offset) {
+    uint32_t value;
+
+    pthread_mutex_lock(&_mutex);
+    value = _read_reg(offset);
+    pthread_mutex_unlock(&_mutex);
+
+    return value;
+}
+
+void aes_core_backend::tick() {
+    pthread_mutex_lock(&_mutex);
+    _tick();
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool aes_core_backend::stream(channel_t channel, const void *tx, size_t tx_size, void *rx, size_t rx_size,
+                              stream_stats_t *stats) {
+    stream_stats_t result{};
+    size_t beats_in = tx_size / AES_BLOCK_SIZE, beats_out = rx_size / AES_BLOCK_SIZE;
+    size_t src_index = 0, dst_index = 0;
+    unsigned burst_count = 0, idle_cycles = 0;
+    uint64_t start_cycle, src_ready_cycle;
+    bool got_last = false, is_success;
+
+    pthread_mutex_lock(&_mutex);
+
+    axis_port_t &p = port(channel);
+
+    _reset_core_stats(channel);
+    start_cycle = _cycle;
+    src_ready_cycle = _cycle + _config.source_latency;
+
+    while (src_index < beats_in || !(got_last || dst_index >= beats_out)) {
+        // MM2S
+        p.s_tvalid = src_index < beats_in && _cycle >= src_ready_cycle;
+        if (p.s_tvalid) {
+            memcpy(p.s_tdata.data(), (const uint8_t *)tx + src_index * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+            p.s_tlast = src_index == beats_in - 1;
+        }
+
+        // S2MM behind the stream FIFO
+        p.m_tready = p.fifo_resetn &&
+                     !(_config.sink_stall_period &&
+                       (_cycle - start_cycle) % _config.sink_stall_period < _config.sink_stall_cycles);
+
+        bool in_handshake = p.s_tvalid && p.s_tready;
+        bool out_handshake = p.m_tvalid && p.m_tready;
+
+        if (p.s_tvalid && !p.s_tready)
+            result.input_stall_cycles++;
+        if (!p.s_tvalid && p.s_tready)
+            result.input_idle_cycles++;
+
+        if (out_handshake) {
+            if (dst_index < beats_out)
+                memcpy((uint8_t *)rx + dst_index * AES_BLOCK_SIZE, p.m_tdata.data(), AES_BLOCK_SIZE);
+            dst_index++;
+            got_last = got_last || p.m_tlast;
+        }
+
+        _tick();
+
+        if (in_handshake) {
+            src_index++;
+            if (_config.source_burst_beats && ++burst_count == _config.source_burst_beats) {
+                burst_count = 0;
+                src_ready_cycle = _cycle + _config.source_burst_gap;
+            }
+        }
+
+        idle_cycles = (in_handshake || out_handshake) ? 0 : idle_cycles + 1;
+        if (idle_cycles > _config.timeout_cycles) {
+            result.timed_out = true;
+            break;
+        }
+    }
+
+    p.s_tvalid = false;
+    p.s_tlast = false;
+    p.m_tready = true;
+
+    result.cycles = _cycle - start_cycle;
+    result.beats_in = src_index;
+    result.beats_out = dst_index;
+    _core_stats(channel, result);
+    _last_stats[channel] = result;
+
+    is_success = !result.timed_out && dst_index == beats_out &&
+                 !result.beats_lost && !result.beats_repeated &&
+                 !result.results_lost && !result.key_hazards;
+
+    if (stats)
+        *stats = result;
+
+    pthread_mutex_unlock(&_mutex);
+
+    return is_success;
+}
+
+aes_core_backend::stream_stats_t aes_core_backend::last_stats(channel_t channel) const {
+    stream_stats_t stats;
+
+    pthread_mutex_lock(&_mutex);
+    stats = _last_stats[channel];
+    pthread_mutex_unlock(&_mutex);
+
+    return stats;
+}
@@ -0,0 +1,140 @@
+#ifndef AES_MUSIC_PLAYER_APP_AES_CORE_BACKEND_H
+#define AES_MUSIC_PLAYER_APP_AES_CORE_BACKEND_H
+
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <pthread.h>
+
+#include "aes_soft.h"
+
+// clock of the core and its DMAs (FCLK_CLK0)
+#define AES_CORE_CLOCK_HZ 100000000
+
+// Simulated AXI_aes_core the aes class can run its transfers on instead of the hardware.
+//
+// A backend exposes the AXI-Lite registers and the AXI-Stream ports of the IP and advances it clock by clock.
+// stream() plays the role of the AXI DMA: MM2S feeds the S_AXIS port of a channel and S2MM drains the M_AXIS port
+// behind the stream FIFO, which is held in reset while the key loading bit of the control register is set.
+class aes_core_backend {
+public:
+    enum channel_t {CIPHER, DECIPHER, NR_CHANNELS};
+    enum reg_offset_t {CIPHER_CFG_REG = 0x0, DECIPHER_CFG_REG = 0x4, CIPHER_STATUS_REG = 0x8, DECIPHER_STATUS_REG = 0xC};
+
+    typedef std::array<uint8_t, AES_BLOCK_SIZE> block_t;
+
+    // signals of the S_AXIS and M_AXIS port of a channel (inputs are set by the user, outputs by tick())
+    struct axis_port_t {
+        // S_AXIS (input stream)
+        bool s_tvalid = false;
+        bool s_tlast = false;
+        block_t s_tdata{};
+        bool s_tready = false;
+
+        // M_AXIS (output stream)
+        bool m_tready = true;
+        bool m_tvalid = false;
+        bool m_tlast = false;
+        block_t m_tdata{};
+
+        // reset of the stream FIFO in front of S2MM (active low)
+        bool fifo_resetn = true;
+    };
+
+    // behaviour of the DMA engines around the core in stream()
+    struct stream_config_t {
+        // cycles from the start of the transfer until MM2S presents the first beat
+        unsigned source_latency = 16;
+        // MM2S presents bursts of this many beats back to back (0: a single unbounded burst)
+        unsigned source_burst_beats = 16;
+        // cycles between two bursts of MM2S
+        unsigned source_burst_gap = 4;
+        // S2MM keeps TREADY low for sink_stall_cycles out of every sink_stall_period cycles (0: always ready)
+        unsigned sink_stall_period = 0;
+        unsigned sink_stall_cycles = 0;
+        // the transfer is aborted if no beat moves for this many cycles
+        unsigned timeout_cycles = 10000;
+    };
+
+    struct stream_stats_t {
+        // cycles from the start of the transfer until the last output beat
+        uint64_t cycles = 0;
+        // cycles from the capture of the key until the first block was loaded into the core
+        uint64_t key_load_cycles = 0;
+        uint64_t beats_in = 0, beats_out = 0;
+        // blocks loaded into the core
+        uint64_t blocks = 0;
+        // MM2S had a beat, but TREADY was low (throttled by the busy master or the key expansion)
+        uint64_t input_stall_cycles = 0;
+        // TREADY was high, but MM2S had no beat (bubbles)
+        uint64_t input_idle_cycles = 0;
+        // a result was waiting in the master for TREADY
+        uint64_t output_stall_cycles = 0;
+        // beats accepted by the handshake but never captured by the slave
+        uint64_t beats_lost = 0;
+        // beats captured more than once
+        uint64_t beats_repeated = 0;
+        // results dropped by the master (done while busy, TVALID without TREADY)
+        uint64_t results_lost = 0;
+        // blocks started while the decipher key schedule was being rebuilt
+        uint64_t key_hazards = 0;
+        bool timed_out = false;
+
+        double cycles_per_block() const { return blocks ? (double)cycles / (double)blocks : 0; }
+        // payload throughput in bytes/s
+        double throughput(double clock_hz = AES_CORE_CLOCK_HZ) const {
+            return cycles ? (double)(beats_out * AES_BLOCK_SIZE) * clock_hz / (double)cycles : 0;
+        }
+    };
+
+    aes_core_backend();
+    virtual ~aes_core_backend();
+
+    aes_core_backend(const aes_core_backend&) = delete;
+    aes_core_backend& operator=(const aes_core_backend&) = delete;
+
+    // AXI-Lite access, offsets are those of the register map of the IP
+    void write_reg(uint32_t offset, uint32_t value);
+    uint32_t read_reg(uint32_t offset);
+
+    // advances the core by one clock, both channels sample their port inputs
+    void tick();
+    void clock(uint64_t cycles) { while (cycles--) tick(); }
+    uint64_t cycle_count() const { return _cycle; }
+
+    virtual axis_port_t &port(channel_t channel) = 0;
+
+    void set_stream_config(const stream_config_t &config) { _config = config; }
+    const stream_config_t &stream_config() const { return _config; }
+
+    // Runs a DMA transfer through the channel: tx_size bytes are sent from tx (TLAST on the last beat), the output is
+    // written into rx until TLAST or rx_size bytes. Sizes are multiples of AES_BLOCK_SIZE. Returns true if every
+    // beat went through without loss and the output has the expected length.
+    bool stream(channel_t channel, const void *tx, size_t tx_size, void *rx, size_t rx_size,
+                stream_stats_t *stats = nullptr);
+    // statistics of the last stream() of the channel
+    stream_stats_t last_stats(channel_t channel) const;
+
+protected:
+    uint64_t _cycle = 0;
+
+    // serializes the users of the backend (cipher and decipher may be used from different threads)
+    mutable pthread_mutex_t _mutex{};
+
+    // implemented by the backends, called with the mutex held
+    virtual void _write_reg(uint32_t offset, uint32_t value) = 0;
+    virtual uint32_t _read_reg(uint32_t offset) = 0;
+    // one clock of the core, increments _cycle
+    virtual void _tick() = 0;
+    // counters of the core the backend can observe (blocks, key loading, lost beats), cleared by _reset_core_stats()
+    virtual void _reset_core_stats(channel_t channel) = 0;
+    virtual void _core_stats(channel_t channel, stream_stats_t &stats) = 0;
+
+private:
+    stream_config_t _config;
+    stream_stats_t _last_stats[NR_CHANNELS];
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_AES_CORE_BACKEND_H
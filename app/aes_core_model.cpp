@@ -0,0 +1,316 @@
+#include "aes_core_model.h"
+
+#include <cstring>
+
+aes_core_model::aes_core_model(bool gated_capture) : _gated_capture(gated_capture) {
+    reset();
+}
+
+void aes_core_model::_reset_channel(_channel_state_t &ch) {
+    ch.ctrl_reg = 0;
+    ch.setup_req = ch.setup_req_prev = false;
+
+    ch.s_state = S_IDLE;
+    ch.port.s_tready = false;
+    ch.data_valid = ch.data_last = false;
+    ch.setup_done = true;
+    ch.key_valid = true;
+    ch.data.fill(0);
+    ch.key.fill(0);
+
+    ch.start = ch.start_prev = ch.kload = ch.kload_prev = false;
+
+    ch.dcnt = 0;
+    ch.done = ch.go = false;
+    ch.kcnt = 0xA;
+    ch.kb_ld = ch.kdone = false;
+    ch.block_hazard = false;
+    ch.text_out.fill(0);
+    ch.engine_keyed = false;
+
+    ch.m_state = M_IDLE;
+    ch.m_busy = false;
+    ch.port.m_tvalid = ch.port.m_tlast = false;
+    ch.port.m_tdata.fill(0);
+
+    ch.port.fifo_resetn = true;
+
+    ch.beat_captured = false;
+    ch.key_captured = false;
+    ch.key_capture_cycle = 0;
+    ch.stats = {};
+}
+
+void aes_core_model::reset() {
+    pthread_mutex_lock(&_mutex);
+
+    for (auto &ch : _channels)
+        _reset_channel(ch);
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+void aes_core_model::_write_reg(uint32_t offset, uint32_t value) {
+    if (offset == CIPHER_CFG_REG)
+        _channels[CIPHER].ctrl_reg = value;
+    else if (offset == DECIPHER_CFG_REG)
+        _channels[DECIPHER].ctrl_reg = value;
+
+    // the core runs on while the write completes
+    for (int i = 0; i < AES_CORE_REG_WRITE_CYCLES; ++i)
+        _tick();
+}
+
+uint32_t aes_core_model::_read_reg(uint32_t offset) {
+    uint32_t value = 0;
+
+    switch (offset) {
+        case CIPHER_CFG_REG:
+            value = _channels[CIPHER].ctrl_reg;
+            break;
+        case DECIPHER_CFG_REG:
+            value = _channels[DECIPHER].ctrl_reg;
+            break;
+        case CIPHER_STATUS_REG: {
+            // key_valid of the cipher slave is combinational (!setup_needed)
+            const _channel_state_t &ch = _channels[CIPHER];
+            value = !((ch.setup_req && !ch.setup_req_prev) || !ch.setup_done);
+            break;
+        }
+        case DECIPHER_STATUS_REG:
+            value = _channels[DECIPHER].key_valid;
+            break;
+        default:
+            break;
+    }
+
+    return value;
+}
+
+void aes_core_model::_tick() {
+    _tick_channel(_channels[CIPHER], false);
+    _tick_channel(_channels[DECIPHER], true);
+    _cycle++;
+}
+
+void aes_core_model::_tick_channel(_channel_state_t &ch, bool is_decipher) {
+    axis_port_t &port = ch.port;
+    stream_stats_t &stats = ch.stats;
+
+    // values of the registers and combinational signals before the clock edge
+    const bool setup_needed = (ch.setup_req && !ch.setup_req_prev) || !ch.setup_done;
+    const bool busy = ch.m_busy || (ch.ctrl_reg & 1);
+    const bool ld = ch.start && !ch.start_prev;
+    const bool kld = is_decipher && ch.kload && !ch.kload_prev;
+    const bool finished = ch.done;
+    const bool data_valid = ch.data_valid, data_last = ch.data_last, key_valid = ch.key_valid;
+    const bool s_tready = port.s_tready, m_tvalid = port.m_tvalid;
+    const unsigned dcnt = ch.dcnt, kcnt = ch.kcnt;
+    const bool kb_ld = ch.kb_ld, kdone = ch.kdone, go = ch.go;
+    const master_state_t m_state = ch.m_state;
+    const bool s_take = port.s_tvalid && (!_gated_capture || s_tready);
+    bool captured = false, key_captured = false;
+
+    // S_AXI: setup pulse on the rising edge of bit 0 of the control register
+    ch.setup_req_prev = ch.setup_req;
+    ch.setup_req = ch.ctrl_reg & 1;
+
+    // AXI_aes_core_v1_0: start and key load pulse generators
+    ch.start_prev = ch.start;
+    ch.start = data_valid;
+    ch.kload_prev = ch.kload;
+    ch.kload = !key_valid;
+
+    // S_AXIS slave, the RTL captures S_AXIS_TDATA on TVALID regardless of the registered TREADY
+    switch (ch.s_state) {
+        case S_IDLE:
+            port.s_tready = setup_needed || !busy;
+            ch.data_valid = false;
+            ch.data_last = false;
+            ch.key_valid = true;
+            if (setup_needed) {
+                if (s_take) {
+                    ch.setup_done = true;
+                    ch.key = port.s_tdata;
+                    key_captured = captured = true;
+                    if (is_decipher) {
+                        ch.key_valid = false;
+                        ch.s_state = S_KEY_EXPAND;
+                        if (_gated_capture)
+                            port.s_tready = false;
+                    }
+                } else {
+                    ch.setup_done = false;
+                }
+            } else if ((!busy || _gated_capture) && s_take) {
+                // with gated capture TREADY already reflects busy of the previous cycle
+                ch.data = port.s_tdata;
+                ch.data_last = port.s_tlast;
+                ch.s_state = S_BLOCK;
+                captured = true;
+                if (_gated_capture)
+                    port.s_tready = false;
+            }
+            break;
+        case S_BLOCK:
+            port.s_tready = setup_needed;
+            ch.key_valid = true;
+            if (setup_needed) {
+                ch.data_valid = false;
+                if (!finished) {
+                    ch.setup_done = false;
+                    port.s_tready = false;
+                } else if (s_take) {
+                    ch.setup_done = true;
+                    ch.key = port.s_tdata;
+                    key_captured = captured = true;
+                    if (is_decipher)
+                        ch.key_valid = false;
+                    ch.s_state = is_decipher ? S_KEY_EXPAND : S_IDLE;
+                } else {
+                    ch.setup_done = false;
+                    ch.s_state = S_IDLE;
+                }
+            } else {
+                ch.data_valid = true;
+                if (finished)
+                    ch.s_state = S_IDLE;
+            }
+            break;
+        case S_KEY_EXPAND:
+            port.s_tready = false;
+            ch.key_valid = false;
+            if (kdone) {
+                ch.key_valid = true;
+                ch.s_state = S_IDLE;
+            }
+            break;
+    }
+
+    // aes_cipher_top / aes_inv_cipher_top
+    if (!is_decipher) {
+        if (ld)
+            ch.dcnt = 0xB;
+        else if (dcnt)
+            ch.dcnt = dcnt - 1;
+        ch.done = (dcnt >> 1) == 0 && (dcnt & 1) && !ld;
+
+        // the cipher expands the key on the fly from the value at ld
+        if (ld && (!ch.engine_keyed || ch.engine_key != ch.key)) {
+            ch.engine.set_stream_key(ch.key.data());
+            ch.engine_key = ch.key;
+            ch.engine_keyed = true;
+        }
+    } else {
+        // key schedule is stored in kb[] while kb_ld is set
+        if (kld)
+            ch.kcnt = 0xA;
+        else if (kb_ld)
+            ch.kcnt = (kcnt - 1) & 0xF;
+        if (kld)
+            ch.kb_ld = true;
+        else if (kcnt == 0)
+            ch.kb_ld = false;
+        ch.kdone = kcnt == 0 && !kld;
+
+        if (kld) {
+            ch.engine.set_stream_key(ch.key.data());
+            ch.engine_key = ch.key;
+            ch.engine_keyed = true;
+        }
+
+        if (finished)
+            ch.dcnt = 0;
+        else if (ld)
+            ch.dcnt = 1;
+        else if (go)
+            ch.dcnt = (dcnt + 1) & 0xF;
+        ch.done = dcnt == 0xB && !ld;
+        if (ld)
+            ch.go = true;
+        else if (finished)
+            ch.go = false;
+
+        // rounds read kb[] while it is rewritten: the block is computed with a mixture of the two keys
+        if (ld)
+            ch.block_hazard = false;
+        if ((ld || go) && (kb_ld || kld) && !ch.block_hazard) {
+            ch.block_hazard = true;
+            stats.key_hazards++;
+        }
+    }
+
+    if (ld) {
+        if (is_decipher)
+            ch.engine.decrypt_stream(ch.data.data(), ch.text_out.data(), AES_BLOCK_SIZE);
+        else
+            ch.engine.encrypt_stream(ch.data.data(), ch.text_out.data(), AES_BLOCK_SIZE);
+        stats.blocks++;
+
+        if (ch.key_captured) {
+            stats.key_load_cycles += _cycle - ch.key_capture_cycle;
+            ch.key_captured = false;
+        }
+    }
+
+    // M_AXIS master, TVALID is held for a single cycle
+    switch (m_state) {
+        case M_IDLE:
+            port.m_tvalid = false;
+            port.m_tlast = false;
+            ch.m_busy = !port.m_tready;
+            if (finished) {
+                port.m_tdata = ch.text_out;
+                port.m_tlast = data_last;
+                ch.m_state = port.m_tready ? M_SEND : M_WAIT;
+            }
+            break;
+        case M_SEND:
+            port.m_tvalid = true;
+            ch.m_busy = true;
+            ch.m_state = M_IDLE;
+            break;
+        case M_WAIT:
+            ch.m_busy = true;
+            if (port.m_tready)
+                ch.m_state = M_SEND;
+            stats.output_stall_cycles++;
+            break;
+    }
+
+    if (finished && m_state != M_IDLE)
+        stats.results_lost++;
+    if (m_tvalid && !port.m_tready)
+        stats.results_lost++;
+
+    // the stream FIFO is held in reset while bit 0 of the control register is set
+    port.fifo_resetn = !(ch.ctrl_reg & 1);
+
+    // handshake bookkeeping of the presented beat
+    if (captured) {
+        if (ch.beat_captured)
+            stats.beats_repeated++;
+        ch.beat_captured = true;
+    }
+    if (key_captured) {
+        ch.key_captured = true;
+        ch.key_capture_cycle = _cycle;
+    }
+    if (port.s_tvalid && s_tready) {
+        if (!ch.beat_captured)
+            stats.beats_lost++;
+        ch.beat_captured = false;
+    }
+}
+
+void aes_core_model::_core_stats(channel_t channel, stream_stats_t &stats) {
+    const stream_stats_t &core = _channels[channel].stats;
+
+    stats.key_load_cycles = core.key_load_cycles;
+    stats.blocks = core.blocks;
+    stats.output_stall_cycles = core.output_stall_cycles;
+    stats.beats_lost = core.beats_lost;
+    stats.beats_repeated = core.beats_repeated;
+    stats.results_lost = core.results_lost;
+    stats.key_hazards = core.key_hazards;
+}
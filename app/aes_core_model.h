@@ -0,0 +1,90 @@
+#ifndef AES_MUSIC_PLAYER_APP_AES_CORE_MODEL_H
+#define AES_MUSIC_PLAYER_APP_AES_CORE_MODEL_H
+
+
+#include "aes_core_backend.h"
+
+// cycles an AXI-Lite register write takes through the general purpose port
+#define AES_CORE_REG_WRITE_CYCLES 8
+
+// Cycle-approximate model of the AXI_aes_core IP (rtl/AXI_aes_core_1_0).
+//
+// Every clock the registers of the RTL are updated the same way as in the HDL: the S_AXI control register and its
+// setup pulse, the S_AXIS slave state machines (key capture, throttling on the master busy signal, the S2 key expansion
+// wait of the decipher), the start/key load pulse generators, the round counters of aes_cipher_top and
+// aes_inv_cipher_top and the M_AXIS master state machines. The AES rounds themselves are computed in one step with
+// aes_soft when a block is loaded into the core, only their latency is modelled.
+//
+// Besides the port level statistics of stream() it reports the blocks and key loads seen inside the core, and beats or
+// results the RTL drops.
+//
+// Note: the slaves capture S_AXIS_TDATA on TVALID while TREADY is registered, so a beat that follows a key or an idle
+// cycle back to back is accepted in S1/S2 without being captured (reported as beats_lost). gated_capture models the
+// core with the capture qualified by TREADY and TREADY dropped when a block or key is taken.
+class aes_core_model : public aes_core_backend {
+public:
+    explicit aes_core_model(bool gated_capture = false);
+
+    // reset of the IP (aresetn)
+    void reset();
+
+    axis_port_t &port(channel_t channel) override { return _channels[channel].port; }
+
+protected:
+    void _write_reg(uint32_t offset, uint32_t value) override;
+    uint32_t _read_reg(uint32_t offset) override;
+    void _tick() override;
+    void _reset_core_stats(channel_t channel) override { _channels[channel].stats = {}; }
+    void _core_stats(channel_t channel, stream_stats_t &stats) override;
+
+private:
+    enum slave_state_t {S_IDLE = 0, S_BLOCK = 1, S_KEY_EXPAND = 2};
+    enum master_state_t {M_IDLE = 0, M_SEND = 1, M_WAIT = 2};
+
+    struct _channel_state_t {
+        axis_port_t port;
+
+        // S_AXI: control register and the registers of the setup pulse
+        uint32_t ctrl_reg;
+        bool setup_req, setup_req_prev;
+
+        // S_AXIS slave
+        slave_state_t s_state;
+        bool data_valid, data_last, setup_done, key_valid;
+        block_t data, key;
+
+        // start and key load pulse generators
+        bool start, start_prev, kload, kload_prev;
+
+        // aes_cipher_top / aes_inv_cipher_top
+        unsigned dcnt;
+        bool done, go;
+        unsigned kcnt;
+        bool kb_ld, kdone;
+        bool block_hazard;
+        block_t text_out;
+        aes_soft engine;
+        block_t engine_key;
+        bool engine_keyed;
+
+        // M_AXIS master
+        master_state_t m_state;
+        bool m_busy;
+
+        // capture bookkeeping of the beat currently presented on S_AXIS
+        bool beat_captured;
+        uint64_t key_capture_cycle;
+        bool key_captured;
+
+        stream_stats_t stats;
+    };
+
+    _channel_state_t _channels[NR_CHANNELS];
+    bool _gated_capture;
+
+    void _reset_channel(_channel_state_t &ch);
+    void _tick_channel(_channel_state_t &ch, bool is_decipher);
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_AES_CORE_MODEL_H
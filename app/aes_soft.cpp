@@ -0,0 +1,197 @@
+#include "aes_soft.h"
+
+#include <algorithm>
+
+namespace {
+    struct aes_tables {
+        uint8_t sbox[256];
+        uint8_t inv_sbox[256];
+        uint32_t te[4][256];
+        uint32_t td[4][256];
+
+        aes_tables() {
+            // generate the S-box from the multiplicative inverse in GF(2^8) and the affine transformation
+            uint8_t p = 1, q = 1;
+            do {
+                p = p ^ (uint8_t)(p << 1) ^ ((p & 0x80) ? 0x1B : 0);
+                q ^= q << 1;
+                q ^= q << 2;
+                q ^= q << 4;
+                if (q & 0x80)
+                    q ^= 0x09;
+                sbox[p] = 0x63 ^ q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4);
+            } while (p != 1);
+            sbox[0] = 0x63;
+
+            for (int i = 0; i < 256; ++i)
+                inv_sbox[sbox[i]] = (uint8_t)i;
+
+            // combined SubBytes + MixColumns (and inverse) tables, one per byte position
+            for (int i = 0; i < 256; ++i) {
+                uint8_t s = sbox[i], si = inv_sbox[i];
+                uint32_t e = ((uint32_t)gmul(s, 2) << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | gmul(s, 3);
+                uint32_t d = ((uint32_t)gmul(si, 14) << 24) | ((uint32_t)gmul(si, 9) << 16) |
+                             ((uint32_t)gmul(si, 13) << 8) | gmul(si, 11);
+
+                for (int t = 0; t < 4; ++t) {
+                    te[t][i] = rotr32(e, 8 * t);
+                    td[t][i] = rotr32(d, 8 * t);
+                }
+            }
+        }
+
+        static uint8_t rotl8(uint8_t x, int n) { return (uint8_t)((x << n) | (x >> (8 - n))); }
+        static uint32_t rotr32(uint32_t x, int n) { return n ? (x >> n) | (x << (32 - n)) : x; }
+
+        static uint8_t gmul(uint8_t a, uint8_t b) {
+            uint8_t r = 0;
+            while (b) {
+                if (b & 1)
+                    r ^= a;
+                a = (uint8_t)(a << 1) ^ ((a & 0x80) ? 0x1B : 0);
+                b >>= 1;
+            }
+            return r;
+        }
+    };
+
+    const aes_tables &tables() {
+        static const aes_tables t;
+        return t;
+    }
+
+    inline uint32_t load_be32(const uint8_t *p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    inline void store_be32(uint8_t *p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+    inline void reverse_block(const void *in, uint8_t out[AES_BLOCK_SIZE]) {
+        std::reverse_copy((const uint8_t *)in, (const uint8_t *)in + AES_BLOCK_SIZE, out);
+    }
+}
+
+void aes_soft::set_key(const uint8_t key[AES_BLOCK_SIZE]) {
+    static const uint8_t rcon[AES_128_ROUNDS] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+    const aes_tables &t = tables();
+    uint32_t *rk = _enc_round_keys;
+
+    // key expansion
+    for (int i = 0; i < 4; ++i)
+        rk[i] = load_be32(key + 4 * i);
+
+    for (int r = 0; r < AES_128_ROUNDS; ++r, rk += 4) {
+        uint32_t w = rk[3];
+        rk[4] = rk[0] ^ ((uint32_t)rcon[r] << 24) ^
+                ((uint32_t)t.sbox[(w >> 16) & 0xFF] << 24) ^ ((uint32_t)t.sbox[(w >> 8) & 0xFF] << 16) ^
+                ((uint32_t)t.sbox[w & 0xFF] << 8) ^ t.sbox[w >> 24];
+        rk[5] = rk[1] ^ rk[4];
+        rk[6] = rk[2] ^ rk[5];
+        rk[7] = rk[3] ^ rk[6];
+    }
+
+    // decryption round keys for the equivalent inverse cipher: reversed order, InvMixColumns on the inner rounds
+    for (int r = 0; r <= AES_128_ROUNDS; ++r) {
+        for (int i = 0; i < 4; ++i) {
+            uint32_t w = _enc_round_keys[4 * (AES_128_ROUNDS - r) + i];
+            if (r != 0 && r != AES_128_ROUNDS)
+                w = t.td[0][t.sbox[w >> 24]] ^ t.td[1][t.sbox[(w >> 16) & 0xFF]] ^
+                    t.td[2][t.sbox[(w >> 8) & 0xFF]] ^ t.td[3][t.sbox[w & 0xFF]];
+            _dec_round_keys[4 * r + i] = w;
+        }
+    }
+}
+
+void aes_soft::encrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) const {
+    const aes_tables &t = tables();
+    const uint32_t *rk = _enc_round_keys;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+
+    s0 = load_be32(in) ^ rk[0];
+    s1 = load_be32(in + 4) ^ rk[1];
+    s2 = load_be32(in + 8) ^ rk[2];
+    s3 = load_be32(in + 12) ^ rk[3];
+
+    for (int r = 1; r < AES_128_ROUNDS; ++r) {
+        rk += 4;
+        t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xFF] ^ t.te[2][(s2 >> 8) & 0xFF] ^ t.te[3][s3 & 0xFF] ^ rk[0];
+        t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xFF] ^ t.te[2][(s3 >> 8) & 0xFF] ^ t.te[3][s0 & 0xFF] ^ rk[1];
+        t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xFF] ^ t.te[2][(s0 >> 8) & 0xFF] ^ t.te[3][s1 & 0xFF] ^ rk[2];
+        t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xFF] ^ t.te[2][(s1 >> 8) & 0xFF] ^ t.te[3][s2 & 0xFF] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // last round has no MixColumns
+    rk += 4;
+    store_be32(out, ((uint32_t)t.sbox[s0 >> 24] << 24 | (uint32_t)t.sbox[(s1 >> 16) & 0xFF] << 16 |
+                     (uint32_t)t.sbox[(s2 >> 8) & 0xFF] << 8 | t.sbox[s3 & 0xFF]) ^ rk[0]);
+    store_be32(out + 4, ((uint32_t)t.sbox[s1 >> 24] << 24 | (uint32_t)t.sbox[(s2 >> 16) & 0xFF] << 16 |
+                         (uint32_t)t.sbox[(s3 >> 8) & 0xFF] << 8 | t.sbox[s0 & 0xFF]) ^ rk[1]);
+    store_be32(out + 8, ((uint32_t)t.sbox[s2 >> 24] << 24 | (uint32_t)t.sbox[(s3 >> 16) & 0xFF] << 16 |
+                         (uint32_t)t.sbox[(s0 >> 8) & 0xFF] << 8 | t.sbox[s1 & 0xFF]) ^ rk[2]);
+    store_be32(out + 12, ((uint32_t)t.sbox[s3 >> 24] << 24 | (uint32_t)t.sbox[(s0 >> 16) & 0xFF] << 16 |
+                          (uint32_t)t.sbox[(s1 >> 8) & 0xFF] << 8 | t.sbox[s2 & 0xFF]) ^ rk[3]);
+}
+
+void aes_soft::decrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) const {
+    const aes_tables &t = tables();
+    const uint32_t *rk = _dec_round_keys;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+
+    s0 = load_be32(in) ^ rk[0];
+    s1 = load_be32(in + 4) ^ rk[1];
+    s2 = load_be32(in + 8) ^ rk[2];
+    s3 = load_be32(in + 12) ^ rk[3];
+
+    for (int r = 1; r < AES_128_ROUNDS; ++r) {
+        rk += 4;
+        t0 = t.td[0][s0 >> 24] ^ t.td[1][(s3 >> 16) & 0xFF] ^ t.td[2][(s2 >> 8) & 0xFF] ^ t.td[3][s1 & 0xFF] ^ rk[0];
+        t1 = t.td[0][s1 >> 24] ^ t.td[1][(s0 >> 16) & 0xFF] ^ t.td[2][(s3 >> 8) & 0xFF] ^ t.td[3][s2 & 0xFF] ^ rk[1];
+        t2 = t.td[0][s2 >> 24] ^ t.td[1][(s1 >> 16) & 0xFF] ^ t.td[2][(s0 >> 8) & 0xFF] ^ t.td[3][s3 & 0xFF] ^ rk[2];
+        t3 = t.td[0][s3 >> 24] ^ t.td[1][(s2 >> 16) & 0xFF] ^ t.td[2][(s1 >> 8) & 0xFF] ^ t.td[3][s0 & 0xFF] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // last round has no InvMixColumns
+    rk += 4;
+    store_be32(out, ((uint32_t)t.inv_sbox[s0 >> 24] << 24 | (uint32_t)t.inv_sbox[(s3 >> 16) & 0xFF] << 16 |
+                     (uint32_t)t.inv_sbox[(s2 >> 8) & 0xFF] << 8 | t.inv_sbox[s1 & 0xFF]) ^ rk[0]);
+    store_be32(out + 4, ((uint32_t)t.inv_sbox[s1 >> 24] << 24 | (uint32_t)t.inv_sbox[(s0 >> 16) & 0xFF] << 16 |
+                         (uint32_t)t.inv_sbox[(s3 >> 8) & 0xFF] << 8 | t.inv_sbox[s2 & 0xFF]) ^ rk[1]);
+    store_be32(out + 8, ((uint32_t)t.inv_sbox[s2 >> 24] << 24 | (uint32_t)t.inv_sbox[(s1 >> 16) & 0xFF] << 16 |
+                         (uint32_t)t.inv_sbox[(s0 >> 8) & 0xFF] << 8 | t.inv_sbox[s3 & 0xFF]) ^ rk[2]);
+    store_be32(out + 12, ((uint32_t)t.inv_sbox[s3 >> 24] << 24 | (uint32_t)t.inv_sbox[(s2 >> 16) & 0xFF] << 16 |
+                          (uint32_t)t.inv_sbox[(s1 >> 8) & 0xFF] << 8 | t.inv_sbox[s0 & 0xFF]) ^ rk[3]);
+}
+
+void aes_soft::set_stream_key(const void *key) {
+    uint8_t k[AES_BLOCK_SIZE];
+
+    reverse_block(key, k);
+    set_key(k);
+}
+
+void aes_soft::encrypt_stream(const void *in, void *out, size_t len) const {
+    uint8_t block[AES_BLOCK_SIZE], result[AES_BLOCK_SIZE];
+
+    for (size_t i = 0; i + AES_BLOCK_SIZE <= len; i += AES_BLOCK_SIZE) {
+        reverse_block((const uint8_t *)in + i, block);
+        encrypt_block(block, result);
+        reverse_block(result, (uint8_t *)out + i);
+    }
+}
+
+void aes_soft::decrypt_stream(const void *in, void *out, size_t len) const {
+    uint8_t block[AES_BLOCK_SIZE], result[AES_BLOCK_SIZE];
+
+    for (size_t i = 0; i + AES_BLOCK_SIZE <= len; i += AES_BLOCK_SIZE) {
+        reverse_block((const uint8_t *)in + i, block);
+        decrypt_block(block, result);
+        reverse_block(result, (uint8_t *)out + i);
+    }
+}
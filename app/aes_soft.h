@@ -0,0 +1,38 @@
+#ifndef AES_MUSIC_PLAYER_APP_AES_SOFT_H
+#define AES_MUSIC_PLAYER_APP_AES_SOFT_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+#define AES_BLOCK_SIZE 16
+#define AES_128_ROUNDS 10
+
+// Table based software implementation of AES-128 (FIPS-197).
+//
+// The *_block functions use the byte order of FIPS-197. The *_stream functions use the byte order of the
+// AXI_aes_core: a 16 byte block is one little-endian 128-bit AXI-Stream beat, and the core processes
+// TDATA[127:120] as the first byte of the state (so each block and the key are byte reversed in memory).
+// Data encrypted with the stream functions can be decrypted with the hardware core and vice versa.
+class aes_soft {
+public:
+    aes_soft() = default;
+    explicit aes_soft(const uint8_t key[AES_BLOCK_SIZE]) { set_key(key); }
+
+    void set_key(const uint8_t key[AES_BLOCK_SIZE]);
+    void encrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) const;
+    void decrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) const;
+
+    // key as it is sent to the core as the first beat of a transfer
+    void set_stream_key(const void *key);
+    // ECB over len bytes (multiple of AES_BLOCK_SIZE), in and out may be the same buffer
+    void encrypt_stream(const void *in, void *out, size_t len) const;
+    void decrypt_stream(const void *in, void *out, size_t len) const;
+
+private:
+    uint32_t _enc_round_keys[4 * (AES_128_ROUNDS + 1)]{};
+    uint32_t _dec_round_keys[4 * (AES_128_ROUNDS + 1)]{};
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_AES_SOFT_H
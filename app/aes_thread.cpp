@@ -1,5 +1,7 @@
 #include "aes_thread.h"
 
+#include <poll.h>
+
 void aes_thread::_dma_complete_callback(bool is_success, void *callback_params) {
     aes_thread *aes_thread = static_cast<class aes_thread *>(callback_params);
 
@@ -21,9 +23,20 @@ void aes_thread::run() {
     pthread_mutex_unlock(&_aes_mutex);
 
     std::function<void(bool, void*)> cb = std::function<void(bool, void*)>(aes_thread::_dma_complete_callback);
+    aes::engine_t engine = (_current_operation == ENCRYPT || _current_operation == ENCRYPT_INTO) ?
+                           aes::CIPHER_ENGINE : aes::DECIPHER_ENGINE;
+    int completion_fd = _aes_inst.get_completion_fd(engine);
     try {
         switch (_current_operation) {
             case ENCRYPT:
+                // the same content was already encrypted with the key, a copy of it is made instead
+                if (_reuse_ciphertext()) {
+                    pthread_mutex_lock(&_aes_mutex);
+                    _operation_status = SUCCESS;
+                    pthread_mutex_unlock(&_aes_mutex);
+
+                    goto send_results;
+                }
                 _aes_inst.encrypt_file(_key.data(), _input_path, _output_path, &cb, this);
                 break;
             case ENCRYPT_INTO:
@@ -44,8 +57,19 @@ void aes_thread::run() {
 
     // wait until operation finishes
     pthread_mutex_lock(&_aes_mutex);
-    while (_operation_status == BUSY)
-        pthread_cond_wait(&_aes_cond, &_aes_mutex);
+    while (_operation_status == BUSY) {
+        if (completion_fd < 0) {
+            pthread_cond_wait(&_aes_cond, &_aes_mutex);
+            continue;
+        }
+
+        // the completion is handled on this thread, the callback is invoked from process_completions()
+        pthread_mutex_unlock(&_aes_mutex);
+        struct pollfd poll_fd = {completion_fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, -1) > 0)
+            _aes_inst.process_completions(engine);
+        pthread_mutex_lock(&_aes_mutex);
+    }
     pthread_mutex_unlock(&_aes_mutex);
 
 send_results:
@@ -86,3 +110,24 @@ std::string aes_thread::get_output_path() const {
 std::pair<size_t, void *> aes_thread::get_output_buffer() const {
     return std::pair{_output_buffer_size, _output_buffer};
 }
+
+std::array<uint32_t , 4> aes_thread::get_key() const {
+    return _key;
+}
+
+bool aes_thread::get_content(content_index::content_t &content) const {
+    content = _content;
+
+    return _has_content;
+}
+
+bool aes_thread::_reuse_ciphertext() {
+    std::string ciphertext_path;
+
+    if (!(_has_content = _index.get_content(_input_path, _content)))
+        return false;
+
+    ciphertext_path = _index.find_ciphertext(_content, _key.data(), sizeof(_key));
+
+    return !ciphertext_path.empty() && content_index::clone_file(ciphertext_path, _output_path);
+}
@@ -0,0 +1,146 @@
+#include "cma_budget.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <ctime>
+#include <cerrno>
+
+cma_budget::cma_budget(size_t total_size, size_t playback_reserved_size) {
+    pthread_condattr_t cond_attr;
+
+    if (total_size == 0) {
+        size_t cma_size = system_cma_size();
+        if (cma_size == 0)
+            cma_size = CMA_DEFAULT_SIZE;
+
+        total_size = cma_size > 2 * CMA_SYSTEM_MARGIN_SIZE ? cma_size - CMA_SYSTEM_MARGIN_SIZE : cma_size / 2;
+    }
+
+    _total_size = total_size;
+    _playback_reserved_size = std::min(playback_reserved_size, total_size);
+
+    // timed waits are measured on the monotonic clock
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_released_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_mutex_init(&_mutex, nullptr);
+}
+
+cma_budget::~cma_budget() {
+    pthread_cond_destroy(&_released_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+size_t cma_budget::system_cma_size() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t value;
+
+    // line format: "CmaTotal:          81920 kB"
+    while (meminfo >> key >> value) {
+        if (key == "CmaTotal:")
+            return value * 1024;
+
+        meminfo.ignore(256, '\n');
+    }
+
+    return 0;
+}
+
+size_t cma_budget::limit(client_t client) const {
+    return client == PLAYER ? _total_size : _total_size - _playback_reserved_size;
+}
+
+bool cma_budget::_fits(client_t client, size_t size) const {
+    if (_total_usage + size > _total_size)
+        return false;
+
+    // other clients must leave the playback slice untouched
+    if (client != PLAYER && _total_usage - _usage[PLAYER] + size > limit(client))
+        return false;
+
+    return true;
+}
+
+bool cma_budget::reserve(client_t client, size_t size, int timeout_ms) {
+    struct timespec deadline{};
+    bool reserved = false;
+
+    if (size > limit(client))
+        return false;
+
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&_mutex);
+
+    // queue until enough memory is released by the other subsystems
+    while (!(reserved = _fits(client, size)) && timeout_ms != 0) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&_released_cond, &_mutex);
+        } else if (pthread_cond_timedwait(&_released_cond, &_mutex, &deadline) == ETIMEDOUT) {
+            reserved = _fits(client, size);
+            break;
+        }
+    }
+
+    if (reserved) {
+        _usage[client] += size;
+        _total_usage += size;
+        _peak_usage = std::max(_peak_usage, _total_usage);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+
+    return reserved;
+}
+
+void cma_budget::release(client_t client, size_t size) {
+    pthread_mutex_lock(&_mutex);
+
+    size = std::min(size, _usage[client]);
+    _usage[client] -= size;
+    _total_usage -= size;
+
+    pthread_cond_broadcast(&_released_cond);
+    pthread_mutex_unlock(&_mutex);
+}
+
+size_t cma_budget::current_usage() const {
+    size_t usage;
+
+    pthread_mutex_lock(&_mutex);
+    usage = _total_usage;
+    pthread_mutex_unlock(&_mutex);
+
+    return usage;
+}
+
+size_t cma_budget::current_usage(client_t client) const {
+    size_t usage;
+
+    pthread_mutex_lock(&_mutex);
+    usage = _usage[client];
+    pthread_mutex_unlock(&_mutex);
+
+    return usage;
+}
+
+size_t cma_budget::peak_usage() const {
+    size_t usage;
+
+    pthread_mutex_lock(&_mutex);
+    usage = _peak_usage;
+    pthread_mutex_unlock(&_mutex);
+
+    return usage;
+}
@@ -0,0 +1,60 @@
+#ifndef AES_MUSIC_PLAYER_APP_CMA_BUDGET_H
+#define AES_MUSIC_PLAYER_APP_CMA_BUDGET_H
+
+
+#include <cstddef>
+#include <pthread.h>
+
+// used if the size of the CMA area cannot be read from /proc/meminfo
+#define CMA_DEFAULT_SIZE (64 * 1024 * 1024)
+// part of the CMA area left for the kernel and other drivers
+#define CMA_SYSTEM_MARGIN_SIZE (8 * 1024 * 1024)
+// part of the budget only the player may reserve from
+#define CMA_PLAYBACK_RESERVED_SIZE (16 * 1024 * 1024)
+
+// Central budget for the continuous (CMA) memory allocated through axidma_malloc.
+// Every subsystem reserves the size of its DMA buffers here before allocating them, so concurrent
+// jobs wait for each other instead of failing in the driver. A slice of the budget is kept for playback.
+class cma_budget {
+public:
+    enum client_t {CIPHER, DECIPHER, PLAYER, NR_CLIENTS};
+
+    // total_size == 0: derive the budget from the CMA size of the system
+    explicit cma_budget(size_t total_size = 0, size_t playback_reserved_size = CMA_PLAYBACK_RESERVED_SIZE);
+    ~cma_budget();
+
+    cma_budget(const cma_budget&) = delete;
+    cma_budget& operator=(const cma_budget&) = delete;
+
+    // Reserves size bytes for the client. If it does not fit currently, the call waits until enough is released
+    // (timeout_ms < 0: wait forever, 0: do not wait). Returns false on timeout or if the size exceeds the limit of
+    // the client, as such a request could never be satisfied.
+    bool reserve(client_t client, size_t size, int timeout_ms = -1);
+    void release(client_t client, size_t size);
+
+    // maximal amount the client can hold at once
+    size_t limit(client_t client) const;
+    size_t total_size() const { return _total_size; }
+    size_t current_usage() const;
+    size_t current_usage(client_t client) const;
+    size_t peak_usage() const;
+
+    // size of the CMA area (CmaTotal in /proc/meminfo), 0 if not available
+    static size_t system_cma_size();
+
+private:
+    size_t _total_size;
+    size_t _playback_reserved_size;
+
+    size_t _usage[NR_CLIENTS]{};
+    size_t _total_usage = 0;
+    size_t _peak_usage = 0;
+
+    mutable pthread_mutex_t _mutex{};
+    pthread_cond_t _released_cond{};
+
+    bool _fits(client_t client, size_t size) const;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_CMA_BUDGET_H
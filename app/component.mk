@@ -2,10 +2,12 @@ include libaxidma/library.mk
 
 APP_DIR = $(ROOT)/app
 
-SOURCE_FILES = main.cpp util.cpp aes.cpp directory_navigator.hpp adau1761.cpp virtual_file_wrapper.cpp player_thread.cpp aes_thread.cpp ui_thread.cpp
+SOURCE_FILES = main.cpp util.cpp aes.cpp directory_navigator.hpp adau1761.cpp virtual_file_wrapper.cpp player_thread.cpp aes_thread.cpp ui_thread.cpp cma_budget.cpp aes_soft.cpp aes_core_backend.cpp aes_core_model.cpp xxhash64.cpp content_index.cpp dma_copy.cpp i2s_stream.cpp playback_source.cpp play_queue.cpp player_track.cpp resampler.cpp sample_convert.cpp gain_stage.cpp crossfade_mixer.cpp loudness.cpp loudness_thread.cpp
 SOURCE_FILE_PATHS = $(addprefix $(APP_DIR)/,$(SOURCE_FILES))
 
-APP_CXXFLAGS = $(GLOBAL_CFLAGS) -pthread
+# the Cortex-A9 of the Zynq-7000 has NEON, the copy kernels of the DMA buffers use it
+APP_ARCH_FLAGS ?= -mcpu=cortex-a9 -mfpu=neon
+APP_CXXFLAGS = $(GLOBAL_CFLAGS) $(APP_ARCH_FLAGS) -pthread
 APP_LINKER_FLAGS = -Wl,-rpath,'$$ORIGIN/../lib'
 APP_LIB_FLAGS = -L $(OUTPUT_DIR)/lib -l axidma -l mpg123 -l mp3lame -l sndfile $(APP_LINKER_FLAGS)
 
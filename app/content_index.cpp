@@ -0,0 +1,270 @@
+#include "content_index.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "util.h"
+#include "xxhash64.h"
+
+namespace {
+    struct header_t {
+        uint32_t magic;
+        uint32_t version;
+    };
+}
+
+content_index::content_index(std::string path) : _path(std::move(path)) {
+    pthread_mutex_init(&_mutex, nullptr);
+
+    if (!_path.empty())
+        _load();
+}
+
+content_index::~content_index() {
+    if (_journal_fd >= 0)
+        close(_journal_fd);
+
+    pthread_mutex_destroy(&_mutex);
+}
+
+bool content_index::get_content(const std::string &path, content_t &content) {
+    file_id_t file_id{}, file_id_after{};
+    std::vector<char> buffer(CONTENT_INDEX_READ_CHUNK_SIZE);
+    std::ifstream in_file;
+    xxhash64 hash;
+
+    if (!_get_file_id(path, file_id))
+        return false;
+
+    // unchanged since it was last hashed
+    pthread_mutex_lock(&_mutex);
+    auto it = _files.find(path);
+    if (it != _files.end() && it->second.file_id == file_id) {
+        content = it->second.content;
+        pthread_mutex_unlock(&_mutex);
+        return true;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    in_file.open(path, std::ios::in | std::ios::binary);
+    if (!in_file)
+        return false;
+
+    while (in_file) {
+        in_file.read(buffer.data(), (std::streamsize)buffer.size());
+        hash.update(buffer.data(), in_file.gcount());
+    }
+    in_file.close();
+
+    content.hash = hash.digest();
+    content.size = file_id.size;
+
+    // the file was modified while it was read, the hash is not remembered
+    if (!_get_file_id(path, file_id_after) || !(file_id_after == file_id))
+        return true;
+
+    pthread_mutex_lock(&_mutex);
+    _files[path] = {file_id, content};
+    _append({FILE_RECORD, 0, 0, 0, file_id, content, 0}, path);
+    pthread_mutex_unlock(&_mutex);
+
+    return true;
+}
+
+std::string content_index::find_ciphertext(const content_t &content, const void *key, size_t key_size) {
+    _ciphertext_key_t ciphertext_key{content.hash, content.size, _key_id(key, key_size)};
+    _ciphertext_entry_t entry;
+    file_id_t file_id{};
+
+    pthread_mutex_lock(&_mutex);
+    auto it = _ciphertexts.find(ciphertext_key);
+    if (it == _ciphertexts.end()) {
+        pthread_mutex_unlock(&_mutex);
+        return "";
+    }
+    entry = it->second;
+    pthread_mutex_unlock(&_mutex);
+
+    // the encrypted file must be the same version that was registered
+    if (_get_file_id(entry.path, file_id) && file_id == entry.file_id && is_encrypted(entry.path))
+        return entry.path;
+
+    // stale, it is left out from the journal on the next compaction
+    pthread_mutex_lock(&_mutex);
+    it = _ciphertexts.find(ciphertext_key);
+    if (it != _ciphertexts.end() && it->second.path == entry.path && it->second.file_id == entry.file_id)
+        _ciphertexts.erase(it);
+    pthread_mutex_unlock(&_mutex);
+
+    return "";
+}
+
+void content_index::add_ciphertext(const content_t &content, const void *key, size_t key_size, const std::string &path) {
+    _ciphertext_key_t ciphertext_key{content.hash, content.size, _key_id(key, key_size)};
+    file_id_t file_id{};
+
+    if (!_get_file_id(path, file_id))
+        return;
+
+    pthread_mutex_lock(&_mutex);
+    _ciphertexts[ciphertext_key] = {path, file_id};
+    _append({CIPHERTEXT_RECORD, 0, 0, 0, file_id, content, ciphertext_key.key_id}, path);
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool content_index::clone_file(const std::string &from, const std::string &to) {
+    std::error_code ec;
+
+#ifdef FICLONE
+    int from_fd, to_fd;
+
+    // reflink: the copy shares the data blocks of the source until either is modified
+    if ((from_fd = open(from.c_str(), O_RDONLY)) >= 0) {
+        if ((to_fd = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0) {
+            int ret = ioctl(to_fd, FICLONE, from_fd);
+
+            close(to_fd);
+            close(from_fd);
+            if (ret == 0)
+                return true;
+        } else {
+            close(from_fd);
+        }
+    }
+#endif
+
+    // not supported by the file system (or across file systems), copy the content
+    return std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec) && !ec;
+}
+
+std::string content_index::default_path() {
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (cache_home && *cache_home)
+        return std::string(cache_home) + "/aes_music_player/content_index";
+    if (home && *home)
+        return std::string(home) + "/.cache/aes_music_player/content_index";
+
+    return "";
+}
+
+void content_index::_load() {
+    std::ifstream in_file(_path, std::ios::in | std::ios::binary);
+    header_t header{};
+    _record_t record{};
+    std::string path;
+    size_t nr_records = 0;
+
+    if (in_file.read((char *)&header, sizeof(header)) &&
+        header.magic == CONTENT_INDEX_MAGIC && header.version == CONTENT_INDEX_VERSION) {
+        // replay the journal, later records override the earlier ones
+        while (in_file.read((char *)&record, sizeof(record))) {
+            path.resize(record.path_size);
+            if (!in_file.read(path.data(), record.path_size))
+                break;
+
+            if (record.type == FILE_RECORD)
+                _files[path] = {record.file_id, record.content};
+            else if (record.type == CIPHERTEXT_RECORD)
+                _ciphertexts[{record.content.hash, record.content.size, record.key_id}] = {path, record.file_id};
+            nr_records++;
+        }
+        in_file.close();
+
+        if (nr_records <= CONTENT_INDEX_COMPACT_RATIO * (_files.size() + _ciphertexts.size()) + 64 &&
+            _open_journal())
+            return;
+    }
+
+    // missing, unknown version, truncated or too long journal
+    _compact();
+}
+
+bool content_index::_compact() {
+    std::string tmp_path = _path + ".tmp";
+    std::error_code ec;
+
+    if (_journal_fd >= 0) {
+        close(_journal_fd);
+        _journal_fd = -1;
+    }
+
+    std::filesystem::create_directories(std::filesystem::path(_path).parent_path(), ec);
+    if ((_journal_fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return false;
+
+    header_t header{CONTENT_INDEX_MAGIC, CONTENT_INDEX_VERSION};
+    bool is_success = write(_journal_fd, &header, sizeof(header)) == sizeof(header);
+
+    for (const auto &[path, entry] : _files)
+        _append({FILE_RECORD, 0, 0, 0, entry.file_id, entry.content, 0}, path);
+    for (const auto &[key, entry] : _ciphertexts)
+        _append({CIPHERTEXT_RECORD, 0, 0, 0, entry.file_id, {key.hash, key.size}, key.key_id}, entry.path);
+
+    // replace the journal only if the new one is complete
+    if (!is_success || _journal_fd < 0 || rename(tmp_path.c_str(), _path.c_str()) != 0) {
+        if (_journal_fd >= 0)
+            close(_journal_fd);
+        _journal_fd = -1;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    // keep appending to the new journal
+    close(_journal_fd);
+    _journal_fd = -1;
+
+    return _open_journal();
+}
+
+bool content_index::_open_journal() {
+    _journal_fd = open(_path.c_str(), O_WRONLY | O_APPEND);
+
+    return _journal_fd >= 0;
+}
+
+void content_index::_append(const _record_t &record, const std::string &path) {
+    std::vector<char> buffer(sizeof(record) + path.size());
+
+    if (_journal_fd < 0 || path.size() > UINT16_MAX)
+        return;
+
+    // a record is written with a single write, so an interrupted append only loses the last record
+    memcpy(buffer.data(), &record, sizeof(record));
+    ((_record_t *)buffer.data())->path_size = (uint16_t)path.size();
+    memcpy(buffer.data() + sizeof(record), path.data(), path.size());
+
+    if (write(_journal_fd, buffer.data(), buffer.size()) != (ssize_t)buffer.size()) {
+        // the journal is unusable, the index is kept in memory only
+        close(_journal_fd);
+        _journal_fd = -1;
+    }
+}
+
+bool content_index::_get_file_id(const std::string &path, file_id_t &file_id) {
+    struct stat file_stat{};
+
+    if (stat(path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+        return false;
+
+    file_id.dev = file_stat.st_dev;
+    file_id.ino = file_stat.st_ino;
+    file_id.size = file_stat.st_size;
+    file_id.mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+
+    return true;
+}
+
+uint64_t content_index::_key_id(const void *key, size_t key_size) {
+    // seeded, so the id can not be matched against a plain hash of a key
+    return xxhash64::hash(key, key_size, CONTENT_INDEX_MAGIC);
+}
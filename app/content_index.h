@@ -0,0 +1,122 @@
+#ifndef AES_MUSIC_PLAYER_APP_CONTENT_INDEX_H
+#define AES_MUSIC_PLAYER_APP_CONTENT_INDEX_H
+
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <pthread.h>
+
+#define CONTENT_INDEX_MAGIC 0x58444943 // "CIDX"
+#define CONTENT_INDEX_VERSION 1
+// the journal is compacted on load if it holds more than this many times the live records
+#define CONTENT_INDEX_COMPACT_RATIO 2
+// chunk size of reading a file for hashing
+#define CONTENT_INDEX_READ_CHUNK_SIZE (256 * 1024)
+
+// Persistent index of file contents, used to skip redundant encryptions.
+//
+// The content hash of a file is remembered together with its identity (device, inode, size, mtime), so an unchanged
+// file is not read again. Encrypted files are registered by the hash of their plaintext and the key, so another copy
+// of the same content can be cloned from an existing ciphertext instead of running it through the core.
+// The index is an append-only journal of records, replayed on load and compacted when it grew too long. Entries
+// are validated against the file system when used, so a missing or stale index only costs rehashing.
+class content_index {
+public:
+    // identity of a version of a file, changes if the file is modified or replaced
+    struct file_id_t {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        int64_t mtime_ns;
+
+        bool operator==(const file_id_t &other) const {
+            return dev == other.dev && ino == other.ino && size == other.size && mtime_ns == other.mtime_ns;
+        }
+    };
+
+    // plaintext content of a file
+    struct content_t {
+        uint64_t hash;
+        uint64_t size;
+    };
+
+    // path of the index file, loaded if it exists (empty path: the index is not persisted)
+    explicit content_index(std::string path);
+    ~content_index();
+
+    content_index(const content_index&) = delete;
+    content_index& operator=(const content_index&) = delete;
+
+    // content of the file, only read and hashed if it changed since it was last seen
+    bool get_content(const std::string &path, content_t &content);
+    // path of a valid encrypted file holding the content encrypted with the key, empty if there is none
+    std::string find_ciphertext(const content_t &content, const void *key, size_t key_size);
+    // registers the encrypted file at path as the ciphertext of the content with the key
+    void add_ciphertext(const content_t &content, const void *key, size_t key_size, const std::string &path);
+
+    // copies the file, sharing the extents with the source where the file system supports it (reflink)
+    static bool clone_file(const std::string &from, const std::string &to);
+    // $XDG_CACHE_HOME/aes_music_player/content_index (or ~/.cache/...)
+    static std::string default_path();
+
+private:
+    enum _record_type_t : uint8_t {FILE_RECORD = 1, CIPHERTEXT_RECORD = 2};
+
+    // the fixed part of a journal record, followed by path_size bytes of path
+    struct _record_t {
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t path_size;
+        uint32_t reserved2;
+        file_id_t file_id;
+        content_t content;
+        // hash of the key the ciphertext was made with (0 for a file record)
+        uint64_t key_id;
+    };
+
+    struct _file_entry_t {
+        file_id_t file_id;
+        content_t content;
+    };
+
+    struct _ciphertext_key_t {
+        uint64_t hash;
+        uint64_t size;
+        uint64_t key_id;
+
+        bool operator==(const _ciphertext_key_t &other) const {
+            return hash == other.hash && size == other.size && key_id == other.key_id;
+        }
+    };
+
+    struct _ciphertext_key_hasher_t {
+        size_t operator()(const _ciphertext_key_t &key) const { return (size_t)(key.hash ^ key.key_id); }
+    };
+
+    struct _ciphertext_entry_t {
+        std::string path;
+        file_id_t file_id;
+    };
+
+    std::string _path;
+    int _journal_fd = -1;
+
+    // path -> identity and content of the file as it was last hashed
+    std::unordered_map<std::string, _file_entry_t> _files;
+    // content and key -> location of an encrypted copy
+    std::unordered_map<_ciphertext_key_t, _ciphertext_entry_t, _ciphertext_key_hasher_t> _ciphertexts;
+
+    mutable pthread_mutex_t _mutex{};
+
+    void _load();
+    bool _compact();
+    bool _open_journal();
+    void _append(const _record_t &record, const std::string &path);
+
+    static bool _get_file_id(const std::string &path, file_id_t &file_id);
+    static uint64_t _key_id(const void *key, size_t key_size);
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_CONTENT_INDEX_H
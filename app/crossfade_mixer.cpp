@@ -0,0 +1,152 @@
+#include "crossfade_mixer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CROSSFADE_MIXER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CROSSFADE_MIXER_SSE2
+#endif
+
+namespace {
+    constexpr float QUARTER_TURN = 1.5707963267948966f;
+
+    int16_t saturate(float sample) {
+        sample = std::min(std::max(sample, -32768.0f), 32767.0f);
+        return (int16_t)(int32_t)(sample + std::copysign(0.5f, sample));
+    }
+
+    // frame i gets the gains at angle + step * (i + 1), from frame first on (the vector kernels leave their tails to
+    // it)
+    void mix_scalar(int16_t *outgoing, const int16_t *incoming, size_t frames, float angle, float step, float out_scale,
+                    float in_scale, size_t first = 0) {
+        float out_gain = std::cos(angle + step * (float)(first + 1));
+        float in_gain = std::sin(angle + step * (float)(first + 1));
+        const float c = std::cos(step), s = std::sin(step);
+
+        for (size_t i = first; i < frames; ++i) {
+            for (size_t channel = 0; channel < 2; ++channel) {
+                outgoing[i * 2 + channel] = saturate((float)outgoing[i * 2 + channel] * out_gain * out_scale +
+                                                     (float)incoming[i * 2 + channel] * in_gain * in_scale);
+            }
+
+            float next_out = out_gain * c - in_gain * s;
+            in_gain = in_gain * c + out_gain * s;
+            out_gain = next_out;
+        }
+    }
+
+#if defined(CROSSFADE_MIXER_NEON)
+    void mix(int16_t *outgoing, const int16_t *incoming, size_t frames, float angle, float step, float out_scale,
+             float in_scale) {
+        float32x4_t out_gains = simd::frame_pairs(std::cos(angle + step), std::cos(angle + 2 * step));
+        float32x4_t in_gains = simd::frame_pairs(std::sin(angle + step), std::sin(angle + 2 * step));
+        const float c = std::cos(2 * step), s = std::sin(2 * step);
+        size_t i = 0;
+
+        const auto rotate = [&]() {
+            float32x4_t next_out = vmlsq_n_f32(vmulq_n_f32(out_gains, c), in_gains, s);
+            in_gains = vmlaq_n_f32(vmulq_n_f32(in_gains, c), out_gains, s);
+            out_gains = next_out;
+        };
+        for (; i + 4 <= frames; i += 4) {
+            int16x8_t out = vld1q_s16(outgoing + i * 2), in = vld1q_s16(incoming + i * 2);
+
+            float32x4_t low = vmulq_f32(simd::widen_low(out), vmulq_n_f32(out_gains, out_scale));
+            low = vmlaq_f32(low, simd::widen_low(in), vmulq_n_f32(in_gains, in_scale));
+            rotate();
+            float32x4_t high = vmulq_f32(simd::widen_high(out), vmulq_n_f32(out_gains, out_scale));
+            high = vmlaq_f32(high, simd::widen_high(in), vmulq_n_f32(in_gains, in_scale));
+            rotate();
+
+            vst1q_s16(outgoing + i * 2, vcombine_s16(simd::round_4(low), simd::round_4(high)));
+        }
+        mix_scalar(outgoing, incoming, frames, angle, step, out_scale, in_scale, i);
+    }
+
+    const char *instruction_set = "neon";
+#elif defined(CROSSFADE_MIXER_SSE2)
+    void mix(int16_t *outgoing, const int16_t *incoming, size_t frames, float angle, float step, float out_scale,
+             float in_scale) {
+        __m128 out_gains = simd::frame_pairs(std::cos(angle + step), std::cos(angle + 2 * step));
+        __m128 in_gains = simd::frame_pairs(std::sin(angle + step), std::sin(angle + 2 * step));
+        const __m128 c = _mm_set1_ps(std::cos(2 * step)), s = _mm_set1_ps(std::sin(2 * step));
+        const __m128 out_scales = _mm_set1_ps(out_scale), in_scales = _mm_set1_ps(in_scale);
+        size_t i = 0;
+
+        const auto rotate = [&]() {
+            __m128 next_out = _mm_sub_ps(_mm_mul_ps(out_gains, c), _mm_mul_ps(in_gains, s));
+            in_gains = _mm_add_ps(_mm_mul_ps(in_gains, c), _mm_mul_ps(out_gains, s));
+            out_gains = next_out;
+        };
+        for (; i + 4 <= frames; i += 4) {
+            __m128i out = _mm_loadu_si128((const __m128i *)(outgoing + i * 2));
+            __m128i in = _mm_loadu_si128((const __m128i *)(incoming + i * 2));
+
+            __m128 low = _mm_add_ps(_mm_mul_ps(simd::widen_low(out), _mm_mul_ps(out_gains, out_scales)),
+                                    _mm_mul_ps(simd::widen_low(in), _mm_mul_ps(in_gains, in_scales)));
+            rotate();
+            __m128 high = _mm_add_ps(_mm_mul_ps(simd::widen_high(out), _mm_mul_ps(out_gains, out_scales)),
+                                     _mm_mul_ps(simd::widen_high(in), _mm_mul_ps(in_gains, in_scales)));
+            rotate();
+
+            // rounds to nearest, the packing saturates
+            _mm_storeu_si128((__m128i *)(outgoing + i * 2),
+                             _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+        }
+        mix_scalar(outgoing, incoming, frames, angle, step, out_scale, in_scale, i);
+    }
+
+    const char *instruction_set = "sse2";
+#else
+    void mix(int16_t *outgoing, const int16_t *incoming, size_t frames, float angle, float step, float out_scale,
+             float in_scale) {
+        mix_scalar(outgoing, incoming, frames, angle, step, out_scale, in_scale);
+    }
+
+    const char *instruction_set = "scalar";
+#endif
+}
+
+void crossfade_mixer::start(size_t overlap_frames, float ratio) {
+    _angle = 0;
+    _remaining = overlap_frames;
+    _step = overlap_frames > 0 ? QUARTER_TURN / (float)overlap_frames : 0;
+    // the louder one is brought down to the other one
+    _outgoing_scale = ratio > 1.0f ? 1.0f / ratio : 1.0f;
+    _incoming_scale = ratio > 1.0f ? 1.0f : ratio;
+}
+
+void crossfade_mixer::mix(int16_t *outgoing, const int16_t *incoming, size_t frames) {
+    frames = std::min(frames, _remaining);
+    ::mix(outgoing, incoming, frames, _angle, _step, _outgoing_scale, _incoming_scale);
+
+    _remaining -= frames;
+    _angle = _remaining > 0 ? _angle + _step * (float)frames : QUARTER_TURN;
+}
+
+void crossfade_mixer::scale(int16_t *frames, size_t nr_frames) const {
+    if (_incoming_scale == 1.0f)
+        return;
+
+    // the rest of the period the fade ended in, the stream takes the ratio over from the next one
+    for (size_t i = 0; i < nr_frames * 2; ++i)
+        frames[i] = saturate((float)frames[i] * _incoming_scale);
+}
+
+void crossfade_mixer::shorten(size_t frames) {
+    if (frames == 0 || frames >= _remaining)
+        return;
+
+    _remaining = frames;
+    _step = (QUARTER_TURN - _angle) / (float)frames;
+}
+
+const char *crossfade_mixer::kernel_name() {
+    return instruction_set;
+}
@@ -0,0 +1,49 @@
+#ifndef AES_MUSIC_PLAYER_APP_CROSSFADE_MIXER_H
+#define AES_MUSIC_PLAYER_APP_CROSSFADE_MIXER_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+// Mixing of the two sources of the stream during a crossfade: the outgoing one fades out and the incoming one fades
+// in over the overlap, along equal power curves (the cosine and the sine of a quarter turn), so two uncorrelated
+// tracks keep their loudness through it. The two are also brought to the same gain: the ratio of the gain of the
+// incoming track to the one of the outgoing track scales the incoming frames, or if it is above 1, its inverse scales
+// the outgoing ones (see i2s_stream::crossfade()). The gains sum to more than 1 inside the fade (to 1.41 at its middle),
+// so correlated material (the same note held across the splice) is up to 3 dB louder than either track there, and is
+// saturated to full scale where they are close to it.
+//
+// The curves are not evaluated frame by frame: the sine and the cosine of 2 frames in the lanes of a vector are
+// rotated on by the angle of 2 frames, from the angle the fade is at at the start of each call. The frames are mixed
+// with NEON (SSE2 on x86), 4 at a time, in place and without allocating.
+class crossfade_mixer {
+public:
+    // starts a fade over overlap_frames frames, the gain of the incoming frames ratio times the one of the outgoing
+    void start(size_t overlap_frames, float ratio);
+    // mixes the next frames of the fade (at most remaining()) into the outgoing ones
+    void mix(int16_t *outgoing, const int16_t *incoming, size_t frames);
+    // scales incoming frames past the end of the fade as the ones mixed (by the ratio, if it is not above 1)
+    void scale(int16_t *frames, size_t nr_frames) const;
+    // completes the fade within the next frames frames, from the gains it is at
+    void shorten(size_t frames);
+    // ends the fade, the outgoing source is not mixed anymore
+    void stop() { _remaining = 0; }
+
+    bool is_fading() const { return _remaining > 0; }
+    size_t remaining() const { return _remaining; }
+
+    // the instruction set of the mixing built for the target
+    static const char *kernel_name();
+
+private:
+    // of the last frame mixed, from 0 to a quarter turn
+    float _angle = 0;
+    // per frame
+    float _step = 0;
+    size_t _remaining = 0;
+    float _outgoing_scale = 1.0f;
+    float _incoming_scale = 1.0f;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_CROSSFADE_MIXER_H
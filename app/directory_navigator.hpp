@@ -51,6 +51,7 @@ public:
     void change_tags(const T &from, const T &to);
 
     std::optional<std::reference_wrapper<const entry>> get_current_entry() const;
+    std::vector<std::string> get_entry_paths(const std::function<bool(const entry&)>& predicate) const;
 
     template <typename U>
     friend std::ostream& operator<<(std::ostream& os, directory_navigator<U> const& navigator);
@@ -251,6 +252,18 @@ void directory_navigator<T>::change_tags(const T &from, const T &to) {
     }
 }
 
+template <typename T>
+std::vector<std::string> directory_navigator<T>::get_entry_paths(const std::function<bool(const entry&)>& predicate) const {
+    std::vector<std::string> paths;
+
+    for (const auto& e : _entries) {
+        if (predicate(e))
+            paths.push_back(e.path);
+    }
+
+    return paths;
+}
+
 template <typename T>
 std::optional<std::reference_wrapper<const typename directory_navigator<T>::entry>> directory_navigator<T>::get_current_entry() const {
     std::reference_wrapper<const directory_navigator::entry> ref = std::cref(_entries[_current_entry_ind]);
@@ -0,0 +1,215 @@
+#include "dma_copy.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "simd.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DMA_COPY_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DMA_COPY_SSE2
+#endif
+
+namespace {
+    // samples of 16 bits in a line
+    constexpr size_t LINE_SAMPLES = DMA_COPY_LINE_SIZE / sizeof(int16_t);
+
+    // rounds half away from zero, as the vector conversions do
+    int16_t to_s16(float sample) {
+        float scaled = std::min(std::max(sample * 32767.0f, -32768.0f), 32767.0f);
+        return (int16_t)(scaled + (scaled < 0 ? -0.5f : 0.5f));
+    }
+
+    // bytes to handle before dst is aligned to a line
+    size_t head_size(const void *dst, size_t size) {
+        size_t misalignment = (uintptr_t)dst & (DMA_COPY_LINE_SIZE - 1);
+        return std::min(size, misalignment ? DMA_COPY_LINE_SIZE - misalignment : 0);
+    }
+
+#if defined(DMA_COPY_NEON)
+    void copy_lines(uint8_t *dst, const uint8_t *src, size_t lines) {
+        auto *d = (uint8_t *)__builtin_assume_aligned(dst, DMA_COPY_LINE_SIZE);
+
+        for (; lines > 0; --lines, src += DMA_COPY_LINE_SIZE, d += DMA_COPY_LINE_SIZE) {
+            __builtin_prefetch(src + 4 * DMA_COPY_LINE_SIZE);
+            uint8x16_t q0 = vld1q_u8(src), q1 = vld1q_u8(src + 16), q2 = vld1q_u8(src + 32), q3 = vld1q_u8(src + 48);
+            vst1q_u8(d, q0);
+            vst1q_u8(d + 16, q1);
+            vst1q_u8(d + 32, q2);
+            vst1q_u8(d + 48, q3);
+        }
+    }
+
+    void fill_lines(uint8_t *dst, int value, size_t lines) {
+        auto *d = (uint8_t *)__builtin_assume_aligned(dst, DMA_COPY_LINE_SIZE);
+        uint8x16_t q = vdupq_n_u8((uint8_t)value);
+
+        for (; lines > 0; --lines, d += DMA_COPY_LINE_SIZE) {
+            vst1q_u8(d, q);
+            vst1q_u8(d + 16, q);
+            vst1q_u8(d + 32, q);
+            vst1q_u8(d + 48, q);
+        }
+    }
+
+    void float_to_s16_lines(int16_t *dst, const float *src, size_t lines) {
+        auto *d = (int16_t *)__builtin_assume_aligned(dst, DMA_COPY_LINE_SIZE);
+
+        for (; lines > 0; --lines, src += LINE_SAMPLES, d += LINE_SAMPLES) {
+            int16x8_t q0 = vcombine_s16(simd::convert_4(src), simd::convert_4(src + 4));
+            int16x8_t q1 = vcombine_s16(simd::convert_4(src + 8), simd::convert_4(src + 12));
+            int16x8_t q2 = vcombine_s16(simd::convert_4(src + 16), simd::convert_4(src + 20));
+            int16x8_t q3 = vcombine_s16(simd::convert_4(src + 24), simd::convert_4(src + 28));
+            vst1q_s16(d, q0);
+            vst1q_s16(d + 8, q1);
+            vst1q_s16(d + 16, q2);
+            vst1q_s16(d + 24, q3);
+        }
+    }
+#elif defined(DMA_COPY_SSE2)
+    // streaming stores bypass the cache, as the stores to uncached memory do
+    void copy_lines(uint8_t *dst, const uint8_t *src, size_t lines) {
+        for (; lines > 0; --lines, src += DMA_COPY_LINE_SIZE, dst += DMA_COPY_LINE_SIZE) {
+            __m128i q0 = _mm_loadu_si128((const __m128i *)src), q1 = _mm_loadu_si128((const __m128i *)(src + 16));
+            __m128i q2 = _mm_loadu_si128((const __m128i *)(src + 32)), q3 = _mm_loadu_si128((const __m128i *)(src + 48));
+            _mm_stream_si128((__m128i *)dst, q0);
+            _mm_stream_si128((__m128i *)(dst + 16), q1);
+            _mm_stream_si128((__m128i *)(dst + 32), q2);
+            _mm_stream_si128((__m128i *)(dst + 48), q3);
+        }
+        _mm_sfence();
+    }
+
+    void fill_lines(uint8_t *dst, int value, size_t lines) {
+        __m128i q = _mm_set1_epi8((char)value);
+
+        for (; lines > 0; --lines, dst += DMA_COPY_LINE_SIZE) {
+            _mm_stream_si128((__m128i *)dst, q);
+            _mm_stream_si128((__m128i *)(dst + 16), q);
+            _mm_stream_si128((__m128i *)(dst + 32), q);
+            _mm_stream_si128((__m128i *)(dst + 48), q);
+        }
+        _mm_sfence();
+    }
+
+    void float_to_s16_lines(int16_t *dst, const float *src, size_t lines) {
+        for (; lines > 0; --lines, src += LINE_SAMPLES, dst += LINE_SAMPLES) {
+            for (size_t i = 0; i < LINE_SAMPLES; i += 8)
+                _mm_stream_si128((__m128i *)(dst + i), _mm_packs_epi32(simd::convert_4(src + i), simd::convert_4(src + i + 4)));
+        }
+        _mm_sfence();
+    }
+#else
+    // whole lines by word-sized sequential stores
+    void copy_lines(uint8_t *dst, const uint8_t *src, size_t lines) {
+        uint64_t words[DMA_COPY_LINE_SIZE / sizeof(uint64_t)];
+
+        for (; lines > 0; --lines, src += DMA_COPY_LINE_SIZE, dst += DMA_COPY_LINE_SIZE) {
+            memcpy(words, src, DMA_COPY_LINE_SIZE);
+            for (size_t i = 0; i < DMA_COPY_LINE_SIZE / sizeof(uint64_t); ++i)
+                ((volatile uint64_t *)dst)[i] = words[i];
+        }
+    }
+
+    void fill_lines(uint8_t *dst, int value, size_t lines) {
+        uint64_t word = 0x0101010101010101ULL * (uint8_t)value;
+
+        for (; lines > 0; --lines, dst += DMA_COPY_LINE_SIZE) {
+            for (size_t i = 0; i < DMA_COPY_LINE_SIZE / sizeof(uint64_t); ++i)
+                ((volatile uint64_t *)dst)[i] = word;
+        }
+    }
+
+    // a line is converted in cached memory, then stored whole
+    void float_to_s16_lines(int16_t *dst, const float *src, size_t lines) {
+        int16_t line[LINE_SAMPLES];
+
+        for (; lines > 0; --lines, src += LINE_SAMPLES, dst += LINE_SAMPLES) {
+            for (size_t i = 0; i < LINE_SAMPLES; ++i)
+                line[i] = to_s16(src[i]);
+            copy_lines((uint8_t *)dst, (const uint8_t *)line, 1);
+        }
+    }
+#endif
+
+    void float_to_s16_cached(int16_t *dst, const float *src, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            dst[i] = to_s16(src[i]);
+    }
+
+    void copy_uncached(void *dst, const void *src, size_t size) {
+        auto *d = (uint8_t *)dst;
+        auto *s = (const uint8_t *)src;
+        size_t head = head_size(d, size);
+
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        size -= head;
+
+        copy_lines(d, s, size / DMA_COPY_LINE_SIZE);
+        memcpy(d + size / DMA_COPY_LINE_SIZE * DMA_COPY_LINE_SIZE, s + size / DMA_COPY_LINE_SIZE * DMA_COPY_LINE_SIZE,
+               size % DMA_COPY_LINE_SIZE);
+    }
+
+    void fill_uncached(void *dst, int value, size_t size) {
+        auto *d = (uint8_t *)dst;
+        size_t head = head_size(d, size);
+
+        memset(d, value, head);
+        d += head;
+        size -= head;
+
+        fill_lines(d, value, size / DMA_COPY_LINE_SIZE);
+        memset(d + size / DMA_COPY_LINE_SIZE * DMA_COPY_LINE_SIZE, value, size % DMA_COPY_LINE_SIZE);
+    }
+
+    void float_to_s16_uncached(int16_t *dst, const float *src, size_t count) {
+        // samples not aligned on themselves never get to a line boundary
+        if ((uintptr_t)dst % sizeof(int16_t) != 0) {
+            float_to_s16_cached(dst, src, count);
+            return;
+        }
+
+        size_t head = head_size(dst, count * sizeof(int16_t)) / sizeof(int16_t);
+        float_to_s16_cached(dst, src, head);
+        dst += head;
+        src += head;
+        count -= head;
+
+        float_to_s16_lines(dst, src, count / LINE_SAMPLES);
+        float_to_s16_cached(dst + count / LINE_SAMPLES * LINE_SAMPLES, src + count / LINE_SAMPLES * LINE_SAMPLES,
+                            count % LINE_SAMPLES);
+    }
+
+    void copy_cached(void *dst, const void *src, size_t size) {
+        memcpy(dst, src, size);
+    }
+
+    void fill_cached(void *dst, int value, size_t size) {
+        memset(dst, value, size);
+    }
+
+    const dma_copy::kernels_t cached_kernels{"libc", copy_cached, fill_cached, float_to_s16_cached};
+#if defined(DMA_COPY_NEON)
+    const dma_copy::kernels_t uncached_kernels{"neon", copy_uncached, fill_uncached, float_to_s16_uncached};
+#elif defined(DMA_COPY_SSE2)
+    const dma_copy::kernels_t uncached_kernels{"sse2", copy_uncached, fill_uncached, float_to_s16_uncached};
+#else
+    const dma_copy::kernels_t uncached_kernels{"lines", copy_uncached, fill_uncached, float_to_s16_uncached};
+#endif
+}
+
+const dma_copy::kernels_t &dma_copy::kernels(dma_copy::mapping_t mapping) {
+    return mapping == UNCACHED ? uncached_kernels : cached_kernels;
+}
+
+const dma_copy::kernels_t &dma_copy::kernels(axidma_dev_t dev, const void *buffer, size_t size) {
+    if (!dev || axidma_is_cached(dev, buffer, size))
+        return cached_kernels;
+
+    return uncached_kernels;
+}
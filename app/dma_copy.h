@@ -0,0 +1,38 @@
+#ifndef AES_MUSIC_PLAYER_APP_DMA_COPY_H
+#define AES_MUSIC_PLAYER_APP_DMA_COPY_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include "libaxidma.h"
+
+// size of the lines the uncached kernels store whole: two of the 32-byte cache lines of the Cortex-A9 L1 and of the
+// PL310 L2, so each iteration of the kernels is 4 quadword stores and still covers whole cache lines
+#define DMA_COPY_LINE_SIZE 64
+
+// Copy, fill and sample conversion kernels for DMA buffers.
+//
+// The memory of axidma_malloc is mapped uncached: each access of the CPU goes out on the bus, stores are only merged
+// when they are sequential, and loads are not prefetched. libc's memcpy and memset (tuned for cached memory) and
+// writes sample by sample run many times slower on it. The uncached kernels move whole lines with NEON (SSE2
+// streaming stores on x86): the destination is aligned to a line first, then every line is stored by sequential
+// 16-byte stores. The cached kernels are the libc functions. The kernels are chosen for a buffer by how it is mapped.
+namespace dma_copy {
+    enum mapping_t {CACHED, UNCACHED};
+
+    struct kernels_t {
+        const char *name;
+        void (*copy)(void *dst, const void *src, size_t size);
+        void (*fill)(void *dst, int value, size_t size);
+        // converts count samples in [-1.0, 1.0] to 16-bit, saturating the ones outside
+        void (*float_to_s16)(int16_t *dst, const float *src, size_t count);
+    };
+
+    const kernels_t &kernels(mapping_t mapping);
+    // the kernels for size bytes of a DMA buffer of the device (cached ones if there is no device)
+    const kernels_t &kernels(axidma_dev_t dev, const void *buffer, size_t size);
+}
+
+
+#endif //AES_MUSIC_PLAYER_APP_DMA_COPY_H
@@ -0,0 +1,223 @@
+#include "gain_stage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GAIN_STAGE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GAIN_STAGE_SSE2
+#endif
+
+namespace {
+    constexpr float FULL_SCALE = 32767.0f;
+    constexpr float KNEE = GAIN_STAGE_KNEE * FULL_SCALE;
+    // between the knee and full scale, the soft clipped samples approach full scale
+    constexpr float HEADROOM = FULL_SCALE - KNEE;
+    constexpr float DITHER_SCALE = 1.0f / 65536;
+
+    uint32_t xorshift(uint32_t &seed) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    float soft_clip(float sample) {
+        float magnitude = std::fabs(sample);
+        if (magnitude <= KNEE)
+            return sample;
+
+        float over = (magnitude - KNEE) / HEADROOM;
+        return std::copysign(KNEE + HEADROOM * over / (1 + over), sample);
+    }
+
+    // the two halves of the random value are the two uniform values of the TPDF dither, in (-1, 1) LSB
+    int16_t quantize(float sample, uint32_t random) {
+        sample += (float)(random & 0xFFFF) * DITHER_SCALE + (float)(random >> 16) * DITHER_SCALE - 1;
+        sample = std::min(std::max(sample, -32768.0f), FULL_SCALE);
+        return (int16_t)(int32_t)(sample + std::copysign(0.5f, sample));
+    }
+
+    // frame i is scaled by gain + step * (i + 1), from frame first on (the vector kernels leave their tails to it)
+    template<bool CLIP>
+    void scale_scalar(int16_t *dst, const int16_t *src, size_t frames, float gain, float step, uint32_t *seeds,
+                      size_t first = 0) {
+        for (size_t i = first; i < frames; ++i) {
+            float frame_gain = gain + step * (float)(i + 1);
+
+            for (size_t channel = 0; channel < 2; ++channel) {
+                float sample = (float)src[i * 2 + channel] * frame_gain;
+                dst[i * 2 + channel] = quantize(CLIP ? soft_clip(sample) : sample, xorshift(seeds[0]));
+            }
+        }
+    }
+
+#if defined(GAIN_STAGE_NEON)
+    float32x4_t reciprocal(float32x4_t value) {
+        float32x4_t estimate = vrecpeq_f32(value);
+
+        estimate = vmulq_f32(vrecpsq_f32(value, estimate), estimate);
+        return vmulq_f32(vrecpsq_f32(value, estimate), estimate);
+    }
+
+    template<bool CLIP>
+    int16x4_t quantize_4(float32x4_t samples, uint32x4_t &state) {
+        if (CLIP) {
+            float32x4_t magnitude = vabsq_f32(samples);
+            float32x4_t over = vmulq_n_f32(vmaxq_f32(vsubq_f32(magnitude, vdupq_n_f32(KNEE)), vdupq_n_f32(0)),
+                                           1 / HEADROOM);
+            float32x4_t clipped = vmlaq_n_f32(vdupq_n_f32(KNEE),
+                                              vmulq_f32(over, reciprocal(vaddq_f32(over, vdupq_n_f32(1)))), HEADROOM);
+            uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(samples), vdupq_n_u32(0x80000000));
+
+            magnitude = vbslq_f32(vcgtq_f32(magnitude, vdupq_n_f32(KNEE)), clipped, magnitude);
+            samples = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(magnitude), sign));
+        }
+
+        state = veorq_u32(state, vshlq_n_u32(state, 13));
+        state = veorq_u32(state, vshrq_n_u32(state, 17));
+        state = veorq_u32(state, vshlq_n_u32(state, 5));
+        float32x4_t dither = vaddq_f32(vcvtq_f32_u32(vandq_u32(state, vdupq_n_u32(0xFFFF))),
+                                       vcvtq_f32_u32(vshrq_n_u32(state, 16)));
+        samples = vaddq_f32(samples, vmlaq_n_f32(vdupq_n_f32(-1), dither, DITHER_SCALE));
+
+        return simd::round_4(samples);
+    }
+
+    template<bool CLIP>
+    void scale(int16_t *dst, const int16_t *src, size_t frames, float gain, float step, uint32_t *seeds) {
+        uint32x4_t state = vld1q_u32(seeds);
+        float32x4_t gains = simd::frame_pairs(gain + step, gain + 2 * step);
+        float32x4_t increment = vdupq_n_f32(2 * step);
+        size_t i = 0;
+
+        for (; i + 4 <= frames; i += 4) {
+            int16x8_t samples = vld1q_s16(src + i * 2);
+            float32x4_t low = vmulq_f32(simd::widen_low(samples), gains);
+            gains = vaddq_f32(gains, increment);
+            float32x4_t high = vmulq_f32(simd::widen_high(samples), gains);
+            gains = vaddq_f32(gains, increment);
+
+            vst1q_s16(dst + i * 2, vcombine_s16(quantize_4<CLIP>(low, state), quantize_4<CLIP>(high, state)));
+        }
+        vst1q_u32(seeds, state);
+        scale_scalar<CLIP>(dst, src, frames, gain, step, seeds, i);
+    }
+
+    const char *instruction_set = "neon";
+#elif defined(GAIN_STAGE_SSE2)
+    template<bool CLIP>
+    __m128i quantize_4(__m128 samples, __m128i &state) {
+        if (CLIP) {
+            __m128 sign = _mm_and_ps(samples, _mm_set1_ps(-0.0f));
+            __m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), samples);
+            __m128 over = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(magnitude, _mm_set1_ps(KNEE)), _mm_setzero_ps()),
+                                     _mm_set1_ps(1 / HEADROOM));
+            __m128 clipped = _mm_add_ps(_mm_set1_ps(KNEE), _mm_mul_ps(_mm_set1_ps(HEADROOM),
+                                        _mm_div_ps(over, _mm_add_ps(over, _mm_set1_ps(1)))));
+            __m128 is_over = _mm_cmpgt_ps(magnitude, _mm_set1_ps(KNEE));
+
+            magnitude = _mm_or_ps(_mm_and_ps(is_over, clipped), _mm_andnot_ps(is_over, magnitude));
+            samples = _mm_or_ps(magnitude, sign);
+        }
+
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        __m128 dither = _mm_add_ps(_mm_cvtepi32_ps(_mm_and_si128(state, _mm_set1_epi32(0xFFFF))),
+                                   _mm_cvtepi32_ps(_mm_srli_epi32(state, 16)));
+        samples = _mm_add_ps(samples, _mm_sub_ps(_mm_mul_ps(dither, _mm_set1_ps(DITHER_SCALE)), _mm_set1_ps(1)));
+
+        // rounds to nearest, the packing saturates
+        return _mm_cvtps_epi32(samples);
+    }
+
+    template<bool CLIP>
+    void scale(int16_t *dst, const int16_t *src, size_t frames, float gain, float step, uint32_t *seeds) {
+        __m128i state = _mm_loadu_si128((const __m128i *)seeds);
+        __m128 gains = simd::frame_pairs(gain + step, gain + 2 * step);
+        __m128 increment = _mm_set1_ps(2 * step);
+        size_t i = 0;
+
+        for (; i + 4 <= frames; i += 4) {
+            __m128i samples = _mm_loadu_si128((const __m128i *)(src + i * 2));
+            __m128 low = _mm_mul_ps(simd::widen_low(samples), gains);
+            gains = _mm_add_ps(gains, increment);
+            __m128 high = _mm_mul_ps(simd::widen_high(samples), gains);
+            gains = _mm_add_ps(gains, increment);
+
+            _mm_storeu_si128((__m128i *)(dst + i * 2),
+                             _mm_packs_epi32(quantize_4<CLIP>(low, state), quantize_4<CLIP>(high, state)));
+        }
+        _mm_storeu_si128((__m128i *)seeds, state);
+        scale_scalar<CLIP>(dst, src, frames, gain, step, seeds, i);
+    }
+
+    const char *instruction_set = "sse2";
+#else
+    template<bool CLIP>
+    void scale(int16_t *dst, const int16_t *src, size_t frames, float gain, float step, uint32_t *seeds) {
+        scale_scalar<CLIP>(dst, src, frames, gain, step, seeds);
+    }
+
+    const char *instruction_set = "scalar";
+#endif
+}
+
+gain_stage::gain_stage(float gain) : _gain(std::max(gain, 0.0f)), _target(_gain) { }
+
+void gain_stage::ramp(float from, float to, size_t ramp_frames) {
+    _gain = std::max(from, 0.0f);
+    _target = std::max(to, 0.0f);
+    _remaining = _gain != _target ? ramp_frames : 0;
+    _step = _remaining > 0 ? (_target - _gain) / (float)_remaining : 0;
+    if (_remaining == 0)
+        _gain = _target;
+}
+
+void gain_stage::rescale(float factor) {
+    factor = std::max(factor, 0.0f);
+    _gain *= factor;
+    _target *= factor;
+    _step *= factor;
+}
+
+void gain_stage::process(int16_t *dst, const int16_t *src, size_t frames) {
+    size_t done = 0;
+
+    while (done < frames) {
+        if (is_unity()) {
+            if (dst != src)
+                memcpy(dst + done * 2, src + done * 2, (frames - done) * 2 * sizeof(int16_t));
+            break;
+        }
+
+        // the ramp, then the rest at the target
+        size_t count = _remaining > 0 ? std::min(frames - done, _remaining) : frames - done;
+        float step = _remaining > 0 ? _step : 0;
+        if (std::max(_gain, _target) > 1.0f)
+            scale<true>(dst + done * 2, src + done * 2, count, _gain, step, _seeds);
+        else
+            scale<false>(dst + done * 2, src + done * 2, count, _gain, step, _seeds);
+
+        if (_remaining > 0) {
+            _remaining -= count;
+            _gain = _remaining > 0 ? _gain + step * (float)count : _target;
+        }
+        done += count;
+    }
+}
+
+float gain_stage::db_to_gain(float db) {
+    return std::pow(10.0f, db / 20);
+}
+
+const char *gain_stage::kernel_name() {
+    return instruction_set;
+}
@@ -0,0 +1,53 @@
+#ifndef AES_MUSIC_PLAYER_APP_GAIN_STAGE_H
+#define AES_MUSIC_PLAYER_APP_GAIN_STAGE_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+// a gain change ramps over 5 ms, without the zipper noise of a step
+#define GAIN_STAGE_RAMP_MS 5
+// soft clipping starts 1 dB below full scale (only while the gain is above 1)
+#define GAIN_STAGE_KNEE 0.891f
+
+// Gain of the 16-bit stereo frames of the stream, in the sample domain.
+//
+// A change of the gain ramps linearly, sample by sample, from the gain the stage is at. The scaled samples are
+// requantized to 16 bits with TPDF dither (the sum of two uniform random values, +-1 LSB) so the rounding error is
+// noise rather than distortion at low levels. Above a gain of 1, the samples beyond the knee are soft clipped
+// (x / (1 + x) from the knee to full scale) instead of wrapping or clipping hard. At a gain of 1 the frames are copied
+// untouched. Scaling runs with NEON (SSE2 on x86), 4 frames at a time.
+class gain_stage {
+public:
+    explicit gain_stage(float gain = 1.0f);
+
+    // ramps from the gain it is at to gain over ramp_frames frames (right away with 0)
+    void set_gain(float gain, size_t ramp_frames = 0) { ramp(_gain, gain, ramp_frames); }
+    // ramps from the gain it was at earlier, to scale the frames from there again towards another gain
+    void ramp(float from, float to, size_t ramp_frames);
+    // multiplies the gain it is at and the one it ramps to, the ramp goes on from there
+    void rescale(float factor);
+    // writes the frames scaled to dst (which may be src)
+    void process(int16_t *dst, const int16_t *src, size_t frames);
+
+    // at the frames processed so far, the gain it ramps to
+    float gain() const { return _gain; }
+    float target() const { return _target; }
+    bool is_unity() const { return _gain == 1.0f && _remaining == 0; }
+
+    static float db_to_gain(float db);
+    // the instruction set of the scaling built for the target
+    static const char *kernel_name();
+
+private:
+    float _gain;
+    float _target;
+    // per frame, for the frames left to ramp
+    float _step = 0;
+    size_t _remaining = 0;
+    // xorshift states of the dither, a lane each
+    uint32_t _seeds[4] = {0x9E3779B9, 0x7F4A7C15, 0xF39CC060, 0x5CED6A2B};
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_GAIN_STAGE_H
@@ -0,0 +1,415 @@
+#include "i2s_stream.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "util.h"
+
+int i2s_stream::start(source_t source, size_t period_frames, int num_periods) {
+    double start = now_us();
+
+    if (period_frames == 0 || num_periods < 2)
+        return -1;
+
+    stop();
+
+    // the ring is the only continuous memory of the stream
+    size_t ring_size = period_frames * I2S_FRAME_SIZE * (size_t)num_periods;
+    if (!_budget.reserve(cma_budget::PLAYER, ring_size, _reserve_timeout_ms))
+        return -1;
+
+    _ring = (int16_t *)axidma_malloc(_dev, ring_size);
+    if (!_ring) {
+        _budget.release(cma_budget::PLAYER, ring_size);
+        return -1;
+    }
+
+    _ring_size = ring_size;
+    _kernels = &dma_copy::kernels(_dev, _ring, _ring_size);
+    _period_frames = period_frames;
+    _num_periods = num_periods;
+    _staging.resize(period_frames * I2S_CHANNELS * (size_t)num_periods);
+    _lengths.assign((size_t)num_periods, 0);
+    _scaled.resize(period_frames * I2S_CHANNELS);
+    _faded.resize(period_frames * I2S_CHANNELS);
+    _gains.assign((size_t)num_periods, _gain.gain());
+    _started = 0;
+    _stats = {};
+
+    return _start_transfer(std::move(source), start);
+}
+
+int i2s_stream::restart(source_t source) {
+    double start = now_us();
+
+    if (!_ring)
+        return -1;
+
+    // the sources that were read from but did not start are dropped with the periods
+    int nr_dropped = (int)_start_periods.size();
+
+    axidma_stop_transfer(_dev, _channel);
+    if (_start_transfer(std::move(source), start) != 0)
+        return -1;
+    ++_stats.restarts;
+
+    return nr_dropped;
+}
+
+size_t i2s_stream::buffered_frames() const {
+    return _ring && _filled > _completed ? (size_t)(_filled - _completed) * _period_frames : 0;
+}
+
+int i2s_stream::_start_transfer(source_t source, double start) {
+    _source = std::move(source);
+    _filled = 0;
+    _completed = 0;
+    _end_period = -1;
+    _start_periods.clear();
+    _pause_period = -1;
+    _is_parked = false;
+    _parked = std::vector<int16_t>();
+    _staged_first = 0;
+    _end_crossfade();
+    _gain_first = 0;
+
+    // the first period is enough to start with, the others are filled while it plays
+    _fill_period(_filled++);
+    if (axidma_cyclic_transfer(_dev, _channel, _ring, _period_frames * I2S_FRAME_SIZE, _num_periods) < 0) {
+        stop();
+        return -1;
+    }
+    _stats.start_latency_us = now_us() - start;
+
+    refill();
+
+    return 0;
+}
+
+bool i2s_stream::refill() {
+    if (!_ring)
+        return true;
+    if (_is_parked)
+        return false;
+
+    long long completed = axidma_get_cyclic_periods(_dev, _channel);
+    if (completed < 0)
+        return false;
+
+    // the DMA is on the silenced periods, the ones after them are not refilled
+    if (_pause_period >= 0) {
+        if (completed >= _pause_period) {
+            axidma_stop_transfer(_dev, _channel);
+            _is_parked = true;
+        }
+        return false;
+    }
+    _stats.periods_played = (unsigned long long)completed;
+    _completed = completed;
+
+    // the DMA is on period completed
+    while (!_start_periods.empty() && _start_periods.front() <= completed) {
+        _start_periods.pop_front();
+        ++_started;
+    }
+
+    if (_end_period >= 0 && completed >= _end_period) {
+        stop();
+        return true;
+    }
+
+    // the DMA is on period completed, the ones up to it not filled yet were played stale
+    if (completed >= _filled) {
+        _stats.underruns += (unsigned long long)(completed - _filled + 1);
+        _filled = completed + 1;
+    }
+
+    // a period shares its slot with the one num_periods before it, which has to be completed
+    while (_filled < completed + _num_periods)
+        _fill_period(_filled++);
+
+    return false;
+}
+
+bool i2s_stream::pause() {
+    if (!_ring || _pause_period >= 0)
+        return false;
+
+    // up to date with the DMA, the periods after the one it is on are all filled
+    if (refill())
+        return false;
+    // the source ends in the period the DMA is on, the stream plays out instead
+    if (_end_period >= 0 && _end_period <= _completed + 1)
+        return false;
+
+    _pause_period = _completed + 1;
+    _parked.resize((size_t)(_filled - _pause_period) * _period_frames * I2S_CHANNELS);
+    for (long long period = _pause_period; period < _filled; ++period) {
+        int16_t *parked = _parked.data() + (size_t)(period - _pause_period) * _period_frames * I2S_CHANNELS;
+
+        _kernels->copy(parked, _slot(period), _period_frames * I2S_FRAME_SIZE);
+        _kernels->fill(_slot(period), 0, _period_frames * I2S_FRAME_SIZE);
+    }
+    ++_stats.pauses;
+
+    return true;
+}
+
+int i2s_stream::resume() {
+    double start = now_us();
+
+    if (!_ring || _pause_period < 0)
+        return -1;
+
+    if (!_is_parked)
+        axidma_stop_transfer(_dev, _channel);
+
+    // the transfer starts from the first slot, the periods are counted from the one parked at
+    long long shift = _pause_period;
+    size_t nr_parked = _parked.size() / (_period_frames * I2S_CHANNELS);
+    for (size_t i = 0; i < nr_parked; ++i)
+        _kernels->copy(_slot((long long)i), _parked.data() + i * _period_frames * I2S_CHANNELS,
+                       _period_frames * I2S_FRAME_SIZE);
+    _filled = (long long)nr_parked;
+    _completed = 0;
+    if (_end_period >= 0)
+        _end_period = std::max(_end_period - shift, 0LL);
+    for (long long &period : _start_periods)
+        period -= shift;
+    _gain_first = std::max(_gain_first - shift, 0LL);
+    if (_fold_period >= 0)
+        _fold_period = std::max(_fold_period - shift, 0LL);
+    _pause_period = -1;
+    _is_parked = false;
+    _parked = std::vector<int16_t>();
+    // the staged frames are of the periods as counted before
+    _staged_first = _filled;
+
+    if (axidma_cyclic_transfer(_dev, _channel, _ring, _period_frames * I2S_FRAME_SIZE, _num_periods) < 0) {
+        stop();
+        return -1;
+    }
+    _stats.start_latency_us = now_us() - start;
+
+    refill();
+
+    return 0;
+}
+
+void i2s_stream::set_gain(float gain, size_t ramp_frames) {
+    // the periods filled ahead are scaled again from the one after the DMA's, which it may reach meanwhile at the
+    // end of its period as with pause()
+    if (!_ring || _pause_period >= 0 || refill()) {
+        _gain.set_gain(gain / _ratio, ramp_frames);
+        return;
+    }
+
+    // relative to the gain the periods are at until the gain stage takes the ratio over
+    gain /= _ratio;
+    long long first = std::max({_completed + 1, _staged_first, _gain_first});
+    if (first >= _filled) {
+        _gain.set_gain(gain, ramp_frames);
+        return;
+    }
+
+    _gain.ramp(_gains[_slot_index(first)], gain, ramp_frames);
+    for (long long period = first; period < _filled; ++period)
+        _scale_period(period);
+}
+
+bool i2s_stream::crossfade(source_t source, size_t overlap_frames, float gain_ratio, double budget_us) {
+    if (!_ring || _pause_period >= 0 || _outgoing || _end_period >= 0 || !_queue.empty() || overlap_frames == 0 ||
+        gain_ratio <= 0)
+        return false;
+
+    // the gain stage takes the ratio of the last crossfade over with the next period, as well now
+    if (_fold_period >= 0)
+        _fold_ratio(_filled);
+
+    // the periods filled ahead play out as they are, the fade starts after them
+    _outgoing = std::move(_source);
+    _source = std::move(source);
+    _mixer.start(overlap_frames, gain_ratio);
+    // a louder source is not amplified into the mix, the gain stage takes its gain right away (see crossfade_mixer)
+    _ratio = gain_ratio;
+    _fold_period = gain_ratio > 1.0f ? _filled : -1;
+    _crossfade_budget_us = budget_us;
+    ++_stats.crossfades;
+
+    return true;
+}
+
+bool i2s_stream::enqueue(source_t source) {
+    if (!_ring || _end_period >= 0)
+        return false;
+
+    _queue.push_back(std::move(source));
+    return true;
+}
+
+size_t i2s_stream::clear_queue() {
+    size_t count = _queue.size();
+
+    _queue.clear();
+    return count;
+}
+
+size_t i2s_stream::take_started() {
+    size_t started = _started;
+
+    _started = 0;
+    return started;
+}
+
+void i2s_stream::stop() {
+    if (!_ring)
+        return;
+
+    axidma_stop_transfer(_dev, _channel);
+    axidma_free(_dev, _ring, _ring_size);
+    _budget.release(cma_budget::PLAYER, _ring_size);
+    _ring = nullptr;
+    _ring_size = 0;
+    _source = nullptr;
+    _queue.clear();
+    _start_periods.clear();
+    _pause_period = -1;
+    _is_parked = false;
+    _parked = std::vector<int16_t>();
+    _end_crossfade();
+}
+
+void i2s_stream::_fill_period(long long period) {
+    int16_t *staged = _staging.data() + _slot_index(period) * _period_frames * I2S_CHANNELS;
+    size_t frames = 0;
+
+    if (_fold_period >= 0 && period >= _fold_period)
+        _fold_ratio(period);
+    if (_outgoing)
+        frames = _fill_crossfade(period, staged);
+    size_t faded = frames;
+
+    // an ending source is followed by the next one within the period
+    while (_end_period < 0 && frames < _period_frames) {
+        size_t count = _period_frames - frames;
+        size_t nr_read = std::min(_source(staged + frames * I2S_CHANNELS, count), count);
+
+        frames += nr_read;
+        if (nr_read == count)
+            break;
+
+        if (_queue.empty()) {
+            _end_period = frames > 0 ? period + 1 : period;
+        } else {
+            _source = std::move(_queue.front());
+            _queue.pop_front();
+            _start_periods.push_back(period);
+        }
+    }
+
+    // the rest of the period the crossfade ended in, scaled as the frames mixed
+    if (!_outgoing && _ratio != 1.0f && faded < frames)
+        _mixer.scale(staged + faded * I2S_CHANNELS, frames - faded);
+
+    _lengths[_slot_index(period)] = frames;
+    _scale_period(period);
+}
+
+size_t i2s_stream::_fill_crossfade(long long period, int16_t *staged) {
+    double start = now_us();
+    size_t frames = std::min(_period_frames, _mixer.remaining());
+    int16_t *incoming = _faded.data();
+
+    // a source ending within the overlap is silent for the rest of it
+    size_t nr_outgoing = std::min(_outgoing(staged, frames), frames);
+    size_t nr_incoming = std::min(_source(incoming, frames), frames);
+    std::fill(staged + nr_outgoing * I2S_CHANNELS, staged + frames * I2S_CHANNELS, 0);
+    std::fill(incoming + nr_incoming * I2S_CHANNELS, incoming + frames * I2S_CHANNELS, 0);
+    _mixer.mix(staged, incoming, frames);
+
+    // the source faded in is shorter than the overlap, the frames after its end are dropped with the fade
+    if (nr_incoming < frames) {
+        _mixer.stop();
+        frames = nr_incoming;
+    }
+
+    // the next period would be filled late, the fade is completed within it at a single decoder from then on
+    if (_mixer.remaining() > _period_frames && now_us() - start > _crossfade_budget_us) {
+        _mixer.shorten(_period_frames);
+        ++_stats.crossfades_shortened;
+    }
+
+    // the frames are scaled by the gain stage alone from the next period
+    if (!_mixer.is_fading()) {
+        _outgoing = nullptr;
+        if (_ratio != 1.0f)
+            _fold_period = period + 1;
+    }
+
+    return frames;
+}
+
+void i2s_stream::_fold_ratio(long long period) {
+    _gain.rescale(_ratio);
+    _ratio = 1.0f;
+    _fold_period = -1;
+    _gain_first = period;
+}
+
+void i2s_stream::_end_crossfade() {
+    _outgoing = nullptr;
+    _mixer.stop();
+    if (_ratio != 1.0f)
+        _fold_ratio(_filled);
+}
+
+void i2s_stream::_scale_period(long long period) {
+    size_t slot = _slot_index(period), frames = _lengths[slot];
+    const int16_t *samples = _staging.data() + slot * _period_frames * I2S_CHANNELS;
+    int16_t *dst = _slot(period);
+
+    _gains[slot] = _gain.gain();
+    if (!_gain.is_unity()) {
+        _gain.process(_scaled.data(), samples, frames);
+        samples = _scaled.data();
+    }
+
+    // the ring is uncached, the staged samples are copied in whole lines
+    _kernels->copy(dst, samples, frames * I2S_FRAME_SIZE);
+    _kernels->fill(dst + frames * I2S_CHANNELS, 0, (_period_frames - frames) * I2S_FRAME_SIZE);
+}
+
+i2s_stream::source_t i2s_predecode(i2s_stream::source_t source, size_t frames) {
+    struct predecoded_t {
+        i2s_stream::source_t source;
+        std::vector<int16_t> frames;
+        size_t position = 0;
+        bool is_ended = false;
+    };
+    auto predecoded = std::make_shared<predecoded_t>();
+
+    predecoded->frames.resize(frames * I2S_CHANNELS);
+    size_t nr_read = std::min(source(predecoded->frames.data(), frames), frames);
+    predecoded->frames.resize(nr_read * I2S_CHANNELS);
+    predecoded->is_ended = nr_read < frames;
+    predecoded->source = std::move(source);
+
+    return [predecoded](int16_t *buffer, size_t count) {
+        size_t available = predecoded->frames.size() / I2S_CHANNELS - predecoded->position;
+        size_t served = std::min(count, available);
+
+        std::copy_n(predecoded->frames.begin() + (long)(predecoded->position * I2S_CHANNELS), served * I2S_CHANNELS,
+                    buffer);
+        predecoded->position += served;
+        if (served == available && !predecoded->frames.empty()) {
+            // served, freed
+            predecoded->frames = std::vector<int16_t>();
+            predecoded->position = 0;
+        }
+
+        if (served < count && !predecoded->is_ended)
+            served += std::min(predecoded->source(buffer + served * I2S_CHANNELS, count - served), count - served);
+
+        return served;
+    };
+}
@@ -0,0 +1,197 @@
+#ifndef AES_MUSIC_PLAYER_APP_I2S_STREAM_H
+#define AES_MUSIC_PLAYER_APP_I2S_STREAM_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "libaxidma.h"
+#include "cma_budget.h"
+#include "crossfade_mixer.h"
+#include "dma_copy.h"
+#include "gain_stage.h"
+
+// the stream is interleaved 16-bit stereo
+#define I2S_CHANNELS 2
+#define I2S_FRAME_SIZE (I2S_CHANNELS * sizeof(int16_t))
+
+// 1024 frames is about 21 ms at 48 kHz, the first period is played that long after starting
+#define I2S_DEFAULT_PERIOD_FRAMES 1024
+#define I2S_DEFAULT_NUM_PERIODS 4
+// share of the duration of a period the fill of one may take during a crossfade, a slower one ends the fade
+#define I2S_CROSSFADE_BUDGET 0.5
+
+// Streaming playback through a ring of DMA periods.
+//
+// The ring is a single buffer of axidma_malloc, played over and over by a cyclic transfer. The source is asked for a
+// period of frames at a time, into cached staging memory that is then copied into the ring. The transfer starts as
+// soon as the first period is filled, the other periods are filled while it plays, and each period is refilled once
+// the DMA completed it. So a stream takes the same memory whatever the length of the track, and the first samples
+// are out after decoding a single period. After the end of the source the periods are filled with silence, and the
+// stream stops once the DMA played the last period with samples.
+//
+// Sources enqueued while it plays follow the current one without a gap: the period the current source ends in is
+// completed from the next one.
+//
+// A paused stream plays out the period the DMA is on and is parked after it: the periods filled ahead are kept aside
+// and their slots silenced, the transfer is stopped once the DMA reached them. The ring, the source and the periods
+// stay as they were, resuming starts the transfer again from the first period kept.
+//
+// The samples are scaled by the gain stage of the stream on their way into the ring. The frames read from the source
+// are kept for each period filled ahead, so a change of the gain scales them again from the period after the one the
+// DMA is on: it is heard within a period, not after the periods filled ahead.
+//
+// A crossfade plays a source in place of the current one through an overlap: both are read and mixed (see
+// crossfade_mixer) into the periods filled from then on, the current one is dropped at the end of the overlap. The two
+// decoders take about twice the time of one, so the fill of each period of the overlap is timed: a fill taking more
+// than its budget completes the fade within the next period, and the periods are refilled ahead of the DMA as usual.
+// The mixing writes into the staging slots and a scratch period allocated with them, it allocates nothing.
+class i2s_stream {
+public:
+    // writes up to frames frames into buffer, returns the number written (less than frames at the end of the source)
+    using source_t = std::function<size_t(int16_t *buffer, size_t frames)>;
+
+    struct stats_t {
+        // time from start() (or restart(), resume()) until the transfer of the first period was started
+        double start_latency_us = 0;
+        unsigned long long periods_played = 0;
+        // periods the DMA reached before they were refilled, it played them stale or partly refilled
+        unsigned long long underruns = 0;
+        unsigned long long restarts = 0;
+        unsigned long long pauses = 0;
+        unsigned long long crossfades = 0;
+        // crossfades ended early, a period of the overlap took longer than the budget to fill
+        unsigned long long crossfades_shortened = 0;
+    };
+
+    i2s_stream(axidma_dev_t dev, int channel, cma_budget &budget, int reserve_timeout_ms = -1) :
+            _dev(dev), _channel(channel), _budget(budget), _reserve_timeout_ms(reserve_timeout_ms) { }
+    ~i2s_stream() { stop(); }
+
+    i2s_stream(const i2s_stream&) = delete;
+    i2s_stream& operator=(const i2s_stream&) = delete;
+
+    // allocates the ring, fills the first period and starts the transfer, 0 on success
+    int start(source_t source, size_t period_frames = I2S_DEFAULT_PERIOD_FRAMES,
+              int num_periods = I2S_DEFAULT_NUM_PERIODS);
+    // refills the periods the DMA completed, returns true once the stream played out (it is stopped then)
+    bool refill();
+    // drops the periods filled ahead and plays the source from the start of the ring, as start() does but keeping
+    // the ring and the enqueued sources; returns the number of enqueued sources dropped as they were read from
+    // already (they are the first ones after the source), -1 on error
+    int restart(source_t source);
+    // frames filled ahead of the DMA, the source was read that far beyond the position played
+    size_t buffered_frames() const;
+    // plays the source right after the current one (and the ones enqueued before it), false if not running
+    bool enqueue(source_t source);
+    // plays the source in place of the current one, fading over overlap_frames frames from the next period filled;
+    // gain_ratio scales the source to the gain of the stream (its own gain relative to the gain of the current one),
+    // budget_us is the time the fill of a period may take before the fade is ended within the next one. False if not
+    // running, paused, fading already, or the current source ended or is followed by enqueued ones
+    bool crossfade(source_t source, size_t overlap_frames, float gain_ratio, double budget_us);
+    // parks the stream at the end of the period the DMA is on, false if not running or paused already; the stream is
+    // paused right away, refill() stops the transfer once the DMA got there
+    bool pause();
+    // starts the transfer from the period it is parked at, 0 on success (the stream is stopped on error)
+    int resume();
+    // ramps to the gain over ramp_frames frames from the period after the one the DMA is on (the periods kept while
+    // paused play at the gain they had, the ramp follows them); during a crossfade the periods filled ahead are kept
+    // and the gain is of the source faded in
+    void set_gain(float gain, size_t ramp_frames);
+    // drops the enqueued sources that did not start yet, returns their number (the latest ones are dropped)
+    size_t clear_queue();
+    // enqueued sources whose first samples the DMA started to play since the last call
+    size_t take_started();
+    // stops the transfer and frees the ring
+    void stop();
+
+    bool is_running() const { return _ring != nullptr; }
+    bool is_paused() const { return _pause_period >= 0; }
+    bool is_crossfading() const { return _outgoing != nullptr; }
+    // paused, and the transfer stopped (there is nothing to refill)
+    bool is_parked() const { return _is_parked; }
+    // duration of a period, the interval to refill at if the periods are not notified
+    int period_ms(int sample_rate) const { return (int)(_period_frames * 1000 / (size_t)sample_rate); }
+    // DMA and staging memory of the stream
+    size_t memory_size() const {
+        return _ring_size + (_staging.size() + _scaled.size() + _faded.size() + _parked.size()) * sizeof(int16_t);
+    }
+    size_t queued() const { return _queue.size(); }
+    const stats_t &stats() const { return _stats; }
+    // the gain the stream ramps to
+    float gain() const { return _gain.target() * _ratio; }
+
+private:
+    axidma_dev_t _dev;
+    int _channel;
+    cma_budget &_budget;
+    int _reserve_timeout_ms;
+
+    source_t _source;
+    std::deque<source_t> _queue;
+    const dma_copy::kernels_t *_kernels = nullptr;
+    int16_t *_ring = nullptr;
+    size_t _ring_size = 0;
+    size_t _period_frames = 0;
+    int _num_periods = 0;
+    // the frames read for each slot, and the frames of the source in it
+    std::vector<int16_t> _staging;
+    std::vector<size_t> _lengths;
+    // a period scaled by the gain stage, and the gain each slot started at
+    gain_stage _gain;
+    std::vector<int16_t> _scaled;
+    std::vector<float> _gains;
+    // the first period whose frames are in the staging slots (not the ones parked before resume())
+    long long _staged_first = 0;
+
+    // periods (counted from the start) filled so far, and completed by the DMA (at the last refill)
+    long long _filled = 0;
+    long long _completed = 0;
+    // periods with samples of the source, known once the source ended (-1 until then)
+    long long _end_period = -1;
+    // periods the enqueued sources started in, not played yet
+    std::deque<long long> _start_periods;
+    size_t _started = 0;
+    // period the stream is parked at (-1 while playing), the transfer is stopped once the DMA is on it
+    long long _pause_period = -1;
+    bool _is_parked = false;
+    // the periods filled ahead of it
+    std::vector<int16_t> _parked;
+
+    // the source faded out during a crossfade, the frames of the one faded in are read into a scratch period
+    source_t _outgoing;
+    crossfade_mixer _mixer;
+    std::vector<int16_t> _faded;
+    double _crossfade_budget_us = 0;
+    // the gain of the source faded in relative to the gain stage, which takes it over at period _fold_period (the first
+    // one of the fade if it is above 1, the one after the fade otherwise; -1 until known)
+    float _ratio = 1.0f;
+    long long _fold_period = -1;
+    // the periods before it were scaled relative to the gain of a source faded out, they are not scaled again
+    long long _gain_first = 0;
+
+    stats_t _stats;
+
+    int _start_transfer(source_t source, double start);
+    int16_t *_slot(long long period) const { return _ring + _slot_index(period) * _period_frames * I2S_CHANNELS; }
+    size_t _slot_index(long long period) const { return (size_t)(period % _num_periods); }
+    void _fill_period(long long period);
+    // mixes the next frames of the crossfade into the staged slot, returns their number
+    size_t _fill_crossfade(long long period, int16_t *staged);
+    // the gain stage takes the ratio over from the period on
+    void _fold_ratio(long long period);
+    // drops the source faded out, the gain stage takes the ratio over right away
+    void _end_crossfade();
+    void _scale_period(long long period);
+};
+
+// Decodes the first frames of the source right away, and serves them before the rest of it. An enqueued source is
+// read while the periods are refilled; predecoded, its opening (the header, the first frames of a compressed format)
+// does not delay the refill of the period it starts in. Takes frames * I2S_FRAME_SIZE bytes until they are served.
+i2s_stream::source_t i2s_predecode(i2s_stream::source_t source, size_t frames);
+
+
+#endif //AES_MUSIC_PLAYER_APP_I2S_STREAM_H
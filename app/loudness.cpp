@@ -0,0 +1,394 @@
+#include "loudness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "gain_stage.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LOUDNESS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LOUDNESS_SSE2
+#endif
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+    constexpr int TAPS = LOUDNESS_PEAK_TAPS;
+    constexpr float SAMPLE_SCALE = 1.0f / 32768;
+    // BS.1770: the K-weighting has a gain of +0.691 dB at 1 kHz, the offset makes a 1 kHz sine read as its level
+    constexpr double LOUDNESS_OFFSET = -0.691;
+    constexpr double ABSOLUTE_GATE = -70;
+    constexpr double RELATIVE_GATE = -10;
+    constexpr uint16_t TAG_VERSION = 1;
+
+    // rows of the K-weighting
+    enum {B0, B1, B2, A1, A2, Z1, Z2, CARRY};
+
+    // stored in the extended attribute
+    struct tag_t {
+        uint16_t version;
+        // in 1/100 LU and 1/100 dB, INT16_MIN for -inf
+        int16_t integrated;
+        int16_t true_peak;
+        uint16_t reserved;
+        // of the file the results are of
+        uint64_t size;
+        int64_t mtime_ns;
+    };
+    static_assert(sizeof(tag_t) == 24, "the stored results are 24 bytes");
+
+    int16_t to_centi(float value) {
+        return std::isfinite(value) ? (int16_t)std::lrint(std::clamp(value * 100.0f, -32767.0f, 32767.0f))
+                                    : INT16_MIN;
+    }
+
+    float from_centi(int16_t value) {
+        return value == INT16_MIN ? -INFINITY : (float)value / 100;
+    }
+
+    bool stat_file(const std::string &path, uint64_t &size, int64_t &mtime_ns) {
+        struct stat file_stat{};
+
+        if (stat(path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode))
+            return false;
+
+        size = (uint64_t)file_stat.st_size;
+        mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+        return true;
+    }
+
+    // the coefficients of BS.1770 at 48 kHz, designed for the rate (as libebur128 does)
+    void design_kweighting(float (&filter)[8][4], int sample_rate) {
+        const double rate = sample_rate;
+
+        // the high shelf, +4 dB above about 1.5 kHz
+        double k = std::tan(PI * 1681.974450955533 / rate);
+        double q = 0.7071752369554196;
+        double vh = std::pow(10.0, 3.999843853973347 / 20);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1 + k / q + k * k;
+        const double shelf[5] = {(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                                 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+
+        // the high-pass at 38 Hz
+        k = std::tan(PI * 38.13547087602444 / rate);
+        q = 0.5003270373238773;
+        a0 = 1 + k / q + k * k;
+        const double high_pass[5] = {1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+
+        for (int row = B0; row <= A2; ++row) {
+            for (int lane = 0; lane < 4; ++lane)
+                filter[row][lane] = (float)(lane < 2 ? shelf[row] : high_pass[row]);
+        }
+    }
+
+    // a windowed sinc, the phases normalised to a gain of 1
+    void design_oversampling(float (&taps)[TAPS][4]) {
+        const int length = TAPS * 4;
+
+        for (int phase = 0; phase < 4; ++phase) {
+            double sum = 0;
+
+            for (int tap = 0; tap < TAPS; ++tap) {
+                int n = tap * 4 + phase;
+                double t = (n - (length - 1) / 2.0) / 4;
+                double sinc = t == 0 ? 1 : std::sin(PI * t) / (PI * t);
+                double window = 0.5 - 0.5 * std::cos(2 * PI * (n + 0.5) / length);
+
+                taps[tap][phase] = (float)(sinc * window);
+                sum += taps[tap][phase];
+            }
+            for (int tap = 0; tap < TAPS; ++tap)
+                taps[tap][phase] = (float)(taps[tap][phase] / sum);
+        }
+    }
+
+    // K-weights the frames from first on, returns the sum of the squares of both channels out of the high-pass (the
+    // vector kernels leave their tails to it)
+    double kweight_scalar(float (&filter)[8][4], const float *left, const float *right, size_t count,
+                          size_t first = 0) {
+        double energy = 0;
+
+        for (size_t i = first; i < count; ++i) {
+            const float in[4] = {left[i], right[i], filter[CARRY][0], filter[CARRY][1]};
+            float out[4];
+
+            for (int lane = 0; lane < 4; ++lane) {
+                out[lane] = filter[B0][lane] * in[lane] + filter[Z1][lane];
+                filter[Z1][lane] = filter[B1][lane] * in[lane] - filter[A1][lane] * out[lane] + filter[Z2][lane];
+                filter[Z2][lane] = filter[B2][lane] * in[lane] - filter[A2][lane] * out[lane];
+            }
+            filter[CARRY][0] = out[0];
+            filter[CARRY][1] = out[1];
+            energy += (double)out[2] * out[2] + (double)out[3] * out[3];
+        }
+
+        return energy;
+    }
+
+#if defined(LOUDNESS_NEON)
+    double kweight(float (&filter)[8][4], const float *left, const float *right, size_t count) {
+        const float32x4_t b0 = vld1q_f32(filter[B0]), b1 = vld1q_f32(filter[B1]), b2 = vld1q_f32(filter[B2]);
+        const float32x4_t a1 = vld1q_f32(filter[A1]), a2 = vld1q_f32(filter[A2]);
+        float32x4_t z1 = vld1q_f32(filter[Z1]), z2 = vld1q_f32(filter[Z2]);
+        float32x4_t out = vcombine_f32(vld1_f32(filter[CARRY]), vdup_n_f32(0));
+        float32x4_t energy = vdupq_n_f32(0);
+        size_t i = 0;
+
+        // the frame in the first lanes, the outputs of the shelf in the others go through the high-pass
+        const auto step = [&](float32x2_t frame) {
+            float32x4_t in = vcombine_f32(frame, vget_low_f32(out));
+
+            out = vmlaq_f32(z1, b0, in);
+            z1 = vmlsq_f32(vmlaq_f32(z2, b1, in), a1, out);
+            z2 = vmlsq_f32(vmulq_f32(b2, in), a2, out);
+            energy = vmlaq_f32(energy, out, out);
+        };
+        for (; i + 4 <= count; i += 4) {
+            float32x4x2_t frames = vzipq_f32(vld1q_f32(left + i), vld1q_f32(right + i));
+
+            step(vget_low_f32(frames.val[0]));
+            step(vget_high_f32(frames.val[0]));
+            step(vget_low_f32(frames.val[1]));
+            step(vget_high_f32(frames.val[1]));
+        }
+        vst1q_f32(filter[Z1], z1);
+        vst1q_f32(filter[Z2], z2);
+        vst1_f32(filter[CARRY], vget_low_f32(out));
+
+        // the squares of the shelf are in the first lanes
+        float32x2_t sum = vget_high_f32(energy);
+        return (double)vget_lane_f32(vpadd_f32(sum, sum), 0) + kweight_scalar(filter, left, right, count, i);
+    }
+
+    float oversampled_peak(const float (&taps)[TAPS][4], const float *samples, size_t count) {
+        float32x4_t h[TAPS];
+        float32x4_t peak = vdupq_n_f32(0);
+
+        for (int tap = 0; tap < TAPS; ++tap)
+            h[tap] = vld1q_f32(taps[tap]);
+        for (size_t i = 0; i < count; ++i) {
+            float32x4_t sum = vmulq_n_f32(h[0], samples[i + TAPS - 1]);
+
+            for (int tap = 1; tap < TAPS; ++tap)
+                sum = vmlaq_n_f32(sum, h[tap], samples[i + TAPS - 1 - tap]);
+            peak = vmaxq_f32(peak, vabsq_f32(sum));
+        }
+
+        float32x2_t max = vpmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+        return vget_lane_f32(vpmax_f32(max, max), 0);
+    }
+
+    const char *instruction_set = "neon";
+#elif defined(LOUDNESS_SSE2)
+    double kweight(float (&filter)[8][4], const float *left, const float *right, size_t count) {
+        const __m128 b0 = _mm_loadu_ps(filter[B0]), b1 = _mm_loadu_ps(filter[B1]), b2 = _mm_loadu_ps(filter[B2]);
+        const __m128 a1 = _mm_loadu_ps(filter[A1]), a2 = _mm_loadu_ps(filter[A2]);
+        __m128 z1 = _mm_loadu_ps(filter[Z1]), z2 = _mm_loadu_ps(filter[Z2]);
+        __m128 out = _mm_setr_ps(filter[CARRY][0], filter[CARRY][1], 0, 0);
+        __m128 energy = _mm_setzero_ps();
+        size_t i = 0;
+
+        // in: the frame in the first lanes, the outputs of the shelf in the others go through the high-pass
+        const auto step = [&](__m128 in) {
+            out = _mm_add_ps(_mm_mul_ps(b0, in), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, in), _mm_mul_ps(a1, out)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, in), _mm_mul_ps(a2, out));
+            energy = _mm_add_ps(energy, _mm_mul_ps(out, out));
+        };
+        for (; i + 4 <= count; i += 4) {
+            __m128 l = _mm_loadu_ps(left + i), r = _mm_loadu_ps(right + i);
+            __m128 first = _mm_unpacklo_ps(l, r), second = _mm_unpackhi_ps(l, r);
+
+            step(_mm_movelh_ps(first, out));
+            step(_mm_shuffle_ps(first, out, _MM_SHUFFLE(1, 0, 3, 2)));
+            step(_mm_movelh_ps(second, out));
+            step(_mm_shuffle_ps(second, out, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+        _mm_storeu_ps(filter[Z1], z1);
+        _mm_storeu_ps(filter[Z2], z2);
+        float lanes[4];
+        _mm_storeu_ps(lanes, out);
+        filter[CARRY][0] = lanes[0];
+        filter[CARRY][1] = lanes[1];
+
+        // the squares of the shelf are in the first lanes
+        _mm_storeu_ps(lanes, energy);
+        return (double)lanes[2] + lanes[3] + kweight_scalar(filter, left, right, count, i);
+    }
+
+    float oversampled_peak(const float (&taps)[TAPS][4], const float *samples, size_t count) {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        __m128 h[TAPS];
+        __m128 peak = _mm_setzero_ps();
+
+        for (int tap = 0; tap < TAPS; ++tap)
+            h[tap] = _mm_loadu_ps(taps[tap]);
+        for (size_t i = 0; i < count; ++i) {
+            __m128 sum = _mm_mul_ps(h[0], _mm_set1_ps(samples[i + TAPS - 1]));
+
+            for (int tap = 1; tap < TAPS; ++tap)
+                sum = _mm_add_ps(sum, _mm_mul_ps(h[tap], _mm_set1_ps(samples[i + TAPS - 1 - tap])));
+            peak = _mm_max_ps(peak, _mm_andnot_ps(sign, sum));
+        }
+
+        peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+        peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(peak);
+    }
+
+    const char *instruction_set = "sse2";
+#else
+    double kweight(float (&filter)[8][4], const float *left, const float *right, size_t count) {
+        return kweight_scalar(filter, left, right, count);
+    }
+
+    float oversampled_peak(const float (&taps)[TAPS][4], const float *samples, size_t count) {
+        float peak = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            for (int phase = 0; phase < 4; ++phase) {
+                float sum = 0;
+
+                for (int tap = 0; tap < TAPS; ++tap)
+                    sum += taps[tap][phase] * samples[i + TAPS - 1 - tap];
+                peak = std::max(peak, std::fabs(sum));
+            }
+        }
+
+        return peak;
+    }
+
+    const char *instruction_set = "scalar";
+#endif
+}
+
+loudness_meter::loudness_meter(int sample_rate) :
+        _left(LOUDNESS_CHUNK_FRAMES + TAPS - 1), _right(LOUDNESS_CHUNK_FRAMES + TAPS - 1),
+        _step_frames((size_t)std::max(sample_rate / 10, 1)) {
+    design_kweighting(_kweighting, sample_rate);
+    design_oversampling(_taps);
+}
+
+void loudness_meter::add(const int16_t *frames, size_t nr_frames) {
+    while (nr_frames > 0) {
+        // a chunk ends at the end of the step
+        size_t count = std::min({nr_frames, (size_t)LOUDNESS_CHUNK_FRAMES, _step_frames - _step_position});
+
+        _add_chunk(frames, count);
+        frames += count * 2;
+        nr_frames -= count;
+
+        if ((_step_position += count) < _step_frames)
+            continue;
+
+        // a block is the step and the 3 before it
+        if (_nr_steps >= 3)
+            _blocks.push_back((_steps[0] + _steps[1] + _steps[2] + _step_energy) / (double)(_step_frames * 4));
+        _steps[0] = _steps[1];
+        _steps[1] = _steps[2];
+        _steps[2] = _step_energy;
+        ++_nr_steps;
+        _step_position = 0;
+        _step_energy = 0;
+    }
+}
+
+void loudness_meter::_add_chunk(const int16_t *frames, size_t nr_frames) {
+    float *left = _left.data() + TAPS - 1, *right = _right.data() + TAPS - 1;
+
+    for (size_t i = 0; i < nr_frames; ++i) {
+        left[i] = (float)frames[i * 2] * SAMPLE_SCALE;
+        right[i] = (float)frames[i * 2 + 1] * SAMPLE_SCALE;
+    }
+
+    _step_energy += kweight(_kweighting, left, right, nr_frames);
+    _peak = std::max({_peak, oversampled_peak(_taps, _left.data(), nr_frames),
+                      oversampled_peak(_taps, _right.data(), nr_frames)});
+
+    // the last samples are the ones before the next chunk
+    std::copy(_left.begin() + (long)nr_frames, _left.begin() + (long)nr_frames + TAPS - 1, _left.begin());
+    std::copy(_right.begin() + (long)nr_frames, _right.begin() + (long)nr_frames + TAPS - 1, _right.begin());
+    _frames += nr_frames;
+}
+
+loudness_meter::result_t loudness_meter::result() const {
+    const double absolute_gate = std::pow(10.0, (ABSOLUTE_GATE - LOUDNESS_OFFSET) / 10);
+    result_t result{-INFINITY, 20 * std::log10(_peak)};
+    double sum = 0;
+    size_t nr_blocks = 0;
+
+    for (double block : _blocks) {
+        if (block > absolute_gate) {
+            sum += block;
+            ++nr_blocks;
+        }
+    }
+    if (nr_blocks == 0)
+        return result;
+
+    // the relative gate is 10 LU below the loudness of the blocks above the absolute one
+    const double relative_gate = std::max(absolute_gate, sum / (double)nr_blocks * std::pow(10.0, RELATIVE_GATE / 10));
+    sum = 0;
+    nr_blocks = 0;
+    for (double block : _blocks) {
+        if (block > relative_gate) {
+            sum += block;
+            ++nr_blocks;
+        }
+    }
+    if (nr_blocks > 0)
+        result.integrated = (float)(LOUDNESS_OFFSET + 10 * std::log10(sum / (double)nr_blocks));
+
+    return result;
+}
+
+float loudness_meter::track_gain(const result_t &result) {
+    if (!std::isfinite(result.integrated))
+        return 1.0f;
+
+    float db = std::clamp(LOUDNESS_REFERENCE_LUFS - result.integrated, LOUDNESS_MIN_GAIN_DB, LOUDNESS_MAX_GAIN_DB);
+    // the gain stage would soft clip the peaks above full scale
+    if (std::isfinite(result.true_peak))
+        db = std::min(db, -result.true_peak);
+
+    return gain_stage::db_to_gain(db);
+}
+
+float loudness_meter::track_gain(const std::string &path) {
+    result_t result{};
+
+    return load(path, result) ? track_gain(result) : 1.0f;
+}
+
+bool loudness_meter::load(const std::string &path, result_t &result) {
+    tag_t tag{};
+    uint64_t size;
+    int64_t mtime_ns;
+
+    if (getxattr(path.c_str(), LOUDNESS_XATTR_NAME, &tag, sizeof(tag)) != (ssize_t)sizeof(tag) ||
+        tag.version != TAG_VERSION || !stat_file(path, size, mtime_ns) || tag.size != size ||
+        tag.mtime_ns != mtime_ns)
+        return false;
+
+    result.integrated = from_centi(tag.integrated);
+    result.true_peak = from_centi(tag.true_peak);
+    return true;
+}
+
+bool loudness_meter::store(const std::string &path, const result_t &result) {
+    tag_t tag{TAG_VERSION, to_centi(result.integrated), to_centi(result.true_peak), 0, 0, 0};
+
+    // setting the attribute leaves the mtime as it is
+    return stat_file(path, tag.size, tag.mtime_ns) &&
+           setxattr(path.c_str(), LOUDNESS_XATTR_NAME, &tag, sizeof(tag), 0) == 0;
+}
+
+const char *loudness_meter::kernel_name() {
+    return instruction_set;
+}
@@ -0,0 +1,87 @@
+#ifndef AES_MUSIC_PLAYER_APP_LOUDNESS_H
+#define AES_MUSIC_PLAYER_APP_LOUDNESS_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ReplayGain 2.0 plays the tracks at -18 LUFS
+#define LOUDNESS_REFERENCE_LUFS -18.0f
+// the gain of a track is limited to this, a nearly silent track is not brought up to the reference
+#define LOUDNESS_MAX_GAIN_DB 12.0f
+#define LOUDNESS_MIN_GAIN_DB -24.0f
+// extended attribute the results are stored in
+#define LOUDNESS_XATTR_NAME "user.loudness"
+// frames converted at a time, the meter takes 24 kB with it
+#define LOUDNESS_CHUNK_FRAMES 1024
+// taps of each of the 4 phases of the oversampling filter of the true peak
+#define LOUDNESS_PEAK_TAPS 12
+
+// Loudness of the 16-bit stereo frames of a track, as EBU R128 (ITU-R BS.1770-4) measures it.
+//
+// The frames are K-weighted (a high shelf, then a high-pass) and their mean square is taken over gating blocks of
+// 400 ms, overlapping by 75 %. The integrated loudness is the one of the blocks above -70 LUFS and above the mean of
+// those less 10 LU. The true peak is the largest sample of the frames oversampled 4 times. Both biquads of both
+// channels run in a vector of 4 lanes, the high-pass a sample behind the shelf; the 4 phases of the oversampling run
+// in the lanes of another. With NEON (SSE2 on x86), see loudness_bench for the rates.
+//
+// The results are stored in an extended attribute of the file (24 bytes), stamped with its size and mtime: they are
+// not used once the file changed.
+class loudness_meter {
+public:
+    struct result_t {
+        // LUFS, -inf if no block was above the gates (silence, or shorter than a block)
+        float integrated;
+        // dBTP, of full scale
+        float true_peak;
+    };
+
+    explicit loudness_meter(int sample_rate);
+
+    loudness_meter(const loudness_meter&) = delete;
+    loudness_meter& operator=(const loudness_meter&) = delete;
+
+    // measures the interleaved stereo frames, following the ones added before
+    void add(const int16_t *frames, size_t nr_frames);
+    // of the frames added so far
+    result_t result() const;
+    size_t frames() const { return _frames; }
+
+    // the gain playing the track at the reference loudness, without its true peak going over full scale (1 if it
+    // was not measured)
+    static float track_gain(const result_t &result);
+    static float track_gain(const std::string &path);
+    // the results stored for the file as it is, false if there are none or it changed since
+    static bool load(const std::string &path, result_t &result);
+    // stamped with the size and the mtime of the file, false if the file system has no extended attributes
+    static bool store(const std::string &path, const result_t &result);
+    // the instruction set of the filters built for the target
+    static const char *kernel_name();
+
+private:
+    // the K-weighting, rows: b0, b1, b2, a1, a2, the state of the transposed direct form II, and the outputs of the
+    // shelf the high-pass takes next (the first 2 lanes); lanes: left and right of the shelf, of the high-pass
+    float _kweighting[8][4]{};
+    // the oversampling filter: the taps of the 4 phases, a lane each
+    float _taps[LOUDNESS_PEAK_TAPS][4];
+    // the frames of a chunk in full scale units, after the last LOUDNESS_PEAK_TAPS - 1 of the chunk before
+    std::vector<float> _left, _right;
+    float _peak = 0;
+
+    // steps of 100 ms: the energy of the frames of the step so far, and of the last 3 steps
+    size_t _step_frames;
+    size_t _step_position = 0;
+    double _step_energy = 0;
+    double _steps[3]{};
+    size_t _nr_steps = 0;
+    // the mean square of each gating block
+    std::vector<double> _blocks;
+    size_t _frames = 0;
+
+    void _add_chunk(const int16_t *frames, size_t nr_frames);
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_LOUDNESS_H
@@ -0,0 +1,152 @@
+#include "loudness_thread.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "aes_soft.h"
+#include "loudness.h"
+#include "player_track.h"
+#include "util.h"
+
+namespace {
+    // ioprio_set() has no wrapper in glibc (linux/ioprio.h)
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+    bool stat_file(const std::string &path, struct stat &file_stat) {
+        return stat(path.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+    }
+
+    bool is_same_file(const struct stat &a, const struct stat &b) {
+        return a.st_ino == b.st_ino && a.st_size == b.st_size && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+               a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+    }
+}
+
+void loudness_thread::run() {
+    struct sched_param param{};
+
+    // run only on the time the other threads leave, and read after them (the player reads its tracks mapped)
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+    for (const std::string &path : _paths) {
+        loudness_meter::result_t result{};
+
+        if (_is_stopping)
+            break;
+        if (loudness_meter::load(path, result)) {
+            pthread_mutex_lock(&_stats_mutex);
+            ++_stats.skipped;
+            pthread_mutex_unlock(&_stats_mutex);
+            continue;
+        }
+
+        bool is_analysed = _analyse(path);
+        if (_is_stopping)
+            break;
+        if (!is_analysed) {
+            pthread_mutex_lock(&_stats_mutex);
+            ++_stats.failed;
+            pthread_mutex_unlock(&_stats_mutex);
+        }
+    }
+
+    pthread_exit(nullptr);
+}
+
+bool loudness_thread::_analyse(const std::string &path) {
+    struct stat before{}, after{};
+    double start = now_us();
+
+    if (!stat_file(path, before))
+        return false;
+
+    std::unique_ptr<player_track> track;
+    try {
+        std::unique_ptr<playback_source> source = is_encrypted(path) ? _decrypt(path)
+                                                                     : std::make_unique<playback_source>(path);
+        if (source)
+            track = player_track::open(std::move(source));
+    } catch (const std::exception &) {
+        return false;
+    }
+    if (!track)
+        return false;
+
+    // the frames the player would play
+    loudness_meter meter(track->sample_rate());
+    std::vector<int16_t> frames(LOUDNESS_THREAD_BLOCK_FRAMES * 2);
+    const i2s_stream::source_t &decoder = track->decoder();
+    size_t nr_frames;
+
+    while (!_is_stopping && (nr_frames = decoder(frames.data(), LOUDNESS_THREAD_BLOCK_FRAMES)) > 0)
+        meter.add(frames.data(), nr_frames);
+
+    // the file was replaced meanwhile (encrypted or decrypted by the UI), it is analysed again next time
+    if (_is_stopping || !stat_file(path, after) || !is_same_file(before, after) ||
+        !loudness_meter::store(path, meter.result()))
+        return false;
+
+    pthread_mutex_lock(&_stats_mutex);
+    ++_stats.analysed;
+    _stats.busy_s += (now_us() - start) / 1e6;
+    _stats.audio_s += (double)meter.frames() / track->sample_rate();
+    pthread_mutex_unlock(&_stats_mutex);
+
+    return true;
+}
+
+std::unique_ptr<playback_source> loudness_thread::_decrypt(const std::string &path) const {
+    size_t file_size = get_file_size(path);
+    // the cores work on whole blocks, the last one is zero padded
+    size_t size = aligned_size(file_size, AES_BLOCK_SIZE);
+    void *buffer = calloc(1, std::max<size_t>(size, 1));
+    aes_soft cipher;
+
+    if (!buffer)
+        throw std::bad_alloc();
+    std::unique_ptr<playback_source> source = std::make_unique<playback_source>(buffer, file_size);
+
+    std::ifstream in_file(path, std::ios::in | std::ios::binary);
+    if (!in_file || !in_file.read((char *)buffer, (std::streamsize)file_size))
+        throw std::runtime_error("Unable to read input file.");
+
+    // the key as it is sent to the core
+    cipher.set_stream_key(_key.data());
+    for (size_t offset = 0; offset < size; offset += LOUDNESS_THREAD_DECRYPT_CHUNK_SIZE) {
+        if (_is_stopping)
+            return nullptr;
+
+        cipher.decrypt_stream((char *)buffer + offset, (char *)buffer + offset,
+                              std::min<size_t>(LOUDNESS_THREAD_DECRYPT_CHUNK_SIZE, size - offset));
+    }
+
+    return source;
+}
+
+loudness_thread::stats_t loudness_thread::get_stats() const {
+    pthread_mutex_lock(&_stats_mutex);
+    stats_t stats = _stats;
+    pthread_mutex_unlock(&_stats_mutex);
+
+    return stats;
+}
+
+void loudness_thread::dump_stats(FILE *stream) const {
+    stats_t stats = get_stats();
+
+    fprintf(stream, "loudness analysis: %zu of %zu tracks analysed, %zu stored already, %zu failed%s\n",
+            stats.analysed, _paths.size(), stats.skipped, stats.failed, _is_stopping ? " (stopped)" : "");
+    if (stats.busy_s > 0)
+        fprintf(stream, "  %.1f tracks/min, %.1f min of audio in %.1f s (%.0fx real time)\n",
+                stats.analysed / stats.busy_s * 60, stats.audio_s / 60, stats.busy_s, stats.audio_s / stats.busy_s);
+}
@@ -0,0 +1,69 @@
+#ifndef AES_MUSIC_PLAYER_APP_LOUDNESS_THREAD_H
+#define AES_MUSIC_PLAYER_APP_LOUDNESS_THREAD_H
+
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pthread_wrapper.h"
+#include "playback_source.h"
+
+// frames decoded and measured at a time, the analyser checks whether it is to stop in between
+#define LOUDNESS_THREAD_BLOCK_FRAMES 4096
+// an encrypted file is decrypted this much at a time
+#define LOUDNESS_THREAD_DECRYPT_CHUNK_SIZE (64 * 1024)
+
+// Measures the loudness of the tracks in the background (see loudness_meter), the results are stored with the files.
+//
+// The thread runs at the idle scheduling and I/O priority: it only gets the CPU time and the reads the player and
+// the UI leave. A track is decoded as the player decodes it (resampled and converted to stereo 16-bit), so the frames
+// measured are the ones played. An encrypted track is decrypted into memory in software: the decipher engine and the
+// continuous memory stay free for the tracks to be played. The tracks with results stored already are skipped.
+class loudness_thread : public pthread_wrapper {
+public:
+    struct stats_t {
+        size_t analysed = 0;
+        // with results stored already
+        size_t skipped = 0;
+        size_t failed = 0;
+        // time spent on the tracks analysed, and the length of them
+        double busy_s = 0;
+        double audio_s = 0;
+    };
+
+    loudness_thread(std::vector<std::string> paths, const std::array<uint32_t, 4> &key) :
+            _paths(std::move(paths)), _key(key) { pthread_mutex_init(&_stats_mutex, nullptr); }
+    ~loudness_thread() override { pthread_mutex_destroy(&_stats_mutex); }
+
+    loudness_thread(const loudness_thread&) = delete;
+    loudness_thread& operator=(const loudness_thread&) = delete;
+
+    // the track being analysed is dropped (nothing is stored for it), the thread ends within a block
+    void stop() { _is_stopping = true; }
+    stats_t get_stats() const;
+    // writes the statistics and the throughput (tracks per minute) to the stream
+    void dump_stats(FILE *stream) const;
+
+protected:
+    void run() override;
+
+private:
+    const std::vector<std::string> _paths;
+    const std::array<uint32_t, 4> _key;
+    std::atomic<bool> _is_stopping{false};
+
+    stats_t _stats;
+    mutable pthread_mutex_t _stats_mutex{};
+
+    // false if the track could not be decoded, or the thread is stopping
+    bool _analyse(const std::string &path);
+    // nullptr if the thread is stopping
+    std::unique_ptr<playback_source> _decrypt(const std::string &path) const;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_LOUDNESS_THREAD_H
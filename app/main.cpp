@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <unistd.h>
@@ -7,6 +9,8 @@
 #include <fstream>
 
 #include "aes.h"
+#include "cma_budget.h"
+#include "content_index.h"
 #include "ui_thread.h"
 #include "player_thread.h"
 
@@ -20,8 +24,12 @@ static void int_handler(int signum)
 }
 
 int main(int argc, char *argv[]) {
+    // budget of continuous memory shared by the AES and the player DMA transfers
+    cma_budget dma_budget;
     // create AES instance
-    aes aes;
+    aes aes(dma_budget);
+    // contents already encrypted, to skip encrypting identical files again
+    content_index index(content_index::default_path());
     // pipe between main and UI thread
     int main_to_ui_pipe[2];
     int ui_to_player_pipe[2];
@@ -41,9 +49,18 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     std::string path(argv[1]);
+    // the tracks follow each other without a gap, unless an overlap (in ms) is passed after the directory
+    int crossfade_ms = argc > 2 ? (int)std::strtol(argv[2], nullptr, 10) : PLAYER_CROSSFADE_MS;
 
-    // initialize aes instance
-    aes.init();
+    // initialize aes instance, the cores are verified with known answers before use
+    aes.init(true);
+    for (auto engine : {aes::CIPHER_ENGINE, aes::DECIPHER_ENGINE}) {
+        const aes::engine_info_t &info = aes.get_engine_info(engine);
+
+        if (info.is_tested && !info.is_passed)
+            std::cout << "AES " << (engine == aes::CIPHER_ENGINE ? "cipher" : "decipher")
+                      << " core failed the self-test (is the right bitstream loaded?)." << std::endl;
+    }
 
     // create pipe for UI thread <=> main simplex communication
     if (pipe(main_to_ui_pipe) != 0) {
@@ -72,14 +89,15 @@ int main(int argc, char *argv[]) {
     sigaction(SIGINT, &sh, nullptr);
 
     // start player thread
-    player_thread player(ui_to_player_pipe[0], player_to_ui_pipe[1]);
+    player_thread player(dma_budget, ui_to_player_pipe[0], player_to_ui_pipe[1], PLAYER_PAUSE_MEMORY_LIMIT,
+                         std::max(crossfade_ms, 0));
     if (!player.start()) {
         std::cout << "Failed creating player thread." << std::endl;
         return -1;
     }
 
     // start UI thread
-    ui_thread ui(aes, path, main_to_ui_pipe[0], player_to_ui_pipe[0], ui_to_player_pipe[1]);
+    ui_thread ui(aes, index, path, main_to_ui_pipe[0], player_to_ui_pipe[0], ui_to_player_pipe[1]);
     if (!ui.start()) {
         std::cout << "Failed creating UI thread." << std::endl;
         return -1;
@@ -0,0 +1,98 @@
+#include "play_queue.h"
+
+#include <algorithm>
+#include <numeric>
+
+void play_queue::set_tracks(std::vector<std::string> paths) {
+    _tracks = std::move(paths);
+    _shuffle();
+}
+
+void play_queue::set_mode(play_queue::mode_t mode) {
+    _mode = mode;
+    if (_mode == SHUFFLE)
+        _shuffle();
+}
+
+void play_queue::enqueue(const std::string &path) {
+    _queue.push_back(path);
+}
+
+void play_queue::clear_queue() {
+    _queue.clear();
+}
+
+void play_queue::set_current(const std::string &path) {
+    _current = path;
+
+    // the shuffled order starts over from the chosen track
+    if (_mode == SHUFFLE)
+        _shuffle();
+}
+
+std::optional<std::string> play_queue::peek_next() const {
+    if (!_queue.empty())
+        return _queue.front();
+
+    switch (_mode) {
+        case IN_FOLDER: {
+            // up to the last track of the folder
+            long long index = _index_of(_current);
+            if (_current.empty() || (size_t)(index + 1) >= _tracks.size())
+                return std::nullopt;
+
+            return _tracks[(size_t)(index + 1)];
+        }
+        case SHUFFLE:
+            if (_order_position + 1 >= _order.size())
+                return _order.empty() ? std::nullopt : std::optional<std::string>(_tracks[_order.front()]);
+
+            return _tracks[_order[_order_position + 1]];
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<std::string> play_queue::advance() {
+    std::optional<std::string> next = peek_next();
+
+    if (!next.has_value())
+        return next;
+
+    if (!_queue.empty()) {
+        _queue.pop_front();
+    } else if (_mode == SHUFFLE) {
+        // a round over, the same order again (reshuffling would change the next track already prepared)
+        _order_position = _order_position + 1 >= _order.size() ? 0 : _order_position + 1;
+    }
+    _current = next.value();
+
+    return next;
+}
+
+const char *play_queue::mode_string(play_queue::mode_t mode) {
+    switch (mode) {
+        case IN_FOLDER: return "in folder";
+        case SHUFFLE:   return "shuffle";
+        case SINGLE:    return "single";
+        default:        return "";
+    }
+}
+
+void play_queue::_shuffle() {
+    _order.resize(_tracks.size());
+    std::iota(_order.begin(), _order.end(), 0);
+    std::shuffle(_order.begin(), _order.end(), _random);
+
+    // the current track is the first of the round
+    long long index = _index_of(_current);
+    if (index >= 0)
+        std::iter_swap(_order.begin(), std::find(_order.begin(), _order.end(), (size_t)index));
+    _order_position = 0;
+}
+
+long long play_queue::_index_of(const std::string &path) const {
+    auto it = std::find(_tracks.begin(), _tracks.end(), path);
+
+    return it == _tracks.end() ? -1 : it - _tracks.begin();
+}
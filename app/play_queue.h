@@ -0,0 +1,57 @@
+#ifndef AES_MUSIC_PLAYER_APP_PLAY_QUEUE_H
+#define AES_MUSIC_PLAYER_APP_PLAY_QUEUE_H
+
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Order the tracks are played in after the one started by the user.
+//
+// The tracks queued explicitly come first, in the order they were queued. Then it goes on in the folder: with the
+// next track up to the last one, in a shuffled order (each track once per round), or not at all. The next
+// track is known in advance (peek_next()), so it can be prepared while the current one plays.
+class play_queue {
+public:
+    enum mode_t {IN_FOLDER, SHUFFLE, SINGLE, NR_MODES};
+
+    explicit play_queue(mode_t mode = IN_FOLDER, uint32_t seed = std::random_device{}()) : _mode(mode), _random(seed) { }
+
+    // the tracks of the folder, in order
+    void set_tracks(std::vector<std::string> paths);
+    void set_mode(mode_t mode);
+    mode_t get_mode() const { return _mode; }
+    void enqueue(const std::string &path);
+    void clear_queue();
+    size_t queued() const { return _queue.size(); }
+
+    // the user started the track
+    void set_current(const std::string &path);
+    const std::string &get_current() const { return _current; }
+    // the track after the current one, none at the end
+    std::optional<std::string> peek_next() const;
+    // the next track became the current one
+    std::optional<std::string> advance();
+
+    static const char *mode_string(mode_t mode);
+
+private:
+    mode_t _mode;
+    std::vector<std::string> _tracks;
+    std::deque<std::string> _queue;
+    std::string _current;
+
+    // the shuffled order of the tracks (indices), and the position of the current track in it
+    std::vector<size_t> _order;
+    size_t _order_position = 0;
+    std::mt19937 _random;
+
+    void _shuffle();
+    long long _index_of(const std::string &path) const;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_PLAY_QUEUE_H
@@ -0,0 +1,83 @@
+#include "playback_source.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+playback_source::playback_source(const std::string &path) {
+    struct stat file_stat{};
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "Failed to open input file.");
+
+    if (fstat(fd, &file_stat) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "Failed to open input file.");
+    }
+    _size = (size_t)file_stat.st_size;
+
+    // an empty file cannot be mapped, the decoder rejects it
+    if (_size > 0) {
+        _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (_data == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "Failed to map input file.");
+        }
+
+        // larger read-ahead of the kernel, the start of the file is read right away
+        madvise(_data, _size, MADV_SEQUENTIAL);
+        advise(0);
+    } else {
+        _data = nullptr;
+    }
+
+    // the mapping keeps the file open
+    close(fd);
+}
+
+void playback_source::advise(size_t position) {
+    if (!_is_mapped || !_data)
+        return;
+
+    auto page_size = (size_t)sysconf(_SC_PAGESIZE);
+    auto *data = (char *)_data;
+
+    // a seek: the read-ahead starts over from the position (and backwards the release, the pages are mapped again)
+    if (position < _position || position > _readahead_end) {
+        _readahead_end = position / page_size * page_size;
+        _released_end = std::min(_released_end, _readahead_end);
+    }
+    _position = position;
+
+    // advised in windows, not on every read
+    if (position + PLAYBACK_SOURCE_READAHEAD_SIZE / 2 > _readahead_end && _readahead_end < _size) {
+        size_t start = _readahead_end / page_size * page_size;
+        size_t end = std::min(_size, position + 2 * PLAYBACK_SOURCE_READAHEAD_SIZE);
+        madvise(data + start, end - start, MADV_WILLNEED);
+        _readahead_end = end;
+    }
+
+    // a window is kept behind, the decoder seeks back a little at times
+    if (position > _released_end + 2 * PLAYBACK_SOURCE_READAHEAD_SIZE) {
+        size_t end = (position - PLAYBACK_SOURCE_READAHEAD_SIZE) / page_size * page_size;
+        madvise(data + _released_end, end - _released_end, MADV_DONTNEED);
+        _released_end = end;
+    }
+}
+
+playback_source::~playback_source() {
+    if (_is_mapped) {
+        if (_data)
+            munmap(_data, _size);
+    } else {
+        free(_data);
+    }
+}
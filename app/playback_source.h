@@ -0,0 +1,52 @@
+#ifndef AES_MUSIC_PLAYER_APP_PLAYBACK_SOURCE_H
+#define AES_MUSIC_PLAYER_APP_PLAYBACK_SOURCE_H
+
+
+#include <cstddef>
+#include <string>
+
+// read ahead of the position of the decoder in a file (it is read that far ahead as soon as it is opened)
+#define PLAYBACK_SOURCE_READAHEAD_SIZE (1024 * 1024)
+
+// Contents of a track the player decodes from, handed over to the player thread with the PLAY command.
+//
+// A file is mapped read-only instead of being read into memory first: the decoder reads straight from the page
+// cache, the playback starts as soon as the header and the first periods are in, and only the pages around the
+// position of the decoder are resident (see advise()). The decrypted contents are in memory already, their buffer is
+// owned instead.
+class playback_source {
+public:
+    // maps the file, throws std::system_error if it cannot be opened or mapped
+    explicit playback_source(const std::string &path);
+    // takes ownership of the buffer (allocated by malloc)
+    playback_source(void *buffer, size_t size) : _data(buffer), _size(size), _is_mapped(false) { }
+    ~playback_source();
+
+    playback_source(const playback_source&) = delete;
+    playback_source& operator=(const playback_source&) = delete;
+
+    const void *data() const { return _data; }
+    size_t size() const { return _size; }
+    bool is_mapped() const { return _is_mapped; }
+    // the gain the contents are played at, to the reference loudness (see loudness_meter), 1 if not measured
+    float gain() const { return _gain; }
+    void set_gain(float gain) { _gain = gain; }
+
+    // the decoder reads at position: the file is read ahead of it, and the pages far behind it are unmapped (they
+    // stay in the page cache, reading them again only faults them back in)
+    void advise(size_t position);
+
+private:
+    void *_data = nullptr;
+    size_t _size = 0;
+    bool _is_mapped = true;
+    float _gain = 1.0f;
+
+    // last position advised, end of the part read ahead, start of the part still mapped
+    size_t _position = 0;
+    size_t _readahead_end = 0;
+    size_t _released_end = 0;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_PLAYBACK_SOURCE_H
@@ -1,27 +1,194 @@
 #include <iostream>
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include "player_thread.h"
 
 #include "adau1761.h"
-#include "sndfile.h"
-#include "virtual_file_wrapper.h"
+#include "player_track.h"
+#include "util.h"
+
+namespace {
+    long int to_ms(const player_track &track, sf_count_t frames) {
+        return track.info().samplerate > 0 ? (long int)(frames * 1000 / track.info().samplerate) : 0;
+    }
+
+    sf_count_t to_frames(const player_track &track, long int ms) {
+        return (sf_count_t)ms * track.info().samplerate / 1000;
+    }
+
+    // frames the decoder of the track has left, at the rate of the stream
+    size_t frames_left(const player_track &track) {
+        if (track.info().samplerate <= 0)
+            return 0;
+
+        return (size_t)(std::max<sf_count_t>(0, track.info().frames - track.position()) * track.sample_rate() /
+                        track.info().samplerate);
+    }
+
+    long long now_ms() {
+        return (long long)(now_us() / 1e3);
+    }
+}
 
 void player_thread::run() {
-    adau1761 codec;
+    adau1761 codec(_budget);
     fd_set read_fds;
     player_thread_msg player_rx_msg, player_tx_msg;
+    // the track playing, then the ones enqueued into the stream after it
+    std::deque<std::unique_ptr<player_track>> tracks;
+    // the next track, if it cannot follow without a gap (at another sample rate), started once the stream ended
+    std::unique_ptr<player_track> pending_track;
+    // the next track, faded in over the end of the one playing once its decoder gets there
+    std::unique_ptr<player_track> crossfade_track;
+    // the track faded out, read by the stream until the end of the fade
+    std::unique_ptr<player_track> outgoing_track;
+    bool is_ended = false;
+    // when the playback was paused, -1 if it is not
+    long long paused_at_ms = -1;
+
+    const auto send_to_ui = [this](player_thread_msg::command_t command, player_thread_msg::result_t result,
+                                   long int payload = 0) {
+        player_thread_msg msg {.command = command, .result = result, .payload = payload};
+        write(_player_to_ui_write_pipe_fd, &msg, sizeof(msg));
+    };
+    const auto play_track = [&](std::unique_ptr<player_track> track) {
+        // played at its loudness from the first period
+        codec.set_track_gain(track->gain());
+        int ret = codec.play_stream(track->sample_rate(), track->decoder(),
+                                    [&is_ended](void *param) {
+                                        (void) param;
+                                        is_ended = true;
+                                    },
+                                    nullptr);
+        if (ret == 0)
+            tracks.push_back(std::move(track));
+
+        return ret;
+    };
+    // the track after the one playing without a gap, or once the stream ended at another sample rate
+    const auto follow = [&](std::unique_ptr<player_track> track) {
+        if (codec.enqueue_stream(track->sample_rate(), track->decoder()) == 0)
+            tracks.push_back(std::move(track));
+        else
+            pending_track = std::move(track);
+    };
+    // the track in place of the only one playing, faded in over what its decoder has left (at most the overlap, and
+    // half of the length of the track)
+    const auto crossfade = [&](std::unique_ptr<player_track> &track) {
+        if (_crossfade_ms <= 0 || tracks.size() != 1 || codec.is_crossfading() || codec.is_stream_paused())
+            return false;
+
+        size_t overlap_frames = std::min({(size_t)_crossfade_ms * (size_t)track->sample_rate() / 1000,
+                                          frames_left(*tracks.front()), frames_left(*track) / 2});
+        if (codec.crossfade_stream(track->sample_rate(), track->decoder(), overlap_frames, track->gain()) != 0)
+            return false;
+
+        outgoing_track = std::move(tracks.front());
+        tracks.front() = std::move(track);
+        return true;
+    };
+    const auto stop = [&]() {
+        codec.stop();
+        tracks.clear();
+        pending_track.reset();
+        crossfade_track.reset();
+        outgoing_track.reset();
+        is_ended = false;
+        paused_at_ms = -1;
+    };
+    // memory kept while paused
+    const auto held_size = [&]() {
+        size_t size = codec.stream_memory_size() + (pending_track ? pending_track->memory_size() : 0) +
+                      (crossfade_track ? crossfade_track->memory_size() : 0) +
+                      (outgoing_track ? outgoing_track->memory_size() : 0);
+
+        for (const auto &track : tracks)
+            size += track->memory_size();
+        return size;
+    };
 
     // initialize codec
     codec.init();
 
     // message handling
     while (true) {
+        int completion_fd = codec.get_completion_fd();
+        int timeout_ms = codec.refill_interval_ms();
+        int nr_ready;
+
+        // a long pause releases the tracks if they take too much memory, tracks played from their mapped files are
+        // kept (paused as long as the user likes)
+        if (paused_at_ms >= 0 && held_size() > _pause_memory_limit) {
+            long long release_ms = paused_at_ms + PLAYER_PAUSE_RELEASE_MS - now_ms();
+
+            if (release_ms <= 0) {
+                stop();
+                send_to_ui(player_thread_msg::STOP, player_thread_msg::SUCCESS);
+                continue;
+            }
+            timeout_ms = timeout_ms >= 0 ? std::min<int>(timeout_ms, (int)release_ms) : (int)release_ms;
+        }
+        struct timeval timeout{timeout_ms / 1000, timeout_ms % 1000 * 1000};
+
         // TODO: check against FD_SETSIZE limit
         FD_ZERO(&read_fds);
         FD_SET(_ui_to_player_read_pipe_fd, &read_fds);
+        if (completion_fd >= 0)
+            FD_SET(completion_fd, &read_fds);
+
+        // without a completion fd, the periods of a stream are refilled on a timeout
+        nr_ready = select(std::max(_ui_to_player_read_pipe_fd, completion_fd) + 1, &read_fds, nullptr, nullptr,
+                          timeout_ms >= 0 ? &timeout : nullptr);
+        if (nr_ready < 0)
+            continue;
+
+        // refill of the stream, the callback passed to play_stream() is invoked from here at its end
+        if (nr_ready == 0 || (completion_fd >= 0 && FD_ISSET(completion_fd, &read_fds))) {
+            codec.process_completions();
+
+            // the enqueued tracks that started follow the ones before them
+            for (size_t nr_started = codec.take_started_streams(); nr_started > 0 && tracks.size() > 1; --nr_started) {
+                tracks.pop_front();
+                // its gain is ramped to within a period of its start
+                codec.set_track_gain(tracks.front()->gain());
+                send_to_ui(player_thread_msg::NEXT, player_thread_msg::SUCCESS,
+                           to_ms(*tracks.front(), tracks.front()->info().frames));
+            }
 
-        while (select(_ui_to_player_read_pipe_fd + 1, &read_fds, nullptr, nullptr, nullptr) == 0);
+            // the stream does not read the track faded out anymore
+            if (outgoing_track && !codec.is_crossfading())
+                outgoing_track.reset();
 
-        if (FD_ISSET(_ui_to_player_read_pipe_fd, &read_fds)) {
+            if (is_ended) {
+                is_ended = false;
+                tracks.clear();
+                outgoing_track.reset();
+                // the stream ended before the decoder got to the overlap (seeked to the end)
+                if (!pending_track)
+                    pending_track = std::move(crossfade_track);
+
+                if (pending_track && play_track(std::move(pending_track)) == 0)
+                    send_to_ui(player_thread_msg::NEXT, player_thread_msg::SUCCESS,
+                               to_ms(*tracks.front(), tracks.front()->info().frames));
+                else
+                    send_to_ui(player_thread_msg::STOP, player_thread_msg::SUCCESS);
+                pending_track.reset();
+                crossfade_track.reset();
+            }
+
+            // the decoder of the track playing got to the overlap, the next track fades in
+            if (crossfade_track && tracks.size() == 1 && !codec.is_crossfading() &&
+                frames_left(*tracks.front()) <= (size_t)_crossfade_ms * (size_t)tracks.front()->sample_rate() / 1000) {
+                if (crossfade(crossfade_track))
+                    send_to_ui(player_thread_msg::NEXT, player_thread_msg::SUCCESS,
+                               to_ms(*tracks.front(), tracks.front()->info().frames));
+                else
+                    follow(std::move(crossfade_track));
+            }
+        }
+
+        if (nr_ready > 0 && FD_ISSET(_ui_to_player_read_pipe_fd, &read_fds)) {
             // read data sent by ui_thread
             if(read(_ui_to_player_read_pipe_fd, &player_rx_msg, sizeof(player_rx_msg)) > 0) {
                 // handle commands coming from UI thread
@@ -30,70 +197,172 @@ void player_thread::run() {
 
                 switch (player_rx_msg.command) {
                     case player_thread_msg::PLAY: {
-                        int ret;
-                        void *buff;
-                        size_t buff_size;
-                        SF_INFO snd_info;
-                        SNDFILE *snd_file;
-                        virtual_file_wrapper vf;
+                        playback_source *source;
+
+                        player_tx_msg.result = player_thread_msg::FAILURE;
 
-                        // stop if anything playing
-                        codec.stop();
+                        if (read(_ui_to_player_read_pipe_fd, &source, sizeof(source)) > 0) {
+                            std::unique_ptr<player_track> track = player_track::open(std::unique_ptr<playback_source>(source));
+
+                            // the tracks after the one playing are dropped, it fades into the new one
+                            for (size_t nr_cleared = codec.clear_stream_queue(); nr_cleared > 0 && tracks.size() > 1; --nr_cleared)
+                                tracks.pop_back();
+                            pending_track.reset();
+                            crossfade_track.reset();
+                            if (track && paused_at_ms < 0 && crossfade(track)) {
+                                player_tx_msg.result = player_thread_msg::SUCCESS;
+                                player_tx_msg.payload = to_ms(*tracks.front(), tracks.front()->info().frames);
+                            } else {
+                                // stop if anything playing
+                                stop();
+
+                                if (track && play_track(std::move(track)) == 0) {
+                                    player_tx_msg.result = player_thread_msg::SUCCESS;
+                                    player_tx_msg.payload = to_ms(*tracks.front(), tracks.front()->info().frames);
+                                }
+                            }
+                        } else {
+                            stop();
+                        }
+
+                        write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+
+                        break;
+                    }
+                    case player_thread_msg::QUEUE: {
+                        player_track *next_track;
 
                         player_tx_msg.result = player_thread_msg::FAILURE;
 
-                        if (read(_ui_to_player_read_pipe_fd, &buff, sizeof(&buff)) > 0) {
-                            buff_size = player_rx_msg.payload;
-
-                            // create virtual file wrapper from buffer
-                            vf.open(buff, buff_size);
-                            // open virtual file
-                            snd_file = sf_open_virtual(vf.as_sf_virtual_io(), SFM_READ, &snd_info, &vf);
-
-                            if (snd_file) {
-                                void *dma_buff = codec.request_buffer(snd_info.frames * snd_info.channels * sizeof(short));
-                                if (dma_buff) {
-                                    // read audio samples from file
-                                    sf_read_short(snd_file, (short *)dma_buff, snd_info.frames * snd_info.channels);
-
-                                    ret = codec.play(dma_buff,
-                                                     snd_info.samplerate,
-                                                     [this](void *param){
-                                                         (void) param;
-                                                         player_thread_msg msg {.command = player_thread_msg::STOP, .result = player_thread_msg::SUCCESS, .payload = 0};
-                                                         write(_player_to_ui_write_pipe_fd, &msg, sizeof(msg));
-                                                     },
-                                                     nullptr);
-                                    if (ret != 0) {
-                                        // error
-                                        codec.release_buffer(dma_buff);
-                                    } else {
-                                        player_tx_msg.result = player_thread_msg::SUCCESS;
-                                    }
+                        // opened and predecoded by the UI thread
+                        if (read(_ui_to_player_read_pipe_fd, &next_track, sizeof(next_track)) > 0) {
+                            std::unique_ptr<player_track> track(next_track);
+
+                            if (tracks.empty()) {
+                                // the stream ended meanwhile, started right away
+                                if (play_track(std::move(track)) == 0) {
+                                    player_tx_msg.result = player_thread_msg::SUCCESS;
+                                    write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+                                    player_tx_msg.command = player_thread_msg::NEXT;
+                                    player_tx_msg.payload = to_ms(*tracks.front(), tracks.front()->info().frames);
                                 }
+                            } else {
+                                player_tx_msg.result = player_thread_msg::SUCCESS;
+                                // faded in once the decoder of the track playing gets to the overlap
+                                if (_crossfade_ms > 0 && tracks.size() == 1 && !crossfade_track &&
+                                    track->sample_rate() == tracks.front()->sample_rate())
+                                    crossfade_track = std::move(track);
+                                else
+                                    follow(std::move(track));
                             }
+                        }
+
+                        write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
 
-                            free(buff);
+                        break;
+                    }
+                    case player_thread_msg::DEQUEUE:
+                        // the tracks the stream already started to read from are played
+                        for (size_t nr_cleared = codec.clear_stream_queue(); nr_cleared > 0 && tracks.size() > 1; --nr_cleared)
+                            tracks.pop_back();
+                        pending_track.reset();
+                        crossfade_track.reset();
+                        player_tx_msg.result = player_thread_msg::SUCCESS;
+                        write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+
+                        break;
+                    case player_thread_msg::SEEK:
+                    case player_thread_msg::SEEK_TO: {
+                        player_tx_msg.result = player_thread_msg::FAILURE;
+                        if (tracks.empty()) {
+                            write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+                            break;
                         }
 
+                        // the position played lags the decoder by the periods filled ahead
+                        player_track &track = *tracks.front();
+                        auto buffered = (sf_count_t)(codec.buffered_stream_frames() * (size_t)track.info().samplerate /
+                                                     (size_t)track.sample_rate());
+                        sf_count_t played = std::max<sf_count_t>(0, track.position() - buffered);
+                        sf_count_t target = to_frames(track, player_rx_msg.payload) +
+                                            (player_rx_msg.command == player_thread_msg::SEEK ? played : 0);
+
+                        // the decoder goes right to the position, the periods filled ahead are dropped
+                        sf_count_t position = track.seek(target);
+                        int nr_dropped = position >= 0 ? codec.restart_stream(track.decoder()) : -1;
+                        if (nr_dropped >= 0) {
+                            paused_at_ms = -1;
+                            // a crossfade is dropped with the periods, the track faded in plays on
+                            outgoing_track.reset();
+
+                            // the tracks the stream read from already start over, the ones after them follow
+                            if (nr_dropped > 0) {
+                                codec.clear_stream_queue();
+                                for (size_t i = 1; i < tracks.size(); ++i) {
+                                    if (i <= (size_t)nr_dropped)
+                                        tracks[i]->seek(0);
+                                    codec.enqueue_stream(tracks[i]->sample_rate(), tracks[i]->decoder());
+                                }
+                            }
+
+                            player_tx_msg.result = player_thread_msg::SUCCESS;
+                            player_tx_msg.payload = to_ms(track, position);
+                        }
                         write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
 
+                        // the stream could not be started again
+                        if (position >= 0 && nr_dropped < 0) {
+                            stop();
+                            send_to_ui(player_thread_msg::STOP, player_thread_msg::SUCCESS);
+                        }
+
                         break;
                     }
+                    case player_thread_msg::PAUSE:
+                        player_tx_msg.result = player_thread_msg::FAILURE;
+                        // the track playing, the ones after it and the periods filled are kept
+                        if (codec.pause_stream() == 0) {
+                            paused_at_ms = now_ms();
+                            player_tx_msg.result = player_thread_msg::SUCCESS;
+                        }
+                        write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+
+                        break;
+                    case player_thread_msg::RESUME:
+                        player_tx_msg.result = player_thread_msg::FAILURE;
+                        if (paused_at_ms >= 0 && codec.resume_stream() == 0) {
+                            paused_at_ms = -1;
+                            player_tx_msg.result = player_thread_msg::SUCCESS;
+                        }
+                        write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+
+                        // the stream could not be started again
+                        if (paused_at_ms >= 0) {
+                            stop();
+                            send_to_ui(player_thread_msg::STOP, player_thread_msg::SUCCESS);
+                        }
+
+                        break;
                     case player_thread_msg::STOP:
-                        codec.stop();
+                        stop();
                         player_tx_msg.result = player_thread_msg::SUCCESS;
                         write(_player_to_ui_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
 
                         break;
                     case player_thread_msg::EXIT:
-                        codec.stop();
+                        stop();
                         close(_ui_to_player_read_pipe_fd);
                         close(_player_to_ui_write_pipe_fd);
                         goto exit;
                     case player_thread_msg::VOLUME:
                         codec.set_relative_volume((int)player_rx_msg.payload);
                         break;
+                    case player_thread_msg::STATS:
+                        codec.dump_dma_stats(stderr);
+                        break;
+                    default:
+                        // left empty intentionally: sent to the UI only
+                        break;
                 }
             }
         }
@@ -4,25 +4,47 @@
 
 #include "pthread_wrapper.h"
 #include "aes.h"
+#include "cma_budget.h"
+
+// a paused player holding more memory than the limit (decrypted tracks, the stream) releases it after a while
+#define PLAYER_PAUSE_MEMORY_LIMIT (16 * 1024 * 1024)
+#define PLAYER_PAUSE_RELEASE_MS (5 * 60 * 1000)
+// overlap of consecutive tracks at the same sample rate, and of a track played in place of the one playing: 0 (the
+// default, overridden from the command line) splices the next track in without a gap, and stops the one playing
+#define PLAYER_CROSSFADE_MS 0
 
 class player_thread : public pthread_wrapper {
 public:
     struct player_thread_msg {
-        enum command_t {PLAY, STOP, VOLUME, EXIT} command{};
+        // PLAY: the track fades in over the one playing with a crossfade (at the same sample rate, it is stopped
+        // otherwise)
+        // QUEUE: the track (opened by the UI) played after the current one, without a gap or faded in over its end,
+        // DEQUEUE drops it,
+        // NEXT: it started playing (the results of PLAY and NEXT carry the length of the track in ms)
+        // SEEK: by payload ms, SEEK_TO: to payload ms (the results carry the position, in ms, a paused track resumes)
+        // PAUSE: parks the playback keeping the tracks, RESUME: plays on; released after a long pause (STOP is sent)
+        enum command_t {PLAY, STOP, VOLUME, STATS, EXIT, QUEUE, DEQUEUE, NEXT, SEEK, SEEK_TO, PAUSE, RESUME} command{};
         enum result_t {SUCCESS, FAILURE} result{};
         long int payload{};
     };
 
-    player_thread(int ui_to_player_read_pipe_fd, int player_to_ui_write_pipe_fd) :
+    player_thread(cma_budget &budget, int ui_to_player_read_pipe_fd, int player_to_ui_write_pipe_fd,
+                  size_t pause_memory_limit = PLAYER_PAUSE_MEMORY_LIMIT, int crossfade_ms = PLAYER_CROSSFADE_MS) :
+            _budget(budget),
             _ui_to_player_read_pipe_fd(ui_to_player_read_pipe_fd),
-            _player_to_ui_write_pipe_fd(player_to_ui_write_pipe_fd) { }
+            _player_to_ui_write_pipe_fd(player_to_ui_write_pipe_fd),
+            _pause_memory_limit(pause_memory_limit),
+            _crossfade_ms(crossfade_ms) { }
 
 protected:
     void run() override;
 
 private:
+    cma_budget &_budget;
     int _ui_to_player_read_pipe_fd;
     int _player_to_ui_write_pipe_fd;
+    size_t _pause_memory_limit;
+    int _crossfade_ms;
 };
 
 
@@ -0,0 +1,149 @@
+#include "player_track.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "adau1761.h"
+
+namespace {
+    // the format the frames of the file are read in: packed 24-bit ones of a RIFF file as they are stored, others as
+    // libsndfile converts them with the least loss
+    sample_convert::format_t read_format(const SF_INFO &info) {
+        int type = info.format & SF_FORMAT_TYPEMASK;
+        bool is_riff = type == SF_FORMAT_WAV || type == SF_FORMAT_WAVEX || type == SF_FORMAT_W64 ||
+                       type == SF_FORMAT_RF64;
+
+        switch (info.format & SF_FORMAT_SUBMASK) {
+            case SF_FORMAT_PCM_24:
+                return is_riff && (info.format & SF_FORMAT_ENDMASK) != SF_ENDIAN_BIG ? sample_convert::S24
+                                                                                      : sample_convert::S32;
+            case SF_FORMAT_PCM_32:
+                return sample_convert::S32;
+            case SF_FORMAT_FLOAT:
+            case SF_FORMAT_DOUBLE:
+            case SF_FORMAT_VORBIS:
+                return sample_convert::FLOAT;
+            default:
+                return sample_convert::S16;
+        }
+    }
+
+    // reads up to frames frames in the format, returns the number read
+    sf_count_t read_frames(SNDFILE *snd_file, sample_convert::format_t format, int channels, void *buffer,
+                           size_t frames) {
+        switch (format) {
+            case sample_convert::S16:
+                return sf_readf_short(snd_file, (short *)buffer, (sf_count_t)frames);
+            case sample_convert::S24: {
+                auto frame_size = (sf_count_t)(channels * 3);
+                sf_count_t nr_read = sf_read_raw(snd_file, buffer, (sf_count_t)frames * frame_size);
+                return nr_read > 0 ? nr_read / frame_size : nr_read;
+            }
+            case sample_convert::S32:
+                return sf_readf_int(snd_file, (int *)buffer, (sf_count_t)frames);
+            default:
+                return sf_readf_float(snd_file, (float *)buffer, (sf_count_t)frames);
+        }
+    }
+}
+
+std::unique_ptr<player_track> player_track::open(std::unique_ptr<playback_source> source, int predecode_ms,
+                                                 resampler::quality_t quality) {
+    std::unique_ptr<player_track> track(new player_track());
+    track->_source = std::move(source);
+
+    // create virtual file wrapper reading the source in place
+    track->_vf.open(*track->_source);
+    // open virtual file
+    track->_snd_file = sf_open_virtual(track->_vf.as_sf_virtual_io(), SFM_READ, &track->_snd_info, &track->_vf);
+    if (!track->_snd_file)
+        return nullptr;
+
+    track->_converter = sample_convert::kernel(read_format(track->_snd_info), track->_snd_info.channels);
+    track->_sample_rate = adau1761::playback_rate(track->_snd_info.samplerate);
+    track->_quality = quality;
+    if (!track->_converter || track->_sample_rate <= 0)
+        return nullptr;
+
+    size_t predecode_frames = (size_t)track->_sample_rate * (size_t)std::max(predecode_ms, 0) / 1000;
+    try {
+        track->_set_decoder(predecode_frames);
+    } catch (const std::invalid_argument &) {
+        // the ratio of the rates needs too many phases
+        return nullptr;
+    }
+    track->_predecoded_size = predecode_frames * I2S_FRAME_SIZE;
+
+    return track;
+}
+
+sf_count_t player_track::seek(sf_count_t frame) {
+    frame = std::clamp<sf_count_t>(frame, 0, _snd_info.frames);
+
+    // the decoders seek without reading from the start (a compressed one from the nearest frame it can)
+    sf_count_t position = sf_seek(_snd_file, frame, SEEK_SET);
+    if (position < 0)
+        return -1;
+
+    _set_decoder(0);
+    _predecoded_size = 0;
+    _start = position;
+
+    return position;
+}
+
+void player_track::_set_decoder(size_t predecode_frames) {
+    SNDFILE *snd_file = _snd_file;
+    std::shared_ptr<sf_count_t> served = std::make_shared<sf_count_t>(0);
+
+    // decoded a period at a time, as the DMA plays the ones before
+    i2s_stream::source_t decoder;
+    if (_converter->format == sample_convert::S16 && _converter->layout == sample_convert::STEREO) {
+        decoder = [snd_file](int16_t *buffer, size_t frames) {
+            sf_count_t nr_read = sf_readf_short(snd_file, buffer, (sf_count_t)frames);
+            return nr_read > 0 ? (size_t)nr_read : 0;
+        };
+    } else {
+        // read into a staging buffer a block at a time, converted into the one of the stream
+        const sample_convert::kernel_t *converter = _converter;
+        int channels = _snd_info.channels;
+        std::vector<uint8_t> staging(PLAYER_TRACK_CONVERT_FRAMES * (size_t)channels *
+                                     sample_convert::sample_size(converter->format));
+
+        decoder = [snd_file, converter, channels, staging](int16_t *buffer, size_t frames) mutable {
+            size_t nr_frames = 0;
+
+            while (nr_frames < frames) {
+                size_t count = std::min<size_t>(frames - nr_frames, PLAYER_TRACK_CONVERT_FRAMES);
+                sf_count_t nr_read = read_frames(snd_file, converter->format, channels, staging.data(), count);
+                if (nr_read <= 0)
+                    break;
+
+                converter->convert(buffer + nr_frames * I2S_CHANNELS, staging.data(), (size_t)nr_read, channels);
+                nr_frames += (size_t)nr_read;
+                if ((size_t)nr_read < count)
+                    break;
+            }
+            return nr_frames;
+        };
+    }
+    if (_sample_rate != _snd_info.samplerate)
+        decoder = i2s_resample(std::move(decoder), _snd_info.samplerate, _sample_rate, _quality);
+    if (predecode_frames > 0)
+        decoder = i2s_predecode(std::move(decoder), predecode_frames);
+
+    // the frames served to the stream
+    _decoder = [decoder = std::move(decoder), served](int16_t *buffer, size_t frames) mutable {
+        size_t nr_frames = decoder(buffer, frames);
+
+        *served += (sf_count_t)nr_frames;
+        return nr_frames;
+    };
+    _served = served;
+}
+
+player_track::~player_track() {
+    if (_snd_file)
+        sf_close(_snd_file);
+}
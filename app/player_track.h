@@ -0,0 +1,76 @@
+#ifndef AES_MUSIC_PLAYER_APP_PLAYER_TRACK_H
+#define AES_MUSIC_PLAYER_APP_PLAYER_TRACK_H
+
+
+#include <memory>
+
+#include "sndfile.h"
+#include "i2s_stream.h"
+#include "playback_source.h"
+#include "resampler.h"
+#include "sample_convert.h"
+#include "virtual_file_wrapper.h"
+
+// the start of a track played next decoded ahead, half a second is 94 kB at 48 kHz
+#define PLAYER_TRACK_PREDECODE_MS 500
+// frames of a file not in stereo 16-bit read at a time before they are converted, 16 kB of 7.1 float
+#define PLAYER_TRACK_CONVERT_FRAMES 512
+
+// A track opened for streaming: the source, its decoder, and the frames of the stream read from it. The file and
+// the decoder stay open until the track is destroyed. A track at a rate the codec does not run at is resampled to
+// one it does (see adau1761::playback_rate()). The frames are read in the format closest to the one of the file and
+// converted to stereo 16-bit (see sample_convert) before that.
+//
+// The next track is opened (and its start decoded) by the UI thread, outside of the refills of the player: it is
+// handed over to the player ready to follow the current one.
+class player_track {
+public:
+    // opens the decoder of the source, predecode_ms of it decoded right away, nullptr if it is not a supported file
+    // (or its rate cannot be resampled, or it has no channels)
+    static std::unique_ptr<player_track> open(std::unique_ptr<playback_source> source, int predecode_ms = 0,
+                                              resampler::quality_t quality = RESAMPLER_DEFAULT_QUALITY);
+    ~player_track();
+
+    player_track(const player_track&) = delete;
+    player_track& operator=(const player_track&) = delete;
+
+    const SF_INFO &info() const { return _snd_info; }
+    // the conversion of the frames of the file to stereo 16-bit
+    const sample_convert::kernel_t &converter() const { return *_converter; }
+    // of the loudness of the source, the player applies it with the volume (see adau1761::set_track_gain())
+    float gain() const { return _source->gain(); }
+    // of the frames of the decoder (the rate of the file if the codec runs at it)
+    int sample_rate() const { return _sample_rate; }
+    // reads the frames of the stream, valid as long as the track
+    const i2s_stream::source_t &decoder() const { return _decoder; }
+    // decoded ahead
+    size_t predecoded_size() const { return _predecoded_size; }
+    // memory held by the track: the file if it was read (decrypted) into memory, a mapped one is in the page cache
+    size_t memory_size() const { return (_source->is_mapped() ? 0 : _source->size()) + _predecoded_size; }
+    // frame of the file the decoder is at (the frames it served, at the rate of the file)
+    sf_count_t position() const { return _start + *_served * _snd_info.samplerate / _sample_rate; }
+    // moves the decoder to the frame (the frames decoded ahead are dropped), returns the frame it is on, -1 on error;
+    // the decoder() before it is not valid anymore
+    sf_count_t seek(sf_count_t frame);
+
+private:
+    player_track() = default;
+
+    std::unique_ptr<playback_source> _source;
+    virtual_file_wrapper _vf;
+    SF_INFO _snd_info{};
+    SNDFILE *_snd_file = nullptr;
+    const sample_convert::kernel_t *_converter = nullptr;
+    int _sample_rate = 0;
+    resampler::quality_t _quality = RESAMPLER_DEFAULT_QUALITY;
+    i2s_stream::source_t _decoder;
+    size_t _predecoded_size = 0;
+    // frame the decoder started at, and the frames it served since (shared with it)
+    sf_count_t _start = 0;
+    std::shared_ptr<sf_count_t> _served = std::make_shared<sf_count_t>(0);
+
+    void _set_decoder(size_t predecode_frames);
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_PLAYER_TRACK_H
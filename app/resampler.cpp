@@ -0,0 +1,245 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#endif
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    struct preset_t {
+        const char *name;
+        size_t taps;
+        // of the lower Nyquist rate, the cutoff is halfway between it and the Nyquist rate
+        double passband;
+        double beta;
+    };
+
+    const preset_t presets[resampler::NR_QUALITIES] = {
+            {"fast", 24, 0.70, 5.65},
+            {"balanced", 48, 0.79, 7.86},
+            {"best", 96, 0.867, 10.06}};
+
+    double bessel_i0(double x) {
+        double sum = 1, term = 1;
+
+        for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    int16_t to_s16(float sample) {
+        return (int16_t)std::lrint(std::min(std::max(sample, -32768.0f), 32767.0f));
+    }
+
+    // the dot products of the coefficients with the frames of both channels, taps is a multiple of 4
+#if defined(RESAMPLER_NEON)
+    void dot2(const float *coefs, const float *left, const float *right, size_t taps, float *out) {
+        float32x4_t l = vdupq_n_f32(0), r = vdupq_n_f32(0);
+
+        for (size_t i = 0; i < taps; i += 4) {
+            float32x4_t c = vld1q_f32(coefs + i);
+            l = vmlaq_f32(l, c, vld1q_f32(left + i));
+            r = vmlaq_f32(r, c, vld1q_f32(right + i));
+        }
+        float32x2_t sums = vpadd_f32(vadd_f32(vget_low_f32(l), vget_high_f32(l)),
+                                     vadd_f32(vget_low_f32(r), vget_high_f32(r)));
+        out[0] = vget_lane_f32(sums, 0);
+        out[1] = vget_lane_f32(sums, 1);
+    }
+
+    const char *kernel = "neon";
+#elif defined(RESAMPLER_SSE2)
+    void dot2(const float *coefs, const float *left, const float *right, size_t taps, float *out) {
+        __m128 l = _mm_setzero_ps(), r = _mm_setzero_ps();
+
+        for (size_t i = 0; i < taps; i += 4) {
+            __m128 c = _mm_loadu_ps(coefs + i);
+            l = _mm_add_ps(l, _mm_mul_ps(c, _mm_loadu_ps(left + i)));
+            r = _mm_add_ps(r, _mm_mul_ps(c, _mm_loadu_ps(right + i)));
+        }
+        // l0+l2 l1+l3 r0+r2 r1+r3, then the pairs
+        __m128 halves = _mm_add_ps(_mm_movelh_ps(l, r), _mm_movehl_ps(r, l));
+        __m128 sums = _mm_add_ps(halves, _mm_shuffle_ps(halves, halves, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[0] = _mm_cvtss_f32(sums);
+        out[1] = _mm_cvtss_f32(_mm_movehl_ps(sums, sums));
+    }
+
+    const char *kernel = "sse2";
+#else
+    void dot2(const float *coefs, const float *left, const float *right, size_t taps, float *out) {
+        float l = 0, r = 0;
+
+        for (size_t i = 0; i < taps; ++i) {
+            l += coefs[i] * left[i];
+            r += coefs[i] * right[i];
+        }
+        out[0] = l;
+        out[1] = r;
+    }
+
+    const char *kernel = "scalar";
+#endif
+}
+
+resampler::resampler(int input_rate, int output_rate, quality_t quality) {
+    if (input_rate <= 0 || output_rate <= 0 || quality < 0 || quality >= NR_QUALITIES)
+        throw std::invalid_argument("Invalid sample rates or quality.");
+
+    int divisor = std::gcd(input_rate, output_rate);
+    _phases = (size_t)(output_rate / divisor);
+    _step = (size_t)(input_rate / divisor);
+    if (_phases > RESAMPLER_MAX_PHASES)
+        throw std::invalid_argument("Ratio of the sample rates needs too many phases.");
+
+    // the taps of the preset are at the lower rate, downsampling takes more at the input rate (a multiple of 4)
+    const preset_t &preset = presets[quality];
+    _taps = (preset.taps * std::max(_phases, _step) + _phases - 1) / _phases;
+    _taps = (_taps + 3) / 4 * 4;
+
+    // the prototype at the upsampled rate, centered on the coefficient length / 2
+    size_t length = _taps * _phases;
+    double center = (double)length / 2;
+    double cutoff = 0.5 / (double)std::max(_phases, _step) * (1 + preset.passband) / 2;
+    std::vector<double> prototype(length);
+    for (size_t n = 0; n < length; ++n) {
+        double x = (double)n - center;
+        double sinc = x == 0 ? 1 : std::sin(2 * PI * cutoff * x) / (2 * PI * cutoff * x);
+        double ratio = x / center;
+        double window = bessel_i0(preset.beta * std::sqrt(std::max(0.0, 1 - ratio * ratio))) / bessel_i0(preset.beta);
+
+        prototype[n] = 2 * cutoff * sinc * window;
+    }
+
+    // each phase has a gain of 1, coefficient i of a phase is applied to the i-th of the last taps frames
+    _coefs.resize(length);
+    for (size_t phase = 0; phase < _phases; ++phase) {
+        double sum = 0;
+
+        for (size_t k = 0; k < _taps; ++k)
+            sum += prototype[phase + k * _phases];
+        for (size_t k = 0; k < _taps; ++k)
+            _coefs[phase * _taps + _taps - 1 - k] = (float)(prototype[phase + k * _phases] / sum);
+    }
+
+    // the output frame j is at the input frame j * M / L, the center of the prototype is at phase 0 of taps / 2
+    for (auto &input : _input)
+        input.assign(_taps, 0);
+    _base = -(long long)_taps;
+    _next = (long long)_taps / 2;
+    _block.resize(RESAMPLER_BLOCK_FRAMES * I2S_CHANNELS);
+}
+
+size_t resampler::process(const i2s_stream::source_t &source, int16_t *buffer, size_t frames) {
+    size_t nr_written = 0;
+
+    while (nr_written < frames && (_output_end < 0 || _output < _output_end)) {
+        if (_next >= _base + (long long)_input[0].size()) {
+            if (!_fetch(source))
+                break;
+            continue;
+        }
+
+        size_t offset = (size_t)(_next - _base) + 1 - _taps;
+        float out[I2S_CHANNELS];
+        dot2(_coefs.data() + _phase * _taps, _input[0].data() + offset, _input[1].data() + offset, _taps, out);
+        buffer[nr_written * I2S_CHANNELS] = to_s16(out[0]);
+        buffer[nr_written * I2S_CHANNELS + 1] = to_s16(out[1]);
+        ++nr_written;
+        ++_output;
+
+        _phase += _step;
+        _next += (long long)(_phase / _phases);
+        _phase %= _phases;
+    }
+
+    return nr_written;
+}
+
+bool resampler::_fetch(const i2s_stream::source_t &source) {
+    if (_output_end >= 0)
+        return false;
+
+    // the frames before the window of the next output frame are dropped, a block at a time
+    size_t consumed = (size_t)(_next - _base) + 1 - _taps;
+    if (consumed >= RESAMPLER_BLOCK_FRAMES) {
+        for (auto &input : _input)
+            input.erase(input.begin(), input.begin() + (long)consumed);
+        _base += (long long)consumed;
+    }
+
+    size_t nr_read = std::min(source(_block.data(), RESAMPLER_BLOCK_FRAMES), (size_t)RESAMPLER_BLOCK_FRAMES);
+    for (size_t channel = 0; channel < I2S_CHANNELS; ++channel) {
+        for (size_t i = 0; i < nr_read; ++i)
+            _input[channel].push_back(_block[i * I2S_CHANNELS + channel]);
+    }
+
+    // the end of the source, the filter is run out on silence
+    if (nr_read < RESAMPLER_BLOCK_FRAMES) {
+        auto nr_input = (unsigned long long)(_base + (long long)_input[0].size());
+        _output_end = (long long)((nr_input * _phases + _step - 1) / _step);
+        for (auto &input : _input)
+            input.resize(input.size() + _taps, 0);
+    }
+
+    return true;
+}
+
+size_t resampler::memory_size() const {
+    return (_coefs.size() + _input[0].capacity() + _input[1].capacity()) * sizeof(float) +
+           _block.size() * sizeof(int16_t);
+}
+
+int resampler::output_rate(int input_rate, const std::vector<int> &rates) {
+    int best = 0;
+
+    for (int rate : rates) {
+        if (rate == input_rate)
+            return rate;
+        if (input_rate <= 0 || rate <= 0)
+            continue;
+
+        int phases = rate / std::gcd(input_rate, rate);
+        int best_phases = best > 0 ? best / std::gcd(input_rate, best) : 0;
+        if (best == 0 || phases < best_phases || (phases == best_phases && rate > best))
+            best = rate;
+    }
+
+    return best;
+}
+
+const char *resampler::quality_string(quality_t quality) {
+    return quality >= 0 && quality < NR_QUALITIES ? presets[quality].name : "";
+}
+
+const char *resampler::kernel_name() {
+    return kernel;
+}
+
+i2s_stream::source_t i2s_resample(i2s_stream::source_t source, int input_rate, int output_rate,
+                                  resampler::quality_t quality) {
+    struct resampled_t {
+        i2s_stream::source_t source;
+        resampler converter;
+
+        resampled_t(i2s_stream::source_t source, int input_rate, int output_rate, resampler::quality_t quality) :
+                source(std::move(source)), converter(input_rate, output_rate, quality) { }
+    };
+    auto resampled = std::make_shared<resampled_t>(std::move(source), input_rate, output_rate, quality);
+
+    return [resampled](int16_t *buffer, size_t frames) {
+        return resampled->converter.process(resampled->source, buffer, frames);
+    };
+}
@@ -0,0 +1,79 @@
+#ifndef AES_MUSIC_PLAYER_APP_RESAMPLER_H
+#define AES_MUSIC_PLAYER_APP_RESAMPLER_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "i2s_stream.h"
+
+// ratios needing more phases are not resampled (L = 1024 takes 384 kB of coefficients at the best quality)
+#define RESAMPLER_MAX_PHASES 1024
+// frames read from the source at a time
+#define RESAMPLER_BLOCK_FRAMES 256
+#define RESAMPLER_DEFAULT_QUALITY resampler::BALANCED
+
+// Polyphase resampler of the 16-bit stereo frames of a stream, by the ratio L/M of the output and input rates.
+//
+// The prototype is a Kaiser windowed sinc of taps * L coefficients, its stopband starts at the Nyquist rate of the
+// lower of the two rates. It is split into L phases of taps coefficients, an output frame is the dot product of a
+// phase with the last taps input frames (NEON, SSE on x86). The output is aligned to the input, the delay of the filter
+// is compensated. Against a reference resampler (a windowed sinc of 512 taps in double precision), the output has a
+// SNR of at least 65 dB at the fast quality, 80 dB at balanced and 85 dB at best over the passband (see
+// resampler_bench, the rounding to 16 bits limits its signal to about 89 dB).
+class resampler {
+public:
+    // taps at the lower rate (times M / L at the input rate when downsampling), passband of the lower Nyquist rate and
+    // stopband attenuation of the presets: fast 24, 70 %, 60 dB; balanced 48, 79 %, 80 dB; best 96, 87 %, 100 dB
+    enum quality_t {FAST, BALANCED, BEST, NR_QUALITIES};
+
+    // throws std::invalid_argument if the rates are not positive or their ratio needs too many phases
+    resampler(int input_rate, int output_rate, quality_t quality = RESAMPLER_DEFAULT_QUALITY);
+
+    resampler(const resampler&) = delete;
+    resampler& operator=(const resampler&) = delete;
+
+    // writes up to frames resampled frames into buffer reading the source as needed, returns the number written
+    // (less than frames at the end of the source)
+    size_t process(const i2s_stream::source_t &source, int16_t *buffer, size_t frames);
+
+    size_t phases() const { return _phases; }
+    size_t taps() const { return _taps; }
+    // coefficients and buffered input
+    size_t memory_size() const;
+
+    // the rate of the rates to resample to: the input rate if it is one, else the one of the simplest ratio (fewest
+    // phases, the higher rate on a tie), 0 if there is none
+    static int output_rate(int input_rate, const std::vector<int> &rates);
+    static const char *quality_string(quality_t quality);
+    // the inner loop built for the target
+    static const char *kernel_name();
+
+private:
+    size_t _phases;
+    size_t _step;
+    size_t _taps;
+    // taps coefficients per phase, in the order of the input frames they are applied to
+    std::vector<float> _coefs;
+
+    // input frames by channel from the one at _base (the first taps are silence before the source)
+    std::vector<float> _input[I2S_CHANNELS];
+    long long _base;
+    std::vector<int16_t> _block;
+    // newest input frame and phase of the next output frame
+    long long _next;
+    size_t _phase = 0;
+    long long _output = 0;
+    // output frames of the source, known once it ended (the input is padded with silence then)
+    long long _output_end = -1;
+
+    bool _fetch(const i2s_stream::source_t &source);
+};
+
+// Resamples the source on the fly (see resampler), throws std::invalid_argument as resampler does.
+i2s_stream::source_t i2s_resample(i2s_stream::source_t source, int input_rate, int output_rate,
+                                  resampler::quality_t quality = RESAMPLER_DEFAULT_QUALITY);
+
+
+#endif //AES_MUSIC_PLAYER_APP_RESAMPLER_H
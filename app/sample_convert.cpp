@@ -0,0 +1,455 @@
+#include "sample_convert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAMPLE_CONVERT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SAMPLE_CONVERT_SSE2
+#endif
+
+using sample_convert::format_t;
+using sample_convert::layout_t;
+
+namespace {
+    constexpr float MINUS_3_DB = 0.70710678f;
+
+    // a sample of the input in 16-bit units
+    template<format_t FORMAT>
+    float sample(const void *src, size_t index);
+
+    template<>
+    float sample<sample_convert::S16>(const void *src, size_t index) {
+        return ((const int16_t *)src)[index];
+    }
+
+    template<>
+    float sample<sample_convert::S24>(const void *src, size_t index) {
+        const auto *bytes = (const uint8_t *)src + index * 3;
+        return (float)(int16_t)(bytes[1] | bytes[2] << 8);
+    }
+
+    template<>
+    float sample<sample_convert::S32>(const void *src, size_t index) {
+        return (float)(((const int32_t *)src)[index] >> 16);
+    }
+
+    template<>
+    float sample<sample_convert::FLOAT>(const void *src, size_t index) {
+        return ((const float *)src)[index] * 32767.0f;
+    }
+
+    // rounds half away from zero as the vector conversions do, a truncation inlines where lrint is a call
+    int16_t to_s16(float value) {
+        value = std::min(std::max(value, -32768.0f), 32767.0f);
+        return (int16_t)(int32_t)(value + std::copysign(0.5f, value));
+    }
+
+    // the front pair plus the center and the surround pairs (from channel 4) at -3 dB, the LFE (channel 3) dropped
+    template<layout_t LAYOUT>
+    struct downmix_t;
+
+    template<>
+    struct downmix_t<sample_convert::SURROUND_5_1> {
+        // FL FR FC LFE BL BR
+        static constexpr int channels = 6;
+        static constexpr int surround_pairs = 1;
+        static constexpr float scale = 1 / (1 + 2 * MINUS_3_DB);
+    };
+
+    template<>
+    struct downmix_t<sample_convert::SURROUND_7_1> {
+        // FL FR FC LFE BL BR SL SR
+        static constexpr int channels = 8;
+        static constexpr int surround_pairs = 2;
+        static constexpr float scale = 1 / (1 + 3 * MINUS_3_DB);
+    };
+
+    // frames converted to float before they are mixed, a block at a time
+    constexpr size_t DOWNMIX_BLOCK_FRAMES = 64;
+
+    // the first two channels of any count
+    template<format_t FORMAT>
+    void first_two(int16_t *dst, const void *src, size_t frames, int channels) {
+        for (size_t i = 0; i < frames; ++i) {
+            dst[i * 2] = to_s16(sample<FORMAT>(src, i * (size_t)channels));
+            dst[i * 2 + 1] = to_s16(sample<FORMAT>(src, i * (size_t)channels + (channels > 1 ? 1 : 0)));
+        }
+    }
+
+    // the scalar mono and stereo kernels, the vector ones leave their tails to them
+    template<format_t FORMAT>
+    void mono_scalar(int16_t *dst, const void *src, size_t frames, size_t first = 0) {
+        for (size_t i = first; i < frames; ++i)
+            dst[i * 2] = dst[i * 2 + 1] = to_s16(sample<FORMAT>(src, i));
+    }
+
+    template<format_t FORMAT>
+    void stereo_scalar(int16_t *dst, const void *src, size_t frames, size_t first = 0) {
+        for (size_t i = first * 2; i < frames * 2; ++i)
+            dst[i] = to_s16(sample<FORMAT>(src, i));
+    }
+
+    template<format_t FORMAT>
+    void mono(int16_t *dst, const void *src, size_t frames, int channels);
+
+    template<format_t FORMAT>
+    void stereo(int16_t *dst, const void *src, size_t frames, int channels);
+
+    template<>
+    void stereo<sample_convert::S16>(int16_t *dst, const void *src, size_t frames, int channels) {
+        (void)channels;
+        memcpy(dst, src, frames * 2 * sizeof(int16_t));
+    }
+
+#if defined(SAMPLE_CONVERT_NEON)
+    template<>
+    void mono<sample_convert::S16>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int16_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            int16x8_t q = vld1q_s16(s + i);
+            vst2q_s16(dst + i * 2, (int16x8x2_t){{q, q}});
+        }
+        mono_scalar<sample_convert::S16>(dst, src, frames, i);
+    }
+
+    template<>
+    void mono<sample_convert::S24>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const uint8_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        // the bytes of 16 samples by their place in the sample, the upper two are the 16-bit sample
+        for (; i + 16 <= frames; i += 16) {
+            uint8x16x3_t bytes = vld3q_u8(s + i * 3);
+            uint8x16x2_t words = vzipq_u8(bytes.val[1], bytes.val[2]);
+            int16x8_t q0 = vreinterpretq_s16_u8(words.val[0]), q1 = vreinterpretq_s16_u8(words.val[1]);
+            vst2q_s16(dst + i * 2, (int16x8x2_t){{q0, q0}});
+            vst2q_s16(dst + i * 2 + 16, (int16x8x2_t){{q1, q1}});
+        }
+        mono_scalar<sample_convert::S24>(dst, src, frames, i);
+    }
+
+    template<>
+    void stereo<sample_convert::S24>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const uint8_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            uint8x16x3_t bytes = vld3q_u8(s + i * 6);
+            uint8x16x2_t words = vzipq_u8(bytes.val[1], bytes.val[2]);
+            vst1q_u8((uint8_t *)(dst + i * 2), words.val[0]);
+            vst1q_u8((uint8_t *)(dst + i * 2 + 8), words.val[1]);
+        }
+        stereo_scalar<sample_convert::S24>(dst, src, frames, i);
+    }
+
+    template<>
+    void mono<sample_convert::S32>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int32_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            int16x8_t q = vcombine_s16(vshrn_n_s32(vld1q_s32(s + i), 16), vshrn_n_s32(vld1q_s32(s + i + 4), 16));
+            vst2q_s16(dst + i * 2, (int16x8x2_t){{q, q}});
+        }
+        mono_scalar<sample_convert::S32>(dst, src, frames, i);
+    }
+
+    template<>
+    void stereo<sample_convert::S32>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int32_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 4 <= frames; i += 4) {
+            int16x8_t q = vcombine_s16(vshrn_n_s32(vld1q_s32(s + i * 2), 16), vshrn_n_s32(vld1q_s32(s + i * 2 + 4), 16));
+            vst1q_s16(dst + i * 2, q);
+        }
+        stereo_scalar<sample_convert::S32>(dst, src, frames, i);
+    }
+
+    // the left and right of two frames, the pairs of the frames side by side
+    template<typename MIX>
+    float32x4_t mix_2(const float *frames) {
+        const float *next = frames + MIX::channels;
+        float32x4_t surround = simd::frame_pairs(frames[2], next[2]);
+
+        for (int pair = 0; pair < MIX::surround_pairs; ++pair)
+            surround = vaddq_f32(surround, vcombine_f32(vld1_f32(frames + 4 + pair * 2), vld1_f32(next + 4 + pair * 2)));
+        float32x4_t front = vcombine_f32(vld1_f32(frames), vld1_f32(next));
+
+        return vmulq_n_f32(vmlaq_n_f32(front, surround, MINUS_3_DB), MIX::scale);
+    }
+
+    // mixes the frames 4 at a time, returns the number mixed
+    template<typename MIX>
+    size_t mix_frames(int16_t *dst, const float *frames, size_t count) {
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const float *f = frames + i * MIX::channels;
+            vst1q_s16(dst + i * 2, vcombine_s16(simd::round_4(mix_2<MIX>(f)), simd::round_4(mix_2<MIX>(f + 2 * MIX::channels))));
+        }
+        return i;
+    }
+
+    template<>
+    void mono<sample_convert::FLOAT>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const float *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            int16x8_t q = vcombine_s16(simd::convert_4(s + i), simd::convert_4(s + i + 4));
+            vst2q_s16(dst + i * 2, (int16x8x2_t){{q, q}});
+        }
+        mono_scalar<sample_convert::FLOAT>(dst, src, frames, i);
+    }
+
+    template<>
+    void stereo<sample_convert::FLOAT>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const float *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 4 <= frames; i += 4)
+            vst1q_s16(dst + i * 2, vcombine_s16(simd::convert_4(s + i * 2), simd::convert_4(s + i * 2 + 4)));
+        stereo_scalar<sample_convert::FLOAT>(dst, src, frames, i);
+    }
+
+    const char *instruction_set = "neon";
+#elif defined(SAMPLE_CONVERT_SSE2)
+    template<>
+    void mono<sample_convert::S16>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int16_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            __m128i q = _mm_loadu_si128((const __m128i *)(s + i));
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi16(q, q));
+            _mm_storeu_si128((__m128i *)(dst + i * 2 + 8), _mm_unpackhi_epi16(q, q));
+        }
+        mono_scalar<sample_convert::S16>(dst, src, frames, i);
+    }
+
+    // no byte shuffles in SSE2, the packed samples are converted one by one
+    template<>
+    void mono<sample_convert::S24>(int16_t *dst, const void *src, size_t frames, int channels) {
+        (void)channels;
+        mono_scalar<sample_convert::S24>(dst, src, frames);
+    }
+
+    template<>
+    void stereo<sample_convert::S24>(int16_t *dst, const void *src, size_t frames, int channels) {
+        (void)channels;
+        stereo_scalar<sample_convert::S24>(dst, src, frames);
+    }
+
+    // the upper halves of 8 samples, packing saturates (they are in range)
+    __m128i shift_8(const int32_t *src) {
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *)src), 16),
+                               _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + 4)), 16));
+    }
+
+    template<>
+    void mono<sample_convert::S32>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int32_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            __m128i q = shift_8(s + i);
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi16(q, q));
+            _mm_storeu_si128((__m128i *)(dst + i * 2 + 8), _mm_unpackhi_epi16(q, q));
+        }
+        mono_scalar<sample_convert::S32>(dst, src, frames, i);
+    }
+
+    template<>
+    void stereo<sample_convert::S32>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const int32_t *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 4 <= frames; i += 4)
+            _mm_storeu_si128((__m128i *)(dst + i * 2), shift_8(s + i * 2));
+        stereo_scalar<sample_convert::S32>(dst, src, frames, i);
+    }
+
+    // the pairs of two frames side by side
+    __m128 load_pairs(const float *first, const float *second) {
+        return _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)first), (const __m64 *)second);
+    }
+
+    // the left and right of two frames
+    template<typename MIX>
+    __m128 mix_2(const float *frames) {
+        const float *next = frames + MIX::channels;
+        __m128 surround = simd::frame_pairs(frames[2], next[2]);
+
+        for (int pair = 0; pair < MIX::surround_pairs; ++pair)
+            surround = _mm_add_ps(surround, load_pairs(frames + 4 + pair * 2, next + 4 + pair * 2));
+        __m128 mixed = _mm_add_ps(load_pairs(frames, next), _mm_mul_ps(surround, _mm_set1_ps(MINUS_3_DB)));
+
+        return _mm_mul_ps(mixed, _mm_set1_ps(MIX::scale));
+    }
+
+    // mixes the frames 4 at a time, returns the number mixed
+    template<typename MIX>
+    size_t mix_frames(int16_t *dst, const float *frames, size_t count) {
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const float *f = frames + i * MIX::channels;
+            _mm_storeu_si128((__m128i *)(dst + i * 2),
+                             _mm_packs_epi32(simd::round_4(mix_2<MIX>(f)), simd::round_4(mix_2<MIX>(f + 2 * MIX::channels))));
+        }
+        return i;
+    }
+
+    template<>
+    void mono<sample_convert::FLOAT>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const float *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 8 <= frames; i += 8) {
+            __m128i q = _mm_packs_epi32(simd::convert_4(s + i), simd::convert_4(s + i + 4));
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi16(q, q));
+            _mm_storeu_si128((__m128i *)(dst + i * 2 + 8), _mm_unpackhi_epi16(q, q));
+        }
+        mono_scalar<sample_convert::FLOAT>(dst, src, frames, i);
+    }
+
+    template<>
+    void stereo<sample_convert::FLOAT>(int16_t *dst, const void *src, size_t frames, int channels) {
+        const auto *s = (const float *)src;
+        size_t i = 0;
+        (void)channels;
+
+        for (; i + 4 <= frames; i += 4)
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_packs_epi32(simd::convert_4(s + i * 2), simd::convert_4(s + i * 2 + 4)));
+        stereo_scalar<sample_convert::FLOAT>(dst, src, frames, i);
+    }
+
+    const char *instruction_set = "sse2";
+#else
+    template<format_t FORMAT>
+    void mono(int16_t *dst, const void *src, size_t frames, int channels) {
+        (void)channels;
+        mono_scalar<FORMAT>(dst, src, frames);
+    }
+
+    template<format_t FORMAT>
+    void stereo(int16_t *dst, const void *src, size_t frames, int channels) {
+        (void)channels;
+        stereo_scalar<FORMAT>(dst, src, frames);
+    }
+
+    template<typename MIX>
+    size_t mix_frames(int16_t *dst, const float *frames, size_t count) {
+        (void)dst, (void)frames, (void)count;
+        return 0;
+    }
+
+    const char *instruction_set = "scalar";
+#endif
+
+    template<typename MIX>
+    void mix_frame(int16_t *dst, const float *frame) {
+        float left = frame[0], right = frame[1], surround_left = frame[2], surround_right = frame[2];
+
+        for (int pair = 0; pair < MIX::surround_pairs; ++pair) {
+            surround_left += frame[4 + pair * 2];
+            surround_right += frame[5 + pair * 2];
+        }
+        dst[0] = to_s16((left + MINUS_3_DB * surround_left) * MIX::scale);
+        dst[1] = to_s16((right + MINUS_3_DB * surround_right) * MIX::scale);
+    }
+
+    template<format_t FORMAT, layout_t LAYOUT>
+    void downmix(int16_t *dst, const void *src, size_t frames, int channels) {
+        using mix = downmix_t<LAYOUT>;
+        float block[DOWNMIX_BLOCK_FRAMES * mix::channels];
+        (void)channels;
+
+        for (size_t first = 0; first < frames; first += DOWNMIX_BLOCK_FRAMES) {
+            size_t count = std::min(frames - first, DOWNMIX_BLOCK_FRAMES);
+
+            for (size_t i = 0; i < count * mix::channels; ++i)
+                block[i] = sample<FORMAT>(src, first * mix::channels + i);
+            for (size_t i = mix_frames<mix>(dst + first * 2, block, count); i < count; ++i)
+                mix_frame<mix>(dst + (first + i) * 2, block + i * mix::channels);
+        }
+    }
+
+    template<format_t FORMAT>
+    constexpr sample_convert::kernel_t kernels_of[sample_convert::NR_LAYOUTS] = {
+            {"mono", FORMAT, sample_convert::MONO, mono<FORMAT>},
+            {"stereo", FORMAT, sample_convert::STEREO, stereo<FORMAT>},
+            {"5.1 downmix", FORMAT, sample_convert::SURROUND_5_1, downmix<FORMAT, sample_convert::SURROUND_5_1>},
+            {"7.1 downmix", FORMAT, sample_convert::SURROUND_7_1, downmix<FORMAT, sample_convert::SURROUND_7_1>},
+            {"first two", FORMAT, sample_convert::OTHER, first_two<FORMAT>}};
+
+    const sample_convert::kernel_t *kernels[sample_convert::NR_FORMATS] = {
+            kernels_of<sample_convert::S16>, kernels_of<sample_convert::S24>, kernels_of<sample_convert::S32>,
+            kernels_of<sample_convert::FLOAT>};
+}
+
+size_t sample_convert::sample_size(format_t format) {
+    switch (format) {
+        case S16:
+            return sizeof(int16_t);
+        case S24:
+            return 3;
+        case S32:
+            return sizeof(int32_t);
+        default:
+            return sizeof(float);
+    }
+}
+
+sample_convert::layout_t sample_convert::layout(int channels) {
+    switch (channels) {
+        case 1:
+            return MONO;
+        case 2:
+            return STEREO;
+        case 6:
+            return SURROUND_5_1;
+        case 8:
+            return SURROUND_7_1;
+        default:
+            return OTHER;
+    }
+}
+
+const sample_convert::kernel_t *sample_convert::kernel(format_t format, int channels) {
+    if (channels < 1 || format < 0 || format >= NR_FORMATS)
+        return nullptr;
+
+    return &kernels[format][layout(channels)];
+}
+
+const char *sample_convert::format_string(format_t format) {
+    static const char *strings[NR_FORMATS] = {"s16", "s24", "s32", "float"};
+
+    return format >= 0 && format < NR_FORMATS ? strings[format] : "";
+}
+
+const char *sample_convert::kernel_name() {
+    return instruction_set;
+}
@@ -0,0 +1,39 @@
+#ifndef AES_MUSIC_PLAYER_APP_SAMPLE_CONVERT_H
+#define AES_MUSIC_PLAYER_APP_SAMPLE_CONVERT_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversion kernels of the frames a decoder reads to the interleaved 16-bit stereo frames of the stream.
+//
+// A kernel is specialised at compile time for the sample format and the channel layout of the input. Mono is played
+// on both channels, 5.1 and 7.1 (in the WAVE channel order) are downmixed with the side and back channels and the
+// center at -3 dB, the LFE dropped, scaled so the sum does not clip. Other layouts play their first two channels.
+// Integer samples are truncated to 16 bits, float ones rounded. The kernels run with NEON (SSE2 on x86): mono and
+// stereo input is converted 8 samples at a time, downmixed input is converted to float a block at a time and mixed 4
+// frames at a time (see sample_convert_bench for their rates).
+namespace sample_convert {
+    // S24: packed, little-endian (as read raw from a WAVE file), S32: as sf_read_int reads, FLOAT: in [-1.0, 1.0]
+    enum format_t {S16, S24, S32, FLOAT, NR_FORMATS};
+    enum layout_t {MONO, STEREO, SURROUND_5_1, SURROUND_7_1, OTHER, NR_LAYOUTS};
+
+    struct kernel_t {
+        const char *name;
+        format_t format;
+        layout_t layout;
+        // converts frames frames of channels channels (the count of the layout, any for OTHER)
+        void (*convert)(int16_t *dst, const void *src, size_t frames, int channels);
+    };
+
+    size_t sample_size(format_t format);
+    layout_t layout(int channels);
+    // the kernel for the format and channel count, nullptr if channels < 1
+    const kernel_t *kernel(format_t format, int channels);
+    const char *format_string(format_t format);
+    // the instruction set of the mono and stereo kernels built for the target
+    const char *kernel_name();
+}
+
+
+#endif //AES_MUSIC_PLAYER_APP_SAMPLE_CONVERT_H
@@ -0,0 +1,74 @@
+#ifndef AES_MUSIC_PLAYER_APP_SIMD_H
+#define AES_MUSIC_PLAYER_APP_SIMD_H
+
+
+// Helpers shared by the vector kernels of the samples (dma_copy, sample_convert, gain_stage, crossfade_mixer), for the
+// instruction set they are built with: NEON on the board, SSE2 on x86 (nothing without either). The vectors hold 4
+// samples of 32 bits, two stereo frames.
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+namespace simd {
+    // rounds half away from zero, the conversions saturate
+    inline int16x4_t round_4(float32x4_t samples) {
+        uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(samples), vdupq_n_u32(0x80000000));
+        float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+
+        return vqmovn_s32(vcvtq_s32_f32(vaddq_f32(samples, half)));
+    }
+
+    // 4 float samples in [-1, 1] to 16 bits
+    inline int16x4_t convert_4(const float *src) {
+        return round_4(vmulq_n_f32(vld1q_f32(src), 32767.0f));
+    }
+
+    // a value of each of two frames, a pair of lanes each
+    inline float32x4_t frame_pairs(float first, float second) {
+        return vcombine_f32(vdup_n_f32(first), vdup_n_f32(second));
+    }
+
+    // the first and the last two of 4 frames of 16 bits
+    inline float32x4_t widen_low(int16x8_t samples) {
+        return vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples)));
+    }
+
+    inline float32x4_t widen_high(int16x8_t samples) {
+        return vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples)));
+    }
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace simd {
+    // clamps first, the conversion gives INT32_MIN for large positive values; rounds half away from zero
+    inline __m128i round_4(__m128 samples) {
+        samples = _mm_min_ps(_mm_max_ps(samples, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+        __m128 half = _mm_or_ps(_mm_and_ps(samples, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+
+        return _mm_cvttps_epi32(_mm_add_ps(samples, half));
+    }
+
+    // 4 float samples in [-1, 1] to 16 bits (in 32-bit lanes, the packing saturates)
+    inline __m128i convert_4(const float *src) {
+        return round_4(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(32767.0f)));
+    }
+
+    // a value of each of two frames, a pair of lanes each
+    inline __m128 frame_pairs(float first, float second) {
+        return _mm_setr_ps(first, first, second, second);
+    }
+
+    // the first and the last two of 4 frames of 16 bits
+    inline __m128 widen_low(__m128i samples) {
+        return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+    }
+
+    inline __m128 widen_high(__m128i samples) {
+        return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+    }
+}
+#endif
+
+
+#endif //AES_MUSIC_PLAYER_APP_SIMD_H
@@ -1,44 +1,51 @@
 #include <sys/ioctl.h>
 #include <sstream>
-#include <fstream>
+#include <iomanip>
 #include <memory>
 #include "ui_thread.h"
 #include "player_thread.h"
 #include "directory_navigator.hpp"
 #include "util.h"
+#include "playback_source.h"
+#include "player_track.h"
+#include "play_queue.h"
 #include "aes_thread.h"
+#include "loudness.h"
+#include "loudness_thread.h"
 
 using player_thread_msg = player_thread::player_thread_msg;
 
-void ui_thread::_start_playing(const std::string& path, void *buffer, size_t buffer_size) const {
+void ui_thread::_start_playing(const std::string& path, void *buffer, size_t buffer_size, bool is_next) const {
     player_thread_msg player_tx_msg;
 
-    size_t size = buffer ? buffer_size : get_file_size(path);
-    void *buff = buffer ? buffer : malloc(size);
-    player_tx_msg.command = player_thread_msg::PLAY;
-    player_tx_msg.payload = size;
+    // play the decrypted buffer or map the file, the player decodes right from it
+    std::unique_ptr<playback_source> source = buffer ? std::make_unique<playback_source>(buffer, buffer_size)
+                                                     : std::make_unique<playback_source>(path);
+    player_tx_msg.payload = (long int)source->size();
+    // played at the reference loudness if it was measured
+    source->set_gain(loudness_meter::track_gain(path));
 
-    if (!buffer && buff) {
-        // fill buffer to play from file
-        std::ifstream in_file;
+    if (!is_next) {
+        playback_source *source_ptr = source.release();
+        player_tx_msg.command = player_thread_msg::PLAY;
 
-        in_file.open(path, std::ios::in | std::ios::binary | std::ios::ate);
-        if(!in_file) {
-            throw std::system_error(ENOENT, std::generic_category(), "Failed to open input file.");
-        }
-
-        in_file.seekg(0, std::ios::beg);
-        in_file.read((char *)buff, size);
-        in_file.close();
-    }
-
-    if (buff) {
         // send PLAY command
         write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
-        // send buffer address the file is loaded into
-        write(_ui_to_player_write_pipe_fd, &buff, sizeof(&buff));
+        // send the source to play, the player owns it from now on
+        write(_ui_to_player_write_pipe_fd, &source_ptr, sizeof(source_ptr));
     } else {
-        throw std::system_error(ENOMEM, std::generic_category(), "Failed to allocate memory for playing.");
+        // the next track is opened and its start decoded here, the player only splices it in
+        std::unique_ptr<player_track> track = player_track::open(std::move(source), PLAYER_TRACK_PREDECODE_MS);
+        if (!track)
+            throw std::runtime_error("Not a supported audio file.");
+
+        player_track *track_ptr = track.release();
+        player_tx_msg.command = player_thread_msg::QUEUE;
+
+        // send QUEUE command
+        write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+        // send the track, the player owns it from now on
+        write(_ui_to_player_write_pipe_fd, &track_ptr, sizeof(track_ptr));
     }
 }
 
@@ -52,6 +59,36 @@ void ui_thread::_stop_playing() const {
     write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
 }
 
+void ui_thread::_drop_next() const {
+    player_thread_msg player_tx_msg;
+
+    player_tx_msg.command = player_thread_msg::DEQUEUE;
+    player_tx_msg.payload = 0;
+
+    // send DEQUEUE command
+    write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+}
+
+void ui_thread::_seek(long int ms, bool is_absolute) const {
+    player_thread_msg player_tx_msg;
+
+    player_tx_msg.command = is_absolute ? player_thread_msg::SEEK_TO : player_thread_msg::SEEK;
+    player_tx_msg.payload = ms;
+
+    // send SEEK (SEEK_TO) command
+    write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+}
+
+void ui_thread::_pause(bool is_paused) const {
+    player_thread_msg player_tx_msg;
+
+    player_tx_msg.command = is_paused ? player_thread_msg::PAUSE : player_thread_msg::RESUME;
+    player_tx_msg.payload = 0;
+
+    // send PAUSE (RESUME) command
+    write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+}
+
 void ui_thread::_change_volume(int delta) const {
     player_thread_msg player_tx_msg;
 
@@ -62,6 +99,16 @@ void ui_thread::_change_volume(int delta) const {
     write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
 }
 
+void ui_thread::_dump_dma_stats() const {
+    player_thread_msg player_tx_msg;
+
+    _aes_inst.dump_dma_stats(stderr);
+
+    // the player writes the statistics of the I2S DMA
+    player_tx_msg.command = player_thread_msg::STATS;
+    write(_ui_to_player_write_pipe_fd, &player_tx_msg, sizeof(player_tx_msg));
+}
+
 void ui_thread::run() {
     // vector holding pointers to running AES thread instances
     std::vector<aes_thread *> aes_threads;
@@ -78,6 +125,25 @@ void ui_thread::run() {
     std::function is_file_pred = [](const directory_navigator<_file_status>::entry& e){ return !e.is_directory; };
     directory_navigator<_file_status> directory_navigator(_dir_name, is_file_pred, _file_status_string, nr_rows - 7);
 
+    // tracks played after the one started, the next one is prepared while the current one plays
+    play_queue queue;
+    queue.set_tracks(directory_navigator.get_entry_paths(is_file_pred));
+    // measures the loudness of the tracks not measured yet in the background
+    // TODO: key input
+    loudness_thread analyser(directory_navigator.get_entry_paths(is_file_pred),
+                             {0xFFFFFFFF, 0x00000000, 0xAAAAAAAA, 0xCCCCCCCC});
+    bool is_analysing = analyser.start();
+    // AES threads decrypting the track to play and the next track
+    aes_thread *play_decrypt = nullptr, *next_decrypt = nullptr;
+    // length of the track playing
+    long int track_ms = 0;
+    bool is_paused = false;
+    const auto& time_string = [](long int ms) {
+        std::ostringstream ss;
+        ss << ms / 60000 << ':' << std::setfill('0') << std::setw(2) << ms / 1000 % 60;
+        return ss.str();
+    };
+
     const auto& start_aes_thread = [&](aes_thread::operation_t operation, const std::array<uint32_t , 4> &key,
             const std::string& input_path, const std::string& output_path = "", void * output_buffer = nullptr, size_t output_buffer_size = 0) -> int {
         int p[2];
@@ -85,7 +151,7 @@ void ui_thread::run() {
             return -1;
 
         aes_to_ui_read_pipe_fds.push_back(p[0]);
-        aes_thread *t = new aes_thread(_aes_inst, operation, key, input_path, output_path, output_buffer, output_buffer_size, p[1]);
+        aes_thread *t = new aes_thread(_aes_inst, _index, operation, key, input_path, output_path, output_buffer, output_buffer_size, p[1]);
 
         if (t->start())
             aes_threads.push_back(t);
@@ -95,6 +161,47 @@ void ui_thread::run() {
         return 0;
     };
 
+    const auto& prepare_next = [&]() {
+        std::optional<std::string> next = queue.peek_next();
+
+        directory_navigator.change_tags(QUEUED, STOPPED);
+        next_decrypt = nullptr;
+        if (!next.has_value())
+            return;
+
+        try {
+            if (!is_encrypted(next.value())) {
+                _start_playing(next.value(), nullptr, 0, true);
+            } else {
+                // decrypt file into buffer
+                size_t file_size = get_file_size(next.value());
+                void *buff = malloc(file_size);
+                // TODO: key input
+                std::array<uint32_t , 4> key{0xFFFFFFFF, 0x00000000, 0xAAAAAAAA, 0xCCCCCCCC};
+
+                if (!buff || start_aes_thread(aes_thread::DECRYPT_INTO, key, next.value(), "", buff, file_size) != 0) {
+                    free(buff);
+                    directory_navigator.set_entry_suffix(next.value(), "Failed to prepare as the next track.");
+                    return;
+                }
+                next_decrypt = aes_threads.back();
+            }
+
+            if (next.value() != queue.get_current())
+                directory_navigator.set_entry_tag(next.value(), QUEUED);
+        } catch (const std::exception &e) {
+            directory_navigator.set_entry_suffix(next.value(), e.what());
+        }
+    };
+    // the next track changed, the one prepared is dropped
+    const auto& replace_next = [&]() {
+        if (!directory_navigator.has_any_tag(PLAYING))
+            return;
+
+        _drop_next();
+        prepare_next();
+    };
+
     while (true) {
         std::cout << "\033[H";
         std::cout << "\x1b[B" << "\x1b[B" << "\x1b[B" << "\x1b[B";
@@ -130,6 +237,11 @@ void ui_thread::run() {
 
             // TODO: inform all aes_thread threads to gracefully exit (a new pipe, or shared variable)
 
+            // the analyser drops the track it is on
+            analyser.stop();
+            if (is_analysing)
+                analyser.join();
+
             // close all pending aes_thread read channels
             for(const auto& e : aes_to_ui_read_pipe_fds) {
                 close(e);
@@ -147,13 +259,54 @@ void ui_thread::run() {
                 // handle ui_thread results
                 switch (player_rx_msg.command) {
                     case player_thread_msg::PLAY:
-                        if (player_rx_msg.result == player_thread_msg::SUCCESS)
+                        // in place of the track playing (faded out or stopped by the player)
+                        directory_navigator.change_tags(PLAYING, STOPPED);
+                        if (player_rx_msg.result == player_thread_msg::SUCCESS) {
                             directory_navigator.change_tags(PREPARING, PLAYING);
-                        else
+                            track_ms = player_rx_msg.payload;
+                            is_paused = false;
+                            prepare_next();
+                        } else {
                             directory_navigator.change_tags(PREPARING, STOPPED);
+                        }
+                        break;
+                    case player_thread_msg::QUEUE:
+                        if (player_rx_msg.result != player_thread_msg::SUCCESS)
+                            directory_navigator.change_tags(QUEUED, STOPPED);
+                        break;
+                    case player_thread_msg::NEXT: {
+                        // the next track is playing, the one after it is prepared
+                        std::optional<std::string> current = queue.advance();
+                        track_ms = player_rx_msg.payload;
+
+                        directory_navigator.change_tags(PLAYING, STOPPED);
+                        directory_navigator.change_tags(QUEUED, STOPPED);
+                        if (current.has_value())
+                            directory_navigator.set_entry_tag(current.value(), PLAYING);
+                        prepare_next();
+
+                        break;
+                    }
+                    case player_thread_msg::SEEK:
+                    case player_thread_msg::SEEK_TO:
+                        if (player_rx_msg.result == player_thread_msg::SUCCESS) {
+                            is_paused = false;
+                            directory_navigator.set_entry_suffix(queue.get_current(),
+                                                                 "at " + time_string(player_rx_msg.payload) + " / " + time_string(track_ms));
+                        }
+                        break;
+                    case player_thread_msg::PAUSE:
+                    case player_thread_msg::RESUME:
+                        if (player_rx_msg.result == player_thread_msg::SUCCESS) {
+                            is_paused = player_rx_msg.command == player_thread_msg::PAUSE;
+                            directory_navigator.set_entry_suffix(queue.get_current(), is_paused ? "paused" : "");
+                        }
                         break;
                     case player_thread_msg::STOP:
                         directory_navigator.change_tags(PLAYING, STOPPED);
+                        directory_navigator.change_tags(QUEUED, STOPPED);
+                        next_decrypt = nullptr;
+                        is_paused = false;
 
                         break;
                     default:
@@ -186,8 +339,18 @@ void ui_thread::run() {
                                         // set xattr of the temporary (encrypted) file to show it is encrypted
                                         bool xattr_val = true;
                                         if (setxattr(output_path.c_str(), "user.is_encrypted", &xattr_val, sizeof(xattr_val), 0) == 0) {
+                                            // the loudness of the content stays, it is stored for the encrypted file
+                                            loudness_meter::result_t loudness{};
+                                            bool has_loudness = loudness_meter::load(input_path, loudness);
                                             // rename temporary (encrypted) file to the original name (this will overwrite th original)
                                             rename(output_path.c_str(), input_path.c_str());
+                                            if (has_loudness)
+                                                loudness_meter::store(input_path, loudness);
+                                            // register the ciphertext, so other copies of the content are cloned from it
+                                            content_index::content_t content{};
+                                            std::array<uint32_t , 4> key = aes_t->get_key();
+                                            if (aes_t->get_content(content))
+                                                _index.add_ciphertext(content, key.data(), sizeof(key), input_path);
                                             // clear status message
                                             directory_navigator.set_entry_suffix(input_path, "");
                                         } else {
@@ -198,6 +361,7 @@ void ui_thread::run() {
                                         }
                                         // reopen directory to reflect changes
                                         directory_navigator.open_directory(_dir_name);
+                                        queue.set_tracks(directory_navigator.get_entry_paths(is_file_pred));
 
                                         break;
                                     }
@@ -206,22 +370,36 @@ void ui_thread::run() {
                                         break;
                                     }
                                     case aes_thread::DECRYPT: {
+                                        loudness_meter::result_t loudness{};
+                                        bool has_loudness = loudness_meter::load(input_path, loudness);
+
                                         // remove original (encrypted) file and rename temporary to original
                                         rename(output_path.c_str(), input_path.c_str());
+                                        if (has_loudness)
+                                            loudness_meter::store(input_path, loudness);
 
                                         // reopen directory to reflect changes
                                         directory_navigator.open_directory(_dir_name);
+                                        queue.set_tracks(directory_navigator.get_entry_paths(is_file_pred));
                                         // clear status message
                                         directory_navigator.set_entry_suffix(input_path, "");
 
                                         break;
                                     }
                                     case aes_thread::DECRYPT_INTO: {
-                                        // play decrypted content
+                                        const auto out = aes_t->get_output_buffer();
+
+                                        // decrypted for a track no longer to be played
+                                        if (aes_t != play_decrypt && aes_t != next_decrypt) {
+                                            free(out.second);
+                                            break;
+                                        }
+
+                                        // play decrypted content, right away or after the current track
                                         try {
-                                            const auto out = aes_t->get_output_buffer();
-                                            _start_playing(input_path, out.second, out.first);
-                                            directory_navigator.set_entry_tag(input_path, PREPARING);
+                                            _start_playing(input_path, out.second, out.first, aes_t == next_decrypt);
+                                            if (aes_t == play_decrypt)
+                                                directory_navigator.set_entry_tag(input_path, PREPARING);
                                         } catch (const std::exception &e) {
                                             directory_navigator.set_entry_suffix(input_path, e.what());
                                             directory_navigator.set_entry_tag(input_path, STOPPED);
@@ -249,6 +427,11 @@ void ui_thread::run() {
                             directory_navigator.set_entry_tag(aes_t->get_input_path(), STOPPED);
                     }
 
+                    if (aes_t == play_decrypt)
+                        play_decrypt = nullptr;
+                    if (aes_t == next_decrypt)
+                        next_decrypt = nullptr;
+
                     // free up AES thread instance
                     delete aes_t;
                     // remove instance from vector
@@ -279,10 +462,16 @@ void ui_thread::run() {
                             _stop_playing();
                         } else if(!directory_navigator.has_any_tag(PREPARING)) {
                             if (directory_navigator.has_any_tag(PLAYING)) {
-                                // stop the playing track and start the selected
-                                _stop_playing();
+                                // the playing track plays on until the selected one is prepared, the player fades
+                                // from it into the selected one
+                                _drop_next();
                             }
 
+                            // the prepared next track is dropped with the playing one
+                            directory_navigator.change_tags(QUEUED, STOPPED);
+                            next_decrypt = nullptr;
+                            queue.set_current(selected_entry.path);
+
                             // check if file is encrypted first
                             bool file_encrypted = is_encrypted(selected_entry.path);
 
@@ -308,10 +497,12 @@ void ui_thread::run() {
                                                                "",
                                                                buff,
                                                                file_size);
-                                        if (ret == 0)
+                                        if (ret == 0) {
+                                            play_decrypt = aes_threads.back();
                                             directory_navigator.set_entry_tag(selected_entry.path, PREPARING);
-                                        else
+                                        } else {
                                             directory_navigator.set_entry_suffix(selected_entry.path, "Failed to start AES thread.");
+                                        }
                                     } else {
                                         directory_navigator.set_entry_suffix(selected_entry.path, "Failed to allocate memory for decryption.");
                                     }
@@ -358,6 +549,48 @@ void ui_thread::run() {
 
                         break;
                     }
+                    case 'q':
+                        // play the selected after the current track (and the ones queued before)
+                        queue.enqueue(selected_entry.path);
+                        directory_navigator.set_entry_suffix(selected_entry.path,
+                                                             "queued (" + std::to_string(queue.queued()) + ")");
+                        if (queue.queued() == 1)
+                            replace_next();
+
+                        break;
+                    case 'm':
+                        // change the order the tracks are played in after the current one
+                        queue.set_mode((play_queue::mode_t)((queue.get_mode() + 1) % play_queue::NR_MODES));
+                        directory_navigator.set_entry_suffix(selected_entry.path,
+                                                             std::string("play order: ") + play_queue::mode_string(queue.get_mode()));
+                        if (queue.queued() == 0)
+                            replace_next();
+
+                        break;
+                    case ',': case '.':
+                        // seek back and forward in the track playing ('<' and '>' unshifted)
+                        if (directory_navigator.has_any_tag(PLAYING))
+                            _seek(stdin_buff[0] == ',' ? -UI_SEEK_STEP_MS : UI_SEEK_STEP_MS, false);
+
+                        break;
+                    case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+                        // seek to the tenth of the track
+                        if (directory_navigator.has_any_tag(PLAYING))
+                            _seek(track_ms / 10 * (stdin_buff[0] - '0'), true);
+
+                        break;
+                    case 'p':
+                        // pause and resume the track playing
+                        if (directory_navigator.has_any_tag(PLAYING))
+                            _pause(!is_paused);
+
+                        break;
+                    case 's':
+                        _dump_dma_stats();
+                        analyser.dump_stats(stderr);
+                        directory_navigator.set_entry_suffix(selected_entry.path, "DMA and loudness statistics written to stderr");
+
+                        break;
                     case 0x5B:
                         if (ret > 2) {
                             switch (stdin_buff[2]) {
@@ -395,6 +628,7 @@ const char *ui_thread::_file_status_string(ui_thread::_file_status s) {
     {
         case PREPARING:   return "preparing to play...";
         case PLAYING:   return "♪ playing ♪";
+        case QUEUED:    return "up next";
         default:      return "";
     }
 }
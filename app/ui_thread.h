@@ -6,11 +6,16 @@
 
 #include "pthread_wrapper.h"
 #include "aes.h"
+#include "content_index.h"
+
+// step of seeking back and forward
+#define UI_SEEK_STEP_MS 10000
 
 class ui_thread : public pthread_wrapper {
 public:
-    ui_thread(aes &aes_inst, std::string dir_name, int main_to_ui_read_pipe_fd, int player_to_ui_read_pipe_fd, int ui_to_player_write_pipe_fd) :
+    ui_thread(aes &aes_inst, content_index &index, std::string dir_name, int main_to_ui_read_pipe_fd, int player_to_ui_read_pipe_fd, int ui_to_player_write_pipe_fd) :
         _aes_inst(aes_inst),
+        _index(index),
         _dir_name(std::move(dir_name)),
         _main_to_ui_read_pipe_fd(main_to_ui_read_pipe_fd),
         _player_to_ui_read_pipe_fd(player_to_ui_read_pipe_fd),
@@ -21,16 +26,24 @@ protected:
 
 private:
     aes& _aes_inst;
+    content_index& _index;
     std::string _dir_name;
     int _main_to_ui_read_pipe_fd;
     int _player_to_ui_read_pipe_fd, _ui_to_player_write_pipe_fd;
 
-    enum _file_status {STOPPED, PREPARING, PLAYING};
+    enum _file_status {STOPPED, PREPARING, PLAYING, QUEUED};
 
 
-    void _start_playing(const std::string& path, void *buffer = nullptr, size_t buffer_size = 0) const;
+    // is_next: played after the current track instead of right away
+    void _start_playing(const std::string& path, void *buffer = nullptr, size_t buffer_size = 0, bool is_next = false) const;
     void _stop_playing() const;
+    void _drop_next() const;
+    // by ms, or to ms if is_absolute
+    void _seek(long int ms, bool is_absolute) const;
+    // sends PAUSE, or RESUME
+    void _pause(bool is_paused) const;
     void _change_volume(int val) const;
+    void _dump_dma_stats() const;
     static inline const char* _file_status_string(_file_status s);
     static unsigned short _get_terminal_height();
 };
@@ -1,6 +1,9 @@
+#include <ctime>
 #include <filesystem>
 #include <sys/xattr.h>
 
+#include "util.h"
+
 size_t get_file_size(const std::string& path) {
     std::filesystem::path p(path);
 
@@ -15,3 +18,10 @@ bool is_encrypted(const std::string& path) {
 
     return ret > 0 && xattr_val;
 }
+
+double now_us() {
+    struct timespec ts{};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
@@ -10,5 +10,7 @@ constexpr size_t aligned_size(size_t size, size_t alignment = 16) {
 
 size_t get_file_size(const std::string& path);
 bool is_encrypted(const std::string& path);
+// the monotonic clock, in us
+double now_us();
 
 #endif //AES_MUSIC_PLAYER_APP_UTIL_H
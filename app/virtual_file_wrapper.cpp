@@ -6,6 +6,12 @@ void virtual_file_wrapper::open(void *buffer, sf_count_t buffer_size) {
     _buffer = buffer;
     _buffer_size = buffer_size;
     _offset = 0;
+    _source = nullptr;
+}
+
+void virtual_file_wrapper::open(playback_source &source) {
+    open(const_cast<void *>(source.data()), (sf_count_t)source.size());
+    _source = &source;
 }
 
 SF_VIRTUAL_IO *virtual_file_wrapper::as_sf_virtual_io() {
@@ -41,6 +47,9 @@ sf_count_t virtual_file_wrapper::_read(void *ptr, sf_count_t count) {
     memcpy(ptr, (char *)_buffer + _offset, actual_count);
     _offset += actual_count;
 
+    if (_source)
+        _source->advise((size_t)_offset);
+
     return actual_count;
 }
 
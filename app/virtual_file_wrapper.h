@@ -6,11 +6,15 @@
 
 #include <functional>
 
+#include "playback_source.h"
+
 class virtual_file_wrapper {
 public:
     virtual_file_wrapper() : virtual_file_wrapper(nullptr, 0) {};
     virtual_file_wrapper(void *buffer, sf_count_t buffer_size) : _buffer(buffer), _buffer_size(buffer_size), _offset(0) {};
     void open(void *buffer, sf_count_t buffer_size);
+    // reads the source in place (for reading only), advising it of the position
+    void open(playback_source &source);
     SF_VIRTUAL_IO *as_sf_virtual_io();
 private:
     sf_count_t _get_filelen();
@@ -39,6 +43,7 @@ private:
 
     void *_buffer;
     sf_count_t _buffer_size, _offset;
+    playback_source *_source = nullptr;
 };
 
 
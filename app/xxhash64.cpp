@@ -0,0 +1,133 @@
+#include "xxhash64.h"
+
+#include <cstring>
+#include <algorithm>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define XXH_STRIPE_SIZE 32
+
+namespace {
+    inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // unaligned little-endian reads (the target is little-endian)
+    inline uint64_t read64(const uint8_t *p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t read32(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * XXH_PRIME64_2;
+        acc = rotl(acc, 31);
+        return acc * XXH_PRIME64_1;
+    }
+
+    inline uint64_t merge_round(uint64_t acc, uint64_t val) {
+        acc ^= round(0, val);
+        return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    // processes every full stripe of data, returns the number of bytes consumed
+    size_t consume_stripes(uint64_t acc[4], const uint8_t *data, size_t size) {
+        const uint8_t *p = data, *end = data + size;
+
+        // four independent lanes, the compiler can keep them in registers
+        while (end - p >= XXH_STRIPE_SIZE) {
+            acc[0] = round(acc[0], read64(p));
+            acc[1] = round(acc[1], read64(p + 8));
+            acc[2] = round(acc[2], read64(p + 16));
+            acc[3] = round(acc[3], read64(p + 24));
+            p += XXH_STRIPE_SIZE;
+        }
+
+        return p - data;
+    }
+}
+
+void xxhash64::reset(uint64_t seed) {
+    _seed = seed;
+    _acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    _acc[1] = seed + XXH_PRIME64_2;
+    _acc[2] = seed;
+    _acc[3] = seed - XXH_PRIME64_1;
+    _total_size = 0;
+    _buffer_size = 0;
+}
+
+void xxhash64::update(const void *data, size_t size) {
+    auto *p = (const uint8_t *)data;
+
+    _total_size += size;
+
+    // complete the buffered stripe first
+    if (_buffer_size) {
+        size_t n = std::min(size, (size_t)XXH_STRIPE_SIZE - _buffer_size);
+
+        memcpy(_buffer + _buffer_size, p, n);
+        _buffer_size += n;
+        p += n;
+        size -= n;
+
+        if (_buffer_size < XXH_STRIPE_SIZE)
+            return;
+        consume_stripes(_acc, _buffer, XXH_STRIPE_SIZE);
+        _buffer_size = 0;
+    }
+
+    size_t consumed = consume_stripes(_acc, p, size);
+    memcpy(_buffer, p + consumed, size - consumed);
+    _buffer_size = size - consumed;
+}
+
+uint64_t xxhash64::digest() const {
+    const uint8_t *p = _buffer, *end = _buffer + _buffer_size;
+    uint64_t h;
+
+    if (_total_size >= XXH_STRIPE_SIZE) {
+        h = rotl(_acc[0], 1) + rotl(_acc[1], 7) + rotl(_acc[2], 12) + rotl(_acc[3], 18);
+        for (uint64_t acc : _acc)
+            h = merge_round(h, acc);
+    } else {
+        h = _seed + XXH_PRIME64_5;
+    }
+
+    h += _total_size;
+
+    for (; end - p >= 8; p += 8)
+        h = rotl(h ^ round(0, read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    if (end - p >= 4) {
+        h = rotl(h ^ (uint64_t)read32(p) * XXH_PRIME64_1, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        h = rotl(h ^ (uint64_t)*p * XXH_PRIME64_5, 11) * XXH_PRIME64_1;
+
+    // avalanche
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+uint64_t xxhash64::hash(const void *data, size_t size, uint64_t seed) {
+    xxhash64 state(seed);
+
+    state.update(data, size);
+    return state.digest();
+}
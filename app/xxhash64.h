@@ -0,0 +1,30 @@
+#ifndef AES_MUSIC_PLAYER_APP_XXHASH64_H
+#define AES_MUSIC_PLAYER_APP_XXHASH64_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming implementation of the XXH64 non-cryptographic hash (https://github.com/Cyan4973/xxHash).
+// Only used to recognize identical contents, it gives no protection against deliberate collisions.
+class xxhash64 {
+public:
+    explicit xxhash64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0);
+    void update(const void *data, size_t size);
+    uint64_t digest() const;
+
+    static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+
+private:
+    uint64_t _acc[4]{};
+    uint64_t _seed = 0;
+    uint64_t _total_size = 0;
+    // input not yet processed (less than a stripe)
+    uint8_t _buffer[32]{};
+    size_t _buffer_size = 0;
+};
+
+
+#endif //AES_MUSIC_PLAYER_APP_XXHASH64_H
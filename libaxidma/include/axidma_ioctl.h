@@ -108,6 +108,7 @@ struct axidma_transaction {
     int channel_id;                 // The id of the DMA channel to use
     void *buf;                      // The buffer used for the transaction
     size_t buf_len;                 // The length of the buffer
+    unsigned int transaction_id;    // Output, the id of the transaction
 
     // Kept as a union for extend ability.
     union {
@@ -125,6 +126,32 @@ struct axidma_inout_transaction {
     void *rx_buf;                   // The buffer to place the data in
     size_t rx_buf_len;              // The length of the receive buffer
     struct axidma_video_frame rx_frame; // Frame information for receive.
+    unsigned int tx_transaction_id; // Output, the id of the transmit transaction
+    unsigned int rx_transaction_id; // Output, the id of the receive transaction
+};
+
+struct axidma_iovec {
+    void *buf;                      // The buffer of the vector entry
+    size_t len;                     // The length of the buffer
+};
+
+struct axidma_iov_transaction {
+    bool wait;                      // Indicates if the call is blocking
+    int tx_channel_id;              // The id of the transmit DMA channel
+    struct axidma_iovec *tx_iov;    // The buffers containing the data to send
+    int tx_iovcnt;                  // The number of transmit buffers (0: none)
+    int rx_channel_id;              // The id of the receive DMA channel
+    struct axidma_iovec *rx_iov;    // The buffers to place the data in
+    int rx_iovcnt;                  // The number of receive buffers (0: none)
+    unsigned int tx_transaction_id; // Output, the id of the transmit transaction
+    unsigned int rx_transaction_id; // Output, the id of the receive transaction
+};
+
+struct axidma_wait {
+    int channel_id;                 // The id of the DMA channel
+    unsigned int transaction_id;    // The id of the transaction to wait for
+    int timeout_ms;                 // Timeout, 0 to poll, negative for none
+    int status;                     // Output, the status of the transaction
 };
 
 struct axidma_video_transaction {
@@ -134,6 +161,67 @@ struct axidma_video_transaction {
     struct axidma_video_frame frame;        // Information about the frame
 };
 
+struct axidma_completion_fd {
+    int channel_id;                 // The id of the DMA channel
+    int fd;                         // The eventfd to signal, or -1 to detach
+};
+
+struct axidma_completion {
+    unsigned int transaction_id;    // The id of the completed transaction
+    int status;                     // 0 if the transaction succeeded
+    unsigned long long timestamp_ns;    // Completion time (CLOCK_MONOTONIC)
+};
+
+struct axidma_reap {
+    int channel_id;                 // The id of the DMA channel
+    int max_completions;            // The capacity of the completions array
+    struct axidma_completion *completions;  // Array filled with completions
+    int num_completions;            // Output, the number of completions
+};
+
+struct axidma_cyclic_transaction {
+    int channel_id;                 // The id of the DMA channel to use
+    void *buf;                      // The ring of period buffers
+    size_t period_len;              // The length of a period
+    int num_periods;                // The number of periods in the ring
+};
+
+struct axidma_cyclic_status {
+    int channel_id;                 // The id of the DMA channel
+    unsigned long long periods_completed;   // Output, periods since the start
+};
+
+// The number of buckets of the latency histograms of a channel
+#define AXIDMA_STATS_BUCKETS            32
+
+/* Bucket 0 of a histogram counts the times under 1 ns, bucket i the times in
+ * [2^(i-1), 2^i) ns, and the last bucket the longer ones. */
+struct axidma_stats {
+    int channel_id;                 // The id of the DMA channel
+    bool reset;                     // Clear the statistics after reading them
+    unsigned long long elapsed_ns;  // Output, time since the last reset
+    unsigned long long bytes;       // Output, bytes of completed transactions
+    unsigned long long transactions;    // Output, completed transactions
+    unsigned long long errors;      // Output, transactions that failed
+    unsigned long long busy_ns;     // Output, time with transactions in flight
+    unsigned long long latency_total_ns;    // Output, sum of the latencies
+    unsigned long long latency_histogram[AXIDMA_STATS_BUCKETS];  // Output
+    unsigned long long idle_total_ns;   // Output, sum of the idle gaps
+    unsigned long long idle_histogram[AXIDMA_STATS_BUCKETS];     // Output
+};
+
+/* The completion status of a channel, in the status page of the device. The
+ * ids only move forward, as the transactions of a channel finish in order. */
+struct axidma_chan_status {
+    unsigned int finished_id;       // Last transaction finished (0: none yet)
+    unsigned int cancelled_id;      // Last transaction cancelled (0: none yet)
+};
+
+struct axidma_polling {
+    int channel_id;                 // The id of the DMA channel
+    bool enable;                    // Only publish completions in the page
+};
+
 /*----------------------------------------------------------------------------
  * IOCTL Interface
  *----------------------------------------------------------------------------*/
@@ -141,8 +229,29 @@ struct axidma_video_transaction {
 // The magic number used to distinguish IOCTL's for our device
 #define AXIDMA_IOCTL_MAGIC              'W'
 
+// The number of completions a channel queues for AXIDMA_REAP
+#define AXIDMA_COMPLETION_QUEUE_SIZE    32
+
+// The maximum number of buffers in each direction of a vectored transfer
+#define AXIDMA_MAX_IOVECS               16
+
+// The number of transactions that can be in flight on a channel
+#define AXIDMA_MAX_IN_FLIGHT            16
+
+/* The largest transaction id. The ids go from 1 to it and wrap around, so that
+ * they stay positive in the int the library returns them as. */
+#define AXIDMA_MAX_TRANSACTION_ID       0x7FFFFFFF
+
 // The number of IOCTL's implemented, used for verification
-#define AXIDMA_NUM_IOCTLS               10
+#define AXIDMA_NUM_IOCTLS               19
+
+/* The offset of the status page of the device. Mapping a page (read-only) at
+ * this offset, instead of allocating DMA memory, gives the completion status
+ * of the channels, an array of struct axidma_chan_status indexed by channel
+ * id. The driver updates it as soon as a transaction finishes, so a caller can
+ * wait for a transaction by spinning on it, and use AXIDMA_WAIT for the status
+ * once it has a cancelled id at or after its own. */
+#define AXIDMA_STATUS_OFFSET            0x40000000
 
 /**
  * Returns the number of available DMA channels in the system.
@@ -250,6 +359,9 @@ struct axidma_video_transaction {
  *  - channel_id - The id for the channel you want receive data over.
  *  - buf - The address of the buffer you want to receive the data in.
  *  - buf_len - The number of bytes to receive.
+ *
+ * Outputs:
+ *  - transaction_id - The id reported when the transaction completes.
  **/
 #define AXIDMA_DMA_READ                 _IOR(AXIDMA_IOCTL_MAGIC, 4, \
                                              struct axidma_transaction)
@@ -271,6 +383,9 @@ struct axidma_video_transaction {
  *  - channel_id - The id for the channel you want to send data over.
  *  - buf - The address of the data you want to send.
  *  - buf_len - The number of bytes to send.
+ *
+ * Outputs:
+ *  - transaction_id - The id reported when the transaction completes.
  **/
 #define AXIDMA_DMA_WRITE                _IOR(AXIDMA_IOCTL_MAGIC, 5, \
                                              struct axidma_transaction)
@@ -296,6 +411,10 @@ struct axidma_video_transaction {
  *  - tx_buf_len - The number of bytes you want to send.
  *  - rx_buf - The address of the buffer you want to receive data in.
  *  - rx_buf_len - The number of bytes you want to receive.
+ *
+ * Outputs:
+ *  - tx_transaction_id - The id of the transmit transaction.
+ *  - rx_transaction_id - The id of the receive transaction.
  **/
 #define AXIDMA_DMA_READWRITE            _IOR(AXIDMA_IOCTL_MAGIC, 6, \
                                              struct axidma_inout_transaction)
@@ -386,6 +505,188 @@ struct axidma_video_transaction {
  **/
 #define AXIDMA_UNREGISTER_BUFFER        _IO(AXIDMA_IOCTL_MAGIC, 10)
 
+/**
+ * Sets the eventfd signalled when transactions on a DMA channel complete.
+ *
+ * Once a channel has an eventfd, its asynchronous transactions are no longer
+ * reported with the signal set by AXIDMA_SET_DMA_SIGNAL. Instead, each
+ * completion is queued in the driver and the eventfd is incremented, so the
+ * completions can be handled from an event loop (poll, select or epoll) and
+ * collected with AXIDMA_REAP. This avoids running user code in a signal
+ * handler.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *  - fd - An eventfd created by the process, or -1 to detach the current one
+ *         and go back to signal notification.
+ **/
+#define AXIDMA_SET_COMPLETION_FD        _IOR(AXIDMA_IOCTL_MAGIC, 11, \
+                                             struct axidma_completion_fd)
+
+/**
+ * Collects the completed transactions of a DMA channel.
+ *
+ * Returns the transactions that completed on a channel with an eventfd since
+ * the last call, oldest first. The queue holds AXIDMA_COMPLETION_QUEUE_SIZE
+ * entries, completions beyond that are dropped until it is reaped.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *  - max_completions - The number of entries the completions array can hold.
+ *  - completions - The array to fill with the completions.
+ *
+ * Outputs:
+ *  - num_completions - The number of completions written to the array.
+ **/
+#define AXIDMA_REAP                     _IOWR(AXIDMA_IOCTL_MAGIC, 12, \
+                                              struct axidma_reap)
+
+/**
+ * Starts a cyclic transfer over a ring of period buffers on a DMA channel.
+ *
+ * The channel transfers the periods of the ring one after the other, and
+ * wraps around to the first one after the last, until it is stopped with the
+ * stop dma channel ioctl. Each completed period is reported: the channel's
+ * completion eventfd (if it has one) is incremented, otherwise the DMA signal
+ * is sent. The application refills the periods behind the position of the
+ * DMA while it keeps running, the number of completed periods is returned by
+ * AXIDMA_GET_CYCLIC_STATUS.
+ *
+ * The ring (num_periods * period_len bytes) must be within an address range
+ * that was allocated by a call to mmap with the AXI DMA device. This call is
+ * always non-blocking.
+ *
+ * Inputs:
+ *  - channel_id - The id for the channel you want to use.
+ *  - buf - The address of the first period of the ring.
+ *  - period_len - The number of bytes in a period.
+ *  - num_periods - The number of periods in the ring (at least 2).
+ **/
+#define AXIDMA_DMA_CYCLIC               _IOR(AXIDMA_IOCTL_MAGIC, 13, \
+                                             struct axidma_cyclic_transaction)
+
+/**
+ * Returns the number of periods completed by the cyclic transfer of a channel.
+ *
+ * The count starts from 0 when the cyclic transfer is started and never wraps
+ * around with the ring, so the period being transferred is the count modulo
+ * the number of periods.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *
+ * Outputs:
+ *  - periods_completed - The number of periods completed since the start.
+ **/
+#define AXIDMA_GET_CYCLIC_STATUS        _IOWR(AXIDMA_IOCTL_MAGIC, 14, \
+                                              struct axidma_cyclic_status)
+
+/**
+ * Performs a vectored transfer, with a scatter-gather list in each direction.
+ *
+ * This is the same as AXIDMA_DMA_READWRITE, except that the data to send and
+ * the data received are described by arrays of buffers. The buffers of a
+ * direction are transferred in order as a single transaction, each one being
+ * a descriptor of the scatter-gather list, so the data does not have to be
+ * gathered into a single buffer first. Either direction can be left out by
+ * setting its number of buffers to 0, making it a one-way transfer. If the
+ * call blocks, it waits for the receive transaction, or for the transmit one
+ * when there is no receive direction.
+ *
+ * Each buffer must be within an address range that was allocated by a call to
+ * mmap with the AXI DMA device, or registered with AXIDMA_REGISTER_BUFFER.
+ *
+ * Inputs:
+ *  - wait - Indicates if the call should be blocking or non-blocking
+ *  - tx_channel_id - The id for the channel you want transmit data on.
+ *  - tx_iov - The array of buffers containing the data you want to send.
+ *  - tx_iovcnt - The number of transmit buffers (at most AXIDMA_MAX_IOVECS).
+ *  - rx_channel_id - The id for the channel you want to receive data on.
+ *  - rx_iov - The array of buffers you want to receive data in.
+ *  - rx_iovcnt - The number of receive buffers (at most AXIDMA_MAX_IOVECS).
+ *
+ * Outputs:
+ *  - tx_transaction_id - The id of the transmit transaction.
+ *  - rx_transaction_id - The id of the receive transaction.
+ **/
+#define AXIDMA_DMA_IOV                  _IOWR(AXIDMA_IOCTL_MAGIC, 15, \
+                                              struct axidma_iov_transaction)
+
+/**
+ * Waits for a transaction of a channel to finish.
+ *
+ * Each non-blocking transfer returns the id of its transactions, and up to
+ * AXIDMA_MAX_IN_FLIGHT transactions can be queued on a channel. The DMA engine
+ * moves from one to the next without waiting for userspace, which can wait for
+ * (or poll) each of them individually with this call. The transactions of a
+ * channel finish in the order they were submitted.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel the transaction was submitted on.
+ *  - transaction_id - The id returned when the transaction was submitted.
+ *  - timeout_ms - The time to wait in milliseconds, 0 to only check the state
+ *                 of the transaction, negative to wait without a timeout.
+ *
+ * Outputs:
+ *  - status - 0 if the transaction completed, -ECANCELED if it was stopped by
+ *             AXIDMA_STOP_DMA_CHANNEL, -ETIME if it is still in flight, or
+ *             -EINVAL if no transaction was submitted with the id.
+ **/
+#define AXIDMA_WAIT                     _IOWR(AXIDMA_IOCTL_MAGIC, 16, \
+                                              struct axidma_wait)
+
+/**
+ * Gets the statistics of a channel.
+ *
+ * The driver counts the transactions of each channel as they are submitted and
+ * completed, whichever way the completions are reported. The latency of a
+ * transaction is the time from its submission to its completion. An idle gap
+ * is the time from the completion leaving the channel without transactions in
+ * flight to the next submission. The periods of a cyclic transfer count as
+ * transactions, the channel is busy while it runs. The latencies are only
+ * taken for one-shot transactions.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel to get the statistics of.
+ *  - reset - Whether to clear the statistics after reading them.
+ *
+ * Outputs:
+ *  - elapsed_ns - The time since the statistics were cleared (or the driver
+ *                 was loaded).
+ *  - bytes, transactions - The data moved by the completed transactions.
+ *  - errors - The number of transactions that could not be prepared or
+ *             submitted, and of blocking transactions that failed.
+ *  - busy_ns - The time the channel had transactions in flight.
+ *  - latency_total_ns, latency_histogram - The sum and the histogram of the
+ *                                          latencies.
+ *  - idle_total_ns, idle_histogram - The sum and the histogram of the idle
+ *                                    gaps.
+ **/
+#define AXIDMA_GET_STATS                _IOWR(AXIDMA_IOCTL_MAGIC, 17, \
+                                              struct axidma_stats)
+
+/**
+ * Switches the polling mode of a channel.
+ *
+ * The completions of a channel in polling mode are only published in the
+ * status page (see AXIDMA_STATUS_OFFSET): no signal is sent, and nothing is
+ * queued for AXIDMA_REAP. For small transfers, sending the signal and handling
+ * it takes longer than the transfer, a caller spinning on the page sees the
+ * completion within microseconds. The mode is cleared when the device is
+ * closed.
+ *
+ * The status page and this IOCTL came together: a driver that maps the page
+ * fails this IOCTL with ENODEV for a negative channel id, without changing
+ * anything, while an older one does not know it (ENOTTY). An older driver
+ * does not refuse a mapping at AXIDMA_STATUS_OFFSET, it ignores the offset.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel, negative to probe for support.
+ *  - enable - Whether the channel is in polling mode.
+ **/
+#define AXIDMA_SET_POLLING              _IOR(AXIDMA_IOCTL_MAGIC, 18, \
+                                              struct axidma_polling)
+
 #ifdef __cplusplus
 }
 #endif
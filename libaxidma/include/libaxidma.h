@@ -6,11 +6,18 @@
  *
  * This file defines the interface to the AXI DMA device through the AXI DMA
  * library.
+ *
+ * The functions can be called from several threads at once. The transfers on
+ * different channels do not wait for each other in the library, the channels
+ * have their own locks; only registering and unregistering external buffers
+ * excludes the transfers for a moment.
  **/
 
 #ifndef LIBAXIDMA_H_
 #define LIBAXIDMA_H_
 
+#include <stdio.h>          // Stream the statistics are written to
+
 #include "axidma_ioctl.h"   // Video frame structure
 
 #ifdef __cplusplus
@@ -143,7 +150,31 @@ const array_t *axidma_get_vdma_rx(axidma_dev_t dev);
 void *axidma_malloc(axidma_dev_t dev, size_t size);
 
 /**
- * Frees a DMA buffer previously allocated by #axidma_malloc.
+ * Allocates ordinary, cached memory of \p size bytes that DMA transfers can
+ * use without copying it into a buffer of #axidma_malloc.
+ *
+ * The memory is backed by a memfd, whose pages are exported as a DMA buffer
+ * through /dev/udmabuf and registered with the driver (see
+ * #axidma_register_buffer) once. Unlike the memory of #axidma_malloc, it is
+ * cached, so the CPU works on it at full speed, such as when decoding into it.
+ * It is not contiguous in physical memory, a transfer gets a scatter-gather
+ * entry for each page (or run of contiguous pages) it spans. The DMA engine
+ * has a limited number of descriptors, so large transfers from this memory
+ * may fail to be prepared.
+ *
+ * The transfer functions write back the cache before a transfer. Before the
+ * CPU reads data the DMA engine wrote, #axidma_sync_for_cpu has to be called.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] size The size of the buffer in bytes, rounded up to pages.
+ * @return The address of buffer on success, NULL on failure (e.g. if the
+ *         kernel has no udmabuf support).
+ **/
+void *axidma_malloc_cached(axidma_dev_t dev, size_t size);
+
+/**
+ * Frees a DMA buffer previously allocated by #axidma_malloc or
+ * #axidma_malloc_cached.
  *
  * This function will abort if \p addr is not an address previously returned by
  * #axidma_malloc, or if \p size does not match the value used when the buffer
@@ -163,7 +194,12 @@ void axidma_free(axidma_dev_t dev, void *addr, size_t size);
  * driver. For example, you might want to perform DMA transfers on a frame
  * buffer allocated by a display rendering manager (DRM) driver. Registering
  * the DMA buffer allows for the AXI DMA device to access it and perform
- * transfers.
+ * transfers. The buffer does not need to be contiguous in physical memory.
+ *
+ * The registrations are cached by address range, registering a range within a
+ * registered buffer again returns immediately, so a buffer can be registered
+ * before each use. Transfers on a registered buffer that is cached by the CPU
+ * need #axidma_sync_for_cpu before the CPU reads what the DMA engine wrote.
  *
  * @param[in] dev An #axidma_dev_t returned by #axidma_init.
  * @param[in] dmabuf_fd File descriptor corresponding to the buffer. This
@@ -190,13 +226,59 @@ int axidma_register_buffer(axidma_dev_t dev, int dmabuf_fd, void *user_addr,
  **/
 void axidma_unregister_buffer(axidma_dev_t dev, void *user_addr);
 
+/**
+ * Gives a registered external buffer back to the CPU after a transfer.
+ *
+ * The cache lines of the buffer are invalidated, so the CPU reads what the DMA
+ * engine wrote into it. Does nothing for a buffer of #axidma_malloc.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] addr Address within the buffer.
+ * @param[in] len Number of bytes the CPU is going to access.
+ * @return 0 on success, a negative integer on failure.
+ **/
+int axidma_sync_for_cpu(axidma_dev_t dev, void *addr, size_t len);
+
+/**
+ * Hands a registered external buffer over to the DMA engine.
+ *
+ * The cache lines of the buffer the CPU wrote are written back to memory. The
+ * transfer functions do this for their buffers, so it is only needed for
+ * buffers of cyclic transfers, which are refilled while the DMA is running.
+ * Does nothing for a buffer of #axidma_malloc.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] addr Address within the buffer.
+ * @param[in] len Number of bytes the CPU wrote.
+ * @return 0 on success, a negative integer on failure.
+ **/
+int axidma_sync_for_device(axidma_dev_t dev, void *addr, size_t len);
+
+/**
+ * Returns whether the CPU caches a DMA buffer.
+ *
+ * The memory of #axidma_malloc is mapped uncached, every access of the CPU
+ * goes out to memory. Stores are only combined when they are sequential and
+ * fill whole lines, and loads are not prefetched, so bulk copies into or out
+ * of these buffers need kernels suited to it. The memory of
+ * #axidma_malloc_cached and the registered external buffers are cached.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] addr Address within a DMA buffer.
+ * @param[in] len Number of bytes from \p addr.
+ * @return True if the range is within a cached buffer, false otherwise.
+ **/
+bool axidma_is_cached(axidma_dev_t dev, const void *addr, size_t len);
+
 /**
  * Registers a user callback function to be invoked upon completion of an
  * asynchronous transfer for the specified DMA channel.
  *
  * The callback will be invoked with a POSIX real-time signal, so it will
  * happen as soon as possible to the completion. The \p data will be passed to
- * the callback function. This function can never fail.
+ * the callback function. This function can never fail. It can be called while
+ * transfers complete, the signal handler sees either the old or the new
+ * callback along with its data.
  *
  * @param[in] dev An #axidma_dev_t returned by #axidma_init.
  * @param[in] channel DMA channel to register the callback for.
@@ -226,7 +308,8 @@ void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
  * @param[in] len Number of bytes that will be transfered.
  * @param[in] wait Indicates if the transfer should be synchronous or
  *                 asynchronous. If true, this function will block.
- * @return 0 upon success, a negative number on failure.
+ * @return The id of the transaction (positive) upon success, a negative number
+ *         on failure. The id is reported by #axidma_reap on completion.
  **/
 int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf, size_t len,
         bool wait);
@@ -259,13 +342,64 @@ int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf, size_t len,
  *                     channel. Should be set to NULL for non-VDMA transfers.
  * @param[in] wait Indicates if the transfer should be synchronous or
  *                 asynchronous. If true, this function will block.
- * @return 0 upon success, a negative number on failure.
+ * @return The id of the receive transaction (positive) upon success, a
+ *         negative number on failure.
  **/
 int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
         size_t tx_len, struct axidma_video_frame *tx_frame, int rx_channel,
         void *rx_buf, size_t rx_len, struct axidma_video_frame *rx_frame,
         bool wait);
 
+/**
+ * Performs a single vectored DMA transfer in the specified direction on the DMA
+ * channel.
+ *
+ * This is the same as #axidma_oneway_transfer, except that the data is
+ * described by an array of buffers. The buffers are transferred in order as a
+ * single transaction, each one being a descriptor of the scatter-gather list,
+ * so they do not have to be copied into one buffer first.
+ *
+ * Each buffer must be within a buffer that was previously allocated by
+ * #axidma_malloc or registered with #axidma_register_buffer.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transfer is performed on.
+ * @param[in] iov Array of the buffers to transfer.
+ * @param[in] iovcnt Number of buffers in \p iov, at most #AXIDMA_MAX_IOVECS.
+ * @param[in] wait Indicates if the transfer should be synchronous or
+ *                 asynchronous. If true, this function will block.
+ * @return The id of the transaction (positive) upon success, a negative number
+ *         on failure.
+ **/
+int axidma_oneway_transfer_iov(axidma_dev_t dev, int channel,
+        const struct axidma_iovec *iov, int iovcnt, bool wait);
+
+/**
+ * Performs two coupled vectored DMA transfers, one in the receive direction,
+ * the other in the transmit direction.
+ *
+ * This is the same as #axidma_twoway_transfer for DMA channels, except that
+ * the data of each direction is described by an array of buffers, as with
+ * #axidma_oneway_transfer_iov.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] tx_channel DMA channel the transmit transfer is performed on.
+ * @param[in] tx_iov Array of the buffers to transmit.
+ * @param[in] tx_iovcnt Number of buffers in \p tx_iov, at most
+ *                      #AXIDMA_MAX_IOVECS.
+ * @param[in] rx_channel DMA channel the receive transfer is performed on.
+ * @param[in] rx_iov Array of the buffers to receive into.
+ * @param[in] rx_iovcnt Number of buffers in \p rx_iov, at most
+ *                      #AXIDMA_MAX_IOVECS.
+ * @param[in] wait Indicates if the transfer should be synchronous or
+ *                 asynchronous. If true, this function will block.
+ * @return The id of the receive transaction (positive) upon success, a
+ *         negative number on failure.
+ **/
+int axidma_twoway_transfer_iov(axidma_dev_t dev, int tx_channel,
+        const struct axidma_iovec *tx_iov, int tx_iovcnt, int rx_channel,
+        const struct axidma_iovec *rx_iov, int rx_iovcnt, bool wait);
+
 /**
  * Starts a video DMA (VDMA) loop/continuous transfer on the given channel.
  *
@@ -298,7 +432,10 @@ int axidma_video_transfer(axidma_dev_t dev, int display_channel, size_t width,
 /**
  * Stops the DMA transfer on specified DMA channel.
  *
- * This function stops transfers on either DMA or VDMA channels.
+ * This function stops transfers on either DMA or VDMA channels. The
+ * transactions queued on the channel are cancelled: on a channel with a
+ * completion descriptor, each asynchronous one is reported by #axidma_reap
+ * with a status of -ECANCELED.
  *
  * This function will abort if the channel is invalid, or if the DMA channel
  * currently has no running transaction on it.
@@ -308,6 +445,181 @@ int axidma_video_transfer(axidma_dev_t dev, int display_channel, size_t width,
  **/
 void axidma_stop_transfer(axidma_dev_t dev, int channel);
 
+/**
+ * Returns a file descriptor that becomes readable when transactions complete
+ * on the specified DMA channel.
+ *
+ * The descriptor is an eventfd, created on the first call and owned by the
+ * library. Once a channel has one, its asynchronous completions are no longer
+ * delivered through the real-time signal, so the callback registered with
+ * #axidma_set_callback is not invoked for it. Instead, the descriptor can be
+ * waited on with poll, select or epoll, and the completed transactions
+ * collected with #axidma_reap outside of signal context.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the completion descriptor for.
+ * @return The file descriptor upon success, -1 if the driver does not support
+ *         completion descriptors (the callback keeps working in that case).
+ **/
+int axidma_get_completion_fd(axidma_dev_t dev, int channel);
+
+/**
+ * Collects the transactions that completed on the specified DMA channel.
+ *
+ * Returns the completions queued since the last call, oldest first, and
+ * resets the readiness of the descriptor returned by
+ * #axidma_get_completion_fd. Each completion carries the id returned by the
+ * transfer function, its status and the time the driver saw it complete
+ * (CLOCK_MONOTONIC). Never blocks, returns 0 if nothing has completed.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to reap the completions of.
+ * @param[out] completions Array to fill with the completions.
+ * @param[in] max_completions Number of entries \p completions can hold.
+ * @return The number of completions written, a negative number on failure.
+ **/
+int axidma_reap(axidma_dev_t dev, int channel,
+        struct axidma_completion *completions, int max_completions);
+
+/**
+ * Waits for a transaction on the specified DMA channel to finish.
+ *
+ * Up to #AXIDMA_MAX_IN_FLIGHT non-blocking transfers can be queued on a
+ * channel, the DMA engine starts each of them as soon as the previous one
+ * completed. The id returned by the transfer function identifies the
+ * transaction, the transactions of a channel finish in the order they were
+ * submitted. Waiting does not consume the completion, it is still reported
+ * through the completion descriptor or the callback.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transaction was submitted on.
+ * @param[in] transaction_id The id returned by the transfer function.
+ * @param[in] timeout_ms Time to wait in milliseconds, 0 to only check the
+ *                       state of the transaction, negative to wait without a
+ *                       timeout.
+ * @return 0 if the transaction completed, -ETIME if it is still in flight,
+ *         -ECANCELED if it was stopped by #axidma_stop_transfer, -EINVAL if no
+ *         such transaction was submitted, another negative number on failure.
+ **/
+int axidma_wait(axidma_dev_t dev, int channel, int transaction_id,
+        int timeout_ms);
+
+/**
+ * Sets whether the specified DMA channel is in polling mode.
+ *
+ * In polling mode, the one-shot transactions of the channel are waited on with
+ * #axidma_poll, their completions are neither delivered to the callback nor
+ * queued for #axidma_reap. This saves the signal or the wakeup of the event
+ * loop on every transaction, which dominates the latency of small transfers.
+ * The periods of cyclic transfers are still reported as usual.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to set the mode of.
+ * @param[in] enable Whether the channel is in polling mode.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_set_polling(axidma_dev_t dev, int channel, bool enable);
+
+/**
+ * Waits for a transaction on the specified DMA channel to finish, spinning
+ * first.
+ *
+ * The driver publishes the last transaction finished on each channel in a
+ * page mapped by #axidma_init. This spins on it for up to \p spin_us
+ * microseconds, which catches the completion without sleeping when the
+ * transfer is short, then sleeps in #axidma_wait for the rest of the timeout.
+ * A transaction that may have been stopped is also handed to #axidma_wait, for
+ * its exact status. Without the page (an older driver), this is #axidma_wait.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transaction was submitted on.
+ * @param[in] transaction_id The id returned by the transfer function.
+ * @param[in] spin_us Time to spin for in microseconds, before sleeping.
+ * @param[in] timeout_ms Time to wait in milliseconds after spinning, as for
+ *                       #axidma_wait.
+ * @return The status of the transaction, as for #axidma_wait.
+ **/
+int axidma_poll(axidma_dev_t dev, int channel, int transaction_id,
+        int spin_us, int timeout_ms);
+
+/**
+ * Starts a cyclic DMA transfer over a ring of period buffers on the specified
+ * DMA channel.
+ *
+ * The DMA engine transfers the periods one after the other, wrapping around to
+ * the first one after the last, until #axidma_stop_transfer is called. This
+ * suits continuous streams: the application keeps refilling (transmit) or
+ * draining (receive) the periods the DMA has completed, while it works on the
+ * others. A completion is reported for every period, through the channel's
+ * completion descriptor (#axidma_get_completion_fd) if it has one, otherwise
+ * through the registered callback.
+ *
+ * The ring of \p num_periods * \p period_len bytes starting at \p buf must be
+ * within a single buffer allocated by #axidma_malloc. The period to refill
+ * next is the count returned by #axidma_get_cyclic_periods modulo
+ * \p num_periods. If the application falls behind by the whole ring, the DMA
+ * transfers stale periods (underrun), which the application can detect by
+ * comparing that count with the number of periods it has filled.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the cyclic transfer is performed on.
+ * @param[in] buf Address of the first period of the ring.
+ * @param[in] period_len Number of bytes in a period.
+ * @param[in] num_periods Number of periods in the ring, at least 2.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_cyclic_transfer(axidma_dev_t dev, int channel, void *buf,
+        size_t period_len, int num_periods);
+
+/**
+ * Returns the number of periods the cyclic transfer on the specified DMA
+ * channel has completed since it was started.
+ *
+ * The count does not wrap around with the ring. The pending count of the
+ * channel's completion descriptor is consumed, so it becomes readable again
+ * when the next period completes.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel of the cyclic transfer.
+ * @return The number of completed periods, a negative number on failure.
+ **/
+long long axidma_get_cyclic_periods(axidma_dev_t dev, int channel);
+
+/**
+ * Gets the statistics of the specified DMA channel.
+ *
+ * The driver counts the bytes, transactions and errors of each channel, the
+ * time it has transactions in flight, and keeps histograms (in power of two
+ * buckets) of the latency of the transactions, from submission to
+ * completion, and of the idle gaps, from the completion leaving the channel
+ * idle to the next submission. They are kept whichever way the completions
+ * are reported, and cost the transfers only a few additions. See
+ * #AXIDMA_GET_STATS for the details.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the statistics of.
+ * @param[out] stats The statistics of the channel.
+ * @param[in] reset Whether to clear the statistics after reading them.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_get_stats(axidma_dev_t dev, int channel, struct axidma_stats *stats,
+        bool reset);
+
+/**
+ * Writes the statistics of all DMA channels of the device to a stream.
+ *
+ * For each channel, a summary (throughput, utilization, mean latency and idle
+ * gap) and the non-empty buckets of the histograms are written in a readable
+ * form, prefixed with \p name.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] name Name of the device in the output, or NULL.
+ * @param[in] stream The stream to write the statistics to.
+ * @param[in] reset Whether to clear the statistics after writing them.
+ **/
+void axidma_dump_stats(axidma_dev_t dev, const char *name, FILE *stream,
+        bool reset);
+
 #ifdef __cplusplus
 }
 #endif
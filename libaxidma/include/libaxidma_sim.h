@@ -0,0 +1,166 @@
+/**
+ * @file libaxidma_sim.h
+ *
+ * This file defines the controls of the simulated AXI DMA library.
+ *
+ * The simulated library (libaxidma_sim.so) implements the interface of
+ * libaxidma.h without the AXI DMA driver, so applications can be run and
+ * tested on a host. These functions are only available in the simulated
+ * library.
+ *
+ * An application is simulated by linking it against libaxidma_sim.so, or, at
+ * run time, by preloading it (LD_PRELOAD=libaxidma_sim.so) in front of
+ * libaxidma.so. The controls of the channels are then taken from the
+ * environment variables below when a device is opened, they apply to every
+ * channel.
+ **/
+
+#ifndef LIBAXIDMA_SIM_H_
+#define LIBAXIDMA_SIM_H_
+
+#include <stddef.h>         // Size type
+
+#include "libaxidma.h"      // AXI DMA device type
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The channel ids of the simulated device, it has one channel in each direction
+#define AXIDMA_SIM_TX_CHANNEL               0
+#define AXIDMA_SIM_RX_CHANNEL               1
+
+// The rate of a cyclic transfer on a channel without a rate, in bytes/second
+// (16-bit stereo audio at 48 kHz)
+#define AXIDMA_SIM_DEFAULT_CYCLIC_RATE      192000.0
+
+// The environment variables of the controls (see the functions below)
+#define AXIDMA_SIM_RATE_ENV                 "AXIDMA_SIM_RATE"
+#define AXIDMA_SIM_LATENCY_ENV              "AXIDMA_SIM_LATENCY_US"
+#define AXIDMA_SIM_JITTER_ENV               "AXIDMA_SIM_JITTER_US"
+#define AXIDMA_SIM_ERROR_RATE_ENV           "AXIDMA_SIM_ERROR_RATE"
+#define AXIDMA_SIM_SEED_ENV                 "AXIDMA_SIM_SEED"
+
+/**
+ * Type definition for the data port of a simulated channel.
+ *
+ * On a transmit channel, the port is invoked with the data the simulated
+ * device consumed. On a receive channel, the port fills the data the
+ * simulated device produces. For cyclic transfers, it is invoked with each
+ * period when the simulated device is done with it.
+ **/
+typedef void (*axidma_sim_port_t)(int channel_id, void *data, size_t len,
+                                  void *user_data);
+
+/**
+ * Type definition for the transform of the simulated device.
+ *
+ * The transform produces the received data of a two-way transfer from its
+ * transmitted data, in place of the loopback, as a core between the two
+ * channels would. The buffers of each direction are passed as one stream.
+ * The part of the receive buffer it does not write is left as it is.
+ **/
+typedef void (*axidma_sim_transform_t)(const void *tx_data, size_t tx_len,
+                                       void *rx_data, size_t rx_len,
+                                       void *user_data);
+
+/**
+ * Sets the rate the simulated device transfers the data on a channel with.
+ *
+ * A transfer of len bytes completes len / \p bytes_per_second seconds after it
+ * was started. With a rate of 0 (the default), one-shot transfers complete
+ * immediately and cyclic transfers run at #AXIDMA_SIM_DEFAULT_CYCLIC_RATE.
+ * The rate of a running cyclic transfer changes from its next period.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel The channel to set the rate of.
+ * @param[in] bytes_per_second The rate of the channel, 0 for the default.
+ **/
+void axidma_sim_set_rate(axidma_dev_t dev, int channel,
+                         double bytes_per_second);
+
+/**
+ * Connects a data port to a channel of the simulated device.
+ *
+ * Without a port, the data transmitted by a two-way transfer is looped back
+ * to its receive buffer, the data of a one-way transmit transfer is dropped
+ * and a one-way receive transfer receives zeros.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel The channel to connect the port to.
+ * @param[in] port The port function, or NULL to disconnect.
+ * @param[in] user_data Generic user data that is passed to the port.
+ **/
+void axidma_sim_set_port(axidma_dev_t dev, int channel, axidma_sim_port_t port,
+                         void *user_data);
+
+/**
+ * Sets the latency and the jitter of the transfers on a channel.
+ *
+ * The latency is added to a one-shot transfer for each of its buffers (the
+ * descriptors of the driver), on top of the time given by the rate, and it
+ * delays the transfers queued after it. The jitter delays the completion of
+ * a transfer by a uniformly distributed random time up to \p jitter_us,
+ * without delaying the next transfer. The periods of a cyclic transfer keep
+ * their rate, the latency and the jitter delay their reports. Both are 0 by
+ * default.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel The channel to set the latency of.
+ * @param[in] latency_us The latency of a buffer, in microseconds.
+ * @param[in] jitter_us The longest random delay of a completion, in
+ *                      microseconds.
+ **/
+void axidma_sim_set_latency(axidma_dev_t dev, int channel, double latency_us,
+                            double jitter_us);
+
+/**
+ * Sets the probability of the one-shot transfers on a channel failing.
+ *
+ * A failed transfer takes its time, but moves no data. Its transactions
+ * complete with a status of -EIO, which #axidma_reap and #axidma_wait report,
+ * and a blocking transfer returns -EIO. The callbacks are invoked as for a
+ * successful transfer. Unlike with the driver, where a failed transaction
+ * halts the channel until it is stopped, the next transfers run normally.
+ * The default is 0.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel The channel to set the error rate of. The two-way
+ *                    transfers are queued on (and failed by) the receive
+ *                    channel.
+ * @param[in] probability The probability of a transfer failing, in [0, 1].
+ **/
+void axidma_sim_set_error_rate(axidma_dev_t dev, int channel,
+                               double probability);
+
+/**
+ * Seeds the random number generator of the jitter and the failures.
+ *
+ * The generator is seeded with the same value whenever a device is opened,
+ * so runs with the same transfers draw the same delays and failures.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] seed The seed of the generator.
+ **/
+void axidma_sim_set_seed(axidma_dev_t dev, unsigned int seed);
+
+/**
+ * Sets the transform of the two-way transfers of the simulated device.
+ *
+ * Without a transform (the default), the transmitted data is looped back. A
+ * port on the receive channel takes precedence over the transform. The
+ * transform is invoked on the thread of the receive channel, the time it
+ * takes delays the completion of the transfer.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] transform The transform function, or NULL for the loopback.
+ * @param[in] user_data Generic user data that is passed to the transform.
+ **/
+void axidma_sim_set_transform(axidma_dev_t dev,
+        axidma_sim_transform_t transform, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBAXIDMA_SIM_H_ */
@@ -10,9 +10,12 @@
  * @bug No known bugs.
  **/
 
+#define _GNU_SOURCE             // Memfd_create() system call
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>             // Memset and memcpy functions
 #include <fcntl.h>              // Flags for open()
@@ -23,6 +26,12 @@
 #include <unistd.h>             // Close() system call
 #include <errno.h>              // Error codes
 #include <signal.h>             // Signal handling functions
+#include <pthread.h>            // Locks of the channels and the buffers
+#include <stdatomic.h>          // Callbacks read in the signal handler
+#include <time.h>               // Clock of the busy-polling
+#include <sys/eventfd.h>        // Completion eventfd
+#include <linux/dma-buf.h>      // Cache synchronization of DMA buffers
+#include <linux/udmabuf.h>      // Export of memfd pages as DMA buffers
 
 #include "libaxidma.h"          // Local definitions
 #include "axidma_ioctl.h"       // The IOCTL interface to AXI DMA
@@ -31,16 +40,35 @@
  * Internal definitions
  *----------------------------------------------------------------------------*/
 
-// A structure that holds metadata about each channel
+/* A structure that holds metadata about each channel. The id, direction and
+ * type do not change after the channels are probed. The callback is read by
+ * the signal handler, which cannot take a lock, so its updates are published
+ * through a sequence count instead. */
 typedef struct dma_channel {
     enum axidma_dir dir;        ///< Direction of the channel
     enum axidma_type type;      ///< Type of the channel
     int channel_id;             ///< Integer id of the channel.
-    axidma_cb_t callback;       ///< Callback function for channel completion
-    void *user_data;            ///< User data to pass to the callback
+    pthread_mutex_t lock;       ///< Serializes the updates of the channel
+    atomic_uint callback_seq;   ///< Odd while the callback is being updated
+    _Atomic(axidma_cb_t) callback;  ///< Callback function for completion
+    _Atomic(void *) user_data;  ///< User data to pass to the callback
+    int completion_fd;          ///< Eventfd signalled on completion, or -1
 } dma_channel_t;
 
-// The structure that represents the AXI DMA device
+// The device exporting ordinary memory as DMA buffers
+#define UDMABUF_DEV_PATH        "/dev/udmabuf"
+
+// A structure that holds an external DMA buffer registered with the driver
+typedef struct dma_import {
+    char *addr;                 ///< User address of the buffer
+    size_t size;                ///< Size of the buffer
+    int dmabuf_fd;              ///< The DMA buffer file descriptor
+    int memfd;                  ///< Memfd backing the buffer, or -1 if not ours
+} dma_import_t;
+
+/* The structure that represents the AXI DMA device. The transfers of different
+ * channels share no state in the library, each channel has its own lock. Only
+ * the registered external buffers are shared, behind a read-write lock. */
 struct axidma_dev {
     int fd;                     ///< File descriptor for the device
     array_t dma_tx_chans;       ///< Channel id's for the DMA transmit channels
@@ -49,6 +77,11 @@ struct axidma_dev {
     array_t vdma_rx_chans;      ///< Channel id's for the VDMA receive channels
     int num_channels;           ///< The total number of DMA channels
     dma_channel_t *channels;    ///< All of the VDMA/DMA channels in the system
+    pthread_rwlock_t imports_lock;  ///< Protects the registered buffers
+    dma_import_t *imports;      ///< Registered external buffers, by address
+    atomic_int num_imports;     ///< The number of registered external buffers
+    atomic_int last_import;     ///< Index of the last buffer looked up
+    const volatile struct axidma_chan_status *status_page;  ///< Or NULL
 };
 
 /*----------------------------------------------------------------------------
@@ -131,8 +164,11 @@ static int categorize_channels(axidma_dev_t dev,
         dma_chan->dir = chan->dir;
         dma_chan->type = chan->type;
         dma_chan->channel_id = chan->channel_id;
-        dma_chan->callback = NULL;
-        dma_chan->user_data = NULL;
+        pthread_mutex_init(&dma_chan->lock, NULL);
+        atomic_init(&dma_chan->callback_seq, 0);
+        atomic_init(&dma_chan->callback, NULL);
+        atomic_init(&dma_chan->user_data, NULL);
+        dma_chan->completion_fd = -1;
     }
 
     // Assign the length of the arrays
@@ -181,11 +217,34 @@ static int probe_channels(axidma_dev_t dev)
     return rc;
 }
 
+/* Reads the callback of the channel along with its user data. A read that
+ * overlapped an update (made on another thread, the updating thread blocks the
+ * signal) is retried. */
+static axidma_cb_t load_callback(dma_channel_t *chan, void **user_data)
+{
+    unsigned int seq;
+    axidma_cb_t callback;
+
+    do
+    {
+        seq = atomic_load_explicit(&chan->callback_seq, memory_order_acquire);
+        callback = atomic_load_explicit(&chan->callback, memory_order_relaxed);
+        *user_data = atomic_load_explicit(&chan->user_data,
+                                          memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) != 0 || seq != atomic_load_explicit(&chan->callback_seq,
+                                                           memory_order_relaxed));
+
+    return callback;
+}
+
 static void axidma_callback(int signal, siginfo_t *siginfo, void *context)
 {
     struct axidma_dev *dev = (struct axidma_dev *)siginfo->si_ptr;
     int channel_id = siginfo->si_errno;
     dma_channel_t *chan;
+    axidma_cb_t callback;
+    void *user_data;
 
     assert(dev != NULL);
     assert(channel_id >= 0);
@@ -197,8 +256,9 @@ static void axidma_callback(int signal, siginfo_t *siginfo, void *context)
 
     // If the user defined a callback for a given channel, invoke it
     chan = &dev->channels[channel_id];
-    if (chan->callback != NULL) {
-        chan->callback(channel_id, chan->user_data);
+    callback = load_callback(chan, &user_data);
+    if (callback != NULL) {
+        callback(channel_id, user_data);
     }
 
     return;
@@ -268,6 +328,191 @@ static unsigned long dir_to_ioctl(enum axidma_dir dir)
     return 0;
 }
 
+/* Finds the index of the registered external buffer the given range falls
+ * within, or -1. The buffer found last is checked first, as the transfers
+ * tend to reuse the same buffers, then the sorted array is searched. Called
+ * with the buffers locked, the index found last is only a hint. */
+static int find_import(axidma_dev_t dev, const void *addr, size_t len)
+{
+    int low, high, mid, last;
+    const char *start;
+    dma_import_t *import;
+
+    start = (const char *)addr;
+    last = atomic_load_explicit(&dev->last_import, memory_order_relaxed);
+    if (last < dev->num_imports) {
+        import = &dev->imports[last];
+        if (import->addr <= start && start + len <= import->addr + import->size) {
+            return last;
+        }
+    }
+
+    // Find the last buffer starting at or before the range
+    low = 0;
+    high = dev->num_imports - 1;
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        if (dev->imports[mid].addr <= start) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    if (high < 0) {
+        return -1;
+    }
+    import = &dev->imports[high];
+    if (start + len > import->addr + import->size) {
+        return -1;
+    }
+
+    atomic_store_explicit(&dev->last_import, high, memory_order_relaxed);
+    return high;
+}
+
+/* Checks whether the given range falls within a registered external buffer.
+ * Most applications register none, their transfers do not take the lock. */
+static bool is_imported(axidma_dev_t dev, const void *addr, size_t len)
+{
+    bool is_found;
+
+    if (atomic_load_explicit(&dev->num_imports, memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    pthread_rwlock_rdlock(&dev->imports_lock);
+    is_found = find_import(dev, addr, len) >= 0;
+    pthread_rwlock_unlock(&dev->imports_lock);
+
+    return is_found;
+}
+
+/* Adds a registered external buffer to the array, keeping it sorted. Called
+ * with the buffers locked for writing. */
+static int add_import(axidma_dev_t dev, void *addr, size_t size, int dmabuf_fd,
+                      int memfd)
+{
+    int i;
+    dma_import_t *imports;
+
+    imports = (dma_import_t *)realloc(dev->imports,
+            (dev->num_imports + 1) * sizeof(dev->imports[0]));
+    if (imports == NULL) {
+        return -ENOMEM;
+    }
+    dev->imports = imports;
+
+    for (i = dev->num_imports; i > 0 && imports[i - 1].addr > (char *)addr; i--)
+    {
+        imports[i] = imports[i - 1];
+    }
+    imports[i].addr = (char *)addr;
+    imports[i].size = size;
+    imports[i].dmabuf_fd = dmabuf_fd;
+    imports[i].memfd = memfd;
+    dev->num_imports += 1;
+    atomic_store_explicit(&dev->last_import, i, memory_order_relaxed);
+
+    return 0;
+}
+
+/* Removes a registered external buffer from the array, releasing its memory
+ * if the library allocated it. Called with the buffers locked for writing. */
+static void remove_import(axidma_dev_t dev, int index)
+{
+    dma_import_t *import;
+
+    import = &dev->imports[index];
+    if (import->memfd >= 0) {
+        munmap(import->addr, import->size);
+        close(import->dmabuf_fd);
+        close(import->memfd);
+    }
+
+    memmove(&dev->imports[index], &dev->imports[index + 1],
+            (dev->num_imports - index - 1) * sizeof(dev->imports[0]));
+    dev->num_imports -= 1;
+    atomic_store_explicit(&dev->last_import, 0, memory_order_relaxed);
+}
+
+/* Registers an external DMA buffer with the driver, unless the range is within
+ * one registered already. The memfd backing it is given if the library
+ * allocated the buffer, and released along with the registration. */
+static int register_import(axidma_dev_t dev, int dmabuf_fd, void *user_addr,
+                           size_t size, int memfd)
+{
+    int rc;
+    struct axidma_register_buffer register_buffer;
+
+    pthread_rwlock_wrlock(&dev->imports_lock);
+    if (find_import(dev, user_addr, size) >= 0) {
+        rc = 0;
+        goto unlock;
+    }
+
+    // Setup the argument structure to the IOCTL
+    register_buffer.fd = dmabuf_fd;
+    register_buffer.size = size;
+    register_buffer.user_addr = user_addr;
+
+    // Perform the buffer registration with the driver
+    rc = ioctl(dev->fd, AXIDMA_REGISTER_BUFFER, &register_buffer);
+    if (rc < 0) {
+        perror("Failed to register the external DMA buffer");
+        goto unlock;
+    }
+
+    rc = add_import(dev, user_addr, size, dmabuf_fd, memfd);
+    if (rc < 0) {
+        ioctl(dev->fd, AXIDMA_UNREGISTER_BUFFER, user_addr);
+    }
+
+unlock:
+    pthread_rwlock_unlock(&dev->imports_lock);
+    return rc;
+}
+
+// Synchronizes the caches for a registered external buffer
+static int sync_import(axidma_dev_t dev, void *addr, size_t len,
+                       unsigned long long flags)
+{
+    int rc, index;
+    struct dma_buf_sync sync;
+
+    // The memory of axidma_malloc is not cached
+    if (atomic_load_explicit(&dev->num_imports, memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&dev->imports_lock);
+    rc = 0;
+    index = find_import(dev, addr, len);
+    if (index >= 0) {
+        sync.flags = flags | DMA_BUF_SYNC_RW;
+        rc = ioctl(dev->imports[index].dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync);
+        if (rc < 0) {
+            perror("Failed to synchronize the external DMA buffer");
+        }
+    }
+    pthread_rwlock_unlock(&dev->imports_lock);
+
+    return rc;
+}
+
+/* Checks that the driver maps the status page, by probing for the polling
+ * IOCTL that came with it: a negative channel id fails with ENODEV on a
+ * driver that has it, and changes nothing. */
+static bool has_status_page(axidma_dev_t dev)
+{
+    struct axidma_polling polling;
+
+    polling.channel_id = -1;
+    polling.enable = false;
+    return ioctl(dev->fd, AXIDMA_SET_POLLING, &polling) < 0 && errno == ENODEV;
+}
+
 /*----------------------------------------------------------------------------
  * Public Interface
  *----------------------------------------------------------------------------*/
@@ -284,6 +529,7 @@ struct axidma_dev *axidma_init_dev(unsigned int index)
     const unsigned int pathlen = sizeof(AXIDMA_DEV_PATH) + 10;
     char path[pathlen];
     struct axidma_dev *dev;
+    void *status_page;
 
     dev = (struct axidma_dev *)calloc(1, sizeof(struct axidma_dev));
     if (dev == NULL) {
@@ -299,6 +545,9 @@ struct axidma_dev *axidma_init_dev(unsigned int index)
     else
         dev->fd = open(AXIDMA_DEV_PATH, O_RDWR|O_EXCL);
 
+    pthread_rwlock_init(&dev->imports_lock, NULL);
+    atomic_init(&dev->num_imports, 0);
+    atomic_init(&dev->last_import, 0);
     if (dev->fd < 0) {
         perror("Error opening AXI DMA device");
         fprintf(stderr, "Expected the AXI DMA device at the path `%s`\n",
@@ -320,6 +569,16 @@ struct axidma_dev *axidma_init_dev(unsigned int index)
         return NULL;
     }
 
+    /* Map the status page for axidma_poll. An older driver ignores the offset
+     * and would map a page of DMA memory instead, so its support is probed
+     * first. Without it, the polling falls back to AXIDMA_WAIT. */
+    dev->status_page = NULL;
+    if (has_status_page(dev)) {
+        status_page = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, dev->fd,
+                           AXIDMA_STATUS_OFFSET);
+        dev->status_page = (status_page == MAP_FAILED) ? NULL : status_page;
+    }
+
     // Return the AXI DMA device to the user
     return dev;
 }
@@ -327,6 +586,28 @@ struct axidma_dev *axidma_init_dev(unsigned int index)
 // Tears down the given AXI DMA device structure
 void axidma_destroy(axidma_dev_t dev)
 {
+    int i;
+
+    // Close the completion eventfds, the driver releases them on close
+    for (i = 0; i < dev->num_channels; i++)
+    {
+        if (dev->channels[i].completion_fd >= 0) {
+            close(dev->channels[i].completion_fd);
+        }
+        pthread_mutex_destroy(&dev->channels[i].lock);
+    }
+
+    // Release the memory allocated by axidma_malloc_cached
+    while (dev->num_imports > 0)
+    {
+        remove_import(dev, dev->num_imports - 1);
+    }
+    free(dev->imports);
+    pthread_rwlock_destroy(&dev->imports_lock);
+    if (dev->status_page != NULL) {
+        munmap((void *)dev->status_page, getpagesize());
+    }
+
     // Free the arrays used for channel id's and channel metadata
     free(dev->vdma_rx_chans.data);
     free(dev->vdma_tx_chans.data);
@@ -383,13 +664,100 @@ void *axidma_malloc(axidma_dev_t dev, size_t size)
     return addr;
 }
 
+/* Allocates ordinary, cached memory for DMA transfers. The pages of a sealed
+ * memfd are exported as a DMA buffer by udmabuf, and registered with the
+ * driver once. */
+void *axidma_malloc_cached(axidma_dev_t dev, size_t size)
+{
+    int memfd, udmabuf_fd, dmabuf_fd;
+    long page_size;
+    void *addr;
+    struct udmabuf_create create;
+    struct dma_buf_sync sync;
+
+    // Udmabuf exports whole pages
+    page_size = sysconf(_SC_PAGESIZE);
+    size = (size + page_size - 1) / page_size * page_size;
+    if (size == 0) {
+        return NULL;
+    }
+
+    memfd = memfd_create("axidma", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        perror("Unable to create the memfd of the cached DMA memory");
+        return NULL;
+    }
+    if (ftruncate(memfd, size) < 0 ||
+            fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        perror("Unable to size the memfd of the cached DMA memory");
+        goto close_memfd;
+    }
+
+    // Export the pages of the memfd as a DMA buffer
+    udmabuf_fd = open(UDMABUF_DEV_PATH, O_RDWR);
+    if (udmabuf_fd < 0) {
+        perror("Unable to open " UDMABUF_DEV_PATH);
+        goto close_memfd;
+    }
+    memset(&create, 0, sizeof(create));
+    create.memfd = memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = size;
+    dmabuf_fd = ioctl(udmabuf_fd, UDMABUF_CREATE, &create);
+    close(udmabuf_fd);
+    if (dmabuf_fd < 0) {
+        perror("Unable to export the cached DMA memory");
+        goto close_memfd;
+    }
+
+    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (addr == MAP_FAILED) {
+        perror("Unable to map the cached DMA memory");
+        goto close_dmabuf;
+    }
+
+    // The memory starts out owned by the CPU, transfers hand it over
+    sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
+    if (ioctl(dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        goto unmap_memory;
+    }
+
+    // The registration is cached, the memory is released with it
+    if (register_import(dev, dmabuf_fd, addr, size, memfd) < 0) {
+        goto unmap_memory;
+    }
+    return addr;
+
+unmap_memory:
+    munmap(addr, size);
+close_dmabuf:
+    close(dmabuf_fd);
+close_memfd:
+    close(memfd);
+    return NULL;
+}
+
 /* This frees a region of memory that was allocated with a call to
- * axidma_malloc. The size passed in here must match the one used for that
- * call, or this function will throw an exception. */
+ * axidma_malloc or axidma_malloc_cached. The size passed in here must match
+ * the one used for that call, or this function will throw an exception. */
 void axidma_free(axidma_dev_t dev, void *addr, size_t size)
 {
-    // Silence the compiler
-    (void)dev;
+    int index;
+
+    // The cached memory is unregistered from the driver first
+    pthread_rwlock_wrlock(&dev->imports_lock);
+    index = find_import(dev, addr, 1);
+    if (index >= 0 && dev->imports[index].addr == addr &&
+            dev->imports[index].memfd >= 0) {
+        if (ioctl(dev->fd, AXIDMA_UNREGISTER_BUFFER, addr) < 0) {
+            perror("Failed to unregister the cached DMA memory");
+        }
+        remove_import(dev, index);
+        pthread_rwlock_unlock(&dev->imports_lock);
+        return;
+    }
+    pthread_rwlock_unlock(&dev->imports_lock);
 
     if (munmap(addr, size) < 0) {
         perror("Failed to free the AXI DMA memory mapped region");
@@ -400,17 +768,32 @@ void axidma_free(axidma_dev_t dev, void *addr, size_t size)
 }
 
 /* Sets up a callback function to be called whenever the transaction completes
- * on the given channel for asynchronous transfers. */
+ * on the given channel for asynchronous transfers. The signal is blocked in
+ * this thread meanwhile, the handler would wait for the update forever. */
 void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
                         void *data)
 {
     dma_channel_t *chan;
+    unsigned int seq;
+    sigset_t signals, old_signals;
 
     assert(find_channel(dev, channel) != NULL);
 
     chan = &dev->channels[channel];
-    chan->callback = callback;
-    chan->user_data = data;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGRTMIN);
+    pthread_mutex_lock(&chan->lock);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+    seq = atomic_load_explicit(&chan->callback_seq, memory_order_relaxed);
+    atomic_store_explicit(&chan->callback_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&chan->callback, callback, memory_order_relaxed);
+    atomic_store_explicit(&chan->user_data, data, memory_order_relaxed);
+    atomic_store_explicit(&chan->callback_seq, seq + 2, memory_order_release);
+
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    pthread_mutex_unlock(&chan->lock);
 
     return;
 }
@@ -418,43 +801,60 @@ void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
 /* Registers a DMA buffer allocated by another driver with the AXI DMA driver.
  * This allows it to be used in DMA transfers later on. The user must make sure
  * that the driver that allocated the buffer has exported it. The file
- * descriptor is the one that is returned by the other driver's export. */
+ * descriptor is the one that is returned by the other driver's export. The
+ * registrations are cached, registering a range within a registered buffer
+ * again does not involve the driver. */
 int axidma_register_buffer(axidma_dev_t dev, int dmabuf_fd, void *user_addr,
                            size_t size)
 {
-    int rc;
-    struct axidma_register_buffer register_buffer;
-
-    // Setup the argument structure to the IOCTL
-    register_buffer.fd = dmabuf_fd;
-    register_buffer.size = size;
-    register_buffer.user_addr = user_addr;
-
-    // Perform the buffer registration with the driver
-    rc = ioctl(dev->fd, AXIDMA_REGISTER_BUFFER, &register_buffer);
-    if (rc < 0) {
-        perror("Failed to register the external DMA buffer");
-    }
-
-    return rc;
+    return register_import(dev, dmabuf_fd, user_addr, size, -1);
 }
 
 /* Unregisters a DMA buffer preivously registered with the driver. This is
  * required to clean up the kernel data structures. */
 void axidma_unregister_buffer(axidma_dev_t dev, void *user_addr)
 {
-    int rc;
+    int rc, index;
 
     // Perform the deregistration with the driver
+    pthread_rwlock_wrlock(&dev->imports_lock);
     rc = ioctl(dev->fd, AXIDMA_UNREGISTER_BUFFER, user_addr);
     if (rc < 0) {
         perror("Failed to unregister the external DMA buffer");
         assert(false);
     }
 
+    index = find_import(dev, user_addr, 1);
+    if (index >= 0) {
+        remove_import(dev, index);
+    }
+    pthread_rwlock_unlock(&dev->imports_lock);
+
     return;
 }
 
+/* The registered buffers are cached, the memory mapped by the driver is not.
+ * The driver allocates it with dma_alloc_coherent, without a coherent
+ * interconnect, that mapping is uncached. */
+bool axidma_is_cached(axidma_dev_t dev, const void *addr, size_t len)
+{
+    return is_imported(dev, addr, len);
+}
+
+/* Gives a registered external buffer back to the CPU after a transfer,
+ * invalidating the cache lines the DMA engine wrote behind. */
+int axidma_sync_for_cpu(axidma_dev_t dev, void *addr, size_t len)
+{
+    return sync_import(dev, addr, len, DMA_BUF_SYNC_START);
+}
+
+/* Hands a registered external buffer over to the DMA engine, writing back the
+ * cache lines the CPU wrote. The transfer functions do it for their buffers. */
+int axidma_sync_for_device(axidma_dev_t dev, void *addr, size_t len)
+{
+    return sync_import(dev, addr, len, DMA_BUF_SYNC_END);
+}
+
 /* This performs a one-way transfer over AXI DMA, the direction being specified
  * by the user. The user determines if this is blocking or not with `wait. */
 int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
@@ -462,11 +862,19 @@ int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
 {
     int rc;
     struct axidma_transaction trans;
+    struct axidma_iovec iov;
     unsigned long axidma_cmd;
     dma_channel_t *dma_chan;
 
     assert(find_channel(dev, channel) != NULL);
 
+    // Cached memory may span several regions, only a vector describes those
+    if (is_imported(dev, buf, len)) {
+        iov.buf = buf;
+        iov.len = len;
+        return axidma_oneway_transfer_iov(dev, channel, &iov, 1, wait);
+    }
+
     // Setup the argument structure to the IOCTL
     dma_chan = find_channel(dev, channel);
     trans.wait = wait;
@@ -482,7 +890,7 @@ int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
         return rc;
     }
 
-    return 0;
+    return (int)trans.transaction_id;
 }
 
 /* This performs a two-way transfer over AXI DMA, both sending data out and
@@ -494,12 +902,25 @@ int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
 {
     int rc;
     struct axidma_inout_transaction trans;
+    struct axidma_iovec tx_iov, rx_iov;
 
     assert(find_channel(dev, tx_channel) != NULL);
     assert(find_channel(dev, tx_channel)->dir == AXIDMA_WRITE);
     assert(find_channel(dev, rx_channel) != NULL);
     assert(find_channel(dev, rx_channel)->dir == AXIDMA_READ);
 
+    // Cached memory may span several regions, only a vector describes those
+    if (tx_frame == NULL && rx_frame == NULL &&
+            (is_imported(dev, tx_buf, tx_len) ||
+             is_imported(dev, rx_buf, rx_len))) {
+        tx_iov.buf = tx_buf;
+        tx_iov.len = tx_len;
+        rx_iov.buf = rx_buf;
+        rx_iov.len = rx_len;
+        return axidma_twoway_transfer_iov(dev, tx_channel, &tx_iov, 1,
+                                          rx_channel, &rx_iov, 1, wait);
+    }
+
     // Setup the argument structure for the IOCTL
     trans.wait = wait;
     trans.tx_channel_id = tx_channel;
@@ -525,9 +946,81 @@ int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
     rc = ioctl(dev->fd, AXIDMA_DMA_READWRITE, &trans);
     if (rc < 0) {
         perror("Failed to perform the AXI DMA read-write transfer");
+        return rc;
     }
 
-    return rc;
+    return (int)trans.rx_transaction_id;
+}
+
+/* This performs a one-way vectored transfer over AXI DMA, the buffers being
+ * the entries of the scatter-gather list of a single transaction. */
+int axidma_oneway_transfer_iov(axidma_dev_t dev, int channel,
+        const struct axidma_iovec *iov, int iovcnt, bool wait)
+{
+    dma_channel_t *dma_chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    dma_chan = find_channel(dev, channel);
+    if (dma_chan->dir == AXIDMA_WRITE) {
+        return axidma_twoway_transfer_iov(dev, channel, iov, iovcnt, -1, NULL,
+                                          0, wait);
+    }
+
+    return axidma_twoway_transfer_iov(dev, -1, NULL, 0, channel, iov, iovcnt,
+                                      wait);
+}
+
+/* This performs a two-way vectored transfer over AXI DMA, each direction
+ * having a scatter-gather list built from its buffers. */
+int axidma_twoway_transfer_iov(axidma_dev_t dev, int tx_channel,
+        const struct axidma_iovec *tx_iov, int tx_iovcnt, int rx_channel,
+        const struct axidma_iovec *rx_iov, int rx_iovcnt, bool wait)
+{
+    int i, rc;
+    struct axidma_iov_transaction trans;
+
+    assert(tx_iovcnt == 0 || find_channel(dev, tx_channel) != NULL);
+    assert(tx_iovcnt == 0 ||
+           find_channel(dev, tx_channel)->dir == AXIDMA_WRITE);
+    assert(rx_iovcnt == 0 || find_channel(dev, rx_channel) != NULL);
+    assert(rx_iovcnt == 0 ||
+           find_channel(dev, rx_channel)->dir == AXIDMA_READ);
+
+    // The engine reads and writes memory, not the caches of the CPU
+    for (i = 0; i < tx_iovcnt; i++)
+    {
+        rc = axidma_sync_for_device(dev, tx_iov[i].buf, tx_iov[i].len);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    for (i = 0; i < rx_iovcnt; i++)
+    {
+        rc = axidma_sync_for_device(dev, rx_iov[i].buf, rx_iov[i].len);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    // Setup the argument structure for the IOCTL
+    trans.wait = wait;
+    trans.tx_channel_id = tx_channel;
+    trans.tx_iov = (struct axidma_iovec *)tx_iov;
+    trans.tx_iovcnt = tx_iovcnt;
+    trans.rx_channel_id = rx_channel;
+    trans.rx_iov = (struct axidma_iovec *)rx_iov;
+    trans.rx_iovcnt = rx_iovcnt;
+
+    // Perform the vectored transfer
+    rc = ioctl(dev->fd, AXIDMA_DMA_IOV, &trans);
+    if (rc < 0) {
+        perror("Failed to perform the AXI DMA vectored transfer");
+        return rc;
+    }
+
+    return (int)((rx_iovcnt > 0) ? trans.rx_transaction_id :
+                                   trans.tx_transaction_id);
 }
 
 /* This function performs a video transfer over AXI DMA, setting up a VDMA
@@ -588,3 +1081,261 @@ void axidma_stop_transfer(axidma_dev_t dev, int channel)
 
     return;
 }
+
+/* Returns the eventfd signalled when transactions on the channel complete,
+ * creating it and handing it to the driver on the first call. From then on,
+ * the channel's completions are collected with axidma_reap instead of being
+ * delivered to the callback. */
+int axidma_get_completion_fd(axidma_dev_t dev, int channel)
+{
+    int fd;
+    struct axidma_completion_fd completion_fd;
+    dma_channel_t *dma_chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    dma_chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dma_chan->lock);
+    if (dma_chan->completion_fd >= 0) {
+        fd = dma_chan->completion_fd;
+        goto unlock;
+    }
+
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Unable to create the completion eventfd");
+        goto unlock;
+    }
+
+    // An older driver rejects the IOCTL, the caller can fall back to callbacks
+    completion_fd.channel_id = channel;
+    completion_fd.fd = fd;
+    if (ioctl(dev->fd, AXIDMA_SET_COMPLETION_FD, &completion_fd) < 0) {
+        close(fd);
+        fd = -1;
+        goto unlock;
+    }
+    dma_chan->completion_fd = fd;
+
+unlock:
+    pthread_mutex_unlock(&dma_chan->lock);
+    return fd;
+}
+
+/* Collects the completed transactions of the channel, consuming the pending
+ * count of its eventfd first, so a completion arriving meanwhile wakes up the
+ * next poll rather than being missed. */
+int axidma_reap(axidma_dev_t dev, int channel,
+        struct axidma_completion *completions, int max_completions)
+{
+    int rc, fd;
+    uint64_t count;
+    struct axidma_reap reap;
+    dma_channel_t *dma_chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    dma_chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dma_chan->lock);
+    fd = dma_chan->completion_fd;
+    pthread_mutex_unlock(&dma_chan->lock);
+    if (fd < 0) {
+        return -EINVAL;
+    }
+
+    // Non-blocking, fails with EAGAIN if nothing completed since the last call
+    if (read(fd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+        rc = -errno;
+        perror("Failed to read the completion eventfd");
+        return rc;
+    }
+
+    reap.channel_id = channel;
+    reap.max_completions = max_completions;
+    reap.completions = completions;
+    reap.num_completions = 0;
+    rc = ioctl(dev->fd, AXIDMA_REAP, &reap);
+    if (rc < 0) {
+        perror("Failed to reap the completed AXI DMA transactions");
+        return rc;
+    }
+
+    return reap.num_completions;
+}
+
+/* Waits for a single transaction of the channel, the driver keeps the state of
+ * the last AXIDMA_MAX_IN_FLIGHT transactions of each channel. */
+int axidma_wait(axidma_dev_t dev, int channel, int transaction_id,
+        int timeout_ms)
+{
+    int rc;
+    struct axidma_wait wait;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    wait.channel_id = channel;
+    wait.transaction_id = (unsigned int)transaction_id;
+    wait.timeout_ms = timeout_ms;
+    wait.status = 0;
+    rc = ioctl(dev->fd, AXIDMA_WAIT, &wait);
+    if (rc < 0) {
+        perror("Failed to wait for the AXI DMA transaction");
+        return rc;
+    }
+
+    return wait.status;
+}
+
+/* Puts the channel in polling mode, where its one-shot completions are only
+ * published in the status page. */
+int axidma_set_polling(axidma_dev_t dev, int channel, bool enable)
+{
+    int rc;
+    struct axidma_polling polling;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    polling.channel_id = channel;
+    polling.enable = enable;
+    rc = ioctl(dev->fd, AXIDMA_SET_POLLING, &polling);
+    if (rc < 0) {
+        perror("Failed to set the polling mode of the channel");
+        return rc;
+    }
+
+    return 0;
+}
+
+// Returns the current time of the monotonic clock, in microseconds
+static int64_t monotonic_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Compares transaction ids, which wrap around at AXIDMA_MAX_TRANSACTION_ID
+static bool id_after(unsigned int id, unsigned int other_id)
+{
+    unsigned int distance;
+
+    // How far id is ahead of other_id, 0 counting as the largest id
+    distance = (id >= other_id) ? id - other_id :
+                                  id + (AXIDMA_MAX_TRANSACTION_ID - other_id);
+    return distance != 0 && distance <= AXIDMA_MAX_TRANSACTION_ID / 2;
+}
+
+/* Spins on the status page until the transaction finishes or spin_us runs
+ * out. A transaction that completed is done with, the status of one that may
+ * have been cancelled, or is still in flight, is left to AXIDMA_WAIT. */
+int axidma_poll(axidma_dev_t dev, int channel, int transaction_id,
+        int spin_us, int timeout_ms)
+{
+    const volatile struct axidma_chan_status *status;
+    unsigned int id, finished_id, cancelled_id;
+    int64_t deadline;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    if (dev->status_page == NULL || transaction_id <= 0) {
+        return axidma_wait(dev, channel, transaction_id, timeout_ms);
+    }
+
+    id = (unsigned int)transaction_id;
+    status = &dev->status_page[channel];
+    deadline = monotonic_us() + spin_us;
+    do
+    {
+        // The driver writes the cancelled id before the finished one
+        finished_id = status->finished_id;
+        atomic_thread_fence(memory_order_acquire);
+        cancelled_id = status->cancelled_id;
+        if (!id_after(id, finished_id)) {
+            return id_after(id, cancelled_id) ? 0 :
+                    axidma_wait(dev, channel, transaction_id, 0);
+        }
+    } while (monotonic_us() < deadline);
+
+    return axidma_wait(dev, channel, transaction_id, timeout_ms);
+}
+
+/* Starts a cyclic transfer over the ring of num_periods periods at buf. The
+ * DMA keeps wrapping around the ring until axidma_stop_transfer is called, the
+ * application refills the periods it has completed. */
+int axidma_cyclic_transfer(axidma_dev_t dev, int channel, void *buf,
+        size_t period_len, int num_periods)
+{
+    int rc;
+    struct axidma_cyclic_transaction trans;
+
+    assert(find_channel(dev, channel) != NULL);
+    assert(find_channel(dev, channel)->type == AXIDMA_DMA);
+
+    // Setup the argument structure for the IOCTL
+    trans.channel_id = channel;
+    trans.buf = buf;
+    trans.period_len = period_len;
+    trans.num_periods = num_periods;
+
+    rc = ioctl(dev->fd, AXIDMA_DMA_CYCLIC, &trans);
+    if (rc < 0) {
+        perror("Failed to start the AXI DMA cyclic transfer");
+    }
+
+    return rc;
+}
+
+/* Returns the number of periods the cyclic transfer on the channel completed
+ * since it was started. The pending count of the completion eventfd is
+ * consumed first, so the next poll waits for a period completing after this
+ * call. */
+long long axidma_get_cyclic_periods(axidma_dev_t dev, int channel)
+{
+    int rc, fd;
+    uint64_t count;
+    struct axidma_cyclic_status status;
+    dma_channel_t *dma_chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    dma_chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dma_chan->lock);
+    fd = dma_chan->completion_fd;
+    pthread_mutex_unlock(&dma_chan->lock);
+    if (fd >= 0 && read(fd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+        rc = -errno;
+        perror("Failed to read the completion eventfd");
+        return rc;
+    }
+
+    status.channel_id = channel;
+    rc = ioctl(dev->fd, AXIDMA_GET_CYCLIC_STATUS, &status);
+    if (rc < 0) {
+        perror("Failed to get the status of the AXI DMA cyclic transfer");
+        return rc;
+    }
+
+    return (long long)status.periods_completed;
+}
+
+// Gets the statistics the driver keeps for the channel
+int axidma_get_stats(axidma_dev_t dev, int channel, struct axidma_stats *stats,
+        bool reset)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->channel_id = channel;
+    stats->reset = reset;
+    rc = ioctl(dev->fd, AXIDMA_GET_STATS, stats);
+    if (rc < 0) {
+        perror("Failed to get the statistics of the AXI DMA channel");
+    }
+
+    return rc;
+}
@@ -0,0 +1,1667 @@
+/**
+ * @file libaxidma_sim.c
+ *
+ * This is a simulated implementation of the AXI DMA library, for running the
+ * applications on a host without the AXI DMA driver and the logic fabric.
+ *
+ * The simulated device has a transmit and a receive DMA channel. The data of
+ * a transfer goes to (or comes from) the data port of the channel, or is
+ * looped back from the transmit to the receive channel. Transfers take the
+ * time given by the rate of the channel, and complete on the thread of the
+ * channel. So, unlike with the driver, the callbacks are invoked on that
+ * thread rather than in a signal handler. Queued transfers, completion
+ * descriptors, transaction ids and cyclic transfers behave as with the
+ * driver.
+ *
+ * Each channel can add a latency per buffer and a random jitter to its
+ * transfers, and fail some of them. The random numbers come from a generator
+ * of the device with a fixed seed, so a run can be reproduced. The controls
+ * are set with the functions of libaxidma_sim.h, or from the environment
+ * when the device is opened. The statistics of the channels are kept as the
+ * driver keeps them.
+ *
+ * @bug No known bugs.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>             // Memset and memcpy functions
+#include <sys/mman.h>           // Mmap system call
+#include <sys/eventfd.h>        // Completion eventfd
+#include <unistd.h>             // Close() system call
+#include <errno.h>              // Error codes
+#include <time.h>               // Timing of the transfers
+#include <pthread.h>            // Transfer threads
+#include <sched.h>              // Yielding to the threads when polling
+#include <stdatomic.h>          // Status of the channels read by the pollers
+
+#include "libaxidma.h"          // Local definitions
+#include "libaxidma_sim.h"      // Controls of the simulated device
+#include "axidma_ioctl.h"       // Completion structures
+
+/*----------------------------------------------------------------------------
+ * Internal definitions
+ *----------------------------------------------------------------------------*/
+
+// The number of channels of the simulated device
+#define SIM_NUM_CHANNELS        2
+
+// The seed of the random number generator unless one is set
+#define SIM_DEFAULT_SEED        1
+
+// The status of a failed transfer
+#define SIM_ERROR_STATUS        (-EIO)
+
+// A transfer queued on a simulated channel
+typedef struct sim_job {
+    struct axidma_iovec tx_iov[AXIDMA_MAX_IOVECS];  ///< Data to transmit
+    int tx_iovcnt;              ///< Number of transmit buffers (0: a receive)
+    unsigned int tx_transaction_id; ///< Id of the transmit transaction
+    struct axidma_iovec rx_iov[AXIDMA_MAX_IOVECS];  ///< Buffers to receive to
+    int rx_iovcnt;              ///< Number of receive buffers (0: a transmit)
+    unsigned int rx_transaction_id; ///< Id of the receive transaction
+    bool is_reported;           ///< The completion is reported (non-blocking)
+    struct timespec submit_time;    ///< The time the transfer was queued
+} sim_job_t;
+
+// A transaction that did not complete successfully, for waiting on it
+typedef struct sim_status {
+    unsigned int transaction_id;    ///< Id of the transaction
+    int status;                 ///< Its status (-ECANCELED or -EIO)
+} sim_status_t;
+
+// A structure that holds the state of a simulated channel
+typedef struct sim_channel {
+    struct axidma_dev *dev;     ///< The device the channel belongs to
+    enum axidma_dir dir;        ///< Direction of the channel
+    int channel_id;             ///< Integer id of the channel.
+    axidma_cb_t callback;       ///< Callback function for channel completion
+    void *user_data;            ///< User data to pass to the callback
+    int completion_fd;          ///< Eventfd signalled on completion, or -1
+    double rate;                ///< Transfer rate in bytes/second (0: default)
+    double latency;             ///< Time added by each buffer, in seconds
+    double jitter;              ///< Longest random delay of a completion
+    double error_rate;          ///< Probability of a transfer failing
+    axidma_sim_port_t port;     ///< Data port of the channel
+    void *port_data;            ///< User data to pass to the port
+
+    unsigned int last_transaction_id;   ///< Id of the previous transaction
+    struct axidma_completion completions[AXIDMA_COMPLETION_QUEUE_SIZE];
+    int completions_head;       ///< Index of the oldest queued completion
+    int num_completions;        ///< Number of queued completions
+    sim_status_t failed[AXIDMA_MAX_IN_FLIGHT];  ///< Last unsuccessful ids
+    int failed_next;            ///< Index of the next failed id to record
+    atomic_uint finished_id;    ///< Last transaction finished, as published
+    atomic_uint unsuccessful_id;    ///< Last one cancelled or failed
+    bool is_polling;            ///< Completions are only published
+
+    pthread_t thread;           ///< The thread running the transfers
+    bool is_busy;               ///< The thread works with the device unlocked
+    unsigned int generation;    ///< Incremented when the transfers are stopped
+    struct timespec busy_until; ///< The time the engine is done with the queue
+
+    // The queued one-shot transfers, the first one is running
+    sim_job_t jobs[AXIDMA_MAX_IN_FLIGHT];
+    int jobs_head;              ///< Index of the running transfer
+    int num_jobs;               ///< Number of queued transfers
+
+    // The running cyclic transfer
+    char *ring;                 ///< The ring of periods (NULL: none running)
+    size_t period_len;          ///< The length of a period
+    int num_periods;            ///< The number of periods in the ring
+    unsigned long long periods_completed;   ///< Periods since the start
+
+    // Contiguous copy of the buffers of a transformed transfer
+    char *scratch;              ///< The memory of the copy (NULL: none yet)
+    size_t scratch_len;         ///< The length of the memory
+
+    // The statistics, two-way transfers count on both channels
+    struct axidma_stats stats;  ///< The statistics of the channel
+    int num_in_flight;          ///< Transactions of the channel in flight
+    uint64_t stats_since_ns;    ///< The time the statistics were cleared
+    uint64_t busy_since_ns;     ///< The time the channel became busy
+    uint64_t idle_since_ns;     ///< The time it became idle (0: never busy)
+} sim_channel_t;
+
+// The structure that represents the simulated AXI DMA device
+struct axidma_dev {
+    unsigned int index;         ///< Index of the device that was opened
+    array_t dma_tx_chans;       ///< Channel id's for the DMA transmit channels
+    array_t dma_rx_chans;       ///< Channel id's for the DMA receive channels
+    array_t vdma_tx_chans;      ///< Channel id's for the VDMA transmit channels
+    array_t vdma_rx_chans;      ///< Channel id's for the VDMA receive channels
+    int tx_chan_id;             ///< Storage of the transmit channel id array
+    int rx_chan_id;             ///< Storage of the receive channel id array
+    sim_channel_t channels[SIM_NUM_CHANNELS];   ///< All of the channels
+    int num_threads;            ///< Number of channel threads started
+    bool is_closing;            ///< The channel threads have to exit
+    uint64_t random_state;      ///< State of the random number generator
+    axidma_sim_transform_t transform;   ///< Transform of two-way transfers
+    void *transform_data;       ///< User data to pass to the transform
+    pthread_mutex_t lock;       ///< Protects the state of the channels
+    pthread_cond_t cond;        ///< Signalled on every change of the transfers
+};
+
+/*----------------------------------------------------------------------------
+ * Private Helper Functions
+ *----------------------------------------------------------------------------*/
+
+// Finds the DMA channel with the given id
+static sim_channel_t *find_channel(axidma_dev_t dev, int channel_id)
+{
+    if (channel_id < 0 || channel_id >= SIM_NUM_CHANNELS) {
+        return NULL;
+    }
+
+    return &dev->channels[channel_id];
+}
+
+// Gives the next transaction id of the channel, as the driver does
+static unsigned int next_transaction_id(sim_channel_t *chan)
+{
+    chan->last_transaction_id += 1;
+    if (chan->last_transaction_id > AXIDMA_MAX_TRANSACTION_ID) {
+        chan->last_transaction_id = 1;
+    }
+
+    return chan->last_transaction_id;
+}
+
+// Compares transaction ids, which wrap around at AXIDMA_MAX_TRANSACTION_ID
+static bool id_after(unsigned int id, unsigned int other_id)
+{
+    unsigned int distance;
+
+    // How far id is ahead of other_id, 0 counting as the largest id
+    distance = (id >= other_id) ? id - other_id :
+                                  id + (AXIDMA_MAX_TRANSACTION_ID - other_id);
+    return distance != 0 && distance <= AXIDMA_MAX_TRANSACTION_ID / 2;
+}
+
+// Converts a (non-negative) number of seconds to a time
+static struct timespec to_time(double seconds)
+{
+    struct timespec duration;
+
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (double)duration.tv_sec) * 1e9);
+    return duration;
+}
+
+/* Returns the time the given number of bytes in the given number of buffers
+ * takes on the channel. */
+static struct timespec transfer_time(sim_channel_t *chan, size_t len,
+                                     int num_buffers, bool is_cyclic)
+{
+    double rate, seconds;
+
+    rate = chan->rate;
+    if (rate <= 0 && is_cyclic) {
+        rate = AXIDMA_SIM_DEFAULT_CYCLIC_RATE;
+    }
+
+    seconds = chan->latency * num_buffers;
+    if (rate > 0) {
+        seconds += (double)len / rate;
+    }
+    return to_time(seconds);
+}
+
+// Returns the time in nanoseconds
+static uint64_t time_ns(const struct timespec *time)
+{
+    return (uint64_t)time->tv_sec * 1000000000ULL + (uint64_t)time->tv_nsec;
+}
+
+// Returns the current time on the monotonic clock in nanoseconds
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return time_ns(&now);
+}
+
+/* Returns a uniformly distributed random number in [0, 1) (xorshift64*).
+ * Called with the device locked. */
+static double random_uniform(axidma_dev_t dev)
+{
+    uint64_t x;
+
+    x = dev->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    dev->random_state = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+/* Returns the random delay of a completion on the channel, called with the
+ * device locked. */
+static struct timespec completion_jitter(sim_channel_t *chan)
+{
+    if (chan->jitter <= 0) {
+        return to_time(0);
+    }
+
+    return to_time(chan->jitter * random_uniform(chan->dev));
+}
+
+// Returns true if time a is earlier than time b
+static bool time_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec ||
+           (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void add_time(struct timespec *time, const struct timespec *duration)
+{
+    time->tv_sec += duration->tv_sec;
+    time->tv_nsec += duration->tv_nsec;
+    if (time->tv_nsec >= 1000000000) {
+        time->tv_sec += 1;
+        time->tv_nsec -= 1000000000;
+    }
+}
+
+/* Waits until the deadline with the device locked, returns false if the
+ * transfers of the channel were stopped meanwhile. A deadline that passed
+ * already does not wait, not even for the timer slack of the host. */
+static bool wait_until(sim_channel_t *chan, const struct timespec *deadline,
+                       unsigned int generation)
+{
+    struct timespec now;
+    int rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rc = time_before(deadline, &now) ? ETIMEDOUT : 0;
+    while (chan->generation == generation && rc != ETIMEDOUT)
+    {
+        rc = pthread_cond_timedwait(&chan->dev->cond, &chan->dev->lock,
+                                    deadline);
+    }
+
+    return chan->generation == generation;
+}
+
+/* Queues the completion of a transaction on the channel for reaping, the
+ * caller signals the completion eventfd. Called with the device locked. */
+static void queue_completion(sim_channel_t *chan, unsigned int transaction_id,
+                             int status, const struct timespec *now)
+{
+    struct axidma_completion *completion;
+    int index;
+
+    if (chan->num_completions < AXIDMA_COMPLETION_QUEUE_SIZE) {
+        index = (chan->completions_head + chan->num_completions) %
+                AXIDMA_COMPLETION_QUEUE_SIZE;
+        completion = &chan->completions[index];
+        completion->transaction_id = transaction_id;
+        completion->status = status;
+        completion->timestamp_ns = (unsigned long long)now->tv_sec *
+                1000000000ULL + (unsigned long long)now->tv_nsec;
+        chan->num_completions += 1;
+    } else {
+        fprintf(stderr, "Completion queue of channel %d is full, "
+                "transaction %u is not reported.\n", chan->channel_id,
+                transaction_id);
+    }
+}
+
+// Increments the completion eventfd of the channel
+static void signal_completion_fd(int fd)
+{
+    uint64_t count;
+
+    count = 1;
+    if (write(fd, &count, sizeof(count)) < 0) {
+        perror("Failed to signal the completion eventfd");
+    }
+}
+
+/* Reports the completion of a transaction on the channel with its status,
+ * through its completion eventfd or its callback, unless the channel is in
+ * polling mode. Called with the device
+ * unlocked. */
+static void complete_transaction(sim_channel_t *chan,
+                                 unsigned int transaction_id, int status)
+{
+    struct timespec now;
+    axidma_cb_t callback;
+    void *user_data;
+    int fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&chan->dev->lock);
+    fd = chan->completion_fd;
+    callback = chan->callback;
+    user_data = chan->user_data;
+
+    // The pollers of a channel in polling mode watch the published status
+    if (chan->is_polling && transaction_id != 0) {
+        pthread_mutex_unlock(&chan->dev->lock);
+        return;
+    }
+
+    // Channels with a completion eventfd queue the completion for reaping
+    if (fd >= 0 && transaction_id != 0) {
+        queue_completion(chan, transaction_id, status, &now);
+    }
+    pthread_mutex_unlock(&chan->dev->lock);
+
+    if (fd >= 0) {
+        signal_completion_fd(fd);
+    } else if (callback != NULL) {
+        callback(chan->channel_id, user_data);
+    }
+}
+
+// Returns the total length of the buffers of a vector
+static size_t iov_len(const struct axidma_iovec *iov, int iovcnt)
+{
+    int i;
+    size_t len;
+
+    len = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].len;
+    }
+
+    return len;
+}
+
+/* Runs the transform over a two-way transfer. A direction with more than one
+ * buffer is gathered into (or scattered from) the scratch memory of the
+ * channel running the transfer, so the transform sees one stream each way. */
+static void run_transform(sim_channel_t *chan,
+        axidma_sim_transform_t transform, void *transform_data,
+        const struct axidma_iovec *tx_iov, int tx_iovcnt,
+        const struct axidma_iovec *rx_iov, int rx_iovcnt)
+{
+    int i;
+    size_t tx_len, rx_len, scratch_len, offset;
+    char *scratch, *tx, *rx;
+
+    tx_len = iov_len(tx_iov, tx_iovcnt);
+    rx_len = iov_len(rx_iov, rx_iovcnt);
+    scratch_len = ((tx_iovcnt > 1) ? tx_len : 0) +
+                  ((rx_iovcnt > 1) ? rx_len : 0);
+    if (scratch_len > chan->scratch_len) {
+        scratch = (char *)realloc(chan->scratch, scratch_len);
+        if (scratch == NULL) {
+            fprintf(stderr, "Unable to allocate %zu bytes to transform a "
+                    "transfer, its data is not moved.\n", scratch_len);
+            return;
+        }
+        chan->scratch = scratch;
+        chan->scratch_len = scratch_len;
+    }
+
+    tx = (char *)tx_iov[0].buf;
+    if (tx_iovcnt > 1) {
+        tx = chan->scratch;
+        offset = 0;
+        for (i = 0; i < tx_iovcnt; i++)
+        {
+            memcpy(tx + offset, tx_iov[i].buf, tx_iov[i].len);
+            offset += tx_iov[i].len;
+        }
+    }
+    rx = (rx_iovcnt > 1) ? chan->scratch + scratch_len - rx_len :
+                           (char *)rx_iov[0].buf;
+
+    transform(tx, tx_len, rx, rx_len, transform_data);
+
+    if (rx_iovcnt > 1) {
+        offset = 0;
+        for (i = 0; i < rx_iovcnt; i++)
+        {
+            memcpy(rx_iov[i].buf, rx + offset, rx_iov[i].len);
+            offset += rx_iov[i].len;
+        }
+    }
+}
+
+/* Moves the data of a one-shot transfer through the simulated device, the
+ * buffers of each direction are handled in order as one stream. Called on the
+ * thread of the channel running the transfer, with the device unlocked. */
+static void move_data(sim_channel_t *chan, const struct axidma_iovec *tx_iov,
+        int tx_iovcnt, const struct axidma_iovec *rx_iov, int rx_iovcnt,
+        axidma_sim_transform_t transform, void *transform_data)
+{
+    sim_channel_t *tx_chan, *rx_chan;
+    int i, tx_index, rx_index;
+    size_t tx_offset, rx_offset, len;
+
+    tx_chan = find_channel(chan->dev, AXIDMA_SIM_TX_CHANNEL);
+    rx_chan = find_channel(chan->dev, AXIDMA_SIM_RX_CHANNEL);
+
+    if (tx_chan->port != NULL) {
+        for (i = 0; i < tx_iovcnt; i++)
+        {
+            tx_chan->port(tx_chan->channel_id, tx_iov[i].buf, tx_iov[i].len,
+                          tx_chan->port_data);
+        }
+    }
+
+    if (rx_iovcnt == 0) {
+        return;
+    } else if (rx_chan->port != NULL) {
+        for (i = 0; i < rx_iovcnt; i++)
+        {
+            rx_chan->port(rx_chan->channel_id, rx_iov[i].buf, rx_iov[i].len,
+                          rx_chan->port_data);
+        }
+    } else if (tx_iovcnt == 0) {
+        for (i = 0; i < rx_iovcnt; i++)
+        {
+            memset(rx_iov[i].buf, 0, rx_iov[i].len);
+        }
+    } else if (transform != NULL) {
+        run_transform(chan, transform, transform_data, tx_iov, tx_iovcnt,
+                      rx_iov, rx_iovcnt);
+    } else {
+        // Loopback, the rest of the receive buffers is left as it is
+        tx_index = 0;
+        rx_index = 0;
+        tx_offset = 0;
+        rx_offset = 0;
+        while (tx_index < tx_iovcnt && rx_index < rx_iovcnt)
+        {
+            len = tx_iov[tx_index].len - tx_offset;
+            if (rx_iov[rx_index].len - rx_offset < len) {
+                len = rx_iov[rx_index].len - rx_offset;
+            }
+            memcpy((char *)rx_iov[rx_index].buf + rx_offset,
+                   (char *)tx_iov[tx_index].buf + tx_offset, len);
+
+            tx_offset += len;
+            rx_offset += len;
+            if (tx_offset == tx_iov[tx_index].len) {
+                tx_index += 1;
+                tx_offset = 0;
+            }
+            if (rx_offset == rx_iov[rx_index].len) {
+                rx_index += 1;
+                rx_offset = 0;
+            }
+        }
+    }
+}
+
+/* The statistics are updated with the device locked, as the driver updates
+ * them (see axidma_dma.c). */
+
+// Returns true if the channel has transactions in flight, or runs a cyclic one
+static bool channel_busy(sim_channel_t *chan)
+{
+    return chan->num_in_flight > 0 || chan->ring != NULL;
+}
+
+// Counts a time in its histogram bucket
+static void stats_record(unsigned long long *histogram,
+                         unsigned long long *total_ns, uint64_t time)
+{
+    int bucket;
+
+    bucket = (time == 0) ? 0 : 64 - __builtin_clzll(time);
+    if (bucket > AXIDMA_STATS_BUCKETS - 1) {
+        bucket = AXIDMA_STATS_BUCKETS - 1;
+    }
+    histogram[bucket] += 1;
+    *total_ns += time;
+}
+
+/* Accounts for a transaction being submitted, before it is counted as in
+ * flight. If the channel was idle, this ends its idle gap. */
+static void stats_submit(sim_channel_t *chan, uint64_t now)
+{
+    if (channel_busy(chan)) {
+        return;
+    }
+
+    if (chan->idle_since_ns != 0) {
+        stats_record(chan->stats.idle_histogram, &chan->stats.idle_total_ns,
+                     now - chan->idle_since_ns);
+    }
+    chan->busy_since_ns = now;
+}
+
+// Accounts for the channel becoming idle, after its last transaction left
+static void stats_idle(sim_channel_t *chan, uint64_t now)
+{
+    chan->stats.busy_ns += now - chan->busy_since_ns;
+    chan->idle_since_ns = now;
+}
+
+/* Accounts for a transaction of the given length completing, after it left the
+ * channel. A failed transaction counts as an error. */
+static void stats_complete(sim_channel_t *chan, uint64_t now,
+                           uint64_t submit_ns, size_t len, int status)
+{
+    if (status == 0) {
+        chan->stats.transactions += 1;
+        chan->stats.bytes += len;
+        stats_record(chan->stats.latency_histogram,
+                     &chan->stats.latency_total_ns, now - submit_ns);
+    } else {
+        chan->stats.errors += 1;
+    }
+
+    if (!channel_busy(chan)) {
+        stats_idle(chan, now);
+    }
+}
+
+// Records the status of a transaction that did not succeed, for waiting on it
+static void record_status(sim_channel_t *chan, unsigned int transaction_id,
+                          int status)
+{
+    chan->failed[chan->failed_next].transaction_id = transaction_id;
+    chan->failed[chan->failed_next].status = status;
+    chan->failed_next = (chan->failed_next + 1) % AXIDMA_MAX_IN_FLIGHT;
+}
+
+/* Publishes the last finished transaction of the channel, as the driver does
+ * in its status page. Unlike the driver, failed transactions are published as
+ * unsuccessful too, so that the pollers get their status. */
+static void publish_status(sim_channel_t *chan, unsigned int transaction_id,
+                           bool is_unsuccessful)
+{
+    if (is_unsuccessful) {
+        atomic_store_explicit(&chan->unsuccessful_id, transaction_id,
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&chan->finished_id, transaction_id,
+                          memory_order_release);
+}
+
+/* Runs the first queued transfer of the channel. The engine starts it as soon
+ * as the previous one completed, or when it was queued if the engine was idle
+ * then, so queued transfers run back-to-back even if the thread is late. The
+ * jitter delays the completion, but not the start of the next transfer. A
+ * failed transfer moves no data. Called and returns with the device locked. */
+static void run_job(sim_channel_t *chan)
+{
+    sim_channel_t *tx_chan, *rx_chan;
+    sim_job_t job;
+    struct timespec duration, deadline;
+    axidma_sim_transform_t transform;
+    void *transform_data;
+    unsigned int generation;
+    uint64_t now;
+    size_t len;
+    int num_buffers, status;
+
+    tx_chan = find_channel(chan->dev, AXIDMA_SIM_TX_CHANNEL);
+    rx_chan = find_channel(chan->dev, AXIDMA_SIM_RX_CHANNEL);
+    generation = chan->generation;
+    job = chan->jobs[chan->jobs_head];
+    transform = chan->dev->transform;
+    transform_data = chan->dev->transform_data;
+
+    // The transfer takes the time of the longer direction
+    len = iov_len(job.tx_iov, job.tx_iovcnt);
+    if (iov_len(job.rx_iov, job.rx_iovcnt) > len) {
+        len = iov_len(job.rx_iov, job.rx_iovcnt);
+    }
+    num_buffers = (job.tx_iovcnt > job.rx_iovcnt) ? job.tx_iovcnt :
+                                                    job.rx_iovcnt;
+    duration = transfer_time(chan, len, num_buffers, false);
+    if (time_before(&chan->busy_until, &job.submit_time)) {
+        chan->busy_until = job.submit_time;
+    }
+    add_time(&chan->busy_until, &duration);
+    deadline = chan->busy_until;
+    duration = completion_jitter(chan);
+    add_time(&deadline, &duration);
+    status = 0;
+    if (chan->error_rate > 0 && random_uniform(chan->dev) < chan->error_rate) {
+        status = SIM_ERROR_STATUS;
+    }
+    if (!wait_until(chan, &deadline, generation)) {
+        return;
+    }
+
+    chan->is_busy = true;
+    pthread_mutex_unlock(&chan->dev->lock);
+    if (status == 0) {
+        move_data(chan, job.tx_iov, job.tx_iovcnt, job.rx_iov, job.rx_iovcnt,
+                  transform, transform_data);
+    }
+    pthread_mutex_lock(&chan->dev->lock);
+
+    // A port stopping the channel cancelled the transfer, it is not queued
+    if (chan->generation != generation) {
+        chan->is_busy = false;
+        pthread_cond_broadcast(&chan->dev->cond);
+        return;
+    }
+
+    // The transfer is done once it leaves the queue, waiters are woken up
+    chan->jobs_head = (chan->jobs_head + 1) % AXIDMA_MAX_IN_FLIGHT;
+    chan->num_jobs -= 1;
+    now = now_ns();
+    if (job.tx_iovcnt > 0) {
+        tx_chan->num_in_flight -= 1;
+        stats_complete(tx_chan, now, time_ns(&job.submit_time),
+                       iov_len(job.tx_iov, job.tx_iovcnt), status);
+    }
+    if (job.rx_iovcnt > 0) {
+        rx_chan->num_in_flight -= 1;
+        stats_complete(rx_chan, now, time_ns(&job.submit_time),
+                       iov_len(job.rx_iov, job.rx_iovcnt), status);
+    }
+    if (status != 0 && job.tx_iovcnt > 0) {
+        record_status(tx_chan, job.tx_transaction_id, status);
+    }
+    if (status != 0 && job.rx_iovcnt > 0) {
+        record_status(rx_chan, job.rx_transaction_id, status);
+    }
+    if (job.tx_iovcnt > 0) {
+        publish_status(tx_chan, job.tx_transaction_id, status != 0);
+    }
+    if (job.rx_iovcnt > 0) {
+        publish_status(rx_chan, job.rx_transaction_id, status != 0);
+    }
+    pthread_cond_broadcast(&chan->dev->cond);
+    pthread_mutex_unlock(&chan->dev->lock);
+
+    if (job.is_reported && job.tx_iovcnt > 0) {
+        complete_transaction(tx_chan, job.tx_transaction_id, status);
+    }
+    if (job.is_reported && job.rx_iovcnt > 0) {
+        complete_transaction(rx_chan, job.rx_transaction_id, status);
+    }
+
+    pthread_mutex_lock(&chan->dev->lock);
+    chan->is_busy = false;
+    pthread_cond_broadcast(&chan->dev->cond);
+}
+
+/* Completes the next period of the cyclic transfer of the channel at the
+ * channel's rate. The latency and the jitter delay the report of a period, but
+ * not the periods after it. Called and returns with the device locked. */
+static void run_period(sim_channel_t *chan)
+{
+    struct timespec duration, deadline;
+    unsigned int generation;
+    char *period;
+
+    // The deadlines are absolute, so the periods do not drift
+    generation = chan->generation;
+    duration = transfer_time(chan, chan->period_len, 0, true);
+    add_time(&chan->busy_until, &duration);
+    deadline = chan->busy_until;
+    duration = to_time(chan->latency);
+    add_time(&deadline, &duration);
+    duration = completion_jitter(chan);
+    add_time(&deadline, &duration);
+    if (!wait_until(chan, &deadline, generation)) {
+        return;
+    }
+
+    period = chan->ring + (chan->periods_completed % chan->num_periods) *
+             chan->period_len;
+    chan->is_busy = true;
+    pthread_mutex_unlock(&chan->dev->lock);
+
+    if (chan->port != NULL) {
+        chan->port(chan->channel_id, period, chan->period_len,
+                   chan->port_data);
+    }
+
+    pthread_mutex_lock(&chan->dev->lock);
+    chan->periods_completed += 1;
+    chan->stats.transactions += 1;
+    chan->stats.bytes += chan->period_len;
+    pthread_mutex_unlock(&chan->dev->lock);
+
+    complete_transaction(chan, 0, 0);
+
+    pthread_mutex_lock(&chan->dev->lock);
+    chan->is_busy = false;
+    pthread_cond_broadcast(&chan->dev->cond);
+}
+
+// The thread of a channel, runs its cyclic transfer or its queued transfers
+static void *channel_thread(void *arg)
+{
+    sim_channel_t *chan;
+
+    chan = (sim_channel_t *)arg;
+
+    pthread_mutex_lock(&chan->dev->lock);
+    while (!chan->dev->is_closing)
+    {
+        if (chan->ring != NULL) {
+            run_period(chan);
+        } else if (chan->num_jobs > 0) {
+            run_job(chan);
+        } else {
+            pthread_cond_wait(&chan->dev->cond, &chan->dev->lock);
+        }
+    }
+    pthread_mutex_unlock(&chan->dev->lock);
+
+    return NULL;
+}
+
+/* Records a transaction of the channel as cancelled. If its completion was to
+ * be reported, a completion with -ECANCELED is queued on the eventfd of the
+ * channel, as the driver does. Called with the device locked. */
+static void cancel_transaction(sim_channel_t *chan, unsigned int transaction_id,
+                               bool is_reported, const struct timespec *now)
+{
+    chan->num_in_flight -= 1;
+    record_status(chan, transaction_id, -ECANCELED);
+    publish_status(chan, transaction_id, true);
+    if (is_reported && !chan->is_polling && chan->completion_fd >= 0) {
+        queue_completion(chan, transaction_id, -ECANCELED, now);
+        signal_completion_fd(chan->completion_fd);
+    }
+}
+
+/* Stops the transfers of the channel with the device locked. The transfer the
+ * channel's thread is working on is finished first, unless this is called
+ * from that thread (from a callback or a port). The queued transfers are
+ * discarded, the ones reported through an eventfd get a cancelled completion
+ * there. */
+static void stop_channel(sim_channel_t *chan)
+{
+    sim_channel_t *tx_chan, *rx_chan;
+    sim_job_t *job;
+    bool tx_busy, rx_busy;
+    struct timespec cancel_time;
+    uint64_t now;
+    int i;
+
+    while (chan->is_busy && !pthread_equal(chan->thread, pthread_self()))
+    {
+        pthread_cond_wait(&chan->dev->cond, &chan->dev->lock);
+    }
+
+    tx_chan = find_channel(chan->dev, AXIDMA_SIM_TX_CHANNEL);
+    rx_chan = find_channel(chan->dev, AXIDMA_SIM_RX_CHANNEL);
+    tx_busy = channel_busy(tx_chan);
+    rx_busy = channel_busy(rx_chan);
+    clock_gettime(CLOCK_MONOTONIC, &cancel_time);
+    for (i = 0; i < chan->num_jobs; i++)
+    {
+        job = &chan->jobs[(chan->jobs_head + i) % AXIDMA_MAX_IN_FLIGHT];
+        if (job->tx_iovcnt > 0) {
+            cancel_transaction(tx_chan, job->tx_transaction_id,
+                               job->is_reported, &cancel_time);
+        }
+        if (job->rx_iovcnt > 0) {
+            cancel_transaction(rx_chan, job->rx_transaction_id,
+                               job->is_reported, &cancel_time);
+        }
+    }
+
+    chan->num_jobs = 0;
+    chan->ring = NULL;
+    now = now_ns();
+    if (tx_busy && !channel_busy(tx_chan)) {
+        stats_idle(tx_chan, now);
+    }
+    if (rx_busy && !channel_busy(rx_chan)) {
+        stats_idle(rx_chan, now);
+    }
+    chan->busy_until.tv_sec = 0;
+    chan->busy_until.tv_nsec = 0;
+    chan->generation += 1;
+    pthread_cond_broadcast(&chan->dev->cond);
+}
+
+/* Returns the status of a transaction of the channel, as reported by
+ * AXIDMA_WAIT. Called with the device locked. */
+static int transaction_status(sim_channel_t *chan, unsigned int transaction_id)
+{
+    sim_channel_t *owner;
+    sim_job_t *job;
+    int i, j;
+
+    if (transaction_id == 0 ||
+            id_after(transaction_id, chan->last_transaction_id)) {
+        return -EINVAL;
+    }
+
+    // Two-way transfers are queued on the receive channel
+    for (i = 0; i < SIM_NUM_CHANNELS; i++)
+    {
+        owner = &chan->dev->channels[i];
+        for (j = 0; j < owner->num_jobs; j++)
+        {
+            job = &owner->jobs[(owner->jobs_head + j) % AXIDMA_MAX_IN_FLIGHT];
+            if (chan->dir == AXIDMA_WRITE && job->tx_iovcnt > 0 &&
+                    job->tx_transaction_id == transaction_id) {
+                return -ETIME;
+            } else if (chan->dir == AXIDMA_READ && job->rx_iovcnt > 0 &&
+                    job->rx_transaction_id == transaction_id) {
+                return -ETIME;
+            }
+        }
+    }
+
+    for (i = 0; i < AXIDMA_MAX_IN_FLIGHT; i++)
+    {
+        if (chan->failed[i].transaction_id == transaction_id) {
+            return chan->failed[i].status;
+        }
+    }
+
+    return 0;
+}
+
+/* Waits for a transaction of the channel with the device locked, a timeout of
+ * 0 only checks its state, a negative one waits without a limit. */
+static int wait_transaction(sim_channel_t *chan, unsigned int transaction_id,
+                            int timeout_ms)
+{
+    struct timespec deadline, duration;
+    int status, rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    duration.tv_sec = (timeout_ms > 0) ? timeout_ms / 1000 : 0;
+    duration.tv_nsec = (timeout_ms > 0) ? (timeout_ms % 1000) * 1000000L : 0;
+    add_time(&deadline, &duration);
+
+    rc = 0;
+    status = transaction_status(chan, transaction_id);
+    while (status == -ETIME && timeout_ms != 0 && rc != ETIMEDOUT)
+    {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&chan->dev->cond, &chan->dev->lock);
+        } else {
+            rc = pthread_cond_timedwait(&chan->dev->cond, &chan->dev->lock,
+                                        &deadline);
+        }
+        status = transaction_status(chan, transaction_id);
+    }
+
+    return status;
+}
+
+/* Queues a one-shot transfer, on the receive channel for a two-way transfer,
+ * or on the channel of its direction otherwise. Returns the id of the receive
+ * transaction, or of the transmit transaction without a receive direction. A
+ * blocking transfer waits for the transfers queued before it, and is not
+ * reported. */
+static int queue_oneshot(axidma_dev_t dev, sim_channel_t *chan,
+        const struct axidma_iovec *tx_iov, int tx_iovcnt,
+        const struct axidma_iovec *rx_iov, int rx_iovcnt, bool wait)
+{
+    sim_channel_t *tx_chan, *rx_chan, *full_chan;
+    sim_job_t *job;
+    unsigned int transaction_id;
+    int status;
+
+    if (tx_iovcnt < 0 || tx_iovcnt > AXIDMA_MAX_IOVECS || rx_iovcnt < 0 ||
+            rx_iovcnt > AXIDMA_MAX_IOVECS || tx_iovcnt + rx_iovcnt == 0) {
+        fprintf(stderr, "Invalid number of buffers for a transfer.\n");
+        return -EINVAL;
+    }
+
+    tx_chan = find_channel(dev, AXIDMA_SIM_TX_CHANNEL);
+    rx_chan = find_channel(dev, AXIDMA_SIM_RX_CHANNEL);
+
+    /* As the driver, both directions of a two-way transfer must have room for
+     * it before either of them takes an id. */
+    pthread_mutex_lock(&dev->lock);
+    full_chan = NULL;
+    if (chan->num_jobs == AXIDMA_MAX_IN_FLIGHT) {
+        full_chan = chan;
+    } else if (tx_iovcnt > 0 &&
+               tx_chan->num_in_flight >= AXIDMA_MAX_IN_FLIGHT) {
+        full_chan = tx_chan;
+    } else if (rx_iovcnt > 0 &&
+               rx_chan->num_in_flight >= AXIDMA_MAX_IN_FLIGHT) {
+        full_chan = rx_chan;
+    }
+    if (full_chan != NULL) {
+        pthread_mutex_unlock(&dev->lock);
+        fprintf(stderr, "Too many transactions in flight on channel %d.\n",
+                full_chan->channel_id);
+        return -EBUSY;
+    }
+
+    // A new transfer replaces a cyclic one
+    if (chan->ring != NULL) {
+        stop_channel(chan);
+    }
+
+    job = &chan->jobs[(chan->jobs_head + chan->num_jobs) % AXIDMA_MAX_IN_FLIGHT];
+    memcpy(job->tx_iov, tx_iov, tx_iovcnt * sizeof(tx_iov[0]));
+    job->tx_iovcnt = tx_iovcnt;
+    job->tx_transaction_id = (tx_iovcnt > 0) ? next_transaction_id(tx_chan) : 0;
+    memcpy(job->rx_iov, rx_iov, rx_iovcnt * sizeof(rx_iov[0]));
+    job->rx_iovcnt = rx_iovcnt;
+    job->rx_transaction_id = (rx_iovcnt > 0) ? next_transaction_id(rx_chan) : 0;
+    job->is_reported = !wait;
+    clock_gettime(CLOCK_MONOTONIC, &job->submit_time);
+    if (tx_iovcnt > 0) {
+        stats_submit(tx_chan, time_ns(&job->submit_time));
+        tx_chan->num_in_flight += 1;
+    }
+    if (rx_iovcnt > 0) {
+        stats_submit(rx_chan, time_ns(&job->submit_time));
+        rx_chan->num_in_flight += 1;
+    }
+    transaction_id = (rx_iovcnt > 0) ? job->rx_transaction_id :
+                                       job->tx_transaction_id;
+    chan->num_jobs += 1;
+    pthread_cond_broadcast(&dev->cond);
+
+    status = 0;
+    if (wait) {
+        status = wait_transaction((rx_iovcnt > 0) ? rx_chan : tx_chan,
+                                  transaction_id, -1);
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    return (status < 0) ? status : (int)transaction_id;
+}
+
+/* Reads a control value from the environment, returns false if the variable
+ * is not set or is not a number. */
+static bool getenv_double(const char *name, double *value)
+{
+    const char *str;
+    char *end;
+
+    str = getenv(name);
+    if (str == NULL || *str == '\0') {
+        return false;
+    }
+
+    *value = strtod(str, &end);
+    if (*end != '\0') {
+        fprintf(stderr, "Ignoring %s, '%s' is not a number.\n", name, str);
+        return false;
+    }
+
+    return true;
+}
+
+/* Sets the controls of every channel from the environment, so the programs
+ * linked against (or preloaded with) the simulated library can be set up
+ * without changing them. */
+static void apply_environment(axidma_dev_t dev)
+{
+    double rate, latency_us, jitter_us, error_rate, seed;
+    bool has_rate, has_latency, has_jitter, has_error_rate;
+    int i;
+
+    has_rate = getenv_double(AXIDMA_SIM_RATE_ENV, &rate);
+    has_latency = getenv_double(AXIDMA_SIM_LATENCY_ENV, &latency_us);
+    has_jitter = getenv_double(AXIDMA_SIM_JITTER_ENV, &jitter_us);
+    has_error_rate = getenv_double(AXIDMA_SIM_ERROR_RATE_ENV, &error_rate);
+    if (getenv_double(AXIDMA_SIM_SEED_ENV, &seed)) {
+        axidma_sim_set_seed(dev, (unsigned int)seed);
+    }
+
+    for (i = 0; i < SIM_NUM_CHANNELS; i++)
+    {
+        if (has_rate) {
+            axidma_sim_set_rate(dev, i, rate);
+        }
+        if (has_latency || has_jitter) {
+            axidma_sim_set_latency(dev, i, has_latency ? latency_us : 0,
+                                   has_jitter ? jitter_us : 0);
+        }
+        if (has_error_rate) {
+            axidma_sim_set_error_rate(dev, i, error_rate);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------
+ * Public Interface
+ *----------------------------------------------------------------------------*/
+
+struct axidma_dev *axidma_init()
+{
+    return axidma_init_dev(0);
+}
+
+/* Initializes the simulated AXI DMA device, returning a new handle to the
+ * axidma_device. */
+struct axidma_dev *axidma_init_dev(unsigned int index)
+{
+    int i, rc;
+    struct axidma_dev *dev;
+    pthread_condattr_t cond_attr;
+
+    dev = (struct axidma_dev *)calloc(1, sizeof(struct axidma_dev));
+    if (dev == NULL) {
+        perror("Can't allocate AXI DMA structure");
+        return NULL;
+    }
+    dev->index = index;
+
+    // One DMA channel in each direction, no VDMA channels
+    dev->tx_chan_id = AXIDMA_SIM_TX_CHANNEL;
+    dev->rx_chan_id = AXIDMA_SIM_RX_CHANNEL;
+    dev->dma_tx_chans.len = 1;
+    dev->dma_tx_chans.data = &dev->tx_chan_id;
+    dev->dma_rx_chans.len = 1;
+    dev->dma_rx_chans.data = &dev->rx_chan_id;
+
+    for (i = 0; i < SIM_NUM_CHANNELS; i++)
+    {
+        dev->channels[i].dev = dev;
+        dev->channels[i].channel_id = i;
+        dev->channels[i].dir = (i == AXIDMA_SIM_TX_CHANNEL) ? AXIDMA_WRITE :
+                                                               AXIDMA_READ;
+        dev->channels[i].completion_fd = -1;
+        dev->channels[i].stats_since_ns = now_ns();
+        atomic_init(&dev->channels[i].finished_id, 0);
+        atomic_init(&dev->channels[i].unsuccessful_id, 0);
+    }
+
+    // The transfer deadlines are on the monotonic clock
+    pthread_mutex_init(&dev->lock, NULL);
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&dev->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    axidma_sim_set_seed(dev, SIM_DEFAULT_SEED);
+    apply_environment(dev);
+
+    // Each channel has a thread running its transfers
+    for (i = 0; i < SIM_NUM_CHANNELS; i++)
+    {
+        rc = pthread_create(&dev->channels[i].thread, NULL, channel_thread,
+                            &dev->channels[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("Failed to start the simulated DMA channel");
+            axidma_destroy(dev);
+            return NULL;
+        }
+        dev->num_threads += 1;
+    }
+
+    return dev;
+}
+
+// Tears down the given AXI DMA device structure
+void axidma_destroy(axidma_dev_t dev)
+{
+    int i;
+
+    // Stop the transfers and the threads, then close the completion eventfds
+    pthread_mutex_lock(&dev->lock);
+    for (i = 0; i < dev->num_threads; i++)
+    {
+        stop_channel(&dev->channels[i]);
+    }
+    dev->is_closing = true;
+    pthread_cond_broadcast(&dev->cond);
+    pthread_mutex_unlock(&dev->lock);
+
+    for (i = 0; i < SIM_NUM_CHANNELS; i++)
+    {
+        if (i < dev->num_threads) {
+            pthread_join(dev->channels[i].thread, NULL);
+        }
+        if (dev->channels[i].completion_fd >= 0) {
+            close(dev->channels[i].completion_fd);
+        }
+        free(dev->channels[i].scratch);
+    }
+
+    pthread_cond_destroy(&dev->cond);
+    pthread_mutex_destroy(&dev->lock);
+    free(dev);
+
+    return;
+}
+
+// Returns an array of all the available AXI DMA transmit channels
+const array_t *axidma_get_dma_tx(axidma_dev_t dev)
+{
+    return &dev->dma_tx_chans;
+}
+
+// Returns an array of all the available AXI DMA receive channels
+const array_t *axidma_get_dma_rx(axidma_dev_t dev)
+{
+    return &dev->dma_rx_chans;
+}
+
+// Returns an array of all the available AXI VDMA transmit channels
+const array_t *axidma_get_vdma_tx(axidma_dev_t dev)
+{
+    return &dev->vdma_tx_chans;
+}
+
+// Returns an array of all the available AXI VDMA receive channels
+const array_t *axidma_get_vdma_rx(axidma_dev_t dev)
+{
+    return &dev->vdma_rx_chans;
+}
+
+/* Allocates a region of memory for the simulated transfers, page aligned like
+ * the buffers of the driver. */
+void *axidma_malloc(axidma_dev_t dev, size_t size)
+{
+    void *addr;
+
+    // Silence the compiler
+    (void)dev;
+
+    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
+                -1, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    return addr;
+}
+
+// The simulated transfers work on any memory, the memory is cached anyway
+void *axidma_malloc_cached(axidma_dev_t dev, size_t size)
+{
+    return axidma_malloc(dev, size);
+}
+
+/* Frees a region of memory that was allocated with a call to axidma_malloc or
+ * axidma_malloc_cached. */
+void axidma_free(axidma_dev_t dev, void *addr, size_t size)
+{
+    // Silence the compiler
+    (void)dev;
+
+    if (munmap(addr, size) < 0) {
+        perror("Failed to free the simulated DMA region");
+        assert(false);
+    }
+
+    return;
+}
+
+/* Sets up a callback function to be called whenever the transaction completes
+ * on the given channel for asynchronous transfers. */
+void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
+                        void *data)
+{
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    chan->callback = callback;
+    chan->user_data = data;
+    pthread_mutex_unlock(&dev->lock);
+
+    return;
+}
+
+// The simulated transfers work on any memory, nothing has to be registered
+int axidma_register_buffer(axidma_dev_t dev, int dmabuf_fd, void *user_addr,
+                           size_t size)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)dmabuf_fd;
+    (void)user_addr;
+    (void)size;
+
+    return 0;
+}
+
+void axidma_unregister_buffer(axidma_dev_t dev, void *user_addr)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)user_addr;
+
+    return;
+}
+
+// The simulated device moves the data with the CPU, the caches are coherent
+// The simulated DMA buffers are ordinary memory, all cached
+bool axidma_is_cached(axidma_dev_t dev, const void *addr, size_t len)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)addr;
+    (void)len;
+
+    return true;
+}
+
+int axidma_sync_for_cpu(axidma_dev_t dev, void *addr, size_t len)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)addr;
+    (void)len;
+
+    return 0;
+}
+
+int axidma_sync_for_device(axidma_dev_t dev, void *addr, size_t len)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)addr;
+    (void)len;
+
+    return 0;
+}
+
+/* This performs a one-way transfer on the simulated device, the direction
+ * being specified by the channel. */
+int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
+        size_t len, bool wait)
+{
+    struct axidma_iovec iov;
+
+    iov.buf = buf;
+    iov.len = len;
+    return axidma_oneway_transfer_iov(dev, channel, &iov, 1, wait);
+}
+
+/* This performs a two-way transfer on the simulated device, the transmitted
+ * data is looped back to the receive buffer unless the channels have ports. */
+int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
+        size_t tx_len, struct axidma_video_frame *tx_frame, int rx_channel,
+        void *rx_buf, size_t rx_len, struct axidma_video_frame *rx_frame,
+        bool wait)
+{
+    struct axidma_iovec tx_iov, rx_iov;
+
+    // Silence the compiler
+    (void)tx_frame;
+    (void)rx_frame;
+
+    tx_iov.buf = tx_buf;
+    tx_iov.len = tx_len;
+    rx_iov.buf = rx_buf;
+    rx_iov.len = rx_len;
+    return axidma_twoway_transfer_iov(dev, tx_channel, &tx_iov, 1, rx_channel,
+                                      &rx_iov, 1, wait);
+}
+
+/* This performs a one-way vectored transfer on the simulated device, the
+ * direction being specified by the channel. */
+int axidma_oneway_transfer_iov(axidma_dev_t dev, int channel,
+        const struct axidma_iovec *iov, int iovcnt, bool wait)
+{
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    if (chan->dir == AXIDMA_WRITE) {
+        return queue_oneshot(dev, chan, iov, iovcnt, NULL, 0, wait);
+    }
+
+    return queue_oneshot(dev, chan, NULL, 0, iov, iovcnt, wait);
+}
+
+/* This performs a two-way vectored transfer on the simulated device, the
+ * transmitted data is looped back to the receive buffers unless the channels
+ * have ports. */
+int axidma_twoway_transfer_iov(axidma_dev_t dev, int tx_channel,
+        const struct axidma_iovec *tx_iov, int tx_iovcnt, int rx_channel,
+        const struct axidma_iovec *rx_iov, int rx_iovcnt, bool wait)
+{
+    // Without buffers in a direction, it is a one-way transfer
+    if (rx_iovcnt == 0) {
+        return axidma_oneway_transfer_iov(dev, tx_channel, tx_iov, tx_iovcnt,
+                                          wait);
+    } else if (tx_iovcnt == 0) {
+        return axidma_oneway_transfer_iov(dev, rx_channel, rx_iov, rx_iovcnt,
+                                          wait);
+    }
+
+    assert(find_channel(dev, tx_channel) != NULL);
+    assert(find_channel(dev, tx_channel)->dir == AXIDMA_WRITE);
+    assert(find_channel(dev, rx_channel) != NULL);
+    assert(find_channel(dev, rx_channel)->dir == AXIDMA_READ);
+
+    return queue_oneshot(dev, find_channel(dev, rx_channel), tx_iov, tx_iovcnt,
+                         rx_iov, rx_iovcnt, wait);
+}
+
+// The simulated device has no VDMA channels
+int axidma_video_transfer(axidma_dev_t dev, int display_channel, size_t width,
+        size_t height, size_t depth, void **frame_buffers, int num_buffers)
+{
+    // Silence the compiler
+    (void)dev;
+    (void)display_channel;
+    (void)width;
+    (void)height;
+    (void)depth;
+    (void)frame_buffers;
+    (void)num_buffers;
+
+    fprintf(stderr, "Video transfers are not simulated.\n");
+    return -ENOSYS;
+}
+
+/* This function stops all transfers on the given channel. The queued
+ * transfers are discarded without being reported. */
+void axidma_stop_transfer(axidma_dev_t dev, int channel)
+{
+    sim_channel_t *rx_chan;
+    bool is_twoway;
+    int i;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    pthread_mutex_lock(&dev->lock);
+    stop_channel(find_channel(dev, channel));
+
+    // Two-way transfers are queued on the receive channel
+    rx_chan = find_channel(dev, AXIDMA_SIM_RX_CHANNEL);
+    is_twoway = false;
+    for (i = 0; i < rx_chan->num_jobs; i++)
+    {
+        if (rx_chan->jobs[(rx_chan->jobs_head + i) %
+                          AXIDMA_MAX_IN_FLIGHT].tx_iovcnt > 0) {
+            is_twoway = true;
+        }
+    }
+    if (channel == AXIDMA_SIM_TX_CHANNEL && is_twoway) {
+        stop_channel(rx_chan);
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    return;
+}
+
+// Returns the completion eventfd of the channel, creating it on the first call
+int axidma_get_completion_fd(axidma_dev_t dev, int channel)
+{
+    int fd;
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    if (chan->completion_fd < 0) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            perror("Unable to create the completion eventfd");
+        }
+        chan->completion_fd = fd;
+    }
+    fd = chan->completion_fd;
+    pthread_mutex_unlock(&dev->lock);
+
+    return fd;
+}
+
+// Collects the completed transactions of the channel
+int axidma_reap(axidma_dev_t dev, int channel,
+        struct axidma_completion *completions, int max_completions)
+{
+    int rc, fd, num_completions;
+    uint64_t count;
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    fd = chan->completion_fd;
+    pthread_mutex_unlock(&dev->lock);
+    if (fd < 0 || max_completions <= 0) {
+        return -EINVAL;
+    }
+
+    // Non-blocking, fails with EAGAIN if nothing completed since the last call
+    if (read(fd, &count, sizeof(count)) < 0 &&
+            errno != EAGAIN) {
+        rc = -errno;
+        perror("Failed to read the completion eventfd");
+        return rc;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    num_completions = 0;
+    while (num_completions < max_completions && chan->num_completions > 0)
+    {
+        completions[num_completions] = chan->completions[chan->completions_head];
+        chan->completions_head = (chan->completions_head + 1) %
+                                 AXIDMA_COMPLETION_QUEUE_SIZE;
+        chan->num_completions -= 1;
+        num_completions += 1;
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    return num_completions;
+}
+
+// Waits for a transaction of the channel, queued on the thread of a channel
+int axidma_wait(axidma_dev_t dev, int channel, int transaction_id,
+        int timeout_ms)
+{
+    int status;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    pthread_mutex_lock(&dev->lock);
+    status = wait_transaction(find_channel(dev, channel),
+                              (unsigned int)transaction_id, timeout_ms);
+    pthread_mutex_unlock(&dev->lock);
+
+    return status;
+}
+
+// Sets whether the channel only publishes the completions of its transactions
+int axidma_set_polling(axidma_dev_t dev, int channel, bool enable)
+{
+    assert(find_channel(dev, channel) != NULL);
+
+    pthread_mutex_lock(&dev->lock);
+    find_channel(dev, channel)->is_polling = enable;
+    pthread_mutex_unlock(&dev->lock);
+
+    return 0;
+}
+
+/* Spins on the published status of the channel, then waits for the rest of
+ * the timeout. Unsuccessful transactions get their status from the wait. The
+ * completions come from the thread of the channel rather than an interrupt,
+ * so the spinning yields to it, it would not run on a single CPU otherwise. */
+int axidma_poll(axidma_dev_t dev, int channel, int transaction_id,
+        int spin_us, int timeout_ms)
+{
+    sim_channel_t *chan;
+    unsigned int id, finished_id, unsuccessful_id;
+    uint64_t deadline;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    if (transaction_id <= 0) {
+        return axidma_wait(dev, channel, transaction_id, timeout_ms);
+    }
+
+    chan = find_channel(dev, channel);
+    id = (unsigned int)transaction_id;
+    deadline = now_ns() + (uint64_t)spin_us * 1000;
+    do
+    {
+        finished_id = atomic_load_explicit(&chan->finished_id,
+                                           memory_order_acquire);
+        unsuccessful_id = atomic_load_explicit(&chan->unsuccessful_id,
+                                               memory_order_relaxed);
+        if (!id_after(id, finished_id)) {
+            return id_after(id, unsuccessful_id) ? 0 :
+                    axidma_wait(dev, channel, transaction_id, 0);
+        }
+        sched_yield();
+    } while (now_ns() < deadline);
+
+    return axidma_wait(dev, channel, transaction_id, timeout_ms);
+}
+
+// Starts a cyclic transfer over the ring, run by the thread of the channel
+int axidma_cyclic_transfer(axidma_dev_t dev, int channel, void *buf,
+        size_t period_len, int num_periods)
+{
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    if (num_periods < 2 || period_len == 0) {
+        fprintf(stderr, "A cyclic transfer needs at least 2 non-empty "
+                "periods.\n");
+        return -EINVAL;
+    }
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    stop_channel(chan);
+    clock_gettime(CLOCK_MONOTONIC, &chan->busy_until);
+    stats_submit(chan, time_ns(&chan->busy_until));
+    chan->ring = (char *)buf;
+    chan->period_len = period_len;
+    chan->num_periods = num_periods;
+    chan->periods_completed = 0;
+    pthread_cond_broadcast(&dev->cond);
+    pthread_mutex_unlock(&dev->lock);
+
+    return 0;
+}
+
+// Returns the number of periods the cyclic transfer completed since its start
+long long axidma_get_cyclic_periods(axidma_dev_t dev, int channel)
+{
+    int rc, fd;
+    long long periods_completed;
+    uint64_t count;
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    fd = chan->completion_fd;
+    pthread_mutex_unlock(&dev->lock);
+    if (fd >= 0 && read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        rc = -errno;
+        perror("Failed to read the completion eventfd");
+        return rc;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    periods_completed = (long long)chan->periods_completed;
+    pthread_mutex_unlock(&dev->lock);
+
+    return periods_completed;
+}
+
+// Gets the statistics of the channel, kept as the driver keeps them
+int axidma_get_stats(axidma_dev_t dev, int channel, struct axidma_stats *stats,
+        bool reset)
+{
+    sim_channel_t *chan;
+    uint64_t now;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    now = now_ns();
+    *stats = chan->stats;
+    stats->channel_id = channel;
+    stats->reset = reset;
+    stats->elapsed_ns = now - chan->stats_since_ns;
+    if (channel_busy(chan)) {
+        stats->busy_ns += now - chan->busy_since_ns;
+    }
+
+    if (reset) {
+        memset(&chan->stats, 0, sizeof(chan->stats));
+        chan->stats_since_ns = now;
+        chan->busy_since_ns = now;
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Simulation Controls
+ *----------------------------------------------------------------------------*/
+
+void axidma_sim_set_rate(axidma_dev_t dev, int channel,
+                         double bytes_per_second)
+{
+    assert(find_channel(dev, channel) != NULL);
+
+    pthread_mutex_lock(&dev->lock);
+    find_channel(dev, channel)->rate = bytes_per_second;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void axidma_sim_set_port(axidma_dev_t dev, int channel, axidma_sim_port_t port,
+                         void *user_data)
+{
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    chan->port = port;
+    chan->port_data = user_data;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void axidma_sim_set_latency(axidma_dev_t dev, int channel, double latency_us,
+                            double jitter_us)
+{
+    sim_channel_t *chan;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    chan = find_channel(dev, channel);
+    pthread_mutex_lock(&dev->lock);
+    chan->latency = (latency_us > 0) ? latency_us / 1e6 : 0;
+    chan->jitter = (jitter_us > 0) ? jitter_us / 1e6 : 0;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void axidma_sim_set_error_rate(axidma_dev_t dev, int channel,
+                               double probability)
+{
+    assert(find_channel(dev, channel) != NULL);
+
+    pthread_mutex_lock(&dev->lock);
+    find_channel(dev, channel)->error_rate = probability;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void axidma_sim_set_seed(axidma_dev_t dev, unsigned int seed)
+{
+    // The state of the generator must not be 0, the multiplier is odd
+    pthread_mutex_lock(&dev->lock);
+    dev->random_state = ((uint64_t)seed + 1) * 0x9E3779B97F4A7C15ULL;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+void axidma_sim_set_transform(axidma_dev_t dev,
+        axidma_sim_transform_t transform, void *user_data)
+{
+    pthread_mutex_lock(&dev->lock);
+    dev->transform = transform;
+    dev->transform_data = user_data;
+    pthread_mutex_unlock(&dev->lock);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file libaxidma_stats.c
+ *
+ * This file formats the statistics of the DMA channels. It only uses the
+ * public interface of the library, so it is part of both the AXI DMA library
+ * and the simulated one.
+ *
+ * @bug No known bugs.
+ **/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libaxidma.h"          // Local definitions
+#include "axidma_ioctl.h"       // Statistics structure
+
+/*----------------------------------------------------------------------------
+ * Private Helper Functions
+ *----------------------------------------------------------------------------*/
+
+// Formats a time in nanoseconds with a unit that suits its magnitude
+static const char *format_time(char *buf, size_t size, double time_ns)
+{
+    if (time_ns < 1e3) {
+        snprintf(buf, size, "%.0f ns", time_ns);
+    } else if (time_ns < 1e6) {
+        snprintf(buf, size, "%.1f us", time_ns / 1e3);
+    } else if (time_ns < 1e9) {
+        snprintf(buf, size, "%.1f ms", time_ns / 1e6);
+    } else {
+        snprintf(buf, size, "%.2f s", time_ns / 1e9);
+    }
+
+    return buf;
+}
+
+// Returns the upper bound of a histogram bucket in nanoseconds
+static double bucket_limit(int bucket)
+{
+    return (double)(1ULL << bucket);
+}
+
+/* Returns the bucket the given fraction of the counts of the histogram falls
+ * into, or -1 if it is empty. */
+static int histogram_percentile(const unsigned long long *histogram,
+                                double fraction)
+{
+    unsigned long long total, count;
+    int i;
+
+    total = 0;
+    for (i = 0; i < AXIDMA_STATS_BUCKETS; i++)
+    {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return -1;
+    }
+
+    count = 0;
+    for (i = 0; i < AXIDMA_STATS_BUCKETS - 1; i++)
+    {
+        count += histogram[i];
+        if ((double)count >= fraction * (double)total) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+// Writes the summary and the non-empty buckets of a histogram
+static void dump_histogram(FILE *stream, const char *title,
+        const unsigned long long *histogram, unsigned long long total_ns)
+{
+    char low[16], high[16];
+    unsigned long long count;
+    int i, p50, p99;
+
+    count = 0;
+    for (i = 0; i < AXIDMA_STATS_BUCKETS; i++)
+    {
+        count += histogram[i];
+    }
+    if (count == 0) {
+        fprintf(stream, "  %s: none\n", title);
+        return;
+    }
+
+    p50 = histogram_percentile(histogram, 0.5);
+    p99 = histogram_percentile(histogram, 0.99);
+    fprintf(stream, "  %s: %llu, mean %s, ", title, count,
+            format_time(low, sizeof(low), (double)total_ns / (double)count));
+    fprintf(stream, "p50 < %s, ", format_time(high, sizeof(high),
+            bucket_limit(p50)));
+    fprintf(stream, "p99 < %s\n", format_time(high, sizeof(high),
+            bucket_limit(p99)));
+
+    for (i = 0; i < AXIDMA_STATS_BUCKETS; i++)
+    {
+        if (histogram[i] == 0) {
+            continue;
+        }
+
+        format_time(low, sizeof(low), (i == 0) ? 0 : bucket_limit(i - 1));
+        if (i == AXIDMA_STATS_BUCKETS - 1) {
+            fprintf(stream, "    [%9s, %9s) %llu\n", low, "...",
+                    histogram[i]);
+        } else {
+            format_time(high, sizeof(high), bucket_limit(i));
+            fprintf(stream, "    [%9s, %9s) %llu\n", low, high,
+                    histogram[i]);
+        }
+    }
+}
+
+// Writes the statistics of the channels in the array
+static void dump_channels(axidma_dev_t dev, const char *name,
+        const array_t *channels, const char *kind, FILE *stream, bool reset)
+{
+    struct axidma_stats stats;
+    char elapsed[16], busy[16];
+    double utilization, throughput;
+    int i;
+
+    for (i = 0; i < channels->len; i++)
+    {
+        if (axidma_get_stats(dev, channels->data[i], &stats, reset) < 0) {
+            continue;
+        }
+
+        utilization = 0;
+        throughput = 0;
+        if (stats.elapsed_ns > 0) {
+            utilization = (double)stats.busy_ns / (double)stats.elapsed_ns;
+            throughput = (double)stats.bytes / ((double)stats.elapsed_ns /
+                                                1e9);
+        }
+
+        fprintf(stream, "%s%schannel %d (%s): %llu transactions, %llu bytes, "
+                "%llu errors in %s\n", (name != NULL) ? name : "",
+                (name != NULL) ? " " : "", channels->data[i], kind,
+                stats.transactions, stats.bytes, stats.errors,
+                format_time(elapsed, sizeof(elapsed),
+                            (double)stats.elapsed_ns));
+        fprintf(stream, "  busy %s (%.1f%%), %.2f MB/s\n",
+                format_time(busy, sizeof(busy), (double)stats.busy_ns),
+                utilization * 100, throughput / 1e6);
+        dump_histogram(stream, "latency", stats.latency_histogram,
+                       stats.latency_total_ns);
+        dump_histogram(stream, "idle gap", stats.idle_histogram,
+                       stats.idle_total_ns);
+    }
+}
+
+/*----------------------------------------------------------------------------
+ * Public Interface
+ *----------------------------------------------------------------------------*/
+
+// Writes the statistics of all the channels of the device
+void axidma_dump_stats(axidma_dev_t dev, const char *name, FILE *stream,
+        bool reset)
+{
+    dump_channels(dev, name, axidma_get_dma_tx(dev), "tx", stream, reset);
+    dump_channels(dev, name, axidma_get_dma_rx(dev), "rx", stream, reset);
+    dump_channels(dev, name, axidma_get_vdma_tx(dev), "vdma tx", stream,
+                  reset);
+    dump_channels(dev, name, axidma_get_vdma_rx(dev), "vdma rx", stream,
+                  reset);
+    fflush(stream);
+}
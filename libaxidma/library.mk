@@ -20,18 +20,24 @@ LIBAXIDMA_CFLAGS = $(GLOBAL_CFLAGS) -fPIC -shared \
 
 # The files that makeup the AXI DMA library
 LIBAXIDMA_DIR = $(ROOT)/libaxidma
-LIBAXIDMA_FILES = libaxidma.c
+LIBAXIDMA_FILES = libaxidma.c libaxidma_stats.c
 LIBAXIDMA = $(addprefix $(LIBAXIDMA_DIR)/,$(LIBAXIDMA_FILES))
 
+# The files that makeup the simulated AXI DMA library, for running on a host
+LIBAXIDMA_SIM_FILES = libaxidma_sim.c libaxidma_stats.c
+LIBAXIDMA_SIM = $(addprefix $(LIBAXIDMA_DIR)/,$(LIBAXIDMA_SIM_FILES))
+
 # The header files for the AXI DMA library interface
 LIBAXIDMA_INC_DIRS = $(LIBAXIDMA_DIR)/include
 LIBAXIDMA_INC_FILES = libaxidma.h axidma_ioctl.h
 LIBAXIDMA_INC = $(addprefix $(LIBAXIDMA_INC_DIRS)/,$(LIBAXIDMA_INC_FILES))
+LIBAXIDMA_SIM_INC = $(LIBAXIDMA_INC) $(LIBAXIDMA_INC_DIRS)/libaxidma_sim.h
 LIBAXIDMA_INC_FLAGS = $(addprefix -I ,$(LIBAXIDMA_INC_DIRS))
 
 # The shared library files generated by compilation
 LIBAXIDMA_NAME = libaxidma
 LIBAXIDMA_LIBRARY = $(LIBAXIDMA_DIR)/$(LIBAXIDMA_NAME).so
+LIBAXIDMA_SIM_LIBRARY = $(LIBAXIDMA_DIR)/$(LIBAXIDMA_NAME)_sim.so
 LIBAXIDMA_INSTALL_DIR ?= $(OUTPUT_DIR)
 
 # The Doxygen configuration file and generated libaxidma documentation file
@@ -42,7 +48,7 @@ LIBAXIDMA_DOC = $(DOC_DIR)/html/index.html
 # Targets
 ################################################################################
 
-.PHONY: libaxidma libaxidma_docs libaxidma_clean
+.PHONY: libaxidma libaxidma_sim libaxidma_docs libaxidma_clean
 
 # User-facing targets for compiling the library
 libaxidma: $(LIBAXIDMA_LIBRARY)
@@ -51,12 +57,24 @@ libaxidma: $(LIBAXIDMA_LIBRARY)
 	install -d $(LIBAXIDMA_INSTALL_DIR)/include/
 	install -m 644 $(LIBAXIDMA_INC) $(LIBAXIDMA_INSTALL_DIR)/include/
 
-# Compile the library into a shared library file
+libaxidma_sim: $(LIBAXIDMA_SIM_LIBRARY)
+	install -d $(LIBAXIDMA_INSTALL_DIR)/lib/
+	install -m 644 $< $(LIBAXIDMA_INSTALL_DIR)/lib/
+	install -d $(LIBAXIDMA_INSTALL_DIR)/include/
+	install -m 644 $(LIBAXIDMA_SIM_INC) $(LIBAXIDMA_INSTALL_DIR)/include/
+
+# Compile the library into a shared library file, it locks with pthreads
 $(LIBAXIDMA_LIBRARY): $(LIBAXIDMA) $(LIBAXIDMA_INC)
-	$(CC) $(LIBAXIDMA_CFLAGS) $(LIBAXIDMA_INC_FLAGS) $(filter %.c,$^) -o $@
+	$(CC) $(LIBAXIDMA_CFLAGS) -pthread $(LIBAXIDMA_INC_FLAGS) \
+		$(filter %.c,$^) -o $@
+
+# Compile the simulated library, its transfers run on threads
+$(LIBAXIDMA_SIM_LIBRARY): $(LIBAXIDMA_SIM) $(LIBAXIDMA_SIM_INC)
+	$(CC) $(LIBAXIDMA_CFLAGS) -pthread $(LIBAXIDMA_INC_FLAGS) \
+		$(filter %.c,$^) -o $@
 
 # Clean up all the files generated by compiling the library
 libaxidma-clean:
-	rm -f $(LIBAXIDMA_LIBRARY)
+	rm -f $(LIBAXIDMA_LIBRARY) $(LIBAXIDMA_SIM_LIBRARY)
 
 endif # LIBAXIDMA_MAKEFILE_
@@ -14,6 +14,7 @@
 
 // Kernel dependencies
 #include <linux/list.h>         // Linked list definitions and functions
+#include <linux/rwsem.h>        // Read-write semaphore of the buffer lists
 #include <linux/kernel.h>           // Contains the definition for printk
 #include <linux/device.h>           // Definitions for class and device structs
 #include <linux/cdev.h>             // Definitions for character device structs
@@ -66,8 +67,11 @@ struct axidma_device {
     struct platform_device *pdev;   // The platofrm device from the device tree
     struct axidma_cb_data *cb_data; // The callback data for each channel
     struct axidma_chan *channels;   // All available channels
+    struct axidma_chan_status *status_page; // Status of the channels, by id
+    struct rw_semaphore buffers_sem;    // Protects the lists of buffers
     struct list_head dmabuf_list;   // List of allocated DMA buffers
     struct list_head external_dmabufs;  // Buffers allocated in other drivers
+    void *last_external;            // External buffer of the last lookup
 };
 
 /*----------------------------------------------------------------------------
@@ -111,8 +115,26 @@ int axidma_video_transfer(struct axidma_device *dev,
                           struct axidma_video_transaction *trans,
                           enum axidma_dir dir);
 int axidma_stop_channel(struct axidma_device *dev, struct axidma_chan *chan);
+int axidma_wait_transaction(struct axidma_device *dev, struct axidma_wait *wait);
+int axidma_get_stats(struct axidma_device *dev, struct axidma_stats *stats);
+int axidma_iov_transfer(struct axidma_device *dev,
+                        struct axidma_iov_transaction *trans);
+int axidma_cyclic_transfer(struct axidma_device *dev,
+                           struct axidma_cyclic_transaction *trans);
+int axidma_get_cyclic_status(struct axidma_device *dev,
+                             struct axidma_cyclic_status *status);
+int axidma_set_completion_fd(struct axidma_device *dev,
+                             struct axidma_completion_fd *completion_fd);
+int axidma_reap(struct axidma_device *dev, int channel_id,
+                struct axidma_completion *completions, int max_completions);
+void axidma_clear_completion_fds(struct axidma_device *dev);
+int axidma_set_polling(struct axidma_device *dev,
+                       struct axidma_polling *polling);
+void axidma_clear_polling(struct axidma_device *dev);
 dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
                                   size_t size);
+int axidma_uservirt_to_sg(struct axidma_device *dev, void *user_addr,
+                          size_t size, struct scatterlist *sg_list);
 
 /*----------------------------------------------------------------------------
  * Device Tree Definitions
@@ -68,14 +68,46 @@ static bool valid_dma_request(void *dma_start, size_t dma_size, void *user_addr,
            (char *)user_addr + user_size <= (char *)dma_start + dma_size;
 }
 
-/* Converts the given user space virtual address to a DMA address. If the
- * conversion is unsuccessful, then (dma_addr_t)NULL is returned. */
-dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
-                                  size_t size)
+/* Finds the external DMA buffer the given user buffer falls within. The buffer
+ * of the last lookup is checked first, as transfers tend to reuse the same
+ * buffers. Called with the buffers locked, lookups of several transfers can
+ * run at the same time, so the last buffer is only a hint. */
+static struct axidma_external_allocation *axidma_find_external(
+        struct axidma_device *dev, void *user_addr, size_t size)
+{
+    struct list_head *iter;
+    struct axidma_external_allocation *dma_ext_alloc;
+
+    dma_ext_alloc = READ_ONCE(dev->last_external);
+    if (dma_ext_alloc != NULL && valid_dma_request(dma_ext_alloc->user_addr,
+                dma_ext_alloc->size, user_addr, size)) {
+        return dma_ext_alloc;
+    }
+
+    list_for_each(iter, &dev->external_dmabufs)
+    {
+        dma_ext_alloc = container_of(iter, struct axidma_external_allocation,
+                                     list);
+        if (valid_dma_request(dma_ext_alloc->user_addr, dma_ext_alloc->size,
+                              user_addr, size)) {
+            WRITE_ONCE(dev->last_external, dma_ext_alloc);
+            return dma_ext_alloc;
+        }
+    }
+
+    return NULL;
+}
+
+/* Converts the given user space virtual address to a DMA address, with the
+ * buffers locked. */
+static dma_addr_t axidma_lookup_dma(struct axidma_device *dev, void *user_addr,
+                                    size_t size)
 {
     bool valid;
+    int i;
     dma_addr_t offset;
     struct list_head *iter;
+    struct scatterlist *sg;
     struct axidma_dma_allocation *dma_alloc;
     struct axidma_external_allocation *dma_ext_alloc;
 
@@ -91,23 +123,107 @@ dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
         }
     }
 
-    // Otherwise, iterate over the DMA buffers allocated by other drivers
-    list_for_each(iter, &dev->external_dmabufs)
+    // Otherwise, look for the DMA buffers allocated by other drivers
+    dma_ext_alloc = axidma_find_external(dev, user_addr, size);
+    if (dma_ext_alloc == NULL) {
+        return (dma_addr_t)NULL;
+    }
+
+    offset = (dma_addr_t)(user_addr - dma_ext_alloc->user_addr);
+    for_each_sg(dma_ext_alloc->sg_table->sgl, sg, dma_ext_alloc->sg_table->nents,
+                i)
     {
-        dma_ext_alloc = container_of(iter, struct axidma_external_allocation,
-                                     list);
-        valid = valid_dma_request(dma_ext_alloc->user_addr, dma_ext_alloc->size,
-                                  user_addr, size);
-        if (valid) {
-            offset = (dma_addr_t)(user_addr - dma_ext_alloc->user_addr);
-            return sg_dma_address(&dma_ext_alloc->sg_table->sgl[0]) + offset;
+        if (offset < sg_dma_len(sg)) {
+            valid = offset + size <= sg_dma_len(sg);
+            return valid ? sg_dma_address(sg) + offset : (dma_addr_t)NULL;
         }
+        offset -= sg_dma_len(sg);
     }
 
     // No matching allocation was found
     return (dma_addr_t)NULL;
 }
 
+/* Converts the given user space virtual address to a DMA address. If the
+ * conversion is unsuccessful, then (dma_addr_t)NULL is returned. A buffer
+ * within an external DMA buffer has to fall within one of its regions. The
+ * transfers only read the lists of buffers, so they do not exclude each
+ * other. */
+dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
+                                  size_t size)
+{
+    dma_addr_t dma_addr;
+
+    down_read(&dev->buffers_sem);
+    dma_addr = axidma_lookup_dma(dev, user_addr, size);
+    up_read(&dev->buffers_sem);
+
+    return dma_addr;
+}
+
+/* Fills the scatter-gather entries describing the given user buffer. A buffer
+ * within a DMA buffer of this driver takes a single entry, one within an
+ * external DMA buffer (e.g. a udmabuf made of ordinary pages) takes an entry
+ * for each of its regions the buffer spans. With a NULL list, the entries are
+ * only counted. Returns the number of entries, or -EFAULT if the buffer does
+ * not fall within a DMA buffer. */
+int axidma_uservirt_to_sg(struct axidma_device *dev, void *user_addr,
+                          size_t size, struct scatterlist *sg_list)
+{
+    int i, num_entries;
+    size_t offset, len;
+    dma_addr_t dma_addr;
+    struct scatterlist *sg;
+    struct axidma_external_allocation *dma_ext_alloc;
+
+    down_read(&dev->buffers_sem);
+    dma_addr = axidma_lookup_dma(dev, user_addr, size);
+    if (dma_addr != (dma_addr_t)NULL) {
+        if (sg_list != NULL) {
+            sg_dma_address(&sg_list[0]) = dma_addr;
+            sg_dma_len(&sg_list[0]) = size;
+        }
+        num_entries = 1;
+        goto unlock;
+    }
+
+    dma_ext_alloc = axidma_find_external(dev, user_addr, size);
+    if (dma_ext_alloc == NULL) {
+        num_entries = -EFAULT;
+        goto unlock;
+    }
+
+    // Split the buffer at the boundaries of the regions
+    num_entries = 0;
+    offset = (char *)user_addr - (char *)dma_ext_alloc->user_addr;
+    for_each_sg(dma_ext_alloc->sg_table->sgl, sg, dma_ext_alloc->sg_table->nents,
+                i)
+    {
+        if (size == 0) {
+            break;
+        } else if (offset >= sg_dma_len(sg)) {
+            offset -= sg_dma_len(sg);
+            continue;
+        }
+
+        len = min_t(size_t, size, sg_dma_len(sg) - offset);
+        if (sg_list != NULL) {
+            sg_dma_address(&sg_list[num_entries]) = sg_dma_address(sg) + offset;
+            sg_dma_len(&sg_list[num_entries]) = len;
+        }
+        num_entries += 1;
+        size -= len;
+        offset = 0;
+    }
+    if (size != 0) {
+        num_entries = -EFAULT;
+    }
+
+unlock:
+    up_read(&dev->buffers_sem);
+    return num_entries;
+}
+
 static int axidma_get_external(struct axidma_device *dev,
                                struct axidma_register_buffer *ext_buf)
 {
@@ -148,10 +264,12 @@ static int axidma_get_external(struct axidma_device *dev,
         goto detach_ext_dma;
     }
 
-    // The allocation is expected to be one contiguous memory region
-    if (dma_alloc->sg_table->nents != 1) {
-        axidma_err("External DMA allocations must a single contiguous region "
-                   "of physical memory.\n");
+    /* The allocation may be made of several regions of physical memory (e.g.
+     * the pages of a memfd exported by udmabuf), the transfers using it get a
+     * scatter-gather entry for each region they span. */
+    if (ext_buf->size > dma_alloc->dma_buf->size) {
+        axidma_err("External DMA buffer is smaller than the registered "
+                   "size.\n");
         rc = -EINVAL;
         goto unmap_ext_dma;
     }
@@ -159,7 +277,9 @@ static int axidma_get_external(struct axidma_device *dev,
     // Add ourselves the driver's list of external allocations
     dma_alloc->size = ext_buf->size;
     dma_alloc->user_addr = ext_buf->user_addr;
+    down_write(&dev->buffers_sem);
     list_add(&dma_alloc->list, &dev->external_dmabufs);
+    up_write(&dev->buffers_sem);
     return 0;
 
 unmap_ext_dma:
@@ -181,12 +301,20 @@ static int axidma_put_external(struct axidma_device *dev, void *user_addr)
     struct axidma_external_allocation *dma_alloc;
 
     // Find the allocation corresponding to the user address
+    down_write(&dev->buffers_sem);
     list_for_each(iter, &dev->external_dmabufs)
     {
         dma_alloc = container_of(iter, struct axidma_external_allocation, list);
         end_user_addr = (char *)dma_alloc->user_addr + dma_alloc->size;
 
         if (dma_alloc->user_addr <= user_addr && user_addr <= end_user_addr) {
+            // Remove it from the list, so no transfer finds it anymore
+            if (dev->last_external == dma_alloc) {
+                dev->last_external = NULL;
+            }
+            list_del(&dma_alloc->list);
+            up_write(&dev->buffers_sem);
+
             // Unmap the buffer, and detach ourselves from it
             dma_buf_unmap_attachment(dma_alloc->dma_attach,
                     dma_alloc->sg_table, DMA_BIDIRECTIONAL);
@@ -198,21 +326,26 @@ static int axidma_put_external(struct axidma_device *dev, void *user_addr)
             return 0;
         }
     }
+    up_write(&dev->buffers_sem);
 
     return -ENOENT;
 }
 
 static void axidma_vma_close(struct vm_area_struct *vma)
 {
+    struct axidma_device *dev;
     struct axidma_dma_allocation *dma_alloc;
 
-    // Get the AXI DMA allocation data and free the DMA buffer
+    // Remove the allocation from the list, so no transfer finds it anymore
+    dev = vma->vm_file->private_data;
     dma_alloc = vma->vm_private_data;
+    down_write(&dev->buffers_sem);
+    list_del(&dma_alloc->list);
+    up_write(&dev->buffers_sem);
+
+    // Free the DMA buffer and the structure
     dma_free_coherent(dma_alloc->device, dma_alloc->size, dma_alloc->kern_addr,
                       dma_alloc->dma_addr);
-
-    // Remove the allocation from the list, and free the structure
-    list_del(&dma_alloc->list);
     kfree(dma_alloc);
 
     return;
@@ -246,10 +379,34 @@ static int axidma_open(struct inode *inode, struct file *file)
 
 static int axidma_release(struct inode *inode, struct file *file)
 {
+    // The eventfds and the polling belong to the process closing the device
+    axidma_clear_completion_fds(file->private_data);
+    axidma_clear_polling(file->private_data);
     file->private_data = NULL;
     return 0;
 }
 
+/* Maps the status page of the channels read-only, the driver writes it as the
+ * transactions finish. */
+static int axidma_mmap_status(struct axidma_device *dev,
+                              struct vm_area_struct *vma)
+{
+    unsigned long pfn;
+
+    if (vma->vm_end - vma->vm_start != PAGE_SIZE ||
+            (vma->vm_flags & VM_WRITE) != 0) {
+        axidma_err("The status page can only be mapped whole and "
+                   "read-only.\n");
+        return -EINVAL;
+    }
+
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_DONTCOPY;
+    pfn = virt_to_phys(dev->status_page) >> PAGE_SHIFT;
+    return remap_pfn_range(vma, vma->vm_start, pfn, PAGE_SIZE,
+                           vma->vm_page_prot);
+}
+
 static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
 {
     int rc;
@@ -258,6 +415,9 @@ static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
 
     // Get the axidma device structure
     dev = file->private_data;
+    if (vma->vm_pgoff == AXIDMA_STATUS_OFFSET >> PAGE_SHIFT) {
+        return axidma_mmap_status(dev, vma);
+    }
 
     // Allocate a structure to store data about the DMA mapping
     dma_alloc = kmalloc(sizeof(*dma_alloc), GFP_KERNEL);
@@ -314,7 +474,9 @@ static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
     vma->vm_flags |= VM_DONTCOPY;
 
     // Add the allocation to the driver's list of DMA buffers
+    down_write(&dev->buffers_sem);
     list_add(&dma_alloc->list, &dev->dmabuf_list);
+    up_write(&dev->buffers_sem);
     return 0;
 
 free_dma_region:
@@ -370,6 +532,16 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     struct axidma_inout_transaction inout_trans;
     struct axidma_video_transaction video_trans, *__user user_video_trans;
     struct axidma_chan chan_info;
+    struct axidma_completion_fd completion_fd;
+    struct axidma_reap reap;
+    struct axidma_completion *completions;
+    struct axidma_cyclic_transaction cyclic_trans;
+    struct axidma_cyclic_status cyclic_status;
+    struct axidma_iov_transaction iov_trans, user_iov_trans;
+    struct axidma_wait wait_info;
+    struct axidma_stats *stats;
+    struct axidma_polling polling;
+    struct axidma_iovec tx_iov[AXIDMA_MAX_IOVECS], rx_iov[AXIDMA_MAX_IOVECS];
 
     // Coerce the arguement as a userspace pointer
     arg_ptr = (void __user *)arg;
@@ -454,6 +626,16 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
             rc = axidma_read_transfer(dev, &trans);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the id of the transaction to userspace
+            if (copy_to_user(arg_ptr, &trans, sizeof(trans)) != 0) {
+                axidma_err("Unable to copy transfer info to userspace for "
+                           "AXIDMA_DMA_READ.\n");
+                return -EFAULT;
+            }
             break;
 
         case AXIDMA_DMA_WRITE:
@@ -463,6 +645,16 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
             rc = axidma_write_transfer(dev, &trans);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the id of the transaction to userspace
+            if (copy_to_user(arg_ptr, &trans, sizeof(trans)) != 0) {
+                axidma_err("Unable to copy transfer info to userspace for "
+                           "AXIDMA_DMA_WRITE.\n");
+                return -EFAULT;
+            }
             break;
 
         case AXIDMA_DMA_READWRITE:
@@ -473,6 +665,16 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
             rc = axidma_rw_transfer(dev, &inout_trans);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the id of the transaction to userspace
+            if (copy_to_user(arg_ptr, &inout_trans, sizeof(inout_trans)) != 0) {
+                axidma_err("Unable to copy transfer info to userspace for "
+                           "AXIDMA_DMA_READWRITE.\n");
+                return -EFAULT;
+            }
             break;
 
         case AXIDMA_DMA_VIDEO_READ:
@@ -549,6 +751,188 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             rc = axidma_put_external(dev, (void *)arg);
             break;
 
+        case AXIDMA_SET_COMPLETION_FD:
+            if (copy_from_user(&completion_fd, arg_ptr,
+                               sizeof(completion_fd)) != 0) {
+                axidma_err("Unable to copy eventfd info from userspace for "
+                           "AXIDMA_SET_COMPLETION_FD.\n");
+                return -EFAULT;
+            }
+            rc = axidma_set_completion_fd(dev, &completion_fd);
+            break;
+
+        case AXIDMA_REAP:
+            if (copy_from_user(&reap, arg_ptr, sizeof(reap)) != 0) {
+                axidma_err("Unable to copy reap info from userspace for "
+                           "AXIDMA_REAP.\n");
+                return -EFAULT;
+            }
+
+            // No more than a full queue can be reaped at once
+            if (reap.max_completions <= 0) {
+                return -EINVAL;
+            } else if (reap.max_completions > AXIDMA_COMPLETION_QUEUE_SIZE) {
+                reap.max_completions = AXIDMA_COMPLETION_QUEUE_SIZE;
+            }
+
+            size = reap.max_completions * sizeof(completions[0]);
+            completions = kmalloc(size, GFP_KERNEL);
+            if (completions == NULL) {
+                axidma_err("Unable to allocate array for the completions.\n");
+                return -ENOMEM;
+            }
+
+            rc = axidma_reap(dev, reap.channel_id, completions,
+                             reap.max_completions);
+            if (rc < 0) {
+                kfree(completions);
+                break;
+            }
+
+            // Copy the completions, then their number to userspace
+            reap.num_completions = rc;
+            size = reap.num_completions * sizeof(completions[0]);
+            if (copy_to_user(reap.completions, completions, size) != 0 ||
+                    copy_to_user(arg_ptr, &reap, sizeof(reap)) != 0) {
+                axidma_err("Unable to copy completions to userspace for "
+                           "AXIDMA_REAP.\n");
+                kfree(completions);
+                return -EFAULT;
+            }
+
+            kfree(completions);
+            rc = 0;
+            break;
+
+        case AXIDMA_DMA_CYCLIC:
+            if (copy_from_user(&cyclic_trans, arg_ptr,
+                               sizeof(cyclic_trans)) != 0) {
+                axidma_err("Unable to copy transfer info from userspace for "
+                           "AXIDMA_DMA_CYCLIC.\n");
+                return -EFAULT;
+            }
+            rc = axidma_cyclic_transfer(dev, &cyclic_trans);
+            break;
+
+        case AXIDMA_GET_CYCLIC_STATUS:
+            if (copy_from_user(&cyclic_status, arg_ptr,
+                               sizeof(cyclic_status)) != 0) {
+                axidma_err("Unable to copy channel info from userspace for "
+                           "AXIDMA_GET_CYCLIC_STATUS.\n");
+                return -EFAULT;
+            }
+            rc = axidma_get_cyclic_status(dev, &cyclic_status);
+            if (rc < 0) {
+                break;
+            }
+            if (copy_to_user(arg_ptr, &cyclic_status,
+                             sizeof(cyclic_status)) != 0) {
+                axidma_err("Unable to copy the cyclic status to userspace "
+                           "for AXIDMA_GET_CYCLIC_STATUS.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_DMA_IOV:
+            if (copy_from_user(&iov_trans, arg_ptr, sizeof(iov_trans)) != 0) {
+                axidma_err("Unable to copy transfer info from userspace for "
+                           "AXIDMA_DMA_IOV.\n");
+                return -EFAULT;
+            }
+            if (iov_trans.tx_iovcnt < 0 ||
+                    iov_trans.tx_iovcnt > AXIDMA_MAX_IOVECS ||
+                    iov_trans.rx_iovcnt < 0 ||
+                    iov_trans.rx_iovcnt > AXIDMA_MAX_IOVECS) {
+                axidma_err("Invalid number of buffers for AXIDMA_DMA_IOV.\n");
+                return -EINVAL;
+            }
+
+            // Copy the buffer vectors, the transaction is returned unchanged
+            user_iov_trans = iov_trans;
+            if (copy_from_user(tx_iov, user_iov_trans.tx_iov,
+                        iov_trans.tx_iovcnt * sizeof(tx_iov[0])) != 0 ||
+                    copy_from_user(rx_iov, user_iov_trans.rx_iov,
+                        iov_trans.rx_iovcnt * sizeof(rx_iov[0])) != 0) {
+                axidma_err("Unable to copy the buffer vectors from userspace "
+                           "for AXIDMA_DMA_IOV.\n");
+                return -EFAULT;
+            }
+            iov_trans.tx_iov = tx_iov;
+            iov_trans.rx_iov = rx_iov;
+
+            rc = axidma_iov_transfer(dev, &iov_trans);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the ids of the transactions to userspace
+            user_iov_trans.tx_transaction_id = iov_trans.tx_transaction_id;
+            user_iov_trans.rx_transaction_id = iov_trans.rx_transaction_id;
+            if (copy_to_user(arg_ptr, &user_iov_trans,
+                             sizeof(user_iov_trans)) != 0) {
+                axidma_err("Unable to copy transfer info to userspace for "
+                           "AXIDMA_DMA_IOV.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_WAIT:
+            if (copy_from_user(&wait_info, arg_ptr, sizeof(wait_info)) != 0) {
+                axidma_err("Unable to copy wait info from userspace for "
+                           "AXIDMA_WAIT.\n");
+                return -EFAULT;
+            }
+            rc = axidma_wait_transaction(dev, &wait_info);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the status of the transaction to userspace
+            if (copy_to_user(arg_ptr, &wait_info, sizeof(wait_info)) != 0) {
+                axidma_err("Unable to copy wait info to userspace for "
+                           "AXIDMA_WAIT.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_GET_STATS:
+            // The histograms are too large for the stack
+            stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+            if (stats == NULL) {
+                axidma_err("Unable to allocate the channel statistics.\n");
+                return -ENOMEM;
+            }
+            if (copy_from_user(stats, arg_ptr, sizeof(*stats)) != 0) {
+                axidma_err("Unable to copy statistics info from userspace "
+                           "for AXIDMA_GET_STATS.\n");
+                kfree(stats);
+                return -EFAULT;
+            }
+            rc = axidma_get_stats(dev, stats);
+            if (rc < 0) {
+                kfree(stats);
+                break;
+            }
+
+            // Return the statistics of the channel to userspace
+            if (copy_to_user(arg_ptr, stats, sizeof(*stats)) != 0) {
+                axidma_err("Unable to copy statistics to userspace for "
+                           "AXIDMA_GET_STATS.\n");
+                kfree(stats);
+                return -EFAULT;
+            }
+            kfree(stats);
+            break;
+
+        case AXIDMA_SET_POLLING:
+            if (copy_from_user(&polling, arg_ptr, sizeof(polling)) != 0) {
+                axidma_err("Unable to copy polling info from userspace for "
+                           "AXIDMA_SET_POLLING.\n");
+                return -EFAULT;
+            }
+            rc = axidma_set_polling(dev, &polling);
+            break;
+
         // Invalid command (already handled in preamble)
         default:
             return -ENOTTY;
@@ -609,8 +993,10 @@ int axidma_chrdev_init(struct axidma_device *dev)
     }
 
     // Initialize the list for DMA mmap'ed allocations
+    init_rwsem(&dev->buffers_sem);
     INIT_LIST_HEAD(&dev->dmabuf_list);
     INIT_LIST_HEAD(&dev->external_dmabufs);
+    dev->last_external = NULL;
 
     return 0;
 
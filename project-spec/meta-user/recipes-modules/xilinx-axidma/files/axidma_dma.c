@@ -26,6 +26,10 @@
 #include <linux/errno.h>            // Linux error codes
 #include <linux/platform_device.h>  // Platform device definitions
 #include <linux/device.h>           // Device definitions and functions
+#include <linux/eventfd.h>          // Completion notification through eventfd
+#include <linux/kfifo.h>            // Queue of completed transactions
+#include <linux/spinlock.h>         // Spinlock for the completion queue
+#include <linux/timekeeping.h>      // Completion timestamps
 
 /* Between 3.x and 4.x, the path to Xilinx's DMA include file changes. However,
  * in some 4.x kernels, the path is still the old one from 3.x. The macro is
@@ -61,6 +65,7 @@ struct axidma_transfer {
     void *user_data;                // User data to be passed in the callback
     struct task_struct *process;    // The process requesting the transfer
     struct axidma_cb_data *cb_data; // The callback data struct
+    unsigned int transaction_id;    // Output, the id of the transaction
 
     // VDMA specific fields (kept as union for extensability)
     union {
@@ -68,13 +73,42 @@ struct axidma_transfer {
     };
 };
 
+// A transaction in flight on a channel, passed to the completion callback
+struct axidma_txn {
+    struct axidma_cb_data *cb_data; // The callback data of the channel
+    unsigned int transaction_id;    // The id of the transaction
+    struct completion *comp;        // For sync, the notification to kernel
+    bool in_use;                    // The slot holds a transaction in flight
+    bool is_abandoned;              // Given up on, it finishes unreported
+    u64 submit_ns;                  // The time the transaction was submitted
+    size_t len;                     // The number of bytes of the transaction
+};
+
 // The data to pass to the DMA transfer completion callback function
 struct axidma_cb_data {
     int channel_id;                 // The id of the channel used
     int notify_signal;              // For async, signal to send
     void *user_data;                // User data to be passed in the callback
     struct task_struct *process;    // The process to send the signal to
-    struct completion *comp;        // For sync, the notification to kernel
+    unsigned int last_transaction_id;   // The id of the previous transaction
+    spinlock_t lock;                // Protects the transactions and the queue
+    struct axidma_txn txns[AXIDMA_MAX_IN_FLIGHT];   // Slots by id modulo size
+    int num_in_flight;              // The number of transactions in flight
+    unsigned int cancelled_first;   // First id cancelled by the last stop
+    unsigned int cancelled_last;    // Last id cancelled by the last stop
+    wait_queue_head_t wait_queue;   // Woken up when transactions finish
+    struct eventfd_ctx *event_ctx;  // For async, eventfd instead of signal
+    unsigned long long periods_completed;   // For cyclic, periods so far
+    bool is_cyclic;                 // A cyclic transfer is running
+    size_t period_len;              // For cyclic, the length of a period
+    DECLARE_KFIFO(completions, struct axidma_completion,
+                  AXIDMA_COMPLETION_QUEUE_SIZE);    // Completions to reap
+    struct axidma_stats stats;      // The statistics of the channel
+    u64 stats_since_ns;             // The time the statistics were cleared
+    u64 busy_since_ns;              // The time the channel became busy
+    u64 idle_since_ns;              // The time it became idle (0: never busy)
+    struct axidma_chan_status *status;  // The entry in the status page
+    bool is_polling;                // Completions are only published
 };
 
 /*----------------------------------------------------------------------------
@@ -100,6 +134,78 @@ static enum dma_transfer_direction axidma_to_dma_dir(enum axidma_dir dma_dir)
     return (dma_dir == AXIDMA_WRITE) ? DMA_MEM_TO_DEV : DMA_DEV_TO_MEM;
 }
 
+/*----------------------------------------------------------------------------
+ * Channel Statistics
+ *----------------------------------------------------------------------------*/
+
+/* The statistics are updated with the channel locked, a transaction costs two
+ * timestamps and a few additions. */
+
+// Returns true if the channel has transactions in flight, or runs a cyclic one
+static bool axidma_chan_busy(struct axidma_cb_data *cb_data)
+{
+    return cb_data->num_in_flight > 0 || cb_data->is_cyclic;
+}
+
+// Counts a time in its histogram bucket
+static void axidma_stats_record(unsigned long long *histogram,
+                                unsigned long long *total_ns, u64 time_ns)
+{
+    histogram[min_t(int, fls64(time_ns), AXIDMA_STATS_BUCKETS - 1)] += 1;
+    *total_ns += time_ns;
+}
+
+/* Accounts for a transaction being submitted, before it is counted as in
+ * flight. If the channel was idle, this ends its idle gap. */
+static void axidma_stats_submit(struct axidma_cb_data *cb_data, u64 now_ns)
+{
+    struct axidma_stats *stats;
+
+    stats = &cb_data->stats;
+    if (axidma_chan_busy(cb_data)) {
+        return;
+    }
+
+    if (cb_data->idle_since_ns != 0) {
+        axidma_stats_record(stats->idle_histogram, &stats->idle_total_ns,
+                            now_ns - cb_data->idle_since_ns);
+    }
+    cb_data->busy_since_ns = now_ns;
+}
+
+// Accounts for the channel becoming idle, after its last transaction left
+static void axidma_stats_idle(struct axidma_cb_data *cb_data, u64 now_ns)
+{
+    cb_data->stats.busy_ns += now_ns - cb_data->busy_since_ns;
+    cb_data->idle_since_ns = now_ns;
+}
+
+// Accounts for a transaction completing, after it left the channel
+static void axidma_stats_complete(struct axidma_cb_data *cb_data,
+                                  struct axidma_txn *txn, u64 now_ns)
+{
+    struct axidma_stats *stats;
+
+    stats = &cb_data->stats;
+    stats->transactions += 1;
+    stats->bytes += txn->len;
+    axidma_stats_record(stats->latency_histogram, &stats->latency_total_ns,
+                        now_ns - txn->submit_ns);
+    if (!axidma_chan_busy(cb_data)) {
+        axidma_stats_idle(cb_data, now_ns);
+    }
+}
+
+// Counts a transaction that failed, called with the channel unlocked
+static void axidma_stats_error(struct axidma_cb_data *cb_data)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&cb_data->lock, flags);
+    cb_data->stats.errors += 1;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+}
+
 /*----------------------------------------------------------------------------
  * DMA Operations Helper Functions
  *----------------------------------------------------------------------------*/
@@ -124,6 +230,66 @@ static int axidma_init_sg_entry(struct axidma_device *dev,
     return 0;
 }
 
+/* Sets up a scatter-gather list with an entry for each buffer of the vector,
+ * or for each region a buffer spans in an external DMA buffer, allocating the
+ * list. Returns the number of entries, the caller frees the list once the
+ * transfer is prepared. */
+static int axidma_init_sg_iov(struct axidma_device *dev,
+        struct scatterlist **sg_list, struct axidma_iovec *iov, int iovcnt)
+{
+    int i, rc, sg_len, num_entries;
+
+    if (iovcnt <= 0 || iovcnt > AXIDMA_MAX_IOVECS) {
+        axidma_err("Invalid number of buffers %d for a vectored transfer.\n",
+                   iovcnt);
+        return -EINVAL;
+    }
+
+    // Count the entries first, to allocate the list at once
+    sg_len = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len == 0) {
+            axidma_err("Buffer %d of the vectored transfer is empty.\n", i);
+            return -EINVAL;
+        }
+
+        num_entries = axidma_uservirt_to_sg(dev, iov[i].buf, iov[i].len,
+                                            NULL);
+        if (num_entries < 0) {
+            axidma_err("Requested transfer address %p does not fall within "
+                       "a previously allocated DMA buffer.\n", iov[i].buf);
+            return num_entries;
+        }
+        sg_len += num_entries;
+    }
+
+    *sg_list = kmalloc_array(sg_len, sizeof(**sg_list), GFP_KERNEL);
+    if (*sg_list == NULL) {
+        axidma_err("Unable to allocate the scatter-gather list.\n");
+        return -ENOMEM;
+    }
+
+    sg_init_table(*sg_list, sg_len);
+    num_entries = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        rc = axidma_uservirt_to_sg(dev, iov[i].buf, iov[i].len,
+                                   &(*sg_list)[num_entries]);
+        if (rc < 0) {
+            goto free_sg_list;
+        }
+        num_entries += rc;
+    }
+
+    return sg_len;
+
+free_sg_list:
+    kfree(*sg_list);
+    *sg_list = NULL;
+    return rc;
+}
+
 static struct axidma_chan *axidma_get_chan(struct axidma_device *dev,
         int channel_id)
 {
@@ -142,23 +308,26 @@ static struct axidma_chan *axidma_get_chan(struct axidma_device *dev,
     return NULL;
 }
 
-static void axidma_dma_callback(void *data)
+// Increments the eventfd, the signature changed in the 6.8 kernel
+static void axidma_eventfd_signal(struct eventfd_ctx *event_ctx)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
+    eventfd_signal(event_ctx, 1);
+#else
+    eventfd_signal(event_ctx);
+#endif
+}
+
+// Sends the notification signal of an asynchronous transfer, if requested
+static void axidma_send_signal(struct axidma_cb_data *cb_data)
 {
-    struct axidma_cb_data *cb_data;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 20, 0)
     struct siginfo sig_info;
 #else
     struct kernel_siginfo sig_info;
 #endif
 
-    printk("<<<<<<<<<<< ||||||||||||||||||||||| axidma_dma_callback ||||||||||||||||||||||| >>>>>>>>>>>>>");
-
-    /* For synchronous transfers, notify the kernel thread waiting. For
-     * asynchronous transfers, send a signal to userspace if requested. */
-    cb_data = data;
-    if (cb_data->comp != NULL) {
-        complete(cb_data->comp);
-    } else if (VALID_NOTIFY_SIGNAL(cb_data->notify_signal)) {
+    if (VALID_NOTIFY_SIGNAL(cb_data->notify_signal)) {
         memset(&sig_info, 0, sizeof(sig_info));
         sig_info.si_signo = cb_data->notify_signal;
         sig_info.si_code = SI_QUEUE;
@@ -168,6 +337,282 @@ static void axidma_dma_callback(void *data)
     }
 }
 
+/* Publishes the last finished transaction of the channel in the status page,
+ * and whether it was cancelled. The cancelled id is written first, a reader
+ * that sees the finished id sees it too. Called with the channel locked. */
+static void axidma_publish_status(struct axidma_cb_data *cb_data,
+                                  unsigned int transaction_id,
+                                  bool is_cancelled)
+{
+    if (is_cancelled) {
+        WRITE_ONCE(cb_data->status->cancelled_id, transaction_id);
+    }
+    smp_store_release(&cb_data->status->finished_id, transaction_id);
+}
+
+static void axidma_dma_callback(void *data)
+{
+    struct axidma_txn *txn;
+    struct axidma_cb_data *cb_data;
+    struct axidma_completion completion;
+    struct completion *comp;
+    unsigned int transaction_id;
+    unsigned long flags;
+    u64 now_ns;
+
+    // Release the slot of the transaction, and wake up the ones waiting for it
+    txn = data;
+    cb_data = txn->cb_data;
+    now_ns = ktime_get_ns();
+    spin_lock_irqsave(&cb_data->lock, flags);
+    if (!txn->in_use) {
+        // Cancelled by a stop while the callback was already scheduled
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        return;
+    }
+    transaction_id = txn->transaction_id;
+    comp = txn->comp;
+    txn->in_use = false;
+    cb_data->num_in_flight -= 1;
+    if (txn->is_abandoned) {
+        // Its submitter already returned an error, and counted it
+        if (!axidma_chan_busy(cb_data)) {
+            axidma_stats_idle(cb_data, now_ns);
+        }
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        wake_up_all(&cb_data->wait_queue);
+        return;
+    }
+    axidma_stats_complete(cb_data, txn, now_ns);
+    axidma_publish_status(cb_data, transaction_id, false);
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+    wake_up_all(&cb_data->wait_queue);
+
+    /* For synchronous transfers, notify the kernel thread waiting. For
+     * asynchronous transfers, send a signal to userspace if requested. */
+    if (comp != NULL) {
+        complete(comp);
+        return;
+    }
+
+    /* Channels with an eventfd queue the completion to be reaped from the
+     * event loop of the process, the others are notified with a signal. The
+     * callers of a channel in polling mode watch the status page. */
+    spin_lock_irqsave(&cb_data->lock, flags);
+    if (cb_data->is_polling) {
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        return;
+    } else if (cb_data->event_ctx != NULL) {
+        completion.transaction_id = transaction_id;
+        completion.status = 0;
+        completion.timestamp_ns = now_ns;
+        if (!kfifo_put(&cb_data->completions, completion)) {
+            axidma_err("Completion queue of channel %d is full, transaction "
+                       "%u is not reported.\n", cb_data->channel_id,
+                       completion.transaction_id);
+        }
+        axidma_eventfd_signal(cb_data->event_ctx);
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        return;
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    axidma_send_signal(cb_data);
+}
+
+/* Invoked for every period of a cyclic transfer. The periods are counted, so
+ * the application can tell the position of the DMA in the ring even if it
+ * handles several period notifications at once. */
+static void axidma_dma_cyclic_callback(void *data)
+{
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+    bool has_eventfd;
+
+    cb_data = data;
+    spin_lock_irqsave(&cb_data->lock, flags);
+    cb_data->periods_completed += 1;
+    cb_data->stats.transactions += 1;
+    cb_data->stats.bytes += cb_data->period_len;
+    has_eventfd = cb_data->event_ctx != NULL;
+    if (has_eventfd) {
+        axidma_eventfd_signal(cb_data->event_ctx);
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    if (!has_eventfd) {
+        axidma_send_signal(cb_data);
+    }
+}
+
+// Compares transaction ids, which wrap around at AXIDMA_MAX_TRANSACTION_ID
+static bool axidma_id_after(unsigned int id, unsigned int other_id)
+{
+    unsigned int distance;
+
+    // How far id is ahead of other_id, 0 counting as the largest id
+    distance = (id >= other_id) ? id - other_id :
+                                  id + (AXIDMA_MAX_TRANSACTION_ID - other_id);
+    return distance != 0 && distance <= AXIDMA_MAX_TRANSACTION_ID / 2;
+}
+
+/* Releases the slots of the transactions in flight on the channel after the
+ * DMA engine terminated them, remembering their ids as cancelled. Each one is
+ * reported as it would have been on completion, with a status of -ECANCELED:
+ * the kernel thread waiting for a synchronous one is woken up, and for an
+ * asynchronous one, a completion is queued on the eventfd of the channel. */
+static void axidma_cancel_transactions(struct axidma_cb_data *cb_data)
+{
+    int i, num_comps;
+    unsigned long flags;
+    bool was_busy, is_queued;
+    struct axidma_txn *txn;
+    struct axidma_completion completion;
+    struct completion *comps[AXIDMA_MAX_IN_FLIGHT];
+    u64 now_ns;
+
+    now_ns = ktime_get_ns();
+    num_comps = 0;
+    is_queued = false;
+    spin_lock_irqsave(&cb_data->lock, flags);
+    was_busy = axidma_chan_busy(cb_data);
+    if (cb_data->num_in_flight > 0) {
+        /* The ids in flight are the latest ones, they complete in order. The
+         * ids of failed submissions may leave gaps, so the first one is looked
+         * up in the slots. */
+        cb_data->cancelled_first = cb_data->last_transaction_id;
+        cb_data->cancelled_last = cb_data->last_transaction_id;
+        axidma_publish_status(cb_data, cb_data->last_transaction_id, true);
+    }
+    for (i = 0; i < AXIDMA_MAX_IN_FLIGHT; i++)
+    {
+        txn = &cb_data->txns[i];
+        if (!txn->in_use) {
+            continue;
+        }
+        if (axidma_id_after(cb_data->cancelled_first, txn->transaction_id)) {
+            cb_data->cancelled_first = txn->transaction_id;
+        }
+        txn->in_use = false;
+
+        if (txn->is_abandoned) {
+            continue;
+        } else if (txn->comp != NULL) {
+            comps[num_comps++] = txn->comp;
+        } else if (!cb_data->is_polling && cb_data->event_ctx != NULL) {
+            completion.transaction_id = txn->transaction_id;
+            completion.status = -ECANCELED;
+            completion.timestamp_ns = now_ns;
+            if (!kfifo_put(&cb_data->completions, completion)) {
+                axidma_err("Completion queue of channel %d is full, "
+                           "cancelled transaction %u is not reported.\n",
+                           cb_data->channel_id, completion.transaction_id);
+            }
+            is_queued = true;
+        }
+    }
+    if (is_queued) {
+        axidma_eventfd_signal(cb_data->event_ctx);
+    }
+    cb_data->num_in_flight = 0;
+    cb_data->is_cyclic = false;
+    if (was_busy) {
+        axidma_stats_idle(cb_data, now_ns);
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    wake_up_all(&cb_data->wait_queue);
+    for (i = 0; i < num_comps; i++)
+    {
+        complete(comps[i]);
+    }
+}
+
+/* Terminates the channel if it has nothing in flight anymore but transactions
+ * given up on, the engine is stuck on these. Anything submitted in the
+ * meantime is cancelled with them, and reported as such. */
+static void axidma_stop_if_stuck(struct axidma_chan *chan,
+                                 struct axidma_cb_data *cb_data)
+{
+    int i;
+    unsigned long flags;
+    bool is_stuck;
+
+    spin_lock_irqsave(&cb_data->lock, flags);
+    is_stuck = !cb_data->is_cyclic;
+    for (i = 0; i < AXIDMA_MAX_IN_FLIGHT; i++)
+    {
+        if (cb_data->txns[i].in_use && !cb_data->txns[i].is_abandoned) {
+            is_stuck = false;
+        }
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    if (is_stuck) {
+        dmaengine_terminate_all(chan->chan);
+        axidma_cancel_transactions(cb_data);
+    }
+}
+
+/* Releases the slot of a transaction that was not handed to the engine, its id
+ * is given out again if no later one was. Called with the lock of the channel
+ * held, returns false if a stop released it in the meantime. */
+static bool axidma_release_slot(struct axidma_cb_data *cb_data,
+                                unsigned int transaction_id)
+{
+    struct axidma_txn *txn;
+
+    txn = &cb_data->txns[transaction_id % AXIDMA_MAX_IN_FLIGHT];
+    if (!txn->in_use || txn->transaction_id != transaction_id) {
+        return false;
+    }
+
+    txn->in_use = false;
+    cb_data->num_in_flight -= 1;
+    if (cb_data->last_transaction_id == transaction_id) {
+        cb_data->last_transaction_id = transaction_id - 1;
+    }
+    if (!axidma_chan_busy(cb_data)) {
+        axidma_stats_idle(cb_data, ktime_get_ns());
+    }
+    return true;
+}
+
+/* Gives up on a transaction that failed or timed out, the other transactions
+ * of the channel go on. If it was not handed to the engine, its slot is
+ * released, and its id is given out again if no later one was. Otherwise, it
+ * keeps its slot until the engine finishes it, without being reported then,
+ * and the channel is only terminated once nothing else is in flight on it.
+ * Returns false if the transaction has finished in the meantime. */
+static bool axidma_abandon_transaction(struct axidma_chan *chan,
+                                       struct axidma_cb_data *cb_data,
+                                       unsigned int transaction_id,
+                                       bool is_submitted)
+{
+    struct axidma_txn *txn;
+    unsigned long flags;
+
+    spin_lock_irqsave(&cb_data->lock, flags);
+    txn = &cb_data->txns[transaction_id % AXIDMA_MAX_IN_FLIGHT];
+    if (!txn->in_use || txn->transaction_id != transaction_id) {
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        return false;
+    }
+
+    cb_data->stats.errors += 1;
+    if (!is_submitted) {
+        axidma_release_slot(cb_data, transaction_id);
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        return true;
+    }
+    txn->comp = NULL;
+    txn->is_abandoned = true;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    axidma_stop_if_stuck(chan, cb_data);
+    return true;
+}
+
 // Setup the config structure for VDMA
 static void axidma_setup_vdma_config(struct xilinx_vdma_config *dma_config)
 {
@@ -185,8 +630,90 @@ static void axidma_setup_vdma_config(struct xilinx_vdma_config *dma_config)
     return;
 }
 
-static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
-                                struct axidma_transfer *dma_tfr)
+/* Gives the transaction an id, reported when it completes (from 1 to
+ * AXIDMA_MAX_TRANSACTION_ID), and a slot for its callback data. Several transactions can be queued on the
+ * channel, the engine moves from one to the next by itself. Returns -EBUSY if
+ * the channel has no slot left. */
+static int axidma_reserve_transaction(struct axidma_transfer *dma_tfr)
+{
+    struct axidma_cb_data *cb_data;
+    struct scatterlist *sg;
+    struct axidma_txn *txn;
+    unsigned int transaction_id;
+    unsigned long flags;
+    size_t len;
+    int i;
+
+    cb_data = dma_tfr->cb_data;
+
+    // The length of the transaction, for the statistics
+    len = 0;
+    for_each_sg(dma_tfr->sg_list, sg, dma_tfr->sg_len, i)
+    {
+        len += sg_dma_len(sg);
+    }
+
+    spin_lock_irqsave(&cb_data->lock, flags);
+    transaction_id = cb_data->last_transaction_id + 1;
+    if (transaction_id > AXIDMA_MAX_TRANSACTION_ID) {
+        transaction_id = 1;
+    }
+    txn = &cb_data->txns[transaction_id % AXIDMA_MAX_IN_FLIGHT];
+    if (cb_data->num_in_flight >= AXIDMA_MAX_IN_FLIGHT || txn->in_use) {
+        cb_data->stats.errors += 1;
+        spin_unlock_irqrestore(&cb_data->lock, flags);
+        axidma_err("Too many %s %s transactions in flight.\n",
+                   axidma_type_to_string(dma_tfr->type),
+                   axidma_dir_to_string(dma_tfr->dir));
+        return -EBUSY;
+    }
+    cb_data->last_transaction_id = transaction_id;
+    txn->submit_ns = ktime_get_ns();
+    axidma_stats_submit(cb_data, txn->submit_ns);
+    cb_data->num_in_flight += 1;
+    txn->cb_data = cb_data;
+    txn->transaction_id = transaction_id;
+    txn->len = len;
+    txn->is_abandoned = false;
+    /* If we're going to wait for this transaction, initialize its completion,
+     * and setup the callback to complete it. A stop before it is submitted
+     * completes it as well. */
+    txn->comp = dma_tfr->wait ? &dma_tfr->comp : NULL;
+    if (dma_tfr->wait) {
+        init_completion(txn->comp);
+    }
+    txn->in_use = true;
+    dma_tfr->transaction_id = transaction_id;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    return 0;
+}
+
+/* Releases the slot of a transaction reserved but not submitted, as the other
+ * direction of its transfer could not be reserved or submitted. */
+static void axidma_release_transaction(struct axidma_transfer *dma_tfr)
+{
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+    bool is_released;
+
+    cb_data = dma_tfr->cb_data;
+    spin_lock_irqsave(&cb_data->lock, flags);
+    is_released = axidma_release_slot(cb_data, dma_tfr->transaction_id);
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    /* If a stop cancelled it first, its completion must arrive before the
+     * stack it is on goes away. */
+    if (!is_released && dma_tfr->wait) {
+        wait_for_completion(&dma_tfr->comp);
+    }
+}
+
+/* Prepares the descriptor of a transaction reserved on the channel, and
+ * submits it to the engine. On failure, the slot of the transaction is
+ * released. */
+static int axidma_submit_transfer(struct axidma_chan *axidma_chan,
+                                  struct axidma_transfer *dma_tfr)
 {
     struct dma_chan *chan;
     struct dma_device *dma_dev;
@@ -200,13 +727,11 @@ static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
     struct scatterlist *sg_list;
     int sg_len;
     dma_cookie_t dma_cookie;
+    struct axidma_txn *txn;
+    unsigned int transaction_id;
+    unsigned long flags;
     char *direction, *type;
     int rc;
-    
-       
-      
-    printk("<<<<<<<<<<< ||||||||||||||||||||||| axidma_prep_transfer ||||||||||||||||||||||| >>>>>>>>>>>>>");
-
 
     // Get the fields from the structures
     chan = axidma_chan->chan;
@@ -218,6 +743,8 @@ static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
     direction = axidma_dir_to_string(dma_tfr->dir);
     type = axidma_type_to_string(dma_tfr->type);
     cb_data = dma_tfr->cb_data;
+    transaction_id = dma_tfr->transaction_id;
+    txn = &cb_data->txns[transaction_id % AXIDMA_MAX_IN_FLIGHT];
 
     /* For VDMA transfers, we configure the channel, then prepare an interlaved
      * transfer. For DMA, we simply prepare a slave scatter-gather transfer. */
@@ -252,26 +779,18 @@ static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
         goto stop_dma;
     }
 
-    /* If we're going to wait for this channel, initialize the completion for
-     * the channel, and setup the callback to complete it. */
+    // Setup the notification of asynchronous transfers
+    spin_lock_irqsave(&cb_data->lock, flags);
     cb_data->channel_id = dma_tfr->channel_id;
-    cb_data->user_data = dma_tfr->user_data;
-    if (dma_tfr->wait) {
-        cb_data->comp = dma_comp;
-        cb_data->notify_signal = -1;
-        cb_data->user_data = dma_tfr->user_data;
-        cb_data->process = NULL;
-        init_completion(cb_data->comp);
-        dma_txnd->callback_param = cb_data;
-        dma_txnd->callback = axidma_dma_callback;
-    } else {
-        cb_data->comp = NULL;
+    if (!dma_tfr->wait) {
         cb_data->notify_signal = dma_tfr->notify_signal;
         cb_data->user_data = dma_tfr->user_data;
         cb_data->process = dma_tfr->process;
-        dma_txnd->callback_param = cb_data;
-        dma_txnd->callback = axidma_dma_callback;
     }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+    dma_txnd->callback_param = txn;
+    dma_txnd->callback = axidma_dma_callback;
+
     dma_cookie = dmaengine_submit(dma_txnd);
     if (dma_submit_error(dma_cookie)) {
         axidma_err("Unable to submit the %s %s transaction to the engine.\n",
@@ -285,10 +804,48 @@ static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
     return 0;
 
 stop_dma:
-    dmaengine_terminate_all(chan);
+    /* Nothing was handed to the engine, the other transactions go on. If a
+     * stop cancelled it first, its completion must arrive before the stack it
+     * is on goes away. */
+    if (!axidma_abandon_transaction(axidma_chan, cb_data, transaction_id,
+                                    false) && dma_tfr->wait) {
+        wait_for_completion(dma_comp);
+    }
     return rc;
 }
 
+// Reserves a slot for the transaction, and submits it to the engine
+static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
+                                struct axidma_transfer *dma_tfr)
+{
+    int rc;
+
+    rc = axidma_reserve_transaction(dma_tfr);
+    if (rc < 0) {
+        return rc;
+    }
+
+    return axidma_submit_transfer(axidma_chan, dma_tfr);
+}
+
+/* Gives up on a two-way transfer whose transmit transaction was submitted, but
+ * not its receive transaction. Once issued, the transmit descriptor would feed
+ * the core with no receive buffer for its output, which the next receive
+ * transaction would get instead of its own. Both channels are terminated, the
+ * transactions in flight on them are cancelled, and reported as such. */
+static void axidma_discard_transfer(struct axidma_chan *tx_chan,
+                                    struct axidma_transfer *tx_tfr,
+                                    struct axidma_chan *rx_chan,
+                                    struct axidma_cb_data *rx_cb_data)
+{
+    axidma_abandon_transaction(tx_chan, tx_tfr->cb_data,
+                               tx_tfr->transaction_id, true);
+    dmaengine_terminate_all(tx_chan->chan);
+    axidma_cancel_transactions(tx_tfr->cb_data);
+    dmaengine_terminate_all(rx_chan->chan);
+    axidma_cancel_transactions(rx_cb_data);
+}
+
 static int axidma_start_transfer(struct axidma_chan *chan,
                                  struct axidma_transfer *dma_tfr)
 {
@@ -297,7 +854,6 @@ static int axidma_start_transfer(struct axidma_chan *chan,
     enum dma_status status;
     char *direction, *type;
     unsigned long timeout, time_remain;
-    int rc;
 
     // Get the fields from the structures
     dma_comp = &dma_tfr->comp;
@@ -312,25 +868,30 @@ static int axidma_start_transfer(struct axidma_chan *chan,
     if (dma_tfr->wait) {
         timeout = msecs_to_jiffies(AXIDMA_DMA_TIMEOUT);
         time_remain = wait_for_completion_timeout(dma_comp, timeout);
-        status = dma_async_is_tx_complete(chan->chan, dma_cookie, NULL, NULL);
 
         if (time_remain == 0) {
-            axidma_err("%s %s transaction timed out.\n", type, direction);
-            rc = -ETIME;
-            goto stop_dma;
-        } else if (status != DMA_COMPLETE) {
+            if (axidma_abandon_transaction(chan, dma_tfr->cb_data,
+                                           dma_tfr->transaction_id, true)) {
+                axidma_err("%s %s transaction timed out.\n", type, direction);
+                return -ETIME;
+            }
+
+            /* It finished while timing out, the completion is on its way, and
+             * must arrive before the stack it is on goes away. */
+            wait_for_completion(dma_comp);
+        }
+
+        status = dma_async_is_tx_complete(chan->chan, dma_cookie, NULL, NULL);
+        if (status != DMA_COMPLETE) {
             axidma_err("%s %s transaction did not succceed. Status is %d.\n",
                        type, direction, status);
-            rc = -EBUSY;
-            goto stop_dma;
+            axidma_stats_error(dma_tfr->cb_data);
+            axidma_stop_if_stuck(chan, dma_tfr->cb_data);
+            return -EBUSY;
         }
     }
 
     return 0;
-
-stop_dma:
-    dmaengine_terminate_all(chan->chan);
-    return rc;
 }
 
 /*----------------------------------------------------------------------------
@@ -418,6 +979,7 @@ int axidma_read_transfer(struct axidma_device *dev,
         return rc;
     }
 
+    trans->transaction_id = rx_tfr.transaction_id;
     return 0;
 }
 
@@ -469,6 +1031,7 @@ int axidma_write_transfer(struct axidma_device *dev,
         return rc;
     }
 
+    trans->transaction_id = tx_tfr.transaction_id;
     return 0;
 }
 
@@ -544,13 +1107,27 @@ int axidma_rw_transfer(struct axidma_device *dev,
         memcpy(&rx_tfr.frame, &trans->rx_frame, sizeof(rx_tfr.frame));
     }
 
+    /* Reserve both transactions before submitting either, a full receive
+     * channel must not leave the transmit transaction on the engine. */
+    rc = axidma_reserve_transaction(&tx_tfr);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = axidma_reserve_transaction(&rx_tfr);
+    if (rc < 0) {
+        axidma_release_transaction(&tx_tfr);
+        return rc;
+    }
+
     // Prep both the receive and transmit transfers
-    rc = axidma_prep_transfer(tx_chan, &tx_tfr);
+    rc = axidma_submit_transfer(tx_chan, &tx_tfr);
     if (rc < 0) {
+        axidma_release_transaction(&rx_tfr);
         return rc;
     }
-    rc = axidma_prep_transfer(rx_chan, &rx_tfr);
+    rc = axidma_submit_transfer(rx_chan, &rx_tfr);
     if (rc < 0) {
+        axidma_discard_transfer(tx_chan, &tx_tfr, rx_chan, rx_tfr.cb_data);
         return rc;
     }
 
@@ -564,7 +1141,163 @@ int axidma_rw_transfer(struct axidma_device *dev,
         return rc;
     }
 
+    trans->tx_transaction_id = tx_tfr.transaction_id;
+    trans->rx_transaction_id = rx_tfr.transaction_id;
+    return 0;
+}
+
+/* Transfers the data of the transmit buffers out to the AXI DMA device, and
+ * places the data received into the receive buffers, each buffer being an
+ * entry of the scatter-gather list of its transfer. */
+int axidma_iov_transfer(struct axidma_device *dev,
+                        struct axidma_iov_transaction *trans)
+{
+    int rc;
+    bool has_tx, has_rx;
+    struct axidma_chan *tx_chan, *rx_chan;
+    struct scatterlist *tx_sg_list, *rx_sg_list;
+    struct axidma_transfer tx_tfr, rx_tfr;
+
+    has_tx = trans->tx_iovcnt > 0;
+    has_rx = trans->rx_iovcnt > 0;
+    if (!has_tx && !has_rx) {
+        axidma_err("A vectored transfer needs buffers in a direction.\n");
+        return -EINVAL;
+    }
+
+    // Get the transmit and receive channels with the given ids.
+    tx_chan = NULL;
+    rx_chan = NULL;
+    if (has_tx) {
+        tx_chan = axidma_get_chan(dev, trans->tx_channel_id);
+        if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE ||
+                tx_chan->type != AXIDMA_DMA) {
+            axidma_err("Invalid device id %d for DMA transmit channel.\n",
+                       trans->tx_channel_id);
+            return -ENODEV;
+        }
+    }
+    if (has_rx) {
+        rx_chan = axidma_get_chan(dev, trans->rx_channel_id);
+        if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ ||
+                rx_chan->type != AXIDMA_DMA) {
+            axidma_err("Invalid device id %d for DMA receive channel.\n",
+                       trans->rx_channel_id);
+            return -ENODEV;
+        }
+    }
+
+    // Setup the scatter-gather lists for the transfers (an entry per region)
+    tx_sg_list = NULL;
+    rx_sg_list = NULL;
+    if (has_tx) {
+        rc = axidma_init_sg_iov(dev, &tx_sg_list, trans->tx_iov,
+                                trans->tx_iovcnt);
+        if (rc < 0) {
+            return rc;
+        }
+        tx_tfr.sg_len = rc;
+    }
+    if (has_rx) {
+        rc = axidma_init_sg_iov(dev, &rx_sg_list, trans->rx_iov,
+                                trans->rx_iovcnt);
+        if (rc < 0) {
+            goto free_sg_lists;
+        }
+        rx_tfr.sg_len = rc;
+    }
+
+    // The call waits for the receive transfer, if there is one
+    if (has_tx) {
+        tx_tfr.sg_list = tx_sg_list;
+        tx_tfr.dir = tx_chan->dir;
+        tx_tfr.type = tx_chan->type;
+        tx_tfr.wait = trans->wait && !has_rx;
+        tx_tfr.channel_id = trans->tx_channel_id;
+        tx_tfr.notify_signal = dev->notify_signal;
+        tx_tfr.user_data = dev->user_data;
+        tx_tfr.process = get_current();
+        tx_tfr.cb_data = &dev->cb_data[trans->tx_channel_id];
+    }
+    if (has_rx) {
+        rx_tfr.sg_list = rx_sg_list;
+        rx_tfr.dir = rx_chan->dir;
+        rx_tfr.type = rx_chan->type;
+        rx_tfr.wait = trans->wait;
+        rx_tfr.channel_id = trans->rx_channel_id;
+        rx_tfr.notify_signal = dev->notify_signal;
+        rx_tfr.user_data = dev->user_data;
+        rx_tfr.process = get_current();
+        rx_tfr.cb_data = &dev->cb_data[trans->rx_channel_id];
+    }
+
+    /* Reserve both transactions before submitting either, a full receive
+     * channel must not leave the transmit transaction on the engine. */
+    if (has_tx) {
+        rc = axidma_reserve_transaction(&tx_tfr);
+        if (rc < 0) {
+            goto free_sg_lists;
+        }
+    }
+    if (has_rx) {
+        rc = axidma_reserve_transaction(&rx_tfr);
+        if (rc < 0) {
+            if (has_tx) {
+                axidma_release_transaction(&tx_tfr);
+            }
+            goto free_sg_lists;
+        }
+    }
+    if (has_tx) {
+        rc = axidma_submit_transfer(tx_chan, &tx_tfr);
+        if (rc < 0) {
+            if (has_rx) {
+                axidma_release_transaction(&rx_tfr);
+            }
+            goto free_sg_lists;
+        }
+    }
+    if (has_rx) {
+        rc = axidma_submit_transfer(rx_chan, &rx_tfr);
+        if (rc < 0) {
+            if (has_tx) {
+                axidma_discard_transfer(tx_chan, &tx_tfr, rx_chan,
+                                        rx_tfr.cb_data);
+            }
+            goto free_sg_lists;
+        }
+    }
+
+    // The descriptors are prepared, the lists are no longer needed
+    kfree(tx_sg_list);
+    kfree(rx_sg_list);
+    tx_sg_list = NULL;
+    rx_sg_list = NULL;
+
+    // Submit both transfers to the DMA engine, and wait on the receive transfer
+    trans->tx_transaction_id = 0;
+    trans->rx_transaction_id = 0;
+    if (has_tx) {
+        rc = axidma_start_transfer(tx_chan, &tx_tfr);
+        if (rc < 0) {
+            return rc;
+        }
+        trans->tx_transaction_id = tx_tfr.transaction_id;
+    }
+    if (has_rx) {
+        rc = axidma_start_transfer(rx_chan, &rx_tfr);
+        if (rc < 0) {
+            return rc;
+        }
+        trans->rx_transaction_id = rx_tfr.transaction_id;
+    }
+
     return 0;
+
+free_sg_lists:
+    kfree(tx_sg_list);
+    kfree(rx_sg_list);
+    return rc;
 }
 
 int axidma_video_transfer(struct axidma_device *dev,
@@ -637,6 +1370,7 @@ ret:
 int axidma_stop_channel(struct axidma_device *dev,
                         struct axidma_chan *chan_info)
 {
+    int rc;
     struct axidma_chan *chan;
 
     // Get the transmit and receive channels with the given ids.
@@ -650,7 +1384,322 @@ int axidma_stop_channel(struct axidma_device *dev,
     }
 
     // Terminate all DMA transactions on the given channel
-    return dmaengine_terminate_all(chan->chan);
+    rc = dmaengine_terminate_all(chan->chan);
+    axidma_cancel_transactions(&dev->cb_data[chan->channel_id]);
+    return rc;
+}
+
+/* Waits until the given transaction of the channel finishes, or the timeout
+ * expires. The status of the transaction is 0 if it completed, -ECANCELED if
+ * it was stopped, -ETIME if it is still in flight after the timeout. */
+static bool axidma_txn_finished(struct axidma_cb_data *cb_data,
+                                struct axidma_wait *wait)
+{
+    struct axidma_txn *txn;
+    unsigned long flags;
+    bool finished;
+
+    spin_lock_irqsave(&cb_data->lock, flags);
+    txn = &cb_data->txns[wait->transaction_id % AXIDMA_MAX_IN_FLIGHT];
+    finished = !txn->in_use || txn->transaction_id != wait->transaction_id;
+    if (!finished) {
+        wait->status = -ETIME;
+    } else if (wait->transaction_id == 0 || axidma_id_after(
+                wait->transaction_id, cb_data->last_transaction_id)) {
+        wait->status = -EINVAL;
+    } else if (!axidma_id_after(cb_data->cancelled_first,
+                                wait->transaction_id) &&
+               !axidma_id_after(wait->transaction_id,
+                                cb_data->cancelled_last)) {
+        wait->status = -ECANCELED;
+    } else {
+        wait->status = 0;
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    return finished;
+}
+
+int axidma_wait_transaction(struct axidma_device *dev, struct axidma_wait *wait)
+{
+    struct axidma_chan *chan;
+    struct axidma_cb_data *cb_data;
+    long timeout, rc;
+
+    chan = axidma_get_chan(dev, wait->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid channel id %d for waiting on a transaction.\n",
+                   wait->channel_id);
+        return -ENODEV;
+    }
+
+    cb_data = &dev->cb_data[wait->channel_id];
+    if (wait->timeout_ms < 0) {
+        timeout = MAX_SCHEDULE_TIMEOUT;
+    } else {
+        timeout = msecs_to_jiffies(wait->timeout_ms);
+    }
+
+    // With a timeout of 0, this only polls the state of the transaction
+    rc = wait_event_interruptible_timeout(cb_data->wait_queue,
+            axidma_txn_finished(cb_data, wait), timeout);
+    if (rc < 0) {
+        return rc;
+    }
+
+    return 0;
+}
+
+int axidma_cyclic_transfer(struct axidma_device *dev,
+                           struct axidma_cyclic_transaction *trans)
+{
+    struct axidma_chan *chan;
+    struct axidma_cb_data *cb_data;
+    struct dma_async_tx_descriptor *dma_txnd;
+    dma_addr_t dma_addr;
+    dma_cookie_t dma_cookie;
+    size_t buf_len;
+    unsigned long flags;
+
+    // Get the channel with the given id
+    chan = axidma_get_chan(dev, trans->channel_id);
+    if (chan == NULL || chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA cyclic transfer.\n",
+                   trans->channel_id);
+        return -ENODEV;
+    }
+
+    // The ring needs at least two periods to be refilled while running
+    if (trans->num_periods < 2 || trans->period_len == 0) {
+        axidma_err("A cyclic transfer needs at least 2 non-empty periods.\n");
+        return -EINVAL;
+    }
+    buf_len = trans->period_len * trans->num_periods;
+
+    // The whole ring has to be in a single DMA buffer
+    dma_addr = axidma_uservirt_to_dma(dev, trans->buf, buf_len);
+    if (dma_addr == (dma_addr_t)NULL) {
+        axidma_err("Requested ring address %p does not fall within a "
+                   "previously allocated DMA buffer.\n", trans->buf);
+        return -EFAULT;
+    }
+
+    // Reset the period count, and setup the notification of the periods
+    cb_data = &dev->cb_data[trans->channel_id];
+    spin_lock_irqsave(&cb_data->lock, flags);
+    cb_data->periods_completed = 0;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+    cb_data->channel_id = trans->channel_id;
+    cb_data->notify_signal = dev->notify_signal;
+    cb_data->user_data = dev->user_data;
+    cb_data->process = get_current();
+
+    dma_txnd = dmaengine_prep_dma_cyclic(chan->chan, dma_addr, buf_len,
+            trans->period_len, axidma_to_dma_dir(chan->dir),
+            DMA_CTRL_ACK | DMA_PREP_INTERRUPT);
+    if (dma_txnd == NULL) {
+        axidma_err("Unable to prepare the cyclic %s transfer.\n",
+                   axidma_dir_to_string(chan->dir));
+        axidma_stats_error(cb_data);
+        return -EBUSY;
+    }
+    dma_txnd->callback = axidma_dma_cyclic_callback;
+    dma_txnd->callback_param = cb_data;
+
+    dma_cookie = dmaengine_submit(dma_txnd);
+    if (dma_submit_error(dma_cookie)) {
+        axidma_err("Unable to submit the cyclic %s transfer.\n",
+                   axidma_dir_to_string(chan->dir));
+        dmaengine_terminate_all(chan->chan);
+        axidma_stats_error(cb_data);
+        return -EBUSY;
+    }
+
+    // The channel is busy until the cyclic transfer is stopped
+    spin_lock_irqsave(&cb_data->lock, flags);
+    axidma_stats_submit(cb_data, ktime_get_ns());
+    cb_data->is_cyclic = true;
+    cb_data->period_len = trans->period_len;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    // Start the transfer, it runs until the channel is stopped
+    dma_async_issue_pending(chan->chan);
+    return 0;
+}
+
+int axidma_get_cyclic_status(struct axidma_device *dev,
+                             struct axidma_cyclic_status *status)
+{
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+
+    if (axidma_get_chan(dev, status->channel_id) == NULL) {
+        axidma_err("Invalid channel id %d for the cyclic status.\n",
+                   status->channel_id);
+        return -ENODEV;
+    }
+
+    cb_data = &dev->cb_data[status->channel_id];
+    spin_lock_irqsave(&cb_data->lock, flags);
+    status->periods_completed = cb_data->periods_completed;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    return 0;
+}
+
+/* Gets the statistics of the channel, the busy time includes the time the
+ * channel has been busy for so far. */
+int axidma_get_stats(struct axidma_device *dev, struct axidma_stats *stats)
+{
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+    int channel_id;
+    bool reset;
+    u64 now_ns;
+
+    channel_id = stats->channel_id;
+    reset = stats->reset;
+    if (axidma_get_chan(dev, channel_id) == NULL) {
+        axidma_err("Invalid channel id %d for the statistics.\n", channel_id);
+        return -ENODEV;
+    }
+
+    cb_data = &dev->cb_data[channel_id];
+    now_ns = ktime_get_ns();
+    spin_lock_irqsave(&cb_data->lock, flags);
+    *stats = cb_data->stats;
+    stats->elapsed_ns = now_ns - cb_data->stats_since_ns;
+    if (axidma_chan_busy(cb_data)) {
+        stats->busy_ns += now_ns - cb_data->busy_since_ns;
+    }
+
+    if (reset) {
+        memset(&cb_data->stats, 0, sizeof(cb_data->stats));
+        cb_data->stats_since_ns = now_ns;
+        cb_data->busy_since_ns = now_ns;
+    }
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    stats->channel_id = channel_id;
+    stats->reset = reset;
+    return 0;
+}
+
+int axidma_set_completion_fd(struct axidma_device *dev,
+                             struct axidma_completion_fd *completion_fd)
+{
+    struct axidma_chan *chan;
+    struct axidma_cb_data *cb_data;
+    struct eventfd_ctx *event_ctx, *old_event_ctx;
+    unsigned long flags;
+
+    chan = axidma_get_chan(dev, completion_fd->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid channel id %d for the completion eventfd.\n",
+                   completion_fd->channel_id);
+        return -ENODEV;
+    }
+
+    // A negative descriptor detaches the eventfd, going back to signals
+    event_ctx = NULL;
+    if (completion_fd->fd >= 0) {
+        event_ctx = eventfd_ctx_fdget(completion_fd->fd);
+        if (IS_ERR(event_ctx)) {
+            axidma_err("File descriptor %d is not an eventfd.\n",
+                       completion_fd->fd);
+            return PTR_ERR(event_ctx);
+        }
+    }
+
+    // Swap the eventfd, completions queued for the old one are dropped
+    cb_data = &dev->cb_data[completion_fd->channel_id];
+    spin_lock_irqsave(&cb_data->lock, flags);
+    old_event_ctx = cb_data->event_ctx;
+    cb_data->event_ctx = event_ctx;
+    kfifo_reset(&cb_data->completions);
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    if (old_event_ctx != NULL) {
+        eventfd_ctx_put(old_event_ctx);
+    }
+    return 0;
+}
+
+int axidma_reap(struct axidma_device *dev, int channel_id,
+                struct axidma_completion *completions, int max_completions)
+{
+    struct axidma_chan *chan;
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+    int num_completions;
+
+    chan = axidma_get_chan(dev, channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid channel id %d for reaping completions.\n",
+                   channel_id);
+        return -ENODEV;
+    }
+
+    cb_data = &dev->cb_data[channel_id];
+    spin_lock_irqsave(&cb_data->lock, flags);
+    num_completions = kfifo_out(&cb_data->completions, completions,
+                                max_completions);
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    return num_completions;
+}
+
+void axidma_clear_completion_fds(struct axidma_device *dev)
+{
+    int i;
+    struct axidma_completion_fd completion_fd;
+
+    // Detach the eventfds, the channels go back to signal notification
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        completion_fd.channel_id = dev->channels[i].channel_id;
+        completion_fd.fd = -1;
+        axidma_set_completion_fd(dev, &completion_fd);
+    }
+}
+
+int axidma_set_polling(struct axidma_device *dev,
+                       struct axidma_polling *polling)
+{
+    struct axidma_chan *chan;
+    struct axidma_cb_data *cb_data;
+    unsigned long flags;
+
+    // A negative id only probes for the polling mode, it is not an error
+    chan = axidma_get_chan(dev, polling->channel_id);
+    if (chan == NULL) {
+        if (polling->channel_id >= 0) {
+            axidma_err("Invalid channel id %d for the polling mode.\n",
+                       polling->channel_id);
+        }
+        return -ENODEV;
+    }
+
+    cb_data = &dev->cb_data[polling->channel_id];
+    spin_lock_irqsave(&cb_data->lock, flags);
+    cb_data->is_polling = polling->enable;
+    spin_unlock_irqrestore(&cb_data->lock, flags);
+
+    return 0;
+}
+
+void axidma_clear_polling(struct axidma_device *dev)
+{
+    int i;
+    struct axidma_polling polling;
+
+    // The channels go back to being notified of their completions
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        polling.channel_id = dev->channels[i].channel_id;
+        polling.enable = false;
+        axidma_set_polling(dev, &polling);
+    }
 }
 
 /*----------------------------------------------------------------------------
@@ -691,7 +1740,7 @@ release_channels:
 
 int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
 {
-    int rc;
+    int rc, i;
     size_t elem_size;
     u64 dma_mask;
 
@@ -716,13 +1765,35 @@ int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
         return -ENOMEM;
     }
 
+    // Allocate the page userspace maps to watch the channels' completions
+    if (dev->num_chans * sizeof(dev->status_page[0]) > PAGE_SIZE) {
+        axidma_err("Too many channels for the status page.\n");
+        rc = -EINVAL;
+        goto free_channels;
+    }
+    dev->status_page = (struct axidma_chan_status *)get_zeroed_page(
+            GFP_KERNEL);
+    if (dev->status_page == NULL) {
+        axidma_err("Unable to allocate the status page.\n");
+        rc = -ENOMEM;
+        goto free_channels;
+    }
+
     // Allocate an array to store all callback structures, for async
     elem_size = sizeof(dev->cb_data[0]);
-    dev->cb_data = kmalloc(dev->num_chans * elem_size, GFP_KERNEL);
+    dev->cb_data = kcalloc(dev->num_chans, elem_size, GFP_KERNEL);
     if (dev->cb_data == NULL) {
         axidma_err("Unable to allocate memory for callback structures.\n");
         rc = -ENOMEM;
-        goto free_channels;
+        goto free_status_page;
+    }
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        spin_lock_init(&dev->cb_data[i].lock);
+        INIT_KFIFO(dev->cb_data[i].completions);
+        init_waitqueue_head(&dev->cb_data[i].wait_queue);
+        dev->cb_data[i].stats_since_ns = ktime_get_ns();
+        dev->cb_data[i].status = &dev->status_page[i];
     }
 
     // Parse the type and direction of each DMA channel from the device tree
@@ -745,6 +1816,8 @@ int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
 
 free_callback_data:
     kfree(dev->cb_data);
+free_status_page:
+    free_page((unsigned long)dev->status_page);
 free_channels:
     kfree(dev->channels);
     return rc;
@@ -763,9 +1836,11 @@ void axidma_dma_exit(struct axidma_device *dev)
         dma_release_channel(chan);
     }
 
-    // Free the channel and callback data arrays
+    // Release the eventfds, then free the channel and callback data arrays
+    axidma_clear_completion_fds(dev);
     kfree(dev->channels);
     kfree(dev->cb_data);
+    free_page((unsigned long)dev->status_page);
 
     return;
 }
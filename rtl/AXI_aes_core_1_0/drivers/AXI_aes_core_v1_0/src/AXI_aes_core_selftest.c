@@ -43,17 +43,36 @@ XStatus AXI_AES_CORE_Reg_SelfTest(void * baseaddr_p)
 
 	/*
 	 * Write to user logic slave module register(s) and read back
+	 * Only the config registers (0, 1) are writable, registers 2 and 3 return the
+	 * status of the cipher and decipher. Bit 0 of a config register requests a
+	 * key load, so only the upper bits are exercised and both are cleared after.
 	 */
 	xil_printf("User logic slave module test...\n\r");
 
-	for (write_loop_index = 0 ; write_loop_index < 4; write_loop_index++)
+	for (write_loop_index = 0 ; write_loop_index < 2; write_loop_index++)
 	  AXI_AES_CORE_mWriteReg (baseaddr, write_loop_index*4, (write_loop_index+1)*READ_WRITE_MUL_FACTOR);
-	for (read_loop_index = 0 ; read_loop_index < 4; read_loop_index++)
+	for (read_loop_index = 0 ; read_loop_index < 2; read_loop_index++)
 	  if ( AXI_AES_CORE_mReadReg (baseaddr, read_loop_index*4) != (read_loop_index+1)*READ_WRITE_MUL_FACTOR){
 	    xil_printf ("Error reading register value at address %x\n", (int)baseaddr + read_loop_index*4);
 	    return XST_FAILURE;
 	  }
 
+	for (Index = 0 ; Index < 2; Index++)
+	  AXI_AES_CORE_mWriteReg (baseaddr, Index*4, 0);
+
+	/*
+	 * The status registers are read-only, a write must not change them
+	 */
+	for (Index = 2 ; Index < 4; Index++) {
+	  u32 status = AXI_AES_CORE_mReadReg (baseaddr, Index*4);
+
+	  AXI_AES_CORE_mWriteReg (baseaddr, Index*4, ~status);
+	  if ( AXI_AES_CORE_mReadReg (baseaddr, Index*4) != status){
+	    xil_printf ("Status register at address %x is writable\n", (int)baseaddr + Index*4);
+	    return XST_FAILURE;
+	  }
+	}
+
 	xil_printf("   - slave register write/read passed\n\n\r");
 
 	return XST_SUCCESS;
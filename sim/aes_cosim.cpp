@@ -0,0 +1,183 @@
+// Co-simulation of the aes driver with the AXI_aes_core RTL.
+//
+// Every transfer size is encrypted and decrypted by the aes class running on the verilated core (aes_rtl_sim), the
+// output is checked against aes_soft and the same transfer is run on aes_core_model for comparison. The report shows
+// the cycles per block, the key load overhead and the stalls/bubbles around the cipher_master_busy throttle.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <unistd.h>
+
+#include "verilated.h"
+
+#include "aes.h"
+#include "aes_core_model.h"
+#include "util.h"
+#include "aes_rtl_sim.h"
+
+#define DEFAULT_BUDGET_SIZE (512 * 1024 * 1024)
+
+namespace {
+    const size_t default_sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576};
+
+    struct transfer_result_t {
+        bool is_success;
+        bool is_correct;
+        aes_core_backend::stream_stats_t stats;
+        aes_core_backend::stream_stats_t model_stats;
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-l source_latency] [-b burst_beats] [-g burst_gap] "
+                        "[-s stall_period:stall_cycles] [size ...]\n", name);
+    }
+
+    std::string write_temp_file(const void *data, size_t size) {
+        char path[] = "/tmp/aes_cosim_XXXXXX";
+        int fd = mkstemp(path);
+
+        if (fd < 0 || write(fd, data, size) != (ssize_t)size) {
+            perror("mkstemp");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+
+        return path;
+    }
+
+    transfer_result_t run_transfer(aes &driver, aes_rtl_sim &rtl, aes_core_model &model, aes_core_backend::channel_t channel,
+                                   const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)], const std::vector<uint8_t> &input,
+                                   const std::vector<uint8_t> &expected) {
+        transfer_result_t result{};
+        size_t aligned_input_size = aligned_size(input.size(), AES_TEXT_WIDTH);
+        std::vector<uint8_t> output(aligned_input_size), tx(AES_KEY_WIDTH + aligned_input_size), rx(aligned_input_size);
+        std::string path = write_temp_file(input.data(), input.size());
+        std::function<void(bool, void *)> callback = [&result](bool is_success, void *) {
+            result.is_success = is_success;
+        };
+
+        // through the driver on the RTL
+        if (channel == aes_core_backend::CIPHER)
+            driver.encrypt_file(key, path, output.data(), output.size(), &callback, nullptr);
+        else
+            driver.decrypt_file(key, path, output.data(), output.size(), &callback, nullptr);
+        unlink(path.c_str());
+
+        result.stats = rtl.last_stats(channel);
+        result.is_correct = memcmp(output.data(), expected.data(), expected.size()) == 0;
+
+        // same transfer on the model
+        memcpy(tx.data(), key, AES_KEY_WIDTH);
+        memcpy(tx.data() + AES_KEY_WIDTH, input.data(), input.size());
+        model.write_reg(channel == aes_core_backend::CIPHER ? aes_core_backend::CIPHER_CFG_REG :
+                                                              aes_core_backend::DECIPHER_CFG_REG, 0xFFFFFFFF);
+        model.write_reg(channel == aes_core_backend::CIPHER ? aes_core_backend::CIPHER_CFG_REG :
+                                                              aes_core_backend::DECIPHER_CFG_REG, 0x00000000);
+        model.stream(channel, tx.data(), tx.size(), rx.data(), rx.size(), &result.model_stats);
+
+        return result;
+    }
+
+    void print_row(const char *direction, size_t size, const transfer_result_t &r) {
+        const aes_core_backend::stream_stats_t &s = r.stats;
+        double delta = r.model_stats.cycles && s.cycles ?
+                       100.0 * ((double)r.model_stats.cycles - (double)s.cycles) / (double)s.cycles : 0;
+
+        printf("%-8s %9zu %8lu %10lu %8.2f %8lu %9lu %8lu %5lu %9.1f %10lu %+7.1f%%  %s",
+               direction, size, (unsigned long)s.blocks, (unsigned long)s.cycles, s.cycles_per_block(),
+               (unsigned long)s.key_load_cycles, (unsigned long)s.input_stall_cycles,
+               (unsigned long)s.input_idle_cycles, (unsigned long)(s.beats_lost + s.results_lost),
+               s.throughput() / 1e6, (unsigned long)r.model_stats.cycles, delta,
+               r.is_success && r.is_correct ? "ok" : (r.is_correct ? "flagged" : "MISMATCH"));
+
+        // the model transfer went wrong as well, its cycle count is not comparable
+        if (r.model_stats.timed_out || r.model_stats.beats_lost || r.model_stats.results_lost)
+            printf(" (model: %lu lost%s)", (unsigned long)(r.model_stats.beats_lost + r.model_stats.results_lost),
+                   r.model_stats.timed_out ? ", timed out" : "");
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    aes_core_backend::stream_config_t config;
+    std::vector<size_t> sizes;
+    int opt;
+
+    Verilated::commandArgs(argc, argv);
+
+    while ((opt = getopt(argc, argv, "l:b:g:s:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                config.source_latency = strtoul(optarg, nullptr, 0);
+                break;
+            case 'b':
+                config.source_burst_beats = strtoul(optarg, nullptr, 0);
+                break;
+            case 'g':
+                config.source_burst_gap = strtoul(optarg, nullptr, 0);
+                break;
+            case 's':
+                if (sscanf(optarg, "%u:%u", &config.sink_stall_period, &config.sink_stall_cycles) != 2) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    for (int i = optind; i < argc; ++i)
+        sizes.push_back(strtoul(argv[i], nullptr, 0));
+    if (sizes.empty())
+        sizes.assign(std::begin(default_sizes), std::end(default_sizes));
+
+    aes_rtl_sim rtl;
+    aes_core_model model;
+    cma_budget budget(DEFAULT_BUDGET_SIZE, 0);
+    aes driver(budget);
+
+    rtl.set_stream_config(config);
+    model.set_stream_config(config);
+    driver.init(rtl);
+
+    const uint32_t key[AES_KEY_WIDTH / sizeof(uint32_t)] = {0x16157E2B, 0xA6D2AE28, 0x8815F7AB, 0x3C4FCF09};
+    aes_soft reference;
+    bool is_all_correct = true;
+
+    reference.set_stream_key(key);
+
+    printf("clock %d MHz, MM2S latency %u, bursts of %u beats with %u cycle gaps, S2MM stalls %u/%u\n\n",
+           AES_CORE_CLOCK_HZ / 1000000, config.source_latency, config.source_burst_beats, config.source_burst_gap,
+           config.sink_stall_cycles, config.sink_stall_period);
+    printf("%-8s %9s %8s %10s %8s %8s %9s %8s %5s %9s %10s %8s  %s\n", "dir", "bytes", "blocks", "cycles", "cyc/blk",
+           "key_load", "throttled", "bubbles", "lost", "MB/s", "model_cyc", "model", "result");
+
+    for (size_t size : sizes) {
+        size_t padded_size = aligned_size(size, AES_TEXT_WIDTH);
+        std::vector<uint8_t> plain(size), plain_padded(padded_size, 0), cipher(padded_size);
+
+        for (auto &b : plain)
+            b = (uint8_t)rand();
+        memcpy(plain_padded.data(), plain.data(), size);
+        reference.encrypt_stream(plain_padded.data(), cipher.data(), padded_size);
+
+        transfer_result_t enc = run_transfer(driver, rtl, model, aes_core_backend::CIPHER, key, plain, cipher);
+        print_row("encrypt", size, enc);
+
+        transfer_result_t dec = run_transfer(driver, rtl, model, aes_core_backend::DECIPHER, key, cipher, plain_padded);
+        print_row("decrypt", padded_size, dec);
+
+        is_all_correct = is_all_correct && enc.is_correct && dec.is_correct;
+    }
+
+    driver.destroy();
+
+    return is_all_correct ? EXIT_SUCCESS : EXIT_FAILURE;
+}
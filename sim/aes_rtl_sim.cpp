@@ -0,0 +1,235 @@
+#include "aes_rtl_sim.h"
+
+#include "verilated.h"
+#include "VAXI_aes_core_v1_0.h"
+#include "VAXI_aes_core_v1_0___024root.h"
+
+// internal signals of the RTL, accessible as the model is verilated with --public-flat-rw
+#define RTL_SIGNAL(name) (_top->rootp->AXI_aes_core_v1_0__DOT__##name)
+
+// cycles to wait for an AXI-Lite handshake before giving up
+#define AXI_LITE_TIMEOUT_CYCLES 64
+#define RESET_CYCLES 8
+
+namespace {
+    template<typename wide_t>
+    void block_to_wide(const aes_core_backend::block_t &block, wide_t &wide) {
+        // byte i of the beat is TDATA[8i+7:8i]
+        for (int i = 0; i < 4; ++i)
+            wide[i] = (uint32_t)block[4 * i] | (uint32_t)block[4 * i + 1] << 8 |
+                      (uint32_t)block[4 * i + 2] << 16 | (uint32_t)block[4 * i + 3] << 24;
+    }
+
+    template<typename wide_t>
+    void wide_to_block(const wide_t &wide, aes_core_backend::block_t &block) {
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                block[4 * i + j] = (uint8_t)(wide[i] >> (8 * j));
+    }
+}
+
+aes_rtl_sim::aes_rtl_sim() : _context(new VerilatedContext), _top(new VAXI_aes_core_v1_0(_context.get())) {
+    _top->s_axi_awprot = 0;
+    _top->s_axi_arprot = 0;
+    _top->s_axi_wstrb = 0xF;
+    _top->s_axis_cipher_tstrb = 0xFFFF;
+    _top->s_axis_decipher_tstrb = 0xFFFF;
+
+    reset();
+}
+
+aes_rtl_sim::~aes_rtl_sim() {
+    _top->final();
+}
+
+void aes_rtl_sim::reset() {
+    pthread_mutex_lock(&_mutex);
+
+    _top->s_axi_aresetn = 0;
+    _top->s_axis_cipher_aresetn = 0;
+    _top->s_axis_decipher_aresetn = 0;
+    _top->m_axis_cipher_aresetn = 0;
+    _top->m_axis_decipher_aresetn = 0;
+
+    for (int i = 0; i < RESET_CYCLES; ++i)
+        _tick();
+
+    _top->s_axi_aresetn = 1;
+    _top->s_axis_cipher_aresetn = 1;
+    _top->s_axis_decipher_aresetn = 1;
+    _top->m_axis_cipher_aresetn = 1;
+    _top->m_axis_decipher_aresetn = 1;
+    _tick();
+
+    for (auto &counters : _counters)
+        counters = {};
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+void aes_rtl_sim::_eval_clock(bool level) {
+    _top->s_axi_aclk = level;
+    _top->s_axis_cipher_aclk = level;
+    _top->s_axis_decipher_aclk = level;
+    _top->m_axis_cipher_aclk = level;
+    _top->m_axis_decipher_aclk = level;
+
+    _top->eval();
+    _context->timeInc(5);
+}
+
+void aes_rtl_sim::_drive_inputs() {
+    const axis_port_t &cipher = _ports[CIPHER], &decipher = _ports[DECIPHER];
+
+    _top->s_axis_cipher_tvalid = cipher.s_tvalid;
+    _top->s_axis_cipher_tlast = cipher.s_tlast;
+    block_to_wide(cipher.s_tdata, _top->s_axis_cipher_tdata);
+    _top->m_axis_cipher_tready = cipher.m_tready;
+
+    _top->s_axis_decipher_tvalid = decipher.s_tvalid;
+    _top->s_axis_decipher_tlast = decipher.s_tlast;
+    block_to_wide(decipher.s_tdata, _top->s_axis_decipher_tdata);
+    _top->m_axis_decipher_tready = decipher.m_tready;
+}
+
+void aes_rtl_sim::_sample_outputs() {
+    axis_port_t &cipher = _ports[CIPHER], &decipher = _ports[DECIPHER];
+
+    cipher.s_tready = _top->s_axis_cipher_tready;
+    cipher.m_tvalid = _top->m_axis_cipher_tvalid;
+    cipher.m_tlast = _top->m_axis_cipher_tlast;
+    wide_to_block(_top->m_axis_cipher_tdata, cipher.m_tdata);
+    cipher.fifo_resetn = _top->cipher_fifo_rst;
+
+    decipher.s_tready = _top->s_axis_decipher_tready;
+    decipher.m_tvalid = _top->m_axis_decipher_tvalid;
+    decipher.m_tlast = _top->m_axis_decipher_tlast;
+    wide_to_block(_top->m_axis_decipher_tdata, decipher.m_tdata);
+    decipher.fifo_resetn = _top->decipher_fifo_rst;
+}
+
+void aes_rtl_sim::_tick() {
+    const bool ld[NR_CHANNELS] = {
+            RTL_SIGNAL(cipher_start) && !RTL_SIGNAL(cipher_start_prev),
+            RTL_SIGNAL(decipher_start) && !RTL_SIGNAL(decipher_start_prev)
+    };
+    const bool done[NR_CHANNELS] = {RTL_SIGNAL(aes_cipher__DOT__done) != 0, RTL_SIGNAL(aes_decipher__DOT__done) != 0};
+    const unsigned master_state[NR_CHANNELS] = {
+            RTL_SIGNAL(AXI_aes_core_v1_0_M_AXIS_cipher_inst__DOT__state),
+            RTL_SIGNAL(AXI_aes_core_v1_0_M_AXIS_decipher_inst__DOT__state)
+    };
+
+    _drive_inputs();
+    _eval_clock(false);
+
+    // bookkeeping on the values before the rising edge
+    for (int ch = 0; ch < NR_CHANNELS; ++ch) {
+        _core_counters_t &counters = _counters[ch];
+        const axis_port_t &p = _ports[ch];
+
+        if (counters.key_expected && p.s_tvalid && p.s_tready) {
+            counters.key_expected = false;
+            counters.key_loading = true;
+            counters.key_cycle = _cycle;
+        }
+
+        if (ld[ch]) {
+            counters.blocks++;
+            if (counters.key_loading) {
+                counters.key_load_cycles += _cycle - counters.key_cycle;
+                counters.key_loading = false;
+            }
+        }
+
+        // master states: 0 idle, 1 send, 2 wait for TREADY
+        if (done[ch] && master_state[ch] != 0)
+            counters.results_lost++;
+        if (master_state[ch] == 2)
+            counters.output_stall_cycles++;
+    }
+
+    _eval_clock(true);
+    _sample_outputs();
+    _cycle++;
+}
+
+void aes_rtl_sim::_write_reg(uint32_t offset, uint32_t value) {
+    int timeout = AXI_LITE_TIMEOUT_CYCLES;
+
+    // the first beat after a setup request is the key
+    if (value & 1) {
+        if (offset == CIPHER_CFG_REG)
+            _counters[CIPHER].key_expected = true;
+        else if (offset == DECIPHER_CFG_REG)
+            _counters[DECIPHER].key_expected = true;
+    }
+
+    _top->s_axi_awaddr = offset;
+    _top->s_axi_awvalid = 1;
+    _top->s_axi_wdata = value;
+    _top->s_axi_wvalid = 1;
+    _top->s_axi_bready = 1;
+
+    // address and data are accepted together, the register is written on the handshake
+    do {
+        _tick();
+    } while (!(_top->s_axi_awready && _top->s_axi_wready) && --timeout);
+    _tick();
+
+    _top->s_axi_awvalid = 0;
+    _top->s_axi_wvalid = 0;
+
+    while (!_top->s_axi_bvalid && --timeout)
+        _tick();
+    _tick();
+
+    _top->s_axi_bready = 0;
+}
+
+uint32_t aes_rtl_sim::_read_reg(uint32_t offset) {
+    int timeout = AXI_LITE_TIMEOUT_CYCLES;
+    uint32_t value;
+
+    _top->s_axi_araddr = offset;
+    _top->s_axi_arvalid = 1;
+    _top->s_axi_rready = 1;
+
+    do {
+        _tick();
+    } while (!_top->s_axi_arready && --timeout);
+    _tick();
+
+    _top->s_axi_arvalid = 0;
+
+    while (!_top->s_axi_rvalid && --timeout)
+        _tick();
+    value = _top->s_axi_rdata;
+    _tick();
+
+    _top->s_axi_rready = 0;
+
+    return value;
+}
+
+void aes_rtl_sim::_reset_core_stats(channel_t channel) {
+    _core_counters_t &counters = _counters[channel];
+
+    // a pending key request survives, the key is sent at the beginning of the transfer
+    counters.blocks = 0;
+    counters.key_load_cycles = 0;
+    counters.output_stall_cycles = 0;
+    counters.results_lost = 0;
+}
+
+void aes_rtl_sim::_core_stats(channel_t channel, stream_stats_t &stats) {
+    const _core_counters_t &counters = _counters[channel];
+    // every beat after the key should start exactly one block
+    uint64_t data_beats = stats.beats_in ? stats.beats_in - 1 : 0;
+
+    stats.blocks = counters.blocks;
+    stats.key_load_cycles = counters.key_load_cycles;
+    stats.output_stall_cycles = counters.output_stall_cycles;
+    stats.results_lost = counters.results_lost;
+    stats.beats_lost = data_beats > counters.blocks ? data_beats - counters.blocks : 0;
+    stats.beats_repeated = counters.blocks > data_beats ? counters.blocks - data_beats : 0;
+}
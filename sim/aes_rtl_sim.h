@@ -0,0 +1,57 @@
+#ifndef AES_MUSIC_PLAYER_SIM_AES_RTL_SIM_H
+#define AES_MUSIC_PLAYER_SIM_AES_RTL_SIM_H
+
+
+#include <memory>
+
+#include "aes_core_backend.h"
+
+class VerilatedContext;
+class VAXI_aes_core_v1_0;
+
+// AXI_aes_core_v1_0 RTL compiled with Verilator (see sim.mk), driven as an aes_core_backend.
+// All clocks of the IP are tied to one clock, the registers are accessed with real AXI-Lite transactions.
+class aes_rtl_sim : public aes_core_backend {
+public:
+    aes_rtl_sim();
+    ~aes_rtl_sim() override;
+
+    // reset of the IP (aresetn), held for a few cycles
+    void reset();
+
+    axis_port_t &port(channel_t channel) override { return _ports[channel]; }
+
+protected:
+    void _write_reg(uint32_t offset, uint32_t value) override;
+    uint32_t _read_reg(uint32_t offset) override;
+    void _tick() override;
+    void _reset_core_stats(channel_t channel) override;
+    void _core_stats(channel_t channel, stream_stats_t &stats) override;
+
+private:
+    // counters taken from internal signals of the RTL
+    struct _core_counters_t {
+        uint64_t blocks;
+        uint64_t key_load_cycles;
+        uint64_t output_stall_cycles;
+        uint64_t results_lost;
+
+        // a key is expected after a setup request, its handshake starts the key load measurement
+        bool key_expected;
+        bool key_loading;
+        uint64_t key_cycle;
+    };
+
+    std::unique_ptr<VerilatedContext> _context;
+    std::unique_ptr<VAXI_aes_core_v1_0> _top;
+
+    axis_port_t _ports[NR_CHANNELS];
+    _core_counters_t _counters[NR_CHANNELS]{};
+
+    void _eval_clock(bool level);
+    void _drive_inputs();
+    void _sample_outputs();
+};
+
+
+#endif //AES_MUSIC_PLAYER_SIM_AES_RTL_SIM_H
@@ -0,0 +1,187 @@
+// Benchmark of copy-then-submit against vectored submission of DMA transfers.
+//
+// A transfer is composed of a key block, file chunks of mixed sizes and a padding block, as in aes::_do_transfer.
+// It is either gathered into one staging buffer and submitted with axidma_twoway_transfer, or submitted as is with
+// axidma_twoway_transfer_iov. Both run against the simulated libaxidma (libaxidma_sim), so the report shows the cost
+// of the gathering on the CPU; -r sets the rate of the simulated DMA to see it against the transfer time.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#include "libaxidma.h"
+#include "libaxidma_sim.h"
+#include "bench_util.h"
+
+#define DEFAULT_ITERATIONS 200
+#define KEY_BLOCK_SIZE 16
+#define PAD_BLOCK_SIZE 16
+
+namespace {
+    struct scenario_t {
+        const char *name;
+        std::vector<size_t> chunk_sizes;
+    };
+
+    const scenario_t scenarios[] = {
+        {"small", {512, 1024, 256, 2048, 768, 1536}},
+        {"mixed", {4096, 1500, 65536, 512, 16384, 200, 32768, 8192}},
+        {"large", {262144, 131072, 524288, 65536}},
+        {"many", {4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096, 4096}},
+    };
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-n iterations] [-r bytes_per_second]\n", name);
+    }
+
+    // the buffers of a transfer, each of them DMA memory
+    struct transfer_t {
+        std::vector<axidma_iovec> tx_iov;
+        size_t tx_size = 0;
+        void *staging = nullptr;
+        void *rx = nullptr;
+    };
+
+    transfer_t alloc_transfer(axidma_dev_t dev, const scenario_t &scenario) {
+        transfer_t transfer;
+        std::vector<size_t> sizes = {KEY_BLOCK_SIZE};
+
+        sizes.insert(sizes.end(), scenario.chunk_sizes.begin(), scenario.chunk_sizes.end());
+        sizes.push_back(PAD_BLOCK_SIZE);
+
+        for (size_t size : sizes) {
+            void *buf = axidma_malloc(dev, size);
+
+            if (!buf) {
+                fprintf(stderr, "unable to allocate %zu bytes of DMA memory\n", size);
+                exit(EXIT_FAILURE);
+            }
+            memset(buf, (int)transfer.tx_iov.size() + 1, size);
+            transfer.tx_iov.push_back({buf, size});
+            transfer.tx_size += size;
+        }
+
+        transfer.staging = axidma_malloc(dev, transfer.tx_size);
+        transfer.rx = axidma_malloc(dev, transfer.tx_size);
+        if (!transfer.staging || !transfer.rx) {
+            fprintf(stderr, "unable to allocate %zu bytes of DMA memory\n", transfer.tx_size);
+            exit(EXIT_FAILURE);
+        }
+
+        return transfer;
+    }
+
+    void free_transfer(axidma_dev_t dev, transfer_t &transfer) {
+        for (auto &iov : transfer.tx_iov)
+            axidma_free(dev, iov.buf, iov.len);
+        axidma_free(dev, transfer.staging, transfer.tx_size);
+        axidma_free(dev, transfer.rx, transfer.tx_size);
+    }
+
+    // the received data has to be the chunks in order, whichever way they were submitted
+    bool check_transfer(const transfer_t &transfer) {
+        size_t offset = 0;
+
+        for (const auto &iov : transfer.tx_iov) {
+            if (memcmp((char *)transfer.rx + offset, iov.buf, iov.len) != 0)
+                return false;
+            offset += iov.len;
+        }
+
+        return true;
+    }
+
+    double run_copy(axidma_dev_t dev, transfer_t &transfer, int iterations) {
+        double start = bench::now_us();
+
+        for (int i = 0; i < iterations; ++i) {
+            size_t offset = 0;
+
+            for (const auto &iov : transfer.tx_iov) {
+                memcpy((char *)transfer.staging + offset, iov.buf, iov.len);
+                offset += iov.len;
+            }
+            if (axidma_twoway_transfer(dev, AXIDMA_SIM_TX_CHANNEL, transfer.staging, transfer.tx_size, nullptr,
+                                       AXIDMA_SIM_RX_CHANNEL, transfer.rx, transfer.tx_size, nullptr, true) < 0)
+                exit(EXIT_FAILURE);
+        }
+
+        return (bench::now_us() - start) / iterations;
+    }
+
+    double run_iov(axidma_dev_t dev, transfer_t &transfer, int iterations) {
+        axidma_iovec rx_iov = {transfer.rx, transfer.tx_size};
+        double start = bench::now_us();
+
+        for (int i = 0; i < iterations; ++i) {
+            if (axidma_twoway_transfer_iov(dev, AXIDMA_SIM_TX_CHANNEL, transfer.tx_iov.data(),
+                                           (int)transfer.tx_iov.size(), AXIDMA_SIM_RX_CHANNEL, &rx_iov, 1, true) < 0)
+                exit(EXIT_FAILURE);
+        }
+
+        return (bench::now_us() - start) / iterations;
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = DEFAULT_ITERATIONS;
+    double rate = 0;
+    bool is_all_correct = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'r':
+                rate = strtod(optarg, nullptr);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    axidma_dev_t dev = axidma_init();
+    if (!dev)
+        return EXIT_FAILURE;
+    axidma_sim_set_rate(dev, AXIDMA_SIM_RX_CHANNEL, rate);
+
+    if (rate > 0)
+        printf("%d iterations, simulated DMA rate %.1f MB/s\n\n", iterations, rate / 1e6);
+    else
+        printf("%d iterations, unlimited simulated DMA rate\n\n", iterations);
+    printf("%-8s %7s %10s %12s %12s %9s %9s %8s  %s\n", "scenario", "buffers", "bytes", "copy_us", "iov_us",
+           "copy_MB/s", "iov_MB/s", "speedup", "result");
+
+    for (const auto &scenario : scenarios) {
+        transfer_t transfer = alloc_transfer(dev, scenario);
+        bool is_correct;
+
+        // warm up, the pages of the buffers are touched before the timing
+        run_copy(dev, transfer, 1);
+        double copy_us = run_copy(dev, transfer, iterations);
+        memset(transfer.rx, 0, transfer.tx_size);
+        run_iov(dev, transfer, 1);
+        is_correct = check_transfer(transfer);
+        double iov_us = run_iov(dev, transfer, iterations);
+
+        printf("%-8s %7zu %10zu %12.2f %12.2f %9.1f %9.1f %7.2fx  %s\n", scenario.name, transfer.tx_iov.size(),
+               transfer.tx_size, copy_us, iov_us, (double)transfer.tx_size / copy_us,
+               (double)transfer.tx_size / iov_us, iov_us > 0 ? copy_us / iov_us : 0, is_correct ? "ok" : "MISMATCH");
+
+        is_all_correct = is_all_correct && is_correct;
+        free_transfer(dev, transfer);
+    }
+
+    axidma_destroy(dev);
+
+    return is_all_correct ? EXIT_SUCCESS : EXIT_FAILURE;
+}
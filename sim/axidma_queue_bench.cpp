@@ -0,0 +1,255 @@
+// Benchmark of the queue depth of DMA transfers.
+//
+// Fixed-size two-way transfers are run back-to-back, preparing each of them on the CPU (-w) before its submission, as
+// the player fills a buffer. With a depth of 1 the next transfer is prepared and submitted once the previous one
+// completed, so the DMA is idle meanwhile. With a deeper queue up to depth transfers are in flight, the DMA moves from
+// one to the next without waiting for the CPU. The report shows the throughput, the utilization of the simulated DMA
+// and the latency of the transactions (from submission until axidma_wait returned) for each depth.
+//
+// The simulated DMA can add a latency per transfer (-l) and a random jitter to the completions (-j), fail transfers
+// (-e), and run the software AES in place of the loopback (-a). The random numbers have a fixed seed (-S), so the
+// runs are reproducible. The statistics the DMA keeps of its channels can be printed after each depth (-d).
+//
+// Before the runs, the bench checks that a two-way transfer refused as one of its channels is full takes nothing from
+// the other one: neither a slot nor an id, and the transfers after it get their own data.
+
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+#include "libaxidma.h"
+#include "libaxidma_sim.h"
+#include "axidma_sim_transforms.h"
+#include "bench_util.h"
+
+#define DEFAULT_TRANSFERS 400
+#define DEFAULT_TRANSFER_SIZE 65536
+#define DEFAULT_RATE 400e6
+#define DEFAULT_WORK_US 100
+
+namespace {
+    const int depths[] = {1, 2, 4, 8, AXIDMA_MAX_IN_FLIGHT};
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-n transfers] [-s transfer_size] [-r bytes_per_second] [-w work_us] "
+                        "[-l latency_us] [-j jitter_us] [-e error_rate] [-S seed] [-a] [-d]\n", name);
+    }
+
+    // preparation of a transfer on the CPU, busy as decoding or encrypting would be
+    void work(double duration_us) {
+        bench::spin_until(bench::now_us() + duration_us);
+    }
+
+    struct result_t {
+        double elapsed_us = 0;
+        std::vector<double> latencies_us;
+        // transactions completed with an error
+        int errors = 0;
+    };
+
+    result_t run(axidma_dev_t dev, char *tx, char *rx, size_t size, int transfers, int depth, double work_us) {
+        result_t result;
+        // submitted, not yet completed transactions (id, submission time), oldest first
+        std::vector<std::pair<int, double>> in_flight;
+        double start = bench::now_us();
+
+        for (int i = 0; i < transfers || !in_flight.empty(); ++i) {
+            // the slot of the oldest transaction is needed (or nothing is left to submit)
+            if ((int)in_flight.size() == depth || i >= transfers) {
+                int status = axidma_wait(dev, AXIDMA_SIM_RX_CHANNEL, in_flight.front().first, -1);
+                if (status == -EIO)
+                    ++result.errors;
+                else if (status < 0)
+                    exit(EXIT_FAILURE);
+                result.latencies_us.push_back(bench::now_us() - in_flight.front().second);
+                in_flight.erase(in_flight.begin());
+            }
+            if (i >= transfers)
+                continue;
+
+            int slot = i % AXIDMA_MAX_IN_FLIGHT;
+            work(work_us);
+            int id = axidma_twoway_transfer(dev, AXIDMA_SIM_TX_CHANNEL, tx + slot * size, size, nullptr,
+                                            AXIDMA_SIM_RX_CHANNEL, rx + slot * size, size, nullptr, false);
+            if (id < 0)
+                exit(EXIT_FAILURE);
+            in_flight.emplace_back(id, bench::now_us());
+        }
+
+        result.elapsed_us = bench::now_us() - start;
+        return result;
+    }
+
+    // the id of a blocking one-way transfer, the last one given out on the channel
+    int last_id(axidma_dev_t dev, int channel, char *buf, size_t size) {
+        return axidma_oneway_transfer(dev, channel, buf, size, true);
+    }
+
+    // fills the channel with slow one-way transfers, a two-way transfer is refused then and the other channel is intact
+    bool check_full_channel(axidma_dev_t dev, char *tx, char *rx, size_t size, int full, int other) {
+        char *full_buf = full == AXIDMA_SIM_TX_CHANNEL ? tx : rx, *other_buf = full == AXIDMA_SIM_TX_CHANNEL ? rx : tx;
+        int ids[AXIDMA_MAX_IN_FLIGHT];
+        bool is_ok = true;
+
+        int other_id = last_id(dev, other, other_buf, size);
+        axidma_sim_set_latency(dev, full, 5000, 0);
+        for (int i = 0; i < AXIDMA_MAX_IN_FLIGHT; ++i) {
+            ids[i] = axidma_oneway_transfer(dev, full, full_buf + i * size, size, false);
+            if (ids[i] < 0)
+                is_ok = false;
+        }
+        if (axidma_twoway_transfer(dev, AXIDMA_SIM_TX_CHANNEL, tx, size, nullptr, AXIDMA_SIM_RX_CHANNEL, rx, size,
+                                   nullptr, false) != -EBUSY)
+            is_ok = false;
+        if (last_id(dev, other, other_buf, size) != other_id + 1)
+            is_ok = false;
+        for (int id : ids) {
+            if (id > 0 && axidma_wait(dev, full, id, -1) < 0)
+                is_ok = false;
+        }
+        axidma_sim_set_latency(dev, full, 0, 0);
+
+        printf("two-way transfer with the %s channel full: %s\n", full == AXIDMA_SIM_TX_CHANNEL ? "TX" : "RX",
+               is_ok ? "refused, nothing taken" : "FAILED");
+        return is_ok;
+    }
+
+    // a transfer after the refused ones moves its own data
+    bool check_pairing(axidma_dev_t dev, char *tx, char *rx, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            tx[i] = (char)(i * 7 + 1);
+            rx[i] = 0;
+        }
+        int id = axidma_twoway_transfer(dev, AXIDMA_SIM_TX_CHANNEL, tx, size, nullptr, AXIDMA_SIM_RX_CHANNEL, rx, size,
+                                        nullptr, true);
+        bool is_ok = id > 0 && std::equal(tx, tx + size, rx);
+
+        printf("two-way transfer after them: %s\n\n", is_ok ? "paired" : "FAILED");
+        return is_ok;
+    }
+
+    double percentile(std::vector<double> values, double p) {
+        std::sort(values.begin(), values.end());
+        return values[(size_t)(p * (double)(values.size() - 1))];
+    }
+}
+
+int main(int argc, char **argv) {
+    int transfers = DEFAULT_TRANSFERS;
+    size_t size = DEFAULT_TRANSFER_SIZE;
+    double rate = DEFAULT_RATE;
+    double work_us = DEFAULT_WORK_US;
+    double latency_us = 0, jitter_us = 0, error_rate = 0;
+    unsigned int seed = 1;
+    bool is_aes = false, is_dump = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:r:w:l:j:e:S:adh")) != -1) {
+        switch (opt) {
+            case 'n':
+                transfers = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 's':
+                size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'r':
+                rate = strtod(optarg, nullptr);
+                break;
+            case 'w':
+                work_us = strtod(optarg, nullptr);
+                break;
+            case 'l':
+                latency_us = strtod(optarg, nullptr);
+                break;
+            case 'j':
+                jitter_us = strtod(optarg, nullptr);
+                break;
+            case 'e':
+                error_rate = strtod(optarg, nullptr);
+                break;
+            case 'S':
+                seed = (unsigned int)strtoul(optarg, nullptr, 0);
+                break;
+            case 'a':
+                is_aes = true;
+                break;
+            case 'd':
+                is_dump = true;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (transfers < 1 || size == 0 || rate <= 0 || work_us < 0 || latency_us < 0 || jitter_us < 0 ||
+        error_rate < 0 || error_rate > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench::tight_timer_slack();
+
+    axidma_dev_t dev = axidma_init();
+    if (!dev)
+        return EXIT_FAILURE;
+
+    // a buffer pair for each transaction that can be in flight
+    char *tx = (char *)axidma_malloc(dev, size * AXIDMA_MAX_IN_FLIGHT);
+    char *rx = (char *)axidma_malloc(dev, size * AXIDMA_MAX_IN_FLIGHT);
+    if (!tx || !rx) {
+        fprintf(stderr, "unable to allocate %zu bytes of DMA memory\n", size * AXIDMA_MAX_IN_FLIGHT);
+        return EXIT_FAILURE;
+    }
+
+    // with the loopback, before the rate, latency and failures of the runs
+    bool is_ok = check_full_channel(dev, tx, rx, size, AXIDMA_SIM_RX_CHANNEL, AXIDMA_SIM_TX_CHANNEL);
+    is_ok = check_full_channel(dev, tx, rx, size, AXIDMA_SIM_TX_CHANNEL, AXIDMA_SIM_RX_CHANNEL) && is_ok;
+    is_ok = check_pairing(dev, tx, rx, size) && is_ok;
+
+    axidma_sim_set_rate(dev, AXIDMA_SIM_RX_CHANNEL, rate);
+    axidma_sim_set_latency(dev, AXIDMA_SIM_RX_CHANNEL, latency_us, jitter_us);
+    axidma_sim_set_error_rate(dev, AXIDMA_SIM_RX_CHANNEL, error_rate);
+    sim_aes_transform aes_transform(false);
+    if (is_aes)
+        aes_transform.attach(dev);
+
+    double transfer_us = (double)size / rate * 1e6 + latency_us;
+    printf("%d transfers of %zu bytes, simulated DMA rate %.1f MB/s (%.1f us per transfer), %.1f us of work per "
+           "transfer\n", transfers, size, rate / 1e6, transfer_us, work_us);
+    printf("completion jitter up to %.1f us, error rate %g, seed %u, %s\n\n", jitter_us, error_rate, seed,
+           is_aes ? "software AES" : "loopback");
+    printf("%5s %10s %8s %12s %12s %12s %7s\n", "depth", "MB/s", "dma_use", "lat_mean_us", "lat_p50_us",
+           "lat_p99_us", "errors");
+
+    for (int depth : depths) {
+        // every depth sees the same jitter and failures, and starts with cleared statistics
+        axidma_sim_set_seed(dev, seed);
+        struct axidma_stats stats{};
+        axidma_get_stats(dev, AXIDMA_SIM_TX_CHANNEL, &stats, true);
+        axidma_get_stats(dev, AXIDMA_SIM_RX_CHANNEL, &stats, true);
+        result_t result = run(dev, tx, rx, size, transfers, depth, work_us);
+        double mean = 0;
+
+        for (double latency : result.latencies_us)
+            mean += latency;
+        mean /= (double)result.latencies_us.size();
+
+        printf("%5d %10.1f %7.1f%% %12.1f %12.1f %12.1f %7d\n", depth,
+               (double)size * transfers / result.elapsed_us, transfer_us * transfers / result.elapsed_us * 100,
+               mean, percentile(result.latencies_us, 0.5), percentile(result.latencies_us, 0.99), result.errors);
+        if (is_dump) {
+            char name[32];
+            snprintf(name, sizeof(name), "depth %d", depth);
+            axidma_dump_stats(dev, name, stdout, false);
+        }
+    }
+
+    axidma_free(dev, tx, size * AXIDMA_MAX_IN_FLIGHT);
+    axidma_free(dev, rx, size * AXIDMA_MAX_IN_FLIGHT);
+    axidma_destroy(dev);
+
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
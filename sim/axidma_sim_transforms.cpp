@@ -0,0 +1,119 @@
+#include "axidma_sim_transforms.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+void sim_aes_transform::_transform(const void *tx_data, size_t tx_len, void *rx_data, size_t rx_len, void *user_data) {
+    auto *self = (sim_aes_transform *)user_data;
+
+    if (tx_len < AES_BLOCK_SIZE)
+        return;
+
+    if (!self->_has_key || memcmp(self->_key, tx_data, AES_BLOCK_SIZE) != 0) {
+        memcpy(self->_key, tx_data, AES_BLOCK_SIZE);
+        self->_aes.set_stream_key(self->_key);
+        self->_has_key = true;
+    }
+
+    // the core outputs whole blocks, as many as both buffers hold
+    size_t len = tx_len - AES_BLOCK_SIZE < rx_len ? tx_len - AES_BLOCK_SIZE : rx_len;
+    len -= len % AES_BLOCK_SIZE;
+
+    if (self->_is_decrypt)
+        self->_aes.decrypt_stream((const uint8_t *)tx_data + AES_BLOCK_SIZE, rx_data, len);
+    else
+        self->_aes.encrypt_stream((const uint8_t *)tx_data + AES_BLOCK_SIZE, rx_data, len);
+}
+
+void sim_pcm_sink::_port(int channel_id, void *data, size_t len, void *user_data) {
+    auto *self = (sim_pcm_sink *)user_data;
+    const auto *samples = (const int16_t *)data;
+    size_t count = len / sizeof(int16_t);
+    int peak = self->_peak;
+
+    (void)channel_id;
+
+    for (size_t i = 0; i < count; ++i)
+        if (abs(samples[i]) > peak)
+            peak = abs(samples[i]);
+
+    self->_peak = peak;
+    self->_samples += count;
+
+    if (self->_out && fwrite(data, sizeof(int16_t), count, self->_out) != count)
+        perror("Unable to write the PCM samples");
+}
+
+void sim_i2s_sink::attach(axidma_dev_t dev, int channel) {
+    axidma_sim_set_rate(dev, channel, _rate);
+    axidma_sim_set_port(dev, channel, _port, this);
+}
+
+void sim_i2s_sink::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _samples.clear();
+    _first_sound_us = 0;
+    _last_sound_us = 0;
+    _period_ends.clear();
+}
+
+std::vector<int16_t> sim_i2s_sink::samples() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _samples;
+}
+
+double sim_i2s_sink::first_sound_us() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _first_sound_us;
+}
+
+double sim_i2s_sink::last_sound_us() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _last_sound_us;
+}
+
+double sim_i2s_sink::played_us(size_t sample) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto period_end = std::upper_bound(_period_ends.begin(), _period_ends.end(), sample,
+                                       [](size_t index, const std::pair<size_t, double> &end) { return index < end.first; });
+
+    if (period_end == _period_ends.end())
+        return 0;
+    return period_end->second - (double)((period_end->first - sample) * sizeof(int16_t)) / _rate * 1e6;
+}
+
+void sim_i2s_sink::_port(int channel_id, void *data, size_t len, void *user_data) {
+    auto *self = (sim_i2s_sink *)user_data;
+    const auto *samples = (const int16_t *)data;
+    size_t count = len / sizeof(int16_t);
+    struct timespec now{};
+
+    (void)channel_id;
+
+    // the port gets the period once it was played, the sample came out that far into it
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double end_us = (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+    std::lock_guard<std::mutex> lock(self->_mutex);
+    if (self->_first_sound_us == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (samples[i] != 0) {
+                self->_first_sound_us = end_us - (double)(len - i * sizeof(int16_t)) / self->_rate * 1e6;
+                break;
+            }
+        }
+    }
+    for (size_t i = count; i > 0; --i) {
+        if (samples[i - 1] != 0) {
+            self->_last_sound_us = end_us - (double)(len - i * sizeof(int16_t)) / self->_rate * 1e6;
+            break;
+        }
+    }
+    self->_samples.insert(self->_samples.end(), samples, samples + count);
+    self->_period_ends.emplace_back(self->_samples.size(), end_us);
+}
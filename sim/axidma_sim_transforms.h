@@ -0,0 +1,91 @@
+#ifndef AES_MUSIC_PLAYER_SIM_AXIDMA_SIM_TRANSFORMS_H
+#define AES_MUSIC_PLAYER_SIM_AXIDMA_SIM_TRANSFORMS_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "libaxidma.h"
+#include "libaxidma_sim.h"
+#include "aes_soft.h"
+
+// Stand-ins for the logic behind the DMAs of the simulated libaxidma (see libaxidma_sim.h). The identity is the
+// loopback of the simulated device, it is used when no transform is set.
+
+// Software AES-128 in place of the AXI_aes_core on two-way transfers. The first block of the transmitted stream is
+// the key, as aes sends it, the rest is encrypted or decrypted (ECB, byte order of the core) into the receive buffer.
+class sim_aes_transform {
+public:
+    explicit sim_aes_transform(bool is_decrypt) : _is_decrypt(is_decrypt) {}
+
+    void attach(axidma_dev_t dev) { axidma_sim_set_transform(dev, _transform, this); }
+
+private:
+    bool _is_decrypt;
+    // the key schedule is kept while the key does not change (a transform runs on one thread at a time)
+    uint8_t _key[AES_BLOCK_SIZE]{};
+    bool _has_key = false;
+    aes_soft _aes;
+
+    static void _transform(const void *tx_data, size_t tx_len, void *rx_data, size_t rx_len, void *user_data);
+};
+
+// Sink of the 16-bit PCM samples transmitted to the audio codec, in place of the I2S transmitter. It counts the
+// samples and the peak level, and writes the raw samples into a file if one is given.
+class sim_pcm_sink {
+public:
+    explicit sim_pcm_sink(FILE *out = nullptr) : _out(out) {}
+
+    void attach(axidma_dev_t dev, int channel) { axidma_sim_set_port(dev, channel, _port, this); }
+
+    uint64_t samples() const { return _samples; }
+    // largest absolute value of the samples so far
+    int peak() const { return _peak; }
+
+private:
+    FILE *_out;
+    // read by other threads than the one of the channel
+    std::atomic<uint64_t> _samples{0};
+    std::atomic<int> _peak{0};
+
+    static void _port(int channel_id, void *data, size_t len, void *user_data);
+};
+
+// The I2S transmitter and the codec behind the audio DMA, for streaming playback: the simulated channel consumes the
+// 16-bit stereo frames at the sample rate (times speed, to run faster than real time). The sink keeps the samples it
+// played for checking, and the time the first sound came out.
+class sim_i2s_sink {
+public:
+    explicit sim_i2s_sink(int sample_rate, double speed = 1.0) : _rate(sample_rate * speed * 2 * sizeof(int16_t)) {}
+
+    // sets the rate of the channel as well
+    void attach(axidma_dev_t dev, int channel);
+    void clear();
+
+    std::vector<int16_t> samples() const;
+    // when the first sample that is not silence was played (CLOCK_MONOTONIC, us), 0 if none yet
+    double first_sound_us() const;
+    // when the last sample that is not silence was played, 0 if none yet
+    double last_sound_us() const;
+    // when the sample (an index into samples()) was played, 0 if not yet
+    double played_us(size_t sample) const;
+
+private:
+    double _rate;
+    // written by the thread of the channel
+    mutable std::mutex _mutex;
+    std::vector<int16_t> _samples;
+    double _first_sound_us = 0;
+    double _last_sound_us = 0;
+    // samples played by the end of each period, and when it ended
+    std::vector<std::pair<size_t, double>> _period_ends;
+
+    static void _port(int channel_id, void *data, size_t len, void *user_data);
+};
+
+
+#endif //AES_MUSIC_PLAYER_SIM_AXIDMA_SIM_TRANSFORMS_H
@@ -0,0 +1,226 @@
+// Stress test and benchmark of concurrent DMA submitters.
+//
+// Worker threads run two-way transfers of their own buffers, alternating blocking transfers with non-blocking ones
+// waited on by id, while another thread keeps replacing the callbacks of the channels. Every transfer is checked:
+// the received data has to be the one sent (the simulated DMA loops back), and the transaction ids a channel gives
+// out must not repeat. The workers either share a device, whose engine they compete for, or each has its own (as the
+// AES cipher, decipher and I2S DMAs are), which must not slow each other down: the throughput should scale with the
+// threads until the CPUs run out. Runs against the simulated libaxidma, -r sets the rate of its DMA.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "libaxidma.h"
+#include "libaxidma_sim.h"
+#include "bench_util.h"
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_TRANSFERS 200
+#define DEFAULT_TRANSFER_SIZE 16384
+#define DEFAULT_RATE 400e6
+
+namespace {
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-t max_threads] [-n transfers_per_thread] [-s transfer_size] [-r bytes_per_second]\n",
+                name);
+    }
+
+    // what went wrong in a run, shared by the workers
+    struct errors_t {
+        std::atomic<int> failed{0};
+        std::atomic<int> corrupted{0};
+        std::atomic<int> duplicate_ids{0};
+        std::mutex ids_mutex;
+        // the ids given out on the receive channel of each device
+        std::map<int, std::set<int>> ids;
+
+        // records the id given out on the channel of the device, an id seen before is counted
+        void record_id(int device, int id) {
+            std::lock_guard<std::mutex> lock(ids_mutex);
+
+            if (!ids[device].insert(id).second)
+                ++duplicate_ids;
+        }
+    };
+
+    std::atomic<long> callbacks{0};
+
+    void count_callback(int channel_id, void *data) {
+        (void)channel_id;
+        (void)data;
+        callbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // transfers of a worker, its pattern tells the worker and the transfer apart
+    void worker(axidma_dev_t dev, int device, int worker_index, int transfers, size_t size, errors_t &errors) {
+        char *tx = (char *)axidma_malloc(dev, size);
+        char *rx = (char *)axidma_malloc(dev, size);
+
+        if (!tx || !rx) {
+            fprintf(stderr, "unable to allocate %zu bytes of DMA memory\n", size);
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < transfers; ++i) {
+            bool is_blocking = i % 2 == 0;
+
+            for (size_t j = 0; j < size; ++j)
+                tx[j] = (char)(worker_index * 31 + i * 7 + j);
+            memset(rx, 0, size);
+
+            int id = axidma_twoway_transfer(dev, AXIDMA_SIM_TX_CHANNEL, tx, size, nullptr, AXIDMA_SIM_RX_CHANNEL, rx,
+                                            size, nullptr, is_blocking);
+            if (id < 0) {
+                ++errors.failed;
+                continue;
+            }
+            errors.record_id(device, id);
+
+            if (!is_blocking && axidma_wait(dev, AXIDMA_SIM_RX_CHANNEL, id, -1) != 0) {
+                ++errors.failed;
+                continue;
+            }
+            if (memcmp(tx, rx, size) != 0)
+                ++errors.corrupted;
+        }
+
+        axidma_free(dev, tx, size);
+        axidma_free(dev, rx, size);
+    }
+
+    struct result_t {
+        double elapsed_us = 0;
+        long long bytes = 0;
+    };
+
+    // runs the workers on the devices (each worker uses the device at its index modulo the number of devices)
+    result_t run(const std::vector<axidma_dev_t> &devs, int threads, int transfers, size_t size, errors_t &errors) {
+        std::vector<std::thread> workers;
+        std::atomic<bool> is_done{false};
+        result_t result;
+
+        // the callbacks are replaced while the transfers complete
+        std::thread churn([&]() {
+            while (!is_done.load()) {
+                for (axidma_dev_t dev : devs) {
+                    axidma_set_callback(dev, AXIDMA_SIM_RX_CHANNEL, count_callback, nullptr);
+                    axidma_set_callback(dev, AXIDMA_SIM_RX_CHANNEL, nullptr, nullptr);
+                }
+                std::this_thread::yield();
+            }
+        });
+
+        double start = bench::now_us();
+        for (int i = 0; i < threads; ++i) {
+            int device = i % (int)devs.size();
+            workers.emplace_back(worker, devs[device], device, i, transfers, size, std::ref(errors));
+        }
+        for (auto &thread : workers)
+            thread.join();
+        result.elapsed_us = bench::now_us() - start;
+
+        is_done = true;
+        churn.join();
+
+        result.bytes = (long long)threads * transfers * (long long)size;
+        return result;
+    }
+
+    std::vector<axidma_dev_t> open_devices(int count, double rate) {
+        std::vector<axidma_dev_t> devs;
+
+        for (int i = 0; i < count; ++i) {
+            axidma_dev_t dev = axidma_init_dev(i);
+            if (!dev)
+                exit(EXIT_FAILURE);
+            axidma_sim_set_rate(dev, AXIDMA_SIM_RX_CHANNEL, rate);
+            devs.push_back(dev);
+        }
+
+        return devs;
+    }
+
+    void close_devices(const std::vector<axidma_dev_t> &devs) {
+        for (axidma_dev_t dev : devs)
+            axidma_destroy(dev);
+    }
+}
+
+int main(int argc, char **argv) {
+    int max_threads = DEFAULT_MAX_THREADS;
+    int transfers = DEFAULT_TRANSFERS;
+    size_t size = DEFAULT_TRANSFER_SIZE;
+    double rate = DEFAULT_RATE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:n:s:r:h")) != -1) {
+        switch (opt) {
+            case 't':
+                max_threads = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'n':
+                transfers = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 's':
+                size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'r':
+                rate = strtod(optarg, nullptr);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (max_threads < 1 || transfers < 1 || size == 0 || rate <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench::tight_timer_slack();
+
+    printf("%d transfers of %zu bytes per thread, simulated DMA rate %.1f MB/s, %u CPUs\n\n", transfers, size,
+           rate / 1e6, std::thread::hardware_concurrency());
+    printf("%7s %12s %14s %8s %7s %9s %9s\n", "threads", "shared_MB/s", "per_dev_MB/s", "scaling", "failed",
+           "corrupted", "dup_ids");
+
+    bool is_passed = true;
+    double single_thread_rate = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        errors_t errors, own_errors;
+
+        // all the workers on one device, the engine is shared
+        std::vector<axidma_dev_t> shared = open_devices(1, rate);
+        result_t shared_result = run(shared, threads, transfers, size, errors);
+        close_devices(shared);
+
+        // a device for each worker, nothing is shared
+        std::vector<axidma_dev_t> own = open_devices(threads, rate);
+        result_t own_result = run(own, threads, transfers, size, own_errors);
+        close_devices(own);
+        errors.failed += own_errors.failed;
+        errors.corrupted += own_errors.corrupted;
+        errors.duplicate_ids += own_errors.duplicate_ids;
+
+        double own_rate = (double)own_result.bytes / own_result.elapsed_us;
+        if (threads == 1)
+            single_thread_rate = own_rate;
+
+        printf("%7d %12.1f %14.1f %7.2fx %7d %9d %9d\n", threads, (double)shared_result.bytes / shared_result.elapsed_us,
+               own_rate, own_rate / single_thread_rate, errors.failed.load(), errors.corrupted.load(),
+               errors.duplicate_ids.load());
+        is_passed = is_passed && errors.failed == 0 && errors.corrupted == 0 && errors.duplicate_ids == 0;
+    }
+    printf("\n%ld completions called back while the callbacks were being replaced, %s\n", callbacks.load(),
+           is_passed ? "passed" : "FAILED");
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,46 @@
+#ifndef AES_MUSIC_PLAYER_SIM_BENCH_UTIL_H
+#define AES_MUSIC_PLAYER_SIM_BENCH_UTIL_H
+
+// Helpers shared by the benches. They are apart from the ones of the app (util.h) the benches link with.
+
+#include <cstddef>
+#include <time.h>
+#include <sys/prctl.h>
+
+namespace bench {
+    // the monotonic clock, in us
+    inline double now_us() {
+        struct timespec ts{};
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+    }
+
+    // busy on the CPU until the time, as decoding or encrypting would be
+    inline void spin_until(double until_us) {
+        while (now_us() < until_us) { }
+    }
+
+    // The simulated DMA completes its transfers and periods on timed waits, the default timer slack would add up to
+    // 50 us to each of them. The slack is inherited by the threads created after the call, the ones of the simulation
+    // among them: call it before axidma_init.
+    inline void tight_timer_slack() {
+        prctl(PR_SET_TIMERSLACK, 1UL);
+    }
+
+    // frames per second of run, over runs of frames frames repeated for ms
+    template<typename F>
+    double rate(F run, size_t frames, int ms) {
+        size_t runs = 0;
+        double start = now_us(), elapsed;
+
+        do {
+            run();
+            ++runs;
+        } while ((elapsed = now_us() - start) < ms * 1e3);
+
+        return (double)(runs * frames) / elapsed * 1e6;
+    }
+}
+
+#endif //AES_MUSIC_PLAYER_SIM_BENCH_UTIL_H
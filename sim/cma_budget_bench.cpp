@@ -0,0 +1,141 @@
+// Benchmark of the CMA budget, on a small budget of its own in place of the CMA area of the system: the clients
+// reserve and release as the player and the AES jobs do, the accounting and the waits are checked.
+//
+// The checks: the limits of the clients, a reservation over its limit refused at once; the playback slice left free
+// for the player, the other clients refused even though it is unused; a reservation queued behind another one timing
+// out on its own while the first one still waits; a release waking the waiter it makes room for, and the time until
+// it holds its reservation; the current and the peak usage through all of it.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+#include "cma_budget.h"
+#include "bench_util.h"
+
+#define DEFAULT_TOTAL_SIZE (4 * 1024 * 1024)
+#define DEFAULT_PLAYBACK_SIZE (1024 * 1024)
+#define DEFAULT_TIMEOUT_MS 50
+
+namespace {
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s total_size] [-p playback_size] [-t timeout_ms]\n", name);
+    }
+
+    bool report(const char *name, bool is_passed) {
+        printf("%-60s %s\n", name, is_passed ? "yes" : "NO");
+        return is_passed;
+    }
+
+    // a reservation waiting on its own thread
+    struct waiter_t {
+        std::atomic<bool> is_done{false};
+        bool is_reserved = false;
+        double done_us = 0;
+        std::thread thread;
+
+        waiter_t(cma_budget &budget, cma_budget::client_t client, size_t size, int timeout_ms) {
+            thread = std::thread([this, &budget, client, size, timeout_ms]() {
+                is_reserved = budget.reserve(client, size, timeout_ms);
+                done_us = bench::now_us();
+                is_done = true;
+            });
+        }
+
+        ~waiter_t() { thread.join(); }
+    };
+}
+
+int main(int argc, char **argv) {
+    size_t total_size = DEFAULT_TOTAL_SIZE;
+    size_t playback_size = DEFAULT_PLAYBACK_SIZE;
+    int timeout_ms = DEFAULT_TIMEOUT_MS;
+    bool is_passed = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:t:h")) != -1) {
+        switch (opt) {
+            case 's':
+                total_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'p':
+                playback_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 't':
+                timeout_ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    // the other clients share the rest of the budget in quarters
+    if (playback_size == 0 || total_size < playback_size + 4 || timeout_ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    cma_budget budget(total_size, playback_size);
+    size_t shared_size = total_size - playback_size, quarter = shared_size / 4;
+
+    printf("budget of %zu bytes, %zu of them for playback, timeout %d ms\n\n", total_size, playback_size, timeout_ms);
+
+    is_passed &= report("limits of the clients",
+                        budget.limit(cma_budget::CIPHER) == shared_size &&
+                        budget.limit(cma_budget::DECIPHER) == shared_size &&
+                        budget.limit(cma_budget::PLAYER) == total_size);
+    is_passed &= report("reservation over the limit refused without waiting",
+                        !budget.reserve(cma_budget::CIPHER, shared_size + 1, -1) && budget.current_usage() == 0);
+
+    // the shared part taken, the playback slice is free
+    bool is_reserved = budget.reserve(cma_budget::CIPHER, shared_size - quarter, 0) &&
+                       budget.reserve(cma_budget::DECIPHER, quarter, 0);
+    is_passed &= report("shared part reserved by the AES jobs", is_reserved);
+    is_passed &= report("playback slice unavailable to the other clients",
+                        !budget.reserve(cma_budget::DECIPHER, 1, 0) && !budget.reserve(cma_budget::CIPHER, 1, 0));
+    is_passed &= report("playback slice reserved by the player", budget.reserve(cma_budget::PLAYER, playback_size, 0));
+    is_passed &= report("usage of the full budget",
+                        budget.current_usage() == total_size && budget.peak_usage() == total_size &&
+                        budget.current_usage(cma_budget::PLAYER) == playback_size);
+
+    // A waits for 2 quarters, B queues behind it for one with a timeout and gives up while A still waits
+    {
+        waiter_t first(budget, cma_budget::CIPHER, 2 * quarter, -1);
+        double start = bench::now_us();
+        waiter_t second(budget, cma_budget::DECIPHER, quarter, timeout_ms);
+
+        while (!second.is_done)
+            usleep(1000);
+        double waited_ms = (second.done_us - start) / 1e3;
+        printf("queued reservation gave up after %.1f ms\n", waited_ms);
+        is_passed &= report("queued reservation timed out",
+                            !second.is_reserved && waited_ms >= timeout_ms && !first.is_done);
+
+        // the first release is not enough for A, the second one wakes it
+        budget.release(cma_budget::DECIPHER, quarter);
+        usleep(timeout_ms * 1000);
+        is_passed &= report("release too small leaves the waiter waiting", !first.is_done);
+        double release_us = bench::now_us();
+        budget.release(cma_budget::CIPHER, quarter);
+        while (!first.is_done)
+            usleep(100);
+        printf("waiter reserved %.1f us after the release\n", first.done_us - release_us);
+        is_passed &= report("release woke the waiter", first.is_reserved);
+    }
+
+    is_passed &= report("usage after the waits",
+                        budget.current_usage() == total_size &&
+                        budget.current_usage(cma_budget::CIPHER) == shared_size &&
+                        budget.current_usage(cma_budget::DECIPHER) == 0);
+
+    budget.release(cma_budget::CIPHER, shared_size);
+    budget.release(cma_budget::PLAYER, playback_size);
+    // more than it holds is clamped
+    budget.release(cma_budget::DECIPHER, quarter);
+    is_passed &= report("everything released, the peak kept",
+                        budget.current_usage() == 0 && budget.peak_usage() == total_size);
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+// Benchmark of the crossfade mixer: the frames per second it mixes against a plain loop evaluating the curves frame by
+// frame, and the CPU use of the mixing per period against the budget of the fill of a period during a crossfade.
+//
+// The output is checked against the equal power curves evaluated exactly: over an overlap mixed a period at a time, at
+// a ratio of 1, of a lower and of a higher gain (the outgoing frames attenuated then), and over one shortened within a
+// period (within 1.5 LSB, so the rotation of the gains does not drift over an overlap); the first frame of a fade is
+// the outgoing one, the last one the incoming one, at the same gain.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+#include "crossfade_mixer.h"
+#include "i2s_stream.h"
+#include "bench_util.h"
+
+#define DEFAULT_FRAMES I2S_DEFAULT_PERIOD_FRAMES
+#define DEFAULT_MS 200
+#define DEFAULT_OVERLAP_MS 2000
+#define SAMPLE_RATE 48000
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-f frames] [-o overlap_ms] [-t ms]\n", name);
+    }
+
+    // a stereo sine 6 dB below full scale, the channels out of phase
+    std::vector<int16_t> sine(size_t frames, double frequency) {
+        std::vector<int16_t> samples(frames * 2);
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            double phase = 2 * PI * frequency * (double)(i / 2) / SAMPLE_RATE + (double)(i % 2);
+            samples[i] = (int16_t)std::lrint(16384 * std::sin(phase));
+        }
+        return samples;
+    }
+
+    // the plain loop: the curves evaluated for each frame
+    void plain(int16_t *dst, const int16_t *outgoing, const int16_t *incoming, size_t frames, size_t first,
+               size_t overlap, float ratio) {
+        for (size_t i = 0; i < frames; ++i) {
+            double angle = PI / 2 * (double)(first + i + 1) / (double)overlap;
+            for (size_t channel = 0; channel < 2; ++channel) {
+                double sample = outgoing[i * 2 + channel] * std::cos(angle) +
+                                incoming[i * 2 + channel] * std::sin(angle) * ratio;
+                dst[i * 2 + channel] = (int16_t)std::lrint(std::clamp(sample, -32768.0, 32767.0));
+            }
+        }
+    }
+
+    // mixes the overlap a period at a time, shortened to end within a period once shorten_at frames are mixed; the
+    // largest error to the exact curves, and whether the fade ended on the incoming frame
+    double check(size_t frames, size_t overlap, float ratio, size_t shorten_at, bool &is_ended) {
+        std::vector<int16_t> outgoing = sine(overlap, 997), incoming = sine(overlap, 1499), mixed(outgoing);
+        crossfade_mixer mixer;
+        double max_error = 0;
+        // the louder one is attenuated to the other one
+        double out_scale = ratio > 1 ? 1 / ratio : 1, in_scale = std::min(ratio, 1.0f);
+        // the angle and the step of the exact curves, from the frame the fade was shortened at
+        double angle = 0, step = PI / 2 / (double)overlap;
+        size_t done = 0;
+
+        mixer.start(overlap, ratio);
+        while (mixer.is_fading()) {
+            size_t count = std::min(frames, mixer.remaining());
+
+            mixer.mix(mixed.data() + done * 2, incoming.data() + done * 2, count);
+            for (size_t i = done; i < done + count; ++i) {
+                double exact_angle = angle + step * (double)(i + 1 - (i >= shorten_at ? shorten_at : 0));
+                for (size_t channel = 0; channel < 2; ++channel) {
+                    double exact = outgoing[i * 2 + channel] * std::cos(exact_angle) * out_scale +
+                                   incoming[i * 2 + channel] * std::sin(exact_angle) * in_scale;
+                    max_error = std::max(max_error, std::fabs(mixed[i * 2 + channel] - exact));
+                }
+            }
+            done += count;
+
+            if (done == shorten_at) {
+                mixer.shorten(frames);
+                angle = step * (double)done;
+                step = (PI / 2 - angle) / (double)frames;
+            }
+        }
+
+        size_t last = (done - 1) * 2;
+        is_ended = std::fabs(mixed[last] - incoming[last] * in_scale) <= 1 &&
+                   std::fabs(mixed[0] - outgoing[0] * out_scale) <= 1 && mixer.remaining() == 0;
+        return max_error;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t frames = DEFAULT_FRAMES;
+    int overlap_ms = DEFAULT_OVERLAP_MS;
+    int ms = DEFAULT_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:o:t:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                frames = strtoul(optarg, nullptr, 0);
+                break;
+            case 'o':
+                overlap_ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 't':
+                ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    auto overlap = (size_t)overlap_ms * SAMPLE_RATE / 1000;
+    if (frames < 64 || overlap < frames * 4 || ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool is_passed = true;
+    printf("%s crossfade mixer, periods of %zu stereo frames, overlap of %d ms at %d Hz\n\n",
+           crossfade_mixer::kernel_name(), frames, overlap_ms, SAMPLE_RATE);
+
+    // the curves
+    struct case_t {
+        const char *name;
+        float ratio;
+        size_t shorten_at;
+    };
+    printf("%22s %9s %7s %7s\n", "fade", "max_err", "ended", "passed");
+    for (const case_t &c : {case_t{"equal power", 1.0f, overlap}, case_t{"ratio -6 dB", 0.5f, overlap},
+                            case_t{"ratio +6 dB", 2.0f, overlap},
+                            case_t{"shortened at 1/4", 1.0f, overlap / 4 / frames * frames}}) {
+        bool is_ended = false;
+        double max_error = check(frames, overlap, c.ratio, c.shorten_at, is_ended);
+        bool is_case_passed = max_error <= 1.5 && is_ended;
+
+        printf("%22s %9.2f %7s %7s\n", c.name, max_error, is_ended ? "yes" : "NO", is_case_passed ? "yes" : "NO");
+        is_passed = is_passed && is_case_passed;
+    }
+
+    // the rates, and the share of a period and of its budget the mixing of one takes
+    std::vector<int16_t> outgoing = sine(frames, 997), incoming = sine(frames, 1499), mixed(outgoing);
+    crossfade_mixer mixer;
+    mixer.start((size_t)-1 / 2, 0.5f);
+    double mixer_rate = bench::rate([&]() { mixer.mix(mixed.data(), incoming.data(), frames); }, frames, ms);
+    double plain_rate = bench::rate([&]() {
+        plain(mixed.data(), outgoing.data(), incoming.data(), frames, 0, overlap, 0.5f);
+    }, frames, ms);
+    double period_us = (double)frames * 1e6 / SAMPLE_RATE;
+    double mix_us = (double)frames / mixer_rate * 1e6;
+
+    printf("\n%12s %12s %8s %12s %10s %12s\n", "Mframes/s", "plain_Mf/s", "speedup", "us/period", "cpu_%_48k",
+           "%_of_budget");
+    printf("%12.2f %12.2f %8.1f %12.2f %10.3f %12.3f\n", mixer_rate / 1e6, plain_rate / 1e6, mixer_rate / plain_rate,
+           mix_us, mix_us / period_us * 100, mix_us / (period_us * I2S_CROSSFADE_BUDGET) * 100);
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+// Benchmark of the copy kernels of DMA buffers against libc: copy into and out of a buffer, fill, and conversion of
+// float samples to 16-bit, on cached memory and on the memory of axidma_malloc.
+//
+// On the board the memory of axidma_malloc is uncached, which is what the line kernels are for. Against the simulated
+// libaxidma it is ordinary memory, so on the host both columns measure cached memory (and the x86 streaming stores
+// of the kernels, which bypass the cache). The result of every kernel is checked against libc.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#include "libaxidma.h"
+#include "dma_copy.h"
+#include "bench_util.h"
+
+#define DEFAULT_MIN_SIZE 4096
+#define DEFAULT_MAX_SIZE (4 * 1024 * 1024)
+#define DEFAULT_BYTES_PER_RUN (64 * 1024 * 1024)
+
+namespace {
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s min_size] [-S max_size] [-b bytes_per_run] [-d device_index]\n", name);
+    }
+
+    enum operation_t {COPY_TO, COPY_FROM, FILL, FLOAT_TO_S16};
+
+    const char *operation_names[] = {"copy to", "copy from", "fill", "float>s16"};
+
+    // runs the operation over size bytes of the buffer until bytes_per_run were moved, returns MB/s
+    double measure(const dma_copy::kernels_t &kernels, operation_t operation, char *buffer, char *cached,
+                   const float *samples, size_t size, size_t bytes_per_run) {
+        size_t runs = std::max<size_t>(1, bytes_per_run / size);
+        double start = bench::now_us();
+
+        for (size_t i = 0; i < runs; ++i) {
+            switch (operation) {
+                case COPY_TO:
+                    kernels.copy(buffer, cached, size);
+                    break;
+                case COPY_FROM:
+                    kernels.copy(cached, buffer, size);
+                    break;
+                case FILL:
+                    kernels.fill(buffer, (int)i, size);
+                    break;
+                case FLOAT_TO_S16:
+                    kernels.float_to_s16((int16_t *)buffer, samples, size / sizeof(int16_t));
+                    break;
+            }
+        }
+
+        return (double)(runs * size) / (bench::now_us() - start);
+    }
+
+    // checks the kernels against libc at unaligned offsets and lengths, returns the number of mismatches
+    int check(const dma_copy::kernels_t &kernels, char *buffer, size_t size) {
+        std::vector<char> src(size), expected(size);
+        std::vector<float> samples(size / sizeof(int16_t));
+        int mismatches = 0;
+
+        for (size_t i = 0; i < size; ++i)
+            src[i] = (char)(i * 131 + 7);
+        for (size_t i = 0; i < samples.size(); ++i)
+            samples[i] = 1.25f * sinf((float)i * 0.01f);
+
+        for (size_t offset : {0, 1, 3, 16, 63}) {
+            size_t len = size - offset - (offset * 7) % 61;
+
+            memset(buffer, 0, size);
+            kernels.copy(buffer + offset, src.data(), len);
+            mismatches += memcmp(buffer + offset, src.data(), len) != 0;
+
+            memset(expected.data(), 0x11, size);
+            kernels.copy(expected.data() + offset, buffer + offset, len);
+            mismatches += memcmp(expected.data() + offset, src.data(), len) != 0;
+
+            memset(buffer, 0, size);
+            kernels.fill(buffer + offset, 0xa5, len);
+            mismatches += std::count(buffer + offset, buffer + offset + len, (char)0xa5) != (long)len;
+            mismatches += offset > 0 && buffer[offset - 1] != 0;
+
+            size_t count = len / sizeof(int16_t) - 1, sample_offset = offset & ~(size_t)1;
+            auto *dst = (int16_t *)(buffer + sample_offset);
+            kernels.float_to_s16(dst, samples.data(), count);
+            dma_copy::kernels(dma_copy::CACHED).float_to_s16((int16_t *)expected.data(), samples.data(), count);
+            mismatches += memcmp(dst, expected.data(), count * sizeof(int16_t)) != 0;
+        }
+
+        return mismatches;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t min_size = DEFAULT_MIN_SIZE;
+    size_t max_size = DEFAULT_MAX_SIZE;
+    size_t bytes_per_run = DEFAULT_BYTES_PER_RUN;
+    unsigned int device_index = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:S:b:d:h")) != -1) {
+        switch (opt) {
+            case 's':
+                min_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'S':
+                max_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'b':
+                bytes_per_run = strtoul(optarg, nullptr, 0);
+                break;
+            case 'd':
+                device_index = (unsigned int)strtoul(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (min_size < DMA_COPY_LINE_SIZE * 2 || max_size < min_size || bytes_per_run == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    axidma_dev_t dev = axidma_init_dev(device_index);
+    if (!dev)
+        return EXIT_FAILURE;
+
+    char *dma_buffer = (char *)axidma_malloc(dev, max_size);
+    char *cached_buffer = (char *)malloc(max_size);
+    char *cached_source = (char *)malloc(max_size);
+    std::vector<float> samples(max_size / sizeof(int16_t));
+    if (!dma_buffer || !cached_buffer || !cached_source) {
+        fprintf(stderr, "unable to allocate %zu bytes of memory\n", max_size);
+        return EXIT_FAILURE;
+    }
+    memset(cached_source, 0x3c, max_size);
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = sinf((float)i * 0.001f);
+
+    const dma_copy::kernels_t &libc = dma_copy::kernels(dma_copy::CACHED);
+    const dma_copy::kernels_t &lines = dma_copy::kernels(dma_copy::UNCACHED);
+    const dma_copy::kernels_t &chosen = dma_copy::kernels(dev, dma_buffer, max_size);
+
+    int mismatches = check(lines, dma_buffer, std::min<size_t>(max_size, 65536)) +
+                     check(lines, cached_buffer, std::min<size_t>(max_size, 65536));
+    printf("axidma_malloc memory is %s, the %s kernels are chosen for it; %s kernels checked against libc: %s\n\n",
+           &chosen == &lines ? "uncached" : "cached", chosen.name, lines.name, mismatches == 0 ? "passed" : "FAILED");
+
+    printf("%9s %8s %15s %15s %15s %15s\n", "operation", "size", "cached_libc", "cached_lines", "dma_libc",
+           "dma_lines");
+    for (operation_t operation : {COPY_TO, COPY_FROM, FILL, FLOAT_TO_S16}) {
+        for (size_t size = min_size; size <= max_size; size *= 4) {
+            double rates[4] = {
+                    measure(libc, operation, cached_buffer, cached_source, samples.data(), size, bytes_per_run),
+                    measure(lines, operation, cached_buffer, cached_source, samples.data(), size, bytes_per_run),
+                    measure(libc, operation, dma_buffer, cached_source, samples.data(), size, bytes_per_run),
+                    measure(lines, operation, dma_buffer, cached_source, samples.data(), size, bytes_per_run)};
+
+            printf("%9s %8zu", operation_names[operation], size);
+            for (double rate : rates)
+                printf(" %10.1f MB/s", rate);
+            printf("\n");
+        }
+    }
+
+    free(cached_source);
+    free(cached_buffer);
+    axidma_free(dev, dma_buffer, max_size);
+    axidma_destroy(dev);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+// Benchmark of the gain stage: the samples per second it scales at a steady gain below 1, above 1 (soft clipped), while
+// ramping and at unity (copied), against a plain loop over the samples, and the CPU use of a stereo stream.
+//
+// The output is checked: at unity it is the input; at a steady gain the error to the exact scaled sample is the TPDF
+// dither and the rounding (within 1.5 LSB, mean about 0, variance about 1/6 + 1/12 LSB^2); a ramp goes linearly from
+// one gain to the other over its frames, with no step larger than the ones of the ramp; soft clipping keeps the samples
+// monotonic in the input and leaves the ones below the knee linear.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+#include "gain_stage.h"
+#include "bench_util.h"
+
+#define DEFAULT_FRAMES 1024
+#define DEFAULT_MS 200
+#define SAMPLE_RATE 48000
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-f frames] [-t ms]\n", name);
+    }
+
+    // a full scale stereo sine, not periodic in the block
+    std::vector<int16_t> sine(size_t frames) {
+        std::vector<int16_t> samples(frames * 2);
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            double phase = 2 * PI * 997.0 * (double)(i / 2) / SAMPLE_RATE + (double)(i % 2);
+            samples[i] = (int16_t)std::lrint(32767 * std::sin(phase));
+        }
+        return samples;
+    }
+
+    // the plain loop: gain, rounded, with the dither of two xorshift values
+    void plain(int16_t *dst, const int16_t *src, size_t frames, float gain) {
+        static uint32_t seed = 1;
+
+        for (size_t i = 0; i < frames * 2; ++i) {
+            double dither = -1;
+            for (int k = 0; k < 2; ++k) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                dither += seed / 4294967296.0;
+            }
+            dst[i] = (int16_t)std::lrint(std::clamp(src[i] * gain + dither, -32768.0, 32767.0));
+        }
+    }
+
+    struct error_t {
+        double max = 0;
+        double mean = 0;
+        double variance = 0;
+    };
+
+    error_t error(const std::vector<int16_t> &output, const std::vector<int16_t> &input, float gain) {
+        error_t result;
+
+        for (size_t i = 0; i < output.size(); ++i) {
+            double error = output[i] - input[i] * (double)gain;
+            result.max = std::max(result.max, std::fabs(error));
+            result.mean += error / (double)output.size();
+            result.variance += error * error / (double)output.size();
+        }
+        result.variance -= result.mean * result.mean;
+        return result;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t frames = DEFAULT_FRAMES;
+    int ms = DEFAULT_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                frames = strtoul(optarg, nullptr, 0);
+                break;
+            case 't':
+                ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (frames < 64 || ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int16_t> input = sine(frames), output(frames * 2), plain_output(frames * 2);
+    bool is_passed = true;
+
+    printf("%s gain stage, blocks of %zu stereo frames for %d ms\n\n", gain_stage::kernel_name(), frames, ms);
+    printf("%8s %12s %12s %8s %12s %9s %10s %12s %7s\n", "mode", "Msamples/s", "plain_Ms/s", "speedup", "cpu_%_48k",
+           "max_err", "mean_err", "err_var_LSB2", "passed");
+
+    struct mode_t {
+        const char *name;
+        float gain;
+        // ramps from 1 over the block each time
+        bool is_ramp;
+    };
+    for (const mode_t &mode : {mode_t{"unity", 1.0f, false}, mode_t{"-6dB", 0.5f, false},
+                               mode_t{"+6dB", 2.0f, false}, mode_t{"ramp", 0.25f, true}}) {
+        gain_stage stage(mode.is_ramp ? 1.0f : mode.gain);
+        const auto scale = [&]() {
+            if (mode.is_ramp)
+                stage.ramp(1.0f, mode.gain, frames);
+            stage.process(output.data(), input.data(), frames);
+        };
+
+        double stage_rate = bench::rate(scale, frames, ms);
+        double plain_rate = bench::rate([&]() { plain(plain_output.data(), input.data(), frames, mode.gain); }, frames, ms);
+        scale();
+
+        bool is_mode_passed;
+        error_t result{};
+        if (mode.is_ramp) {
+            // the exact ramp, frame i at 1 + (gain - 1) * (i + 1) / frames
+            double largest_step = 0;
+            for (size_t i = 0; i < frames * 2; ++i) {
+                double gain = 1 + (mode.gain - 1.0) * (double)(i / 2 + 1) / (double)frames;
+                double error = output[i] - input[i] * gain;
+                result.max = std::max(result.max, std::fabs(error));
+                result.mean += error / (double)(frames * 2);
+                result.variance += error * error / (double)(frames * 2);
+                if (i >= 2)
+                    largest_step = std::max(largest_step, std::fabs((double)output[i] - output[i - 2]));
+            }
+            result.variance -= result.mean * result.mean;
+            // a step of the sine at full scale plus the ramp step and the dither
+            double sine_step = 32767 * 2 * PI * 997.0 / SAMPLE_RATE;
+            is_mode_passed = result.max <= 1.5 && stage.gain() == mode.gain &&
+                             largest_step <= sine_step + 32767 * (1 - mode.gain) / (double)frames + 3;
+        } else if (mode.gain == 1.0f) {
+            is_mode_passed = output == input;
+        } else if (mode.gain > 1.0f) {
+            // the input sorted, through the clipping: monotonic, linear below the knee
+            std::vector<int16_t> sorted(input), clipped(frames * 2);
+            std::sort(sorted.begin(), sorted.end());
+            stage.process(clipped.data(), sorted.data(), frames);
+            is_mode_passed = true;
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                double exact = sorted[i] * (double)mode.gain;
+                if (i > 0 && clipped[i] < clipped[i - 1] - 2)
+                    is_mode_passed = false;
+                if (std::fabs(exact) < GAIN_STAGE_KNEE * 32767 && std::fabs(clipped[i] - exact) > 1.5)
+                    is_mode_passed = false;
+                result.max = std::max(result.max, std::fabs(exact) < GAIN_STAGE_KNEE * 32767 ?
+                                                  std::fabs(clipped[i] - exact) : 0);
+            }
+        } else {
+            result = error(output, input, mode.gain);
+            is_mode_passed = result.max <= 1.5 && std::fabs(result.mean) < 0.05 && result.variance > 0.2 &&
+                             result.variance < 0.3;
+        }
+
+        printf("%8s %12.1f %12.1f %8.1f %12.3f %9.2f %10.3f %12.3f %7s\n", mode.name, stage_rate * 2 / 1e6,
+               plain_rate * 2 / 1e6, stage_rate / plain_rate, SAMPLE_RATE / stage_rate * 100, result.max, result.mean,
+               result.variance, is_mode_passed ? "yes" : "NO");
+        is_passed = is_passed && is_mode_passed;
+    }
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,819 @@
+// Benchmark of streaming playback: a track is played through the ring of DMA periods of i2s_stream into a simulated
+// I2S sink, against decoding the whole track into one buffer before playing it (as the player did).
+//
+// For tracks of increasing length, it reports the time from starting the playback to the first sound out of the
+// sink, the memory of the stream and the periods the DMA played before they were refilled (underruns). The decoder
+// is a generated pattern, -w adds the decoding time of a period. Without underruns, the samples played are checked
+// against the source: all of them, in order, then silence. The sink consumes the samples -x times faster than real
+// time. Runs against the simulated libaxidma.
+//
+// Then tracks are played one after the other, at real time, three ways: each one started once the one before it
+// played out (as the player did), enqueued to follow without a gap, and enqueued after predecoding its start in
+// another thread (as the UI thread prepares the next track). Opening a track takes -o ms (the header, a decoder
+// finding its first frames). It reports the gap between the tracks, the underruns and the memory of the predecoded
+// frames, the samples played are checked against the tracks.
+//
+// Last, a track of -l seconds is played at real time and seeked -k times, back and forward, the way the player seeks:
+// the decoder seeks and the stream restarts from it. It reports the latency from the seek until the samples at the
+// new position came out of the sink, against the bound of a period, and the time it would have taken to decode the
+// track from its start up to the position instead. The samples played after each seek are checked against the track.
+//
+// Then a track is paused -u times and resumed. It reports the time from pausing until the sound stopped (the period
+// playing is played out), the time from resuming until it was heard again, against the bound of a period, and the
+// memory the paused stream keeps. The samples are checked to follow on after each pause, none lost or repeated.
+//
+// Last, the volume of a track is changed -v times, halved and restored, the way the player changes it: the gain
+// stage ramps over GAIN_STAGE_RAMP_MS from the period after the one playing. It reports the latency from the change
+// until it was heard, against the bound of a period, and the periods filled ahead a gain applied only to the periods
+// filled next would have waited for. The samples are checked to be between the two gains of the pattern (dithered),
+// and untouched before the first change and after the last one.
+//
+// Then -c tracks are crossfaded into one another over -e ms, their gains alternating between two, the way the player
+// plays a track in place of the one playing: once decoding as fast as -w, once decoding a period taking more than half
+// of the budget of its fill during a crossfade (CROSSFADE_SLOW_DECODE), so the two decoders take longer than it. It
+// reports the crossfades shortened to stay within the budget, the underruns and the longest gap; the last track is
+// checked to be played to its end at its gain, once the gain stage took its gain over.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+#include "libaxidma.h"
+#include "libaxidma_sim.h"
+#include "axidma_sim_transforms.h"
+#include "cma_budget.h"
+#include "i2s_stream.h"
+#include "bench_util.h"
+
+#define DEFAULT_SAMPLE_RATE 48000
+#define DEFAULT_MAX_SECONDS 32
+#define DEFAULT_SPEED 8.0
+#define DEFAULT_DECODE_US 200
+#define DEFAULT_TRACKS 4
+#define DEFAULT_TRACK_MS 500
+#define DEFAULT_OPEN_MS 30
+#define DEFAULT_PREDECODE_MS 500
+#define DEFAULT_SEEKS 8
+#define DEFAULT_SEEK_SECONDS 60
+// time played between the seeks
+#define SEEK_INTERVAL_MS 250
+#define DEFAULT_PAUSES 8
+// time played between the pauses, and paused
+#define PAUSE_INTERVAL_MS 250
+#define PAUSE_MS 100
+#define DEFAULT_GAIN_CHANGES 8
+// time played between the changes of the volume, and the gain of the lower one
+#define GAIN_INTERVAL_MS 250
+#define LOWER_GAIN 0.5f
+#define DEFAULT_CROSSFADES 4
+#define DEFAULT_CROSSFADE_MS 100
+// time played between the crossfades, and the share of a period the slow decoding of one takes
+#define CROSSFADE_INTERVAL_MS 400
+#define CROSSFADE_SLOW_DECODE 0.35
+
+namespace {
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s max_seconds] [-x speed] [-p period_frames] [-n num_periods] "
+                        "[-w decode_us_per_period] [-r sample_rate] [-g tracks] [-t track_ms] [-o open_ms] "
+                        "[-d predecode_ms] [-k seeks] [-l seek_track_seconds] [-u pauses] [-v gain_changes] "
+                        "[-c crossfades] [-e crossfade_ms]\n", name);
+    }
+
+    int16_t pattern(size_t sample) {
+        return (int16_t)((sample * 7919) % 30011 + 1);
+    }
+
+    // the decoder of a track: the pattern (of the track), taking decode_us for a period and open_us at first
+    struct source_t {
+        size_t frames;
+        size_t period_frames;
+        double decode_us;
+        double open_us = 0;
+        size_t track = 0;
+        size_t position = 0;
+
+        size_t operator()(int16_t *buffer, size_t count) {
+            if (open_us > 0) {
+                bench::spin_until(bench::now_us() + open_us);
+                open_us = 0;
+            }
+            double until = bench::now_us() + decode_us * (double)count / (double)period_frames;
+
+            count = std::min(count, frames - position);
+            for (size_t i = 0; i < count * I2S_CHANNELS; ++i)
+                buffer[i] = pattern((track * frames + position) * I2S_CHANNELS + i);
+            position += count;
+
+            bench::spin_until(until);
+            return count;
+        }
+    };
+
+    struct result_t {
+        double full_start_ms = 0;
+        double stream_start_ms = 0;
+        double first_sound_ms = 0;
+        size_t stream_memory = 0;
+        unsigned long long underruns = 0;
+        bool is_intact = false;
+    };
+
+    result_t run(size_t frames, int sample_rate, double speed, size_t period_frames, int num_periods,
+                 double decode_us) {
+        result_t result;
+
+        // the whole track is decoded before anything plays
+        std::vector<int16_t> full(frames * I2S_CHANNELS);
+        source_t full_source{frames, period_frames, decode_us};
+        double start = bench::now_us();
+        full_source(full.data(), frames);
+        result.full_start_ms = (bench::now_us() - start) / 1e3;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate, speed);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+
+            start = bench::now_us();
+            if (stream.start(source_t{frames, period_frames, decode_us}, period_frames, num_periods) != 0) {
+                fprintf(stderr, "unable to start the stream\n");
+                exit(EXIT_FAILURE);
+            }
+            result.stream_start_ms = stream.stats().start_latency_us / 1e3;
+            result.stream_memory = stream.memory_size();
+
+            // the player refills on the completion fd the same way
+            struct pollfd pfd{completion_fd, POLLIN, 0};
+            i2s_stream::stats_t stats = stream.stats();
+            while (true) {
+                poll(&pfd, 1, 100);
+                stats = stream.stats();
+                if (stream.refill())
+                    break;
+            }
+            result.underruns = stats.underruns;
+            result.first_sound_ms = (sink.first_sound_us() - start) / 1e3;
+        }
+
+        std::vector<int16_t> played = sink.samples();
+        result.is_intact = played.size() >= full.size() &&
+                           std::equal(full.begin(), full.end(), played.begin()) &&
+                           std::all_of(played.begin() + (long)full.size(), played.end(), [](int16_t s) { return s == 0; });
+
+        axidma_destroy(dev);
+        return result;
+    }
+
+    enum change_t {RESTART, SPLICE, PREDECODE};
+
+    const char *change_names[] = {"restart", "splice", "predecode"};
+
+    struct change_result_t {
+        double max_gap_ms = 0;
+        size_t max_gap_samples = 0;
+        unsigned long long underruns = 0;
+        size_t predecoded_size = 0;
+        bool is_intact = false;
+    };
+
+    change_result_t run_changes(change_t change, size_t nr_tracks, size_t frames, int sample_rate,
+                                size_t period_frames, int num_periods, double decode_us, double open_us,
+                                size_t predecode_frames) {
+        change_result_t result;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+        struct pollfd pfd{completion_fd, POLLIN, 0};
+
+        const auto track = [&](size_t index) {
+            return i2s_stream::source_t(source_t{frames, period_frames, decode_us, open_us, index});
+        };
+        // the next track is prepared in another thread while the current one plays
+        const auto predecode = [&](size_t index) {
+            return std::async(std::launch::async, [&, index]() { return i2s_predecode(track(index), predecode_frames); });
+        };
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+            std::vector<int16_t> played;
+            std::future<i2s_stream::source_t> next;
+            size_t started = 1, enqueued = 1;
+
+            stream.start(track(0), period_frames, num_periods);
+            if (change == SPLICE)
+                stream.enqueue(track(enqueued++));
+            else if (change == PREDECODE && nr_tracks > 1)
+                next = predecode(enqueued);
+
+            while (true) {
+                poll(&pfd, 1, 100);
+                bool is_ended = stream.refill();
+                started += stream.take_started();
+
+                if (change == PREDECODE && next.valid() &&
+                    next.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    stream.enqueue(next.get());
+                    result.predecoded_size = predecode_frames * I2S_FRAME_SIZE;
+                    ++enqueued;
+                }
+                if (change == PREDECODE && !next.valid() && enqueued < nr_tracks && started == enqueued)
+                    next = predecode(enqueued);
+                if (change == SPLICE && enqueued < nr_tracks && started == enqueued)
+                    stream.enqueue(track(enqueued++));
+
+                if (!is_ended)
+                    continue;
+
+                if (change != RESTART || started == nr_tracks)
+                    break;
+
+                // the next track started once the current one played out
+                result.underruns += stream.stats().underruns;
+                double last_sound_us = sink.last_sound_us();
+                std::vector<int16_t> samples = sink.samples();
+                played.insert(played.end(), samples.begin(), samples.end());
+                sink.clear();
+
+                stream.start(track(started++), period_frames, num_periods);
+                while (sink.first_sound_us() == 0)
+                    poll(&pfd, 1, 1);
+                result.max_gap_ms = std::max(result.max_gap_ms, (sink.first_sound_us() - last_sound_us) / 1e3);
+            }
+            result.underruns += stream.stats().underruns;
+
+            std::vector<int16_t> samples = sink.samples();
+            played.insert(played.end(), samples.begin(), samples.end());
+
+            // the tracks one after the other, and silence after them
+            std::vector<int16_t> expected(nr_tracks * frames * I2S_CHANNELS);
+            for (size_t i = 0; i < expected.size(); ++i)
+                expected[i] = pattern(i);
+
+            size_t gap = 0;
+            for (size_t i = 0, run = 0; i < played.size() && i < expected.size(); ++i) {
+                run = played[i] == 0 ? run + 1 : 0;
+                gap = std::max(gap, run);
+            }
+            result.max_gap_samples = gap / I2S_CHANNELS;
+            if (change != RESTART)
+                result.max_gap_ms = (double)result.max_gap_samples * 1e3 / sample_rate;
+
+            // the silence of the restarts is not in the samples, only the end of the last period of each track
+            if (change == RESTART) {
+                played.erase(std::remove(played.begin(), played.end(), (int16_t)0), played.end());
+                result.is_intact = played == expected;
+            } else {
+                result.is_intact = played.size() >= expected.size() &&
+                                   std::equal(expected.begin(), expected.end(), played.begin()) &&
+                                   std::all_of(played.begin() + (long)expected.size(), played.end(),
+                                               [](int16_t s) { return s == 0; });
+            }
+        }
+
+        axidma_destroy(dev);
+        return result;
+    }
+
+    struct seek_result_t {
+        double max_latency_ms = 0;
+        double mean_latency_ms = 0;
+        double mean_redecode_ms = 0;
+        unsigned long long underruns = 0;
+        bool is_intact = false;
+    };
+
+    seek_result_t run_seeks(size_t nr_seeks, size_t frames, int sample_rate, size_t period_frames, int num_periods,
+                            double decode_us) {
+        struct seek_t {
+            size_t position;
+            // samples the sink played before the seek, and when it was made
+            size_t played;
+            double us;
+        };
+        seek_result_t result;
+        std::vector<seek_t> seeks;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+        struct pollfd pfd{completion_fd, POLLIN, 0};
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+            const auto play_for = [&](double ms) {
+                double until = bench::now_us() + ms * 1e3;
+                while (bench::now_us() < until) {
+                    poll(&pfd, 1, 1);
+                    stream.refill();
+                }
+            };
+
+            stream.start(source_t{frames, period_frames, decode_us}, period_frames, num_periods);
+            for (size_t i = 0; i < nr_seeks; ++i) {
+                play_for(SEEK_INTERVAL_MS);
+
+                // back and forward across the track, not on period boundaries
+                size_t position = frames / 97 * ((i * 61 + 13) % 97) + i * 13;
+                seeks.push_back({position, sink.samples().size(), bench::now_us()});
+                stream.restart(source_t{frames, period_frames, decode_us, 0, 0, position});
+            }
+            play_for(SEEK_INTERVAL_MS);
+            result.underruns = stream.stats().underruns;
+        }
+
+        std::vector<int16_t> played = sink.samples();
+        result.is_intact = true;
+        for (size_t i = 0; i < seeks.size(); ++i) {
+            const seek_t &seek = seeks[i];
+            size_t end = i + 1 < seeks.size() ? seeks[i + 1].played : played.size();
+            size_t first = seek.position * I2S_CHANNELS;
+
+            // the end of the period played at the seek comes before the samples at the position
+            size_t start = seek.played;
+            while (start < end && played[start] != pattern(first))
+                ++start;
+
+            bool is_intact = start < end;
+            for (size_t j = start; j < end && is_intact; ++j)
+                is_intact = played[j] == pattern(first + j - start);
+            result.is_intact = result.is_intact && is_intact;
+
+            double latency_ms = start < end ? (sink.played_us(start) - seek.us) / 1e3 : 0;
+            result.max_latency_ms = std::max(result.max_latency_ms, latency_ms);
+            result.mean_latency_ms += latency_ms / (double)seeks.size();
+            result.mean_redecode_ms += (double)seek.position / (double)period_frames * decode_us / 1e3 /
+                                       (double)seeks.size();
+        }
+
+        axidma_destroy(dev);
+        return result;
+    }
+
+    struct pause_result_t {
+        double max_park_ms = 0;
+        double max_resume_ms = 0;
+        double mean_resume_ms = 0;
+        size_t paused_memory = 0;
+        unsigned long long underruns = 0;
+        bool is_intact = false;
+    };
+
+    pause_result_t run_pauses(size_t nr_pauses, int sample_rate, size_t period_frames, int num_periods,
+                              double decode_us) {
+        struct pause_t {
+            // samples the sink played before pausing and resuming, and when
+            size_t paused;
+            double paused_us;
+            size_t resumed;
+            double resumed_us;
+        };
+        pause_result_t result;
+        std::vector<pause_t> pauses;
+        size_t frames = (nr_pauses + 1) * PAUSE_INTERVAL_MS * (size_t)sample_rate / 1000;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+        struct pollfd pfd{completion_fd, POLLIN, 0};
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+            bool is_ended = false;
+            const auto play_for = [&](double ms) {
+                double until = bench::now_us() + ms * 1e3;
+                while (bench::now_us() < until && !is_ended) {
+                    poll(&pfd, 1, 1);
+                    is_ended = stream.refill();
+                }
+            };
+
+            stream.start(source_t{frames, period_frames, decode_us}, period_frames, num_periods);
+            for (size_t i = 0; i < nr_pauses && !is_ended; ++i) {
+                play_for(PAUSE_INTERVAL_MS);
+
+                pause_t pause{sink.samples().size(), bench::now_us(), 0, 0};
+                if (!stream.pause())
+                    break;
+                play_for(PAUSE_MS);
+                result.paused_memory = stream.memory_size();
+
+                pause.resumed = sink.samples().size();
+                pause.resumed_us = bench::now_us();
+                stream.resume();
+                pauses.push_back(pause);
+            }
+            while (!is_ended)
+                play_for(PAUSE_INTERVAL_MS);
+            result.underruns = stream.stats().underruns;
+        }
+
+        std::vector<int16_t> played = sink.samples();
+        for (const pause_t &pause : pauses) {
+            size_t last = pause.resumed, first = pause.resumed;
+            while (last > 0 && played[last - 1] == 0)
+                --last;
+            while (first < played.size() && played[first] == 0)
+                ++first;
+
+            double park_ms = last > 0 ? (sink.played_us(last - 1) - pause.paused_us) / 1e3 : 0;
+            double resume_ms = first < played.size() ? (sink.played_us(first) - pause.resumed_us) / 1e3 : 0;
+            result.max_park_ms = std::max(result.max_park_ms, park_ms);
+            result.max_resume_ms = std::max(result.max_resume_ms, resume_ms);
+            result.mean_resume_ms += resume_ms / (double)pauses.size();
+        }
+
+        // the track without the silence of the pauses (the pattern has none)
+        played.erase(std::remove(played.begin(), played.end(), (int16_t)0), played.end());
+        result.is_intact = pauses.size() == nr_pauses && played.size() == frames * I2S_CHANNELS;
+        for (size_t i = 0; i < played.size() && result.is_intact; ++i)
+            result.is_intact = played[i] == pattern(i);
+
+        axidma_destroy(dev);
+        return result;
+    }
+
+    struct gain_result_t {
+        double max_latency_ms = 0;
+        double mean_latency_ms = 0;
+        double filled_ahead_ms = 0;
+        unsigned long long underruns = 0;
+        bool is_intact = false;
+    };
+
+    gain_result_t run_gain_changes(size_t nr_changes, int sample_rate, size_t period_frames, int num_periods,
+                                   double decode_us) {
+        struct gain_change_t {
+            // samples the sink played before the change, and when
+            size_t played;
+            double us;
+            float gain;
+        };
+        gain_result_t result;
+        std::vector<gain_change_t> changes;
+        // the last change restores the gain, the track plays on after it
+        size_t frames = (nr_changes + 2) * GAIN_INTERVAL_MS * (size_t)sample_rate / 1000;
+        size_t ramp_frames = (size_t)sample_rate * GAIN_STAGE_RAMP_MS / 1000;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+        struct pollfd pfd{completion_fd, POLLIN, 0};
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+            bool is_ended = false;
+            const auto play_for = [&](double ms) {
+                double until = bench::now_us() + ms * 1e3;
+                while (bench::now_us() < until && !is_ended) {
+                    poll(&pfd, 1, 1);
+                    is_ended = stream.refill();
+                }
+            };
+
+            stream.start(source_t{frames, period_frames, decode_us}, period_frames, num_periods);
+            for (size_t i = 0; i < nr_changes && !is_ended; ++i) {
+                play_for(GAIN_INTERVAL_MS);
+
+                // the last one restores the gain
+                float gain = i % 2 == 0 && i + 1 < nr_changes ? LOWER_GAIN : 1.0f;
+                changes.push_back({sink.samples().size(), bench::now_us(), gain});
+                stream.set_gain(gain, ramp_frames);
+            }
+            while (!is_ended)
+                play_for(GAIN_INTERVAL_MS);
+            result.underruns = stream.stats().underruns;
+        }
+
+        std::vector<int16_t> played = sink.samples();
+        size_t ramp_samples = ramp_frames * I2S_CHANNELS;
+        result.is_intact = changes.size() == nr_changes && played.size() >= frames * I2S_CHANNELS;
+        for (size_t i = 0; i < changes.size() && result.is_intact; ++i) {
+            const gain_change_t &change = changes[i];
+            float from = i > 0 ? changes[i - 1].gain : 1.0f;
+
+            // the first sample off the gain before (by more than the dither), the ramp starts there
+            size_t first = change.played;
+            while (first < played.size() && from != change.gain &&
+                   std::abs(played[first] - pattern(first) * from) <= 2)
+                ++first;
+
+            double latency_ms = first < played.size() ? (sink.played_us(first) - change.us) / 1e3 : 0;
+            result.max_latency_ms = std::max(result.max_latency_ms, latency_ms);
+            result.mean_latency_ms += latency_ms / (double)changes.size();
+            // the ramp has to have started after a period, and to be over a ramp later
+            result.is_intact = first < change.played + (period_frames + 1) * I2S_CHANNELS + ramp_samples;
+        }
+
+        // untouched at unity before the first change and after the last one, in between the two gains
+        size_t untouched = changes.empty() ? played.size() : changes.front().played;
+        size_t restored = changes.empty() ? 0 : changes.back().played + (period_frames + 1) * I2S_CHANNELS +
+                                                2 * ramp_samples;
+        for (size_t i = 0; i < frames * I2S_CHANNELS && result.is_intact; ++i) {
+            float expected = pattern(i);
+
+            if (i < untouched || i >= restored)
+                result.is_intact = played[i] == pattern(i);
+            else
+                result.is_intact = played[i] >= expected * LOWER_GAIN - 2 && played[i] <= expected + 2;
+        }
+        result.filled_ahead_ms = (double)(num_periods - 1) * (double)period_frames * 1e3 / sample_rate;
+
+        axidma_destroy(dev);
+        return result;
+    }
+
+    struct crossfade_result_t {
+        unsigned long long crossfades = 0;
+        unsigned long long shortened = 0;
+        size_t max_gap_frames = 0;
+        unsigned long long underruns = 0;
+        bool is_intact = false;
+    };
+
+    crossfade_result_t run_crossfades(size_t nr_crossfades, int sample_rate, size_t period_frames, int num_periods,
+                                      double decode_us, size_t overlap_frames) {
+        crossfade_result_t result;
+        // each track plays through a crossfade in, the interval and a crossfade out
+        size_t interval_frames = CROSSFADE_INTERVAL_MS * (size_t)sample_rate / 1000;
+        size_t frames = interval_frames * 2 + overlap_frames;
+        double period_us = (double)period_frames * 1e6 / sample_rate;
+        float gain = 1.0f;
+
+        axidma_dev_t dev = axidma_init_dev(0);
+        if (!dev)
+            exit(EXIT_FAILURE);
+        sim_i2s_sink sink(sample_rate);
+        sink.attach(dev, AXIDMA_SIM_TX_CHANNEL);
+        int completion_fd = axidma_get_completion_fd(dev, AXIDMA_SIM_TX_CHANNEL);
+        cma_budget budget(CMA_DEFAULT_SIZE);
+        struct pollfd pfd{completion_fd, POLLIN, 0};
+
+        {
+            i2s_stream stream(dev, AXIDMA_SIM_TX_CHANNEL, budget);
+            bool is_ended = false;
+            const auto play_for = [&](double ms) {
+                double until = bench::now_us() + ms * 1e3;
+                while (bench::now_us() < until && !is_ended) {
+                    poll(&pfd, 1, 1);
+                    is_ended = stream.refill();
+                }
+            };
+
+            stream.start(source_t{frames, period_frames, decode_us}, period_frames, num_periods);
+            for (size_t i = 1; i <= nr_crossfades && !is_ended; ++i) {
+                play_for(CROSSFADE_INTERVAL_MS);
+                while (stream.is_crossfading() && !is_ended)
+                    play_for(1);
+
+                // down to the lower gain and back
+                float ratio = i % 2 == 1 ? LOWER_GAIN : 1.0f / LOWER_GAIN;
+                if (!stream.crossfade(source_t{frames, period_frames, decode_us, 0, i}, overlap_frames, ratio,
+                                      period_us * I2S_CROSSFADE_BUDGET))
+                    break;
+                gain *= ratio;
+            }
+            while (!is_ended)
+                play_for(CROSSFADE_INTERVAL_MS);
+            result.crossfades = stream.stats().crossfades;
+            result.shortened = stream.stats().crossfades_shortened;
+            result.underruns = stream.stats().underruns;
+        }
+
+        // the pattern has no silence, the mix of two has none but for rounding at the ends of a fade
+        std::vector<int16_t> played = sink.samples();
+        while (!played.empty() && played.back() == 0)
+            played.pop_back();
+        for (size_t i = 0, run = 0; i < played.size(); ++i) {
+            run = played[i] == 0 ? run + 1 : 0;
+            result.max_gap_frames = std::max(result.max_gap_frames, run / I2S_CHANNELS);
+        }
+
+        // the end of the last track at its gain, dithered below unity
+        size_t last_end = (result.crossfades + 1) * frames * I2S_CHANNELS, checked = interval_frames * I2S_CHANNELS;
+        result.is_intact = result.crossfades == nr_crossfades && played.size() >= checked;
+        for (size_t i = 1; i <= checked && result.is_intact; ++i) {
+            double expected = pattern(last_end - i) * (double)gain;
+            result.is_intact = std::abs(played[played.size() - i] - expected) <= (gain == 1.0f ? 0 : 2);
+        }
+
+        axidma_destroy(dev);
+        return result;
+    }
+}
+
+int main(int argc, char **argv) {
+    int max_seconds = DEFAULT_MAX_SECONDS;
+    double speed = DEFAULT_SPEED;
+    size_t period_frames = I2S_DEFAULT_PERIOD_FRAMES;
+    int num_periods = I2S_DEFAULT_NUM_PERIODS;
+    double decode_us = DEFAULT_DECODE_US;
+    int sample_rate = DEFAULT_SAMPLE_RATE;
+    int nr_tracks = DEFAULT_TRACKS;
+    int track_ms = DEFAULT_TRACK_MS;
+    double open_ms = DEFAULT_OPEN_MS;
+    int predecode_ms = DEFAULT_PREDECODE_MS;
+    int nr_seeks = DEFAULT_SEEKS;
+    int seek_seconds = DEFAULT_SEEK_SECONDS;
+    int nr_pauses = DEFAULT_PAUSES;
+    int nr_gain_changes = DEFAULT_GAIN_CHANGES;
+    int nr_crossfades = DEFAULT_CROSSFADES;
+    int crossfade_ms = DEFAULT_CROSSFADE_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:x:p:n:w:r:g:t:o:d:k:l:u:v:c:e:h")) != -1) {
+        switch (opt) {
+            case 's':
+                max_seconds = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'x':
+                speed = strtod(optarg, nullptr);
+                break;
+            case 'p':
+                period_frames = strtoul(optarg, nullptr, 0);
+                break;
+            case 'n':
+                num_periods = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'w':
+                decode_us = strtod(optarg, nullptr);
+                break;
+            case 'r':
+                sample_rate = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'g':
+                nr_tracks = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 't':
+                track_ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'o':
+                open_ms = strtod(optarg, nullptr);
+                break;
+            case 'd':
+                predecode_ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'k':
+                nr_seeks = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'l':
+                seek_seconds = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'u':
+                nr_pauses = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'v':
+                nr_gain_changes = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'c':
+                nr_crossfades = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'e':
+                crossfade_ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (max_seconds < 1 || speed <= 0 || period_frames == 0 || num_periods < 2 || decode_us < 0 || sample_rate <= 0 ||
+        nr_tracks < 0 || track_ms <= 0 || open_ms < 0 || predecode_ms < 0 ||
+        nr_seeks < 0 || seek_seconds < 1 || nr_pauses < 0 || nr_gain_changes < 0 ||
+        nr_crossfades < 0 || crossfade_ms <= 0 || crossfade_ms > CROSSFADE_INTERVAL_MS) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench::tight_timer_slack();
+
+    printf("%d Hz, %zu frames x %d periods, decoding a period takes %.0f us, played %.1fx real time\n\n", sample_rate,
+           period_frames, num_periods, decode_us, speed);
+    printf("%7s %13s %14s %13s %15s %13s %9s %7s\n", "seconds", "full_start_ms", "full_memory_kB", "stream_start_ms",
+           "first_sound_ms", "stream_mem_kB", "underruns", "intact");
+
+    bool is_passed = true;
+    for (int seconds = 1; seconds <= max_seconds; seconds *= 2) {
+        size_t frames = (size_t)seconds * (size_t)sample_rate;
+        result_t result = run(frames, sample_rate, speed, period_frames, num_periods, decode_us);
+
+        printf("%7d %13.1f %14zu %15.2f %15.2f %13zu %9llu %7s\n", seconds, result.full_start_ms,
+               frames * I2S_FRAME_SIZE / 1024, result.stream_start_ms, result.first_sound_ms,
+               result.stream_memory / 1024, result.underruns,
+               result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+        is_passed = is_passed && (result.is_intact || result.underruns > 0);
+    }
+
+    if (nr_tracks > 0) {
+        size_t frames = (size_t)track_ms * (size_t)sample_rate / 1000;
+        size_t predecode_frames = (size_t)predecode_ms * (size_t)sample_rate / 1000;
+
+        printf("\n%d tracks of %d ms played one after the other at real time, opening a track takes %.0f ms, "
+               "%d ms predecoded\n\n", nr_tracks, track_ms, open_ms, predecode_ms);
+        printf("%9s %11s %15s %9s %16s %7s\n", "change", "max_gap_ms", "max_gap_frames", "underruns",
+               "predecoded_kB", "intact");
+        for (change_t change : {RESTART, SPLICE, PREDECODE}) {
+            change_result_t result = run_changes(change, (size_t)nr_tracks, frames, sample_rate, period_frames,
+                                                 num_periods, decode_us, open_ms * 1e3, predecode_frames);
+
+            printf("%9s %11.2f %15zu %9llu %16zu %7s\n", change_names[change], result.max_gap_ms,
+                   result.max_gap_samples, result.underruns, result.predecoded_size / 1024,
+                   result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+            is_passed = is_passed && (result.is_intact || result.underruns > 0);
+        }
+    }
+
+    if (nr_seeks > 0) {
+        size_t frames = (size_t)seek_seconds * (size_t)sample_rate;
+        double bound_ms = (double)period_frames * 1e3 / sample_rate;
+        seek_result_t result = run_seeks((size_t)nr_seeks, frames, sample_rate, period_frames, num_periods,
+                                         decode_us);
+
+        printf("\n%d seeks in a track of %d s played at real time, %d ms apart\n\n", nr_seeks, seek_seconds,
+               SEEK_INTERVAL_MS);
+        printf("%15s %16s %9s %17s %9s %7s\n", "max_latency_ms", "mean_latency_ms", "bound_ms", "mean_redecode_ms",
+               "underruns", "intact");
+        printf("%15.2f %16.2f %9.2f %17.1f %9llu %7s\n", result.max_latency_ms, result.mean_latency_ms, bound_ms,
+               result.mean_redecode_ms, result.underruns, result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+        is_passed = is_passed && (result.is_intact || result.underruns > 0) && result.max_latency_ms <= bound_ms;
+    }
+
+    if (nr_pauses > 0) {
+        double bound_ms = (double)period_frames * 1e3 / sample_rate;
+        pause_result_t result = run_pauses((size_t)nr_pauses, sample_rate, period_frames, num_periods, decode_us);
+
+        printf("\n%d pauses of %d ms, %d ms apart, at real time\n\n", nr_pauses, PAUSE_MS, PAUSE_INTERVAL_MS);
+        printf("%12s %14s %15s %9s %16s %9s %7s\n", "max_park_ms", "max_resume_ms", "mean_resume_ms", "bound_ms",
+               "paused_mem_kB", "underruns", "intact");
+        printf("%12.2f %14.2f %15.2f %9.2f %16zu %9llu %7s\n", result.max_park_ms, result.max_resume_ms,
+               result.mean_resume_ms, bound_ms, result.paused_memory / 1024, result.underruns,
+               result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+        is_passed = is_passed && (result.is_intact || result.underruns > 0) && result.max_park_ms <= bound_ms &&
+                    result.max_resume_ms <= bound_ms;
+    }
+
+    if (nr_gain_changes > 0) {
+        double bound_ms = (double)period_frames * 1e3 / sample_rate;
+        gain_result_t result = run_gain_changes((size_t)nr_gain_changes, sample_rate, period_frames, num_periods,
+                                                decode_us);
+
+        printf("\n%d volume changes, %d ms apart, ramped over %d ms (%s gain stage)\n\n", nr_gain_changes,
+               GAIN_INTERVAL_MS, GAIN_STAGE_RAMP_MS, gain_stage::kernel_name());
+        printf("%15s %16s %9s %16s %9s %7s\n", "max_latency_ms", "mean_latency_ms", "bound_ms", "filled_ahead_ms",
+               "underruns", "intact");
+        printf("%15.2f %16.2f %9.2f %16.2f %9llu %7s\n", result.max_latency_ms, result.mean_latency_ms, bound_ms,
+               result.filled_ahead_ms, result.underruns,
+               result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+        is_passed = is_passed && (result.is_intact || result.underruns > 0) && result.max_latency_ms <= bound_ms;
+    }
+
+    if (nr_crossfades > 0) {
+        auto overlap_frames = (size_t)crossfade_ms * (size_t)sample_rate / 1000;
+        double period_us = (double)period_frames * 1e6 / sample_rate;
+
+        printf("\n%d crossfades over %d ms, %d ms apart, at real time, budget of a period %.0f us (%s mixer)\n\n",
+               nr_crossfades, crossfade_ms, CROSSFADE_INTERVAL_MS, period_us * I2S_CROSSFADE_BUDGET,
+               crossfade_mixer::kernel_name());
+        printf("%16s %11s %10s %15s %9s %7s\n", "decode_us/period", "crossfades", "shortened", "max_gap_frames",
+               "underruns", "intact");
+        for (double decode : {decode_us, period_us * CROSSFADE_SLOW_DECODE}) {
+            crossfade_result_t result = run_crossfades((size_t)nr_crossfades, sample_rate, period_frames, num_periods,
+                                                       decode, overlap_frames);
+            // the slow decoders exceed the budget, each of the crossfades is ended early
+            bool is_slow = 2 * decode > period_us * I2S_CROSSFADE_BUDGET;
+
+            printf("%16.0f %11llu %10llu %15zu %9llu %7s\n", decode, result.crossfades, result.shortened,
+                   result.max_gap_frames, result.underruns,
+                   result.underruns > 0 ? "-" : result.is_intact ? "yes" : "NO");
+            is_passed = is_passed && (result.is_intact || result.underruns > 0) && result.max_gap_frames <= 1 &&
+                        (!is_slow || result.shortened == result.crossfades);
+        }
+    }
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
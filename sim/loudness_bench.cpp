@@ -0,0 +1,238 @@
+// Benchmark of the loudness meter: the frames per second it measures against a plain loop in double precision, as the
+// tracks of 4 minutes at 48 kHz it measures per minute (the decoding of the analyser comes on top of it).
+//
+// The results are checked against the test signals of EBU Tech 3341 that are sine waves (the integrated loudness of
+// each is -23 or -33 LUFS, within 0.1 LU), sines of known true peak between their samples (within 0.3 dB), and against
+// the plain loop on noise of varying level (within 0.01 LU and 0.05 dB).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+#include "loudness.h"
+#include "bench_util.h"
+
+#define DEFAULT_SECONDS 60
+#define DEFAULT_MS 500
+#define SAMPLE_RATE 48000
+// the length of a track in the tracks per minute
+#define TRACK_SECONDS 240
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s seconds] [-t ms]\n", name);
+    }
+
+    // a stereo sine of the peak level, in parts of seconds long
+    std::vector<int16_t> sine(int rate, double frequency, const std::vector<std::pair<double, double>> &parts,
+                              double phase = 0) {
+        std::vector<int16_t> samples;
+
+        for (const auto &[level_db, seconds] : parts) {
+            double amplitude = std::pow(10.0, level_db / 20) * 32768;
+            auto frames = (size_t)std::lrint(seconds * rate);
+
+            for (size_t i = 0; i < frames; ++i) {
+                double value = amplitude * std::sin(2 * PI * frequency * (double)(samples.size() / 2) / rate + phase);
+                auto sample = (int16_t)std::lrint(std::clamp(value, -32768.0, 32767.0));
+                samples.push_back(sample);
+                samples.push_back(sample);
+            }
+        }
+
+        return samples;
+    }
+
+    // white noise, its level changing every second (as the passages of a track)
+    std::vector<int16_t> noise(int rate, int seconds) {
+        std::vector<int16_t> samples((size_t)rate * (size_t)seconds * 2);
+        uint32_t seed = 1;
+
+        for (size_t i = 0; i < samples.size(); ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            double level = std::pow(10.0, -(double)(i / 2 / (size_t)rate % 7) * 6 / 20);
+            samples[i] = (int16_t)((int32_t)(seed >> 16) - 32768) * level / 2;
+        }
+
+        return samples;
+    }
+
+    struct biquad_t {
+        double b0, b1, b2, a1, a2;
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+
+        double operator()(double x) {
+            double y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            return y;
+        }
+    };
+
+    // the plain loop: BS.1770 in double precision, direct form I, the peak of the same windowed sinc
+    loudness_meter::result_t plain(const std::vector<int16_t> &samples, int rate) {
+        double k = std::tan(PI * 1681.974450955533 / rate), q = 0.7071752369554196;
+        double vh = std::pow(10.0, 3.999843853973347 / 20), vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1 + k / q + k * k;
+        biquad_t shelf{(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                       2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+        k = std::tan(PI * 38.13547087602444 / rate);
+        q = 0.5003270373238773;
+        a0 = 1 + k / q + k * k;
+        biquad_t high_pass{1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+        biquad_t filters[2][2] = {{shelf, high_pass}, {shelf, high_pass}};
+
+        const int taps = LOUDNESS_PEAK_TAPS * 4;
+        std::vector<double> sinc(taps);
+        for (int n = 0; n < taps; ++n) {
+            double t = (n - (taps - 1) / 2.0) / 4;
+            sinc[n] = (t == 0 ? 1 : std::sin(PI * t) / (PI * t)) * (0.5 - 0.5 * std::cos(2 * PI * (n + 0.5) / taps));
+        }
+        for (int phase = 0; phase < 4; ++phase) {
+            double sum = 0;
+            for (int n = phase; n < taps; n += 4)
+                sum += sinc[n];
+            for (int n = phase; n < taps; n += 4)
+                sinc[n] /= sum;
+        }
+
+        size_t frames = samples.size() / 2, step = (size_t)rate / 10;
+        std::vector<double> steps, blocks;
+        double energy = 0, peak = 0;
+        for (size_t i = 0; i < frames; ++i) {
+            for (size_t channel = 0; channel < 2; ++channel) {
+                double y = filters[channel][1](filters[channel][0](samples[i * 2 + channel] / 32768.0));
+                energy += y * y;
+
+                for (int phase = 0; phase < 4; ++phase) {
+                    double sum = 0;
+                    for (int tap = 0; tap < LOUDNESS_PEAK_TAPS && (size_t)tap <= i; ++tap)
+                        sum += sinc[tap * 4 + phase] * samples[(i - tap) * 2 + channel] / 32768.0;
+                    peak = std::max(peak, std::fabs(sum));
+                }
+            }
+            if ((i + 1) % step == 0) {
+                steps.push_back(energy);
+                energy = 0;
+                if (steps.size() >= 4)
+                    blocks.push_back((steps[steps.size() - 4] + steps[steps.size() - 3] + steps[steps.size() - 2] +
+                                      steps.back()) / (double)(step * 4));
+            }
+        }
+
+        const auto gated_mean = [&blocks](double gate) {
+            double sum = 0;
+            size_t count = 0;
+            for (double block : blocks) {
+                if (block > gate) {
+                    sum += block;
+                    ++count;
+                }
+            }
+            return count > 0 ? sum / (double)count : 0;
+        };
+        double absolute = std::pow(10.0, (-70 + 0.691) / 10);
+        double relative = std::max(absolute, gated_mean(absolute) / 10);
+        double mean = gated_mean(relative);
+
+        return {mean > 0 ? (float)(-0.691 + 10 * std::log10(mean)) : -INFINITY, (float)(20 * std::log10(peak))};
+    }
+
+    loudness_meter::result_t measure(const std::vector<int16_t> &samples, int rate) {
+        loudness_meter meter(rate);
+
+        meter.add(samples.data(), samples.size() / 2);
+        return meter.result();
+    }
+
+}
+
+int main(int argc, char **argv) {
+    int seconds = DEFAULT_SECONDS;
+    int ms = DEFAULT_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:h")) != -1) {
+        switch (opt) {
+            case 's':
+                seconds = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 't':
+                ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (seconds <= 0 || ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool is_passed = true;
+    printf("%s loudness meter\n\n", loudness_meter::kernel_name());
+
+    // EBU Tech 3341 cases 1 to 5, and true peaks between the samples
+    struct case_t {
+        const char *name;
+        int rate;
+        std::vector<int16_t> samples;
+        float integrated;
+        float true_peak;
+    };
+    const case_t cases[] = {
+            {"3341-1 sine -23 dBFS", SAMPLE_RATE, sine(SAMPLE_RATE, 1000, {{-23, 20}}), -23, -23},
+            {"3341-1 at 44.1 kHz", 44100, sine(44100, 1000, {{-23, 20}}), -23, -23},
+            {"3341-2 sine -33 dBFS", SAMPLE_RATE, sine(SAMPLE_RATE, 1000, {{-33, 20}}), -33, -33},
+            {"3341-3 -36 -23 -36", SAMPLE_RATE, sine(SAMPLE_RATE, 1000, {{-36, 10}, {-23, 60}, {-36, 10}}), -23, -23},
+            {"3341-4 -72 .. -23 .. -72", SAMPLE_RATE,
+             sine(SAMPLE_RATE, 1000, {{-72, 10}, {-36, 10}, {-23, 60}, {-36, 10}, {-72, 10}}), -23, -23},
+            {"3341-5 -26 -20 -26", SAMPLE_RATE, sine(SAMPLE_RATE, 1000, {{-26, 20}, {-20, 20.1}, {-26, 20}}), -23, -20},
+            // samples at 45 degrees of a quarter of the rate, 3 dB below the peaks between them
+            {"12 kHz, 45 deg -6 dBTP", SAMPLE_RATE, sine(SAMPLE_RATE, 12000, {{-6, 5}}, PI / 4), NAN, -6},
+            {"silence", SAMPLE_RATE, std::vector<int16_t>(SAMPLE_RATE * 2 * 5), -INFINITY, -INFINITY},
+    };
+    printf("%26s %10s %10s %10s %10s %7s\n", "signal", "LUFS", "expected", "dBTP", "expected", "passed");
+    for (const case_t &c : cases) {
+        loudness_meter::result_t result = measure(c.samples, c.rate);
+        const auto near = [](float value, float expected, float tolerance) {
+            return std::isnan(expected) || (std::isinf(expected) ? value == expected
+                                                                : std::fabs(value - expected) <= tolerance);
+        };
+        bool is_case_passed = near(result.integrated, c.integrated, 0.1f) && near(result.true_peak, c.true_peak, 0.3f);
+
+        printf("%26s %10.2f %10.2f %10.2f %10.2f %7s\n", c.name, result.integrated, c.integrated, result.true_peak,
+               c.true_peak, is_case_passed ? "yes" : "NO");
+        is_passed = is_passed && is_case_passed;
+    }
+
+    // against the plain loop, and the rates
+    std::vector<int16_t> samples = noise(SAMPLE_RATE, seconds);
+    size_t frames = samples.size() / 2;
+    loudness_meter::result_t result = measure(samples, SAMPLE_RATE), expected = plain(samples, SAMPLE_RATE);
+    double meter_rate = bench::rate([&]() { measure(samples, SAMPLE_RATE); }, frames, ms);
+    double plain_rate = bench::rate([&]() { plain(samples, SAMPLE_RATE); }, frames, ms);
+    bool is_noise_passed = std::fabs(result.integrated - expected.integrated) <= 0.01f &&
+                           std::fabs(result.true_peak - expected.true_peak) <= 0.05f;
+
+    printf("\n%d s of noise at %d Hz for %d ms\n\n", seconds, SAMPLE_RATE, ms);
+    printf("%10s %10s %10s %10s %12s %12s %8s %12s %12s %7s\n", "LUFS", "plain", "dBTP", "plain", "Mframes/s",
+           "plain_Mf/s", "speedup", "x_realtime", "tracks/min", "passed");
+    printf("%10.3f %10.3f %10.3f %10.3f %12.2f %12.2f %8.1f %12.0f %12.0f %7s\n", result.integrated,
+           expected.integrated, result.true_peak, expected.true_peak, meter_rate / 1e6, plain_rate / 1e6,
+           meter_rate / plain_rate, meter_rate / SAMPLE_RATE, meter_rate / (TRACK_SECONDS * SAMPLE_RATE) * 60,
+           is_noise_passed ? "yes" : "NO");
+    is_passed = is_passed && is_noise_passed;
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,230 @@
+#ifndef AES_MUSIC_PLAYER_SIM_NEON_ARM_NEON_H
+#define AES_MUSIC_PLAYER_SIM_NEON_ARM_NEON_H
+
+// The NEON intrinsics the kernels of the app use, emulated on the host lane by lane, so their NEON paths are built and
+// checked by the benches without the board (make <bench> NEON_SIM=1, see sim.mk). The vector types are distinct per
+// element type as the ones of the compiler, a vector of one type is not taken for another. The semantics are the ones
+// of the ARMv7 instructions: the conversions to integers round toward zero and saturate, the narrowing ones saturate
+// or truncate as their names say, the multiply-accumulates are not fused and the reciprocal estimate is accurate to 8
+// bits only (the kernels refine it). What it does not emulate: the flush of denormals to zero, and the timing.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+typedef int16_t int16x4_t __attribute__((vector_size(8)));
+typedef int16_t int16x8_t __attribute__((vector_size(16)));
+typedef int32_t int32x4_t __attribute__((vector_size(16)));
+typedef uint8_t uint8x16_t __attribute__((vector_size(16)));
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+typedef float float32x2_t __attribute__((vector_size(8)));
+typedef float float32x4_t __attribute__((vector_size(16)));
+
+typedef struct int16x8x2_t { int16x8_t val[2]; } int16x8x2_t;
+typedef struct uint8x16x2_t { uint8x16_t val[2]; } uint8x16x2_t;
+typedef struct uint8x16x3_t { uint8x16_t val[3]; } uint8x16x3_t;
+typedef struct float32x4x2_t { float32x4_t val[2]; } float32x4x2_t;
+
+namespace neon_sim {
+    template<typename V, typename T>
+    inline V load(const T *src) {
+        V v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+    }
+
+    template<typename T, typename V>
+    inline void store(T *dst, V v) {
+        memcpy(dst, &v, sizeof(v));
+    }
+
+    // FRECPE: 1 / value with the 8 upper bits of the significand, infinity of the sign of a zero
+    inline float reciprocal_estimate(float value) {
+        if (value == 0)
+            return std::copysign(std::numeric_limits<float>::infinity(), value);
+        if (std::isinf(value))
+            return std::copysign(0.0f, value);
+
+        int exponent;
+        float significand = std::frexp(1.0f / value, &exponent);
+        return std::ldexp(std::trunc(significand * 256.0f) / 256.0f, exponent);
+    }
+
+    // VCVT.S32.F32: toward zero, saturating, NaN to 0
+    inline int32_t to_s32(float value) {
+        if (std::isnan(value))
+            return 0;
+        if (value >= 2147483648.0f)
+            return INT32_MAX;
+        if (value < -2147483648.0f)
+            return INT32_MIN;
+        return (int32_t)value;
+    }
+}
+
+// loads and stores
+inline float32x2_t vld1_f32(const float *src) { return neon_sim::load<float32x2_t>(src); }
+inline float32x4_t vld1q_f32(const float *src) { return neon_sim::load<float32x4_t>(src); }
+inline int16x8_t vld1q_s16(const int16_t *src) { return neon_sim::load<int16x8_t>(src); }
+inline int32x4_t vld1q_s32(const int32_t *src) { return neon_sim::load<int32x4_t>(src); }
+inline uint32x4_t vld1q_u32(const uint32_t *src) { return neon_sim::load<uint32x4_t>(src); }
+inline uint8x16_t vld1q_u8(const uint8_t *src) { return neon_sim::load<uint8x16_t>(src); }
+inline void vst1_f32(float *dst, float32x2_t v) { neon_sim::store(dst, v); }
+inline void vst1q_f32(float *dst, float32x4_t v) { neon_sim::store(dst, v); }
+inline void vst1q_s16(int16_t *dst, int16x8_t v) { neon_sim::store(dst, v); }
+inline void vst1q_u32(uint32_t *dst, uint32x4_t v) { neon_sim::store(dst, v); }
+inline void vst1q_u8(uint8_t *dst, uint8x16_t v) { neon_sim::store(dst, v); }
+
+// the lanes of the vectors from elements of 3 interleaved ones
+inline uint8x16x3_t vld3q_u8(const uint8_t *src) {
+    uint8x16x3_t v;
+
+    for (int i = 0; i < 16; ++i) {
+        for (int k = 0; k < 3; ++k)
+            v.val[k][i] = src[i * 3 + k];
+    }
+    return v;
+}
+
+inline void vst2q_s16(int16_t *dst, int16x8x2_t v) {
+    for (int i = 0; i < 8; ++i) {
+        dst[i * 2] = v.val[0][i];
+        dst[i * 2 + 1] = v.val[1][i];
+    }
+}
+
+// lanes
+inline float32x2_t vdup_n_f32(float value) { return float32x2_t{value, value}; }
+inline float32x4_t vdupq_n_f32(float value) { return float32x4_t{value, value, value, value}; }
+inline uint32x4_t vdupq_n_u32(uint32_t value) { return uint32x4_t{value, value, value, value}; }
+inline uint8x16_t vdupq_n_u8(uint8_t value) { return uint8x16_t{} + value; }
+
+inline float32x4_t vcombine_f32(float32x2_t low, float32x2_t high) {
+    return float32x4_t{low[0], low[1], high[0], high[1]};
+}
+
+inline int16x8_t vcombine_s16(int16x4_t low, int16x4_t high) {
+    return int16x8_t{low[0], low[1], low[2], low[3], high[0], high[1], high[2], high[3]};
+}
+
+inline float32x2_t vget_low_f32(float32x4_t v) { return float32x2_t{v[0], v[1]}; }
+inline float32x2_t vget_high_f32(float32x4_t v) { return float32x2_t{v[2], v[3]}; }
+inline int16x4_t vget_low_s16(int16x8_t v) { return int16x4_t{v[0], v[1], v[2], v[3]}; }
+inline int16x4_t vget_high_s16(int16x8_t v) { return int16x4_t{v[4], v[5], v[6], v[7]}; }
+inline float vget_lane_f32(float32x2_t v, int lane) { return v[lane]; }
+
+inline uint8x16x2_t vzipq_u8(uint8x16_t a, uint8x16_t b) {
+    uint8x16x2_t v;
+
+    for (int i = 0; i < 16; ++i) {
+        v.val[i / 8][i % 8 * 2] = a[i];
+        v.val[i / 8][i % 8 * 2 + 1] = b[i];
+    }
+    return v;
+}
+
+inline float32x4x2_t vzipq_f32(float32x4_t a, float32x4_t b) {
+    return float32x4x2_t{{float32x4_t{a[0], b[0], a[1], b[1]}, float32x4_t{a[2], b[2], a[3], b[3]}}};
+}
+
+// bit casts
+inline float32x4_t vreinterpretq_f32_u32(uint32x4_t v) { return (float32x4_t)v; }
+inline uint32x4_t vreinterpretq_u32_f32(float32x4_t v) { return (uint32x4_t)v; }
+inline int16x8_t vreinterpretq_s16_u8(uint8x16_t v) { return (int16x8_t)v; }
+
+// arithmetic, the products rounded before they are accumulated
+inline float32x2_t vadd_f32(float32x2_t a, float32x2_t b) { return a + b; }
+inline float32x4_t vaddq_f32(float32x4_t a, float32x4_t b) { return a + b; }
+inline float32x4_t vsubq_f32(float32x4_t a, float32x4_t b) { return a - b; }
+inline float32x4_t vmulq_f32(float32x4_t a, float32x4_t b) { return a * b; }
+inline float32x4_t vmulq_n_f32(float32x4_t a, float b) { return a * b; }
+
+inline float32x4_t vmlaq_f32(float32x4_t a, float32x4_t b, float32x4_t c) {
+    float32x4_t product = b * c;
+    return a + product;
+}
+
+inline float32x4_t vmlsq_f32(float32x4_t a, float32x4_t b, float32x4_t c) {
+    float32x4_t product = b * c;
+    return a - product;
+}
+
+inline float32x4_t vmlaq_n_f32(float32x4_t a, float32x4_t b, float c) { return vmlaq_f32(a, b, vdupq_n_f32(c)); }
+inline float32x4_t vmlsq_n_f32(float32x4_t a, float32x4_t b, float c) { return vmlsq_f32(a, b, vdupq_n_f32(c)); }
+
+inline float32x4_t vabsq_f32(float32x4_t v) {
+    return (float32x4_t)((uint32x4_t)v & 0x7FFFFFFFu);
+}
+
+inline float32x4_t vmaxq_f32(float32x4_t a, float32x4_t b) {
+    float32x4_t v;
+
+    for (int i = 0; i < 4; ++i)
+        v[i] = std::isnan(a[i]) || std::isnan(b[i]) ? std::numeric_limits<float>::quiet_NaN() : std::max(a[i], b[i]);
+    return v;
+}
+
+inline float32x2_t vpadd_f32(float32x2_t a, float32x2_t b) { return float32x2_t{a[0] + a[1], b[0] + b[1]}; }
+
+inline float32x2_t vpmax_f32(float32x2_t a, float32x2_t b) {
+    return float32x2_t{std::max(a[0], a[1]), std::max(b[0], b[1])};
+}
+
+inline float32x4_t vrecpeq_f32(float32x4_t v) {
+    float32x4_t estimate;
+
+    for (int i = 0; i < 4; ++i)
+        estimate[i] = neon_sim::reciprocal_estimate(v[i]);
+    return estimate;
+}
+
+// the step of Newton-Raphson: 2 - a * b (2 for a zero times an infinity)
+inline float32x4_t vrecpsq_f32(float32x4_t a, float32x4_t b) {
+    float32x4_t step;
+
+    for (int i = 0; i < 4; ++i) {
+        bool is_special = (a[i] == 0 && std::isinf(b[i])) || (std::isinf(a[i]) && b[i] == 0);
+        float product = a[i] * b[i];
+        step[i] = is_special ? 2.0f : 2.0f - product;
+    }
+    return step;
+}
+
+// comparisons and bits
+inline uint32x4_t vcgtq_f32(float32x4_t a, float32x4_t b) { return (uint32x4_t)(a > b); }
+
+inline float32x4_t vbslq_f32(uint32x4_t mask, float32x4_t a, float32x4_t b) {
+    return (float32x4_t)((mask & (uint32x4_t)a) | (~mask & (uint32x4_t)b));
+}
+
+inline uint32x4_t vandq_u32(uint32x4_t a, uint32x4_t b) { return a & b; }
+inline uint32x4_t vorrq_u32(uint32x4_t a, uint32x4_t b) { return a | b; }
+inline uint32x4_t veorq_u32(uint32x4_t a, uint32x4_t b) { return a ^ b; }
+inline uint32x4_t vshlq_n_u32(uint32x4_t v, int n) { return v << n; }
+inline uint32x4_t vshrq_n_u32(uint32x4_t v, int n) { return v >> n; }
+
+// conversions
+inline float32x4_t vcvtq_f32_s32(int32x4_t v) { return float32x4_t{(float)v[0], (float)v[1], (float)v[2], (float)v[3]}; }
+inline float32x4_t vcvtq_f32_u32(uint32x4_t v) { return float32x4_t{(float)v[0], (float)v[1], (float)v[2], (float)v[3]}; }
+
+inline int32x4_t vcvtq_s32_f32(float32x4_t v) {
+    return int32x4_t{neon_sim::to_s32(v[0]), neon_sim::to_s32(v[1]), neon_sim::to_s32(v[2]), neon_sim::to_s32(v[3])};
+}
+
+inline int32x4_t vmovl_s16(int16x4_t v) { return int32x4_t{v[0], v[1], v[2], v[3]}; }
+
+inline int16x4_t vqmovn_s32(int32x4_t v) {
+    int16x4_t narrow;
+
+    for (int i = 0; i < 4; ++i)
+        narrow[i] = (int16_t)std::min<int32_t>(std::max<int32_t>(v[i], INT16_MIN), INT16_MAX);
+    return narrow;
+}
+
+inline int16x4_t vshrn_n_s32(int32x4_t v, int n) {
+    return int16x4_t{(int16_t)(v[0] >> n), (int16_t)(v[1] >> n), (int16_t)(v[2] >> n), (int16_t)(v[3] >> n)};
+}
+
+#endif //AES_MUSIC_PLAYER_SIM_NEON_ARM_NEON_H
@@ -0,0 +1,228 @@
+// Benchmark of the playback source: a file mapped by playback_source against reading it into a buffer of malloc
+// first (as the UI did), with the page cache of the file dropped before each run.
+//
+// The decoder is modelled by reading the source in place the way the virtual file of libsndfile does: 4 kB at a time
+// into its own buffer, advising the source of the position. For files of increasing size, it reports the time until
+// the header and the first period were read (the playback starts then), the time to read through the whole file, and
+// the peak resident memory of the process at the start and at the end, each run in a child process of its own. The
+// data read is checked against the file.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "playback_source.h"
+#include "bench_util.h"
+
+#define DEFAULT_MIN_SIZE (1024 * 1024)
+#define DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+// a read of the virtual file of libsndfile
+#define READ_SIZE 4096
+// the header and the first period of 1024 stereo frames
+#define START_SIZE (READ_SIZE + 4096)
+
+namespace {
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s min_size] [-S max_size] [-f file] [-w] (-w: keep the file cached)\n", name);
+    }
+
+    uint8_t pattern(size_t offset) {
+        return (uint8_t)((offset * 7919) >> 5);
+    }
+
+    // peak resident memory of the process (VmHWM), kB
+    long peak_rss_kb() {
+        FILE *status = fopen("/proc/self/status", "r");
+        char line[256];
+        long kb = -1;
+
+        if (!status)
+            return -1;
+        while (fgets(line, sizeof(line), status)) {
+            if (strncmp(line, "VmHWM:", 6) == 0)
+                kb = strtol(line + 6, nullptr, 10);
+        }
+        fclose(status);
+
+        return kb;
+    }
+
+    enum method_t {READ, MAP};
+
+    const char *method_names[] = {"read", "mmap"};
+
+    struct result_t {
+        double start_ms;
+        double total_ms;
+        long base_rss_kb;
+        long start_rss_kb;
+        long end_rss_kb;
+        bool is_intact;
+    };
+
+    // the source as the UI creates it
+    playback_source *open_source(method_t method, const std::string &path, size_t size) {
+        if (method == MAP)
+            return new playback_source(path);
+
+        void *buffer = malloc(size);
+        std::ifstream in_file(path, std::ios::in | std::ios::binary);
+        if (!buffer || !in_file.read((char *)buffer, (std::streamsize)size)) {
+            free(buffer);
+            return nullptr;
+        }
+
+        return new playback_source(buffer, size);
+    }
+
+    result_t run(method_t method, const std::string &path, size_t size) {
+        result_t result{};
+        std::vector<uint8_t> decoder(READ_SIZE);
+
+        result.base_rss_kb = peak_rss_kb();
+        double start = bench::now_us();
+
+        playback_source *source = open_source(method, path, size);
+        if (!source)
+            return result;
+
+        const auto *data = (const uint8_t *)source->data();
+        size_t offset = 0;
+        bool is_intact = true;
+
+        for (; offset < source->size(); offset += READ_SIZE) {
+            size_t count = std::min<size_t>(READ_SIZE, source->size() - offset);
+
+            memcpy(decoder.data(), data + offset, count);
+            source->advise(offset + count);
+            for (size_t i = 0; i < count; i += 64)
+                is_intact = is_intact && decoder[i] == pattern(offset + i);
+
+            if (offset + count == std::min<size_t>(START_SIZE, source->size())) {
+                result.start_ms = (bench::now_us() - start) / 1e3;
+                result.start_rss_kb = peak_rss_kb();
+            }
+        }
+        result.total_ms = (bench::now_us() - start) / 1e3;
+        result.end_rss_kb = peak_rss_kb();
+        result.is_intact = is_intact && offset >= size;
+
+        delete source;
+        return result;
+    }
+
+    // runs in a child, so the peak resident memory is of the run only
+    result_t run_child(method_t method, const std::string &path, size_t size, bool is_cached) {
+        result_t result{};
+        int fds[2];
+
+        if (!is_cached) {
+            int fd = open(path.c_str(), O_RDONLY);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+
+        if (pipe(fds) != 0)
+            return result;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            result = run(method, path, size);
+            write(fds[1], &result, sizeof(result));
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(fds[1]);
+        if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result))
+            result = {};
+        close(fds[0]);
+        if (pid > 0)
+            waitpid(pid, nullptr, 0);
+
+        return result;
+    }
+
+    bool create_file(const std::string &path, size_t size) {
+        std::vector<uint8_t> chunk(1024 * 1024);
+        FILE *file = fopen(path.c_str(), "wb");
+
+        if (!file)
+            return false;
+        for (size_t offset = 0; offset < size; offset += chunk.size()) {
+            size_t count = std::min(chunk.size(), size - offset);
+            for (size_t i = 0; i < count; ++i)
+                chunk[i] = pattern(offset + i);
+            fwrite(chunk.data(), 1, count, file);
+        }
+        // written back, so its pages can be dropped from the page cache
+        fflush(file);
+        fsync(fileno(file));
+
+        return fclose(file) == 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t min_size = DEFAULT_MIN_SIZE;
+    size_t max_size = DEFAULT_MAX_SIZE;
+    std::string path = "/tmp/playback_source_bench.raw";
+    bool is_cached = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:S:f:wh")) != -1) {
+        switch (opt) {
+            case 's':
+                min_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'S':
+                max_size = strtoul(optarg, nullptr, 0);
+                break;
+            case 'f':
+                path = optarg;
+                break;
+            case 'w':
+                is_cached = true;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (min_size < START_SIZE || max_size < min_size) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("page cache %s before each run, %d B reads, playback starts after %d B\n\n",
+           is_cached ? "kept" : "dropped", READ_SIZE, START_SIZE);
+    printf("%10s %6s %10s %10s %14s %12s %7s\n", "size", "source", "start_ms", "total_ms", "start_rss_kB",
+           "peak_rss_kB", "intact");
+
+    bool is_passed = true;
+    for (size_t size = min_size; size <= max_size; size *= 4) {
+        if (!create_file(path, size)) {
+            fprintf(stderr, "unable to create %s\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+
+        for (method_t method : {READ, MAP}) {
+            result_t result = run_child(method, path, size, is_cached);
+
+            printf("%10zu %6s %10.2f %10.2f %14ld %12ld %7s\n", size, method_names[method], result.start_ms,
+                   result.total_ms, result.start_rss_kb - result.base_rss_kb, result.end_rss_kb - result.base_rss_kb,
+                   result.is_intact ? "yes" : "NO");
+            is_passed = is_passed && result.is_intact;
+        }
+    }
+
+    unlink(path.c_str());
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+// Benchmark of the resampler: the rates libsndfile reads that the codec does not play (it plays 44.1 and 48 kHz),
+// converted to the rate it resamples them to, at each quality.
+//
+// The input is a stereo sum of tones spread over the passband of the quality, and for downsampling a tone in the
+// stopband (1.5 times the Nyquist rate of the output), which the resampler has to reject. It reports the CPU use of a
+// stream (the time to resample -s seconds of it, of real time) and the memory of the resampler. The output is
+// compared with a reference resampler over the first second: a Kaiser windowed sinc of 512 taps (at the lower rate)
+// evaluated in double precision at every output time. The SNR has to reach the one stated for the quality.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+#include <unistd.h>
+
+#include "resampler.h"
+#include "bench_util.h"
+
+#define DEFAULT_SECONDS 10
+// the rates of the codec
+#define CODEC_RATES {44100, 48000}
+// of the reference, at the lower rate
+#define REFERENCE_HALF_TAPS 256
+#define REFERENCE_BETA 14.0
+#define REFERENCE_PASSBAND 0.97
+#define TONE_AMPLITUDE 0.15
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    // stated in resampler.h
+    const double min_snr_db[resampler::NR_QUALITIES] = {65, 80, 85};
+    // the passband of the qualities, the tones are spread over it
+    const double passbands[resampler::NR_QUALITIES] = {0.70, 0.79, 0.867};
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-s seconds] [-r input_rate] [-q quality] (quality: 0 fast, 1 balanced, 2 best)\n",
+                name);
+    }
+
+    double bessel_i0(double x) {
+        double sum = 1, term = 1;
+
+        for (int k = 1; k < 128 && term > sum * 1e-15; ++k) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // the frequencies (Hz) of the tones of the channel
+    std::vector<double> tones(int input_rate, int output_rate, double passband, int channel) {
+        double nyquist = std::min(input_rate, output_rate) / 2.0;
+        std::vector<double> frequencies;
+
+        for (double position : {0.02, 0.21, 0.43, 0.67, 0.93})
+            frequencies.push_back(nyquist * passband * (position + 0.01 * channel));
+        if (input_rate > output_rate && 1.5 * nyquist < 0.95 * input_rate / 2.0)
+            frequencies.push_back(1.5 * nyquist);
+
+        return frequencies;
+    }
+
+    std::vector<int16_t> generate(int input_rate, int output_rate, double passband, size_t frames) {
+        std::vector<int16_t> samples(frames * I2S_CHANNELS);
+
+        for (int channel = 0; channel < I2S_CHANNELS; ++channel) {
+            std::vector<double> frequencies = tones(input_rate, output_rate, passband, channel);
+
+            for (size_t i = 0; i < frames; ++i) {
+                double sample = 0;
+                for (size_t k = 0; k < frequencies.size(); ++k)
+                    sample += TONE_AMPLITUDE * std::sin(2 * PI * frequencies[k] * (double)i / input_rate + (double)k);
+                samples[i * I2S_CHANNELS + channel] = (int16_t)std::lrint(sample * 32767);
+            }
+        }
+
+        return samples;
+    }
+
+    // the first frames of the input resampled by the reference, not rounded
+    std::vector<double> reference(const std::vector<int16_t> &input, int input_rate, int output_rate, size_t frames) {
+        long divisor = std::gcd(input_rate, output_rate), step = input_rate / divisor, phases = output_rate / divisor;
+        // in input frames, the kernel is stretched for downsampling
+        double scale = std::max(1.0, (double)input_rate / output_rate);
+        double cutoff = 0.5 / scale * REFERENCE_PASSBAND;
+        auto half_width = (long)std::ceil(REFERENCE_HALF_TAPS * scale);
+        auto nr_input = (long)(input.size() / I2S_CHANNELS);
+        std::vector<double> output(frames * I2S_CHANNELS);
+
+        // the weights of the input frames around an output time, by its fraction of an input frame
+        std::vector<std::vector<double>> weights((size_t)phases, std::vector<double>((size_t)(2 * half_width + 1)));
+        for (long phase = 0; phase < phases; ++phase) {
+            for (long offset = -half_width; offset <= half_width; ++offset) {
+                double x = (double)phase / (double)phases - (double)offset;
+                double sinc = x == 0 ? 1 : std::sin(2 * PI * cutoff * x) / (2 * PI * cutoff * x);
+                double edge = x / (double)half_width;
+
+                weights[(size_t)phase][(size_t)(offset + half_width)] =
+                        2 * cutoff * sinc * bessel_i0(REFERENCE_BETA * std::sqrt(std::max(0.0, 1 - edge * edge))) /
+                        bessel_i0(REFERENCE_BETA);
+            }
+        }
+
+        for (size_t j = 0; j < frames; ++j) {
+            long time = (long)j * step / phases, phase = (long)j * step % phases;
+            double sums[I2S_CHANNELS]{};
+
+            for (long i = std::max(0L, time - half_width); i <= std::min(nr_input - 1, time + half_width); ++i) {
+                double weight = weights[(size_t)phase][(size_t)(i - time + half_width)];
+
+                for (int channel = 0; channel < I2S_CHANNELS; ++channel)
+                    sums[channel] += weight * input[(size_t)i * I2S_CHANNELS + channel];
+            }
+            for (int channel = 0; channel < I2S_CHANNELS; ++channel)
+                output[j * I2S_CHANNELS + channel] = sums[channel];
+        }
+
+        return output;
+    }
+
+    struct result_t {
+        double cpu_percent = 0;
+        double snr_db = 0;
+        size_t memory = 0;
+        size_t phases = 0;
+        size_t taps = 0;
+        bool is_length_right = false;
+    };
+
+    result_t run(int input_rate, int output_rate, resampler::quality_t quality, int seconds) {
+        result_t result;
+        size_t frames = (size_t)seconds * (size_t)input_rate;
+        std::vector<int16_t> input = generate(input_rate, output_rate, passbands[quality], frames);
+        size_t expected = (frames * (size_t)output_rate + (size_t)input_rate - 1) / (size_t)input_rate;
+        // room for a period more than expected, to find out if there is any
+        std::vector<int16_t> output((expected + I2S_DEFAULT_PERIOD_FRAMES) * I2S_CHANNELS);
+        size_t position = 0;
+
+        // read a period at a time, as the stream does
+        i2s_stream::source_t source = [&](int16_t *buffer, size_t count) {
+            count = std::min(count, frames - position);
+            std::copy_n(input.begin() + (long)(position * I2S_CHANNELS), count * I2S_CHANNELS, buffer);
+            position += count;
+            return count;
+        };
+        resampler converter(input_rate, output_rate, quality);
+        size_t nr_output = 0;
+
+        double start = bench::now_us();
+        while (true) {
+            size_t count = std::min<size_t>(I2S_DEFAULT_PERIOD_FRAMES, output.size() / I2S_CHANNELS - nr_output);
+            size_t nr_written = converter.process(source, output.data() + nr_output * I2S_CHANNELS, count);
+
+            nr_output += nr_written;
+            if (nr_written < count || count == 0)
+                break;
+        }
+        result.cpu_percent = (bench::now_us() - start) / 1e6 / seconds * 100;
+        result.memory = converter.memory_size();
+        result.phases = converter.phases();
+        result.taps = converter.taps();
+        result.is_length_right = nr_output == expected;
+
+        // over the first second, without the edges the reference is windowed at
+        size_t compared = std::min<size_t>(nr_output, (size_t)output_rate);
+        size_t edge = (size_t)output_rate / 20;
+        std::vector<double> expected_output = reference(input, input_rate, output_rate, compared);
+        double signal = 0, noise = 0;
+        for (size_t i = edge * I2S_CHANNELS; i < compared * I2S_CHANNELS; ++i) {
+            signal += expected_output[i] * expected_output[i];
+            noise += (output[i] - expected_output[i]) * (output[i] - expected_output[i]);
+        }
+        result.snr_db = 10 * std::log10(signal / std::max(noise, 1e-9));
+
+        return result;
+    }
+}
+
+int main(int argc, char **argv) {
+    int seconds = DEFAULT_SECONDS;
+    std::vector<int> input_rates{8000, 11025, 16000, 22050, 32000, 88200, 96000, 176400, 192000};
+    std::vector<resampler::quality_t> qualities{resampler::FAST, resampler::BALANCED, resampler::BEST};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:r:q:h")) != -1) {
+        switch (opt) {
+            case 's':
+                seconds = (int)strtol(optarg, nullptr, 0);
+                break;
+            case 'r':
+                input_rates = {(int)strtol(optarg, nullptr, 0)};
+                break;
+            case 'q':
+                qualities = {(resampler::quality_t)strtol(optarg, nullptr, 0)};
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (seconds < 1 || input_rates[0] <= 0 || qualities[0] < 0 || qualities[0] >= resampler::NR_QUALITIES) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s inner loop, %d s of stereo 16-bit per stream\n\n", resampler::kernel_name(), seconds);
+    printf("%7s %7s %9s %7s %5s %10s %7s %8s %8s %7s\n", "input", "output", "quality", "phases", "taps", "memory_kB",
+           "cpu_%", "snr_dB", "min_dB", "passed");
+
+    bool is_passed = true;
+    for (int input_rate : input_rates) {
+        int output_rate = resampler::output_rate(input_rate, CODEC_RATES);
+
+        for (resampler::quality_t quality : qualities) {
+            result_t result = run(input_rate, output_rate, quality, seconds);
+            bool is_run_passed = result.is_length_right && result.snr_db >= min_snr_db[quality];
+
+            printf("%7d %7d %9s %7zu %5zu %10zu %7.2f %8.1f %8.0f %7s\n", input_rate, output_rate,
+                   resampler::quality_string(quality), result.phases, result.taps, result.memory / 1024,
+                   result.cpu_percent, result.snr_db, min_snr_db[quality], is_run_passed ? "yes" : "NO");
+            is_passed = is_passed && is_run_passed;
+        }
+    }
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
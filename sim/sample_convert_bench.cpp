@@ -0,0 +1,163 @@
+// Benchmark of the sample conversion kernels: each format (16, packed 24 and 32-bit integers, float) and layout (mono,
+// stereo, 5.1, 7.1 and four channels, of which the first two are played) converted to stereo 16-bit.
+//
+// A kernel converts a block of -f frames (in the cache, as the staging buffer of a track is) over and over for -t
+// milliseconds. It reports the input samples and the output frames converted per second, against a plain loop over
+// the samples in double precision, which is also the reference the output is checked against: a sample may differ by
+// one (the rounding of float input and of the downmixes in single precision).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#include "sample_convert.h"
+#include "bench_util.h"
+
+#define DEFAULT_FRAMES 4096
+#define DEFAULT_MS 200
+// float input goes beyond full scale, the kernels saturate it
+#define FLOAT_RANGE 1.2
+
+namespace {
+    const int channel_counts[] = {1, 2, 6, 8, 4};
+
+    void usage(const char *name) {
+        fprintf(stderr, "usage: %s [-f frames] [-t ms]\n", name);
+    }
+
+    // full scale random samples of the format
+    std::vector<uint8_t> generate(sample_convert::format_t format, size_t samples, std::mt19937 &random) {
+        std::vector<uint8_t> data(samples * sample_convert::sample_size(format));
+        std::uniform_int_distribution<int64_t> s32(INT32_MIN, INT32_MAX);
+        std::uniform_real_distribution<float> real(-FLOAT_RANGE, FLOAT_RANGE);
+
+        for (size_t i = 0; i < samples; ++i) {
+            auto value = (int32_t)s32(random);
+
+            switch (format) {
+                case sample_convert::S16:
+                    ((int16_t *)data.data())[i] = (int16_t)(value >> 16);
+                    break;
+                case sample_convert::S24:
+                    for (int byte = 0; byte < 3; ++byte)
+                        data[i * 3 + byte] = (uint8_t)(value >> (8 + 8 * byte));
+                    break;
+                case sample_convert::S32:
+                    ((int32_t *)data.data())[i] = value;
+                    break;
+                default:
+                    ((float *)data.data())[i] = real(random);
+            }
+        }
+
+        return data;
+    }
+
+    // the sample in 16-bit units, integers truncated
+    double value(sample_convert::format_t format, const std::vector<uint8_t> &data, size_t index) {
+        switch (format) {
+            case sample_convert::S16:
+                return ((const int16_t *)data.data())[index];
+            case sample_convert::S24: {
+                int32_t sample = data[index * 3] | data[index * 3 + 1] << 8 | data[index * 3 + 2] << 16;
+                return std::floor((double)((int32_t)((uint32_t)sample << 8) >> 8) / 256);
+            }
+            case sample_convert::S32:
+                return std::floor(((const int32_t *)data.data())[index] / 65536.0);
+            default:
+                return ((const float *)data.data())[index] * 32767.0;
+        }
+    }
+
+    // the plain loop, in the WAVE channel order: FL FR FC LFE BL BR SL SR
+    void reference(int16_t *dst, sample_convert::format_t format, const std::vector<uint8_t> &data, size_t frames,
+                   int channels) {
+        const double k = std::sqrt(0.5);
+
+        for (size_t i = 0; i < frames; ++i) {
+            auto at = [&](int channel) { return value(format, data, i * (size_t)channels + (size_t)channel); };
+            double left, right;
+
+            if (channels == 1) {
+                left = right = at(0);
+            } else if (channels == 6) {
+                left = (at(0) + k * at(2) + k * at(4)) / (1 + 2 * k);
+                right = (at(1) + k * at(2) + k * at(5)) / (1 + 2 * k);
+            } else if (channels == 8) {
+                left = (at(0) + k * at(2) + k * at(4) + k * at(6)) / (1 + 3 * k);
+                right = (at(1) + k * at(2) + k * at(5) + k * at(7)) / (1 + 3 * k);
+            } else {
+                left = at(0);
+                right = at(1);
+            }
+            dst[i * 2] = (int16_t)std::lrint(std::clamp(left, -32768.0, 32767.0));
+            dst[i * 2 + 1] = (int16_t)std::lrint(std::clamp(right, -32768.0, 32767.0));
+        }
+    }
+
+    // frames converted per second by the conversion
+}
+
+int main(int argc, char **argv) {
+    size_t frames = DEFAULT_FRAMES;
+    int ms = DEFAULT_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                frames = strtoul(optarg, nullptr, 0);
+                break;
+            case 't':
+                ms = (int)strtol(optarg, nullptr, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (frames == 0 || ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s kernels, blocks of %zu frames for %d ms\n\n", sample_convert::kernel_name(), frames, ms);
+    printf("%6s %9s %11s %12s %13s %12s %8s %8s %7s\n", "format", "channels", "kernel", "Msamples/s", "Mframes_out/s",
+           "plain_Ms/s", "speedup", "max_err", "passed");
+
+    std::mt19937 random(1);
+    bool is_passed = true;
+    for (int f = 0; f < sample_convert::NR_FORMATS; ++f) {
+        auto format = (sample_convert::format_t)f;
+
+        for (int channels : channel_counts) {
+            const sample_convert::kernel_t *kernel = sample_convert::kernel(format, channels);
+            std::vector<uint8_t> input = generate(format, frames * (size_t)channels, random);
+            std::vector<int16_t> output(frames * 2), expected(frames * 2);
+
+            kernel->convert(output.data(), input.data(), frames, channels);
+            reference(expected.data(), format, input, frames, channels);
+            int max_error = 0;
+            for (size_t i = 0; i < output.size(); ++i)
+                max_error = std::max(max_error, std::abs(output[i] - expected[i]));
+
+            double kernel_rate = bench::rate([&] { kernel->convert(output.data(), input.data(), frames, channels); },
+                                      frames, ms);
+            double plain_rate = bench::rate([&] { reference(expected.data(), format, input, frames, channels); },
+                                     frames, ms);
+            bool is_run_passed = max_error <= 1;
+
+            printf("%6s %9d %11s %12.1f %13.1f %12.1f %8.1f %8d %7s\n", sample_convert::format_string(format),
+                   channels, kernel->name, kernel_rate * channels / 1e6, kernel_rate / 1e6,
+                   plain_rate * channels / 1e6, kernel_rate / plain_rate, max_error, is_run_passed ? "yes" : "NO");
+            is_passed = is_passed && is_run_passed;
+        }
+    }
+
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
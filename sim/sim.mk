@@ -0,0 +1,301 @@
+# sim.mk
+#
+# Co-simulation of the aes driver with the AXI_aes_core RTL, built for the host with Verilator (>= 4.210).
+#
+#   make aes_cosim                        build and run with the default transfer sizes
+#   make aes_cosim COSIM_ARGS="-g 0 4096"  pass options/sizes to the report (see aes_cosim -h)
+#
+# Benchmark of copy-then-submit against vectored DMA submission, on the simulated libaxidma.
+#
+#   make axidma_iov_bench                  build and run
+#   make axidma_iov_bench BENCH_ARGS="-r 200e6"  limit the rate of the simulated DMA (see axidma_iov_bench -h)
+#
+# Benchmark of the queue depth of DMA transfers: throughput and latency of the transactions, on the simulated libaxidma.
+#
+#   make axidma_queue_bench                build and run
+#   make axidma_queue_bench BENCH_ARGS="-w 200 -s 16384"  set the work and size of a transfer (see axidma_queue_bench -h)
+#   make axidma_queue_bench BENCH_ARGS="-l 20 -j 50 -e 0.01 -a"  add latency, jitter, errors and the software AES
+#
+# Stress test of concurrent DMA submitters: data and transaction ids are checked, and the throughput of threads on a
+# shared device and on a device each is reported, on the simulated libaxidma.
+#
+#   make axidma_thread_bench               build and run
+#   make axidma_thread_bench BENCH_ARGS="-t 16 -n 1000"  set the threads and the transfers of each (see axidma_thread_bench -h)
+#
+# Benchmark of the completion modes: round-trip latency of small transfers seen through the callback, the completion
+# eventfd and the polling of the status page, on the simulated libaxidma.
+#
+#   make axidma_latency_bench              build and run
+#   make axidma_latency_bench BENCH_ARGS="-p 50 -S 4096"  set the spinning time and the largest size (see axidma_latency_bench -h)
+#
+# Benchmark of the copy kernels of DMA buffers against libc. Built against the simulated libaxidma by default, where
+# the DMA memory is cached; on the board its memory is uncached, build it against libaxidma with the cross compiler:
+#
+#   make dma_copy_bench                    build and run
+#   make dma_copy_bench HOST_CC=arm-linux-gnueabihf-gcc HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon" \
+#        DMA_COPY_BENCH_LIB=libaxidma.o    build for the board (run outputs/sim/dma_copy_bench there)
+#
+# Benchmark of streaming playback through a ring of DMA periods into a simulated I2S sink, against decoding the whole
+# track first: time to the first sound, memory and underruns. Then the gap between tracks restarted, spliced and
+# spliced after predecoding, the latency of seeks from the seek until the new position is heard, of pausing and
+# resuming, and of volume changes, crossfades within their budget, the played samples are checked.
+#
+#   make i2s_stream_bench                  build and run
+#   make i2s_stream_bench BENCH_ARGS="-w 4000 -n 2"  decoding slower than playing, ping-pong periods (see i2s_stream_bench -h)
+#   make i2s_stream_bench BENCH_ARGS="-o 60 -n 2"    opening a track in the refill underruns the splice without predecode
+#   make i2s_stream_bench BENCH_ARGS="-g 0 -k 32"    seeks only, 32 of them
+#   make i2s_stream_bench BENCH_ARGS="-c 8 -e 400"   8 crossfades of 400 ms
+#
+# Benchmark of the playback source: the file mapped against read into memory first, time until the playback starts,
+# time to read it through and peak resident memory, with the page cache dropped before each run.
+#
+#   make playback_source_bench             build and run
+#   make playback_source_bench BENCH_ARGS="-w -S 268435456"  page cache kept, up to 256 MB (see playback_source_bench -h)
+#
+# Benchmark of the resampler: the rates the codec does not run at resampled to the ones it does, at each quality, CPU
+# use per stream and SNR against a reference resampler. The CPU use that matters is the one of the board:
+#
+#   make resampler_bench                   build and run
+#   make resampler_bench BENCH_ARGS="-r 96000 -q 2"  one rate, best quality (see resampler_bench -h)
+#   make resampler_bench HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon"  build for the board (run
+#                                          outputs/sim/resampler_bench there)
+#
+# Benchmark of the conversion kernels of the sample formats and channel layouts of files to stereo 16-bit, samples per
+# second against a plain loop, the output checked against it:
+#
+#   make sample_convert_bench              build and run
+#   make sample_convert_bench BENCH_ARGS="-f 512 -t 1000"  the block size of a track, longer runs (see sample_convert_bench -h)
+#   make sample_convert_bench HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon"  build for the board (run
+#                                          outputs/sim/sample_convert_bench there)
+#
+# Benchmark of the gain stage of the stream: samples per second at unity, attenuating, soft clipping and ramping against
+# a plain loop, the dither, the ramp and the clipping checked:
+#
+#   make gain_stage_bench                  build and run
+#   make gain_stage_bench HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon"  build for the board (run
+#                                          outputs/sim/gain_stage_bench there)
+#
+# Benchmark of the loudness meter of the background analyser: frames per second and tracks per minute against a plain
+# loop, the integrated loudness and the true peak checked against the sine signals of EBU Tech 3341 and the plain loop:
+#
+#   make loudness_bench                    build and run
+#   make loudness_bench BENCH_ARGS="-s 240 -t 2000"  a track of 4 minutes, longer runs (see loudness_bench -h)
+#   make loudness_bench HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon"  build for the board (run
+#                                          outputs/sim/loudness_bench there)
+#
+# Benchmark of the crossfade mixer of the stream: frames per second against a plain loop, the CPU use of a period
+# against the budget of its fill during a crossfade, the curves checked against the exact ones:
+#
+#   make crossfade_mixer_bench             build and run
+#   make crossfade_mixer_bench BENCH_ARGS="-f 256 -o 500"  short periods and overlap (see crossfade_mixer_bench -h)
+#   make crossfade_mixer_bench HOST_CXX="arm-linux-gnueabihf-g++ -mcpu=cortex-a9 -mfpu=neon"  build for the board (run
+#                                          outputs/sim/crossfade_mixer_bench there)
+#
+# Benchmark of the CMA budget on a small budget of its own: the limits of the clients, the playback slice, a queued
+# reservation timing out, the wake-up of a waiter on release and the peak usage are checked:
+#
+#   make cma_budget_bench                  build and run
+#   make cma_budget_bench BENCH_ARGS="-t 200"  longer timeout of the queued reservation (see cma_budget_bench -h)
+#
+# The NEON kernels of the app (dma_copy, resampler, sample_convert, gain_stage, loudness, crossfade_mixer) can be
+# checked on the host: NEON_SIM=1 builds the benches with the intrinsics emulated lane by lane (sim/neon/arm_neon.h),
+# into outputs/sim_neon. Their results are the ones of the board, their rates are not:
+#
+#   make sample_convert_bench NEON_SIM=1   build and run the NEON kernels
+#
+# Programs linked against libaxidma can run on the simulated DMA by preloading libaxidma_sim.so (make libaxidma_sim),
+# configured with the AXIDMA_SIM_* environment variables (see libaxidma_sim.h):
+#
+#   LD_PRELOAD=libaxidma_sim.so AXIDMA_SIM_RATE=100e6 AXIDMA_SIM_JITTER_US=200 ./program
+
+ifndef SIM_MAKEFILE_
+SIM_MAKEFILE_=included
+
+################################################################################
+# Configuration
+################################################################################
+
+VERILATOR ?= verilator
+HOST_CC ?= gcc
+HOST_CXX ?= g++
+# the warnings of the app build
+SIM_CFLAGS = -O2 -Wall -Wextra
+SIM_CXXFLAGS = -std=c++17 $(SIM_CFLAGS)
+# the NEON paths on the emulated intrinsics, the products are not fused as the ones of NEON
+ifdef NEON_SIM
+SIM_CXXFLAGS += -D__ARM_NEON -I$(ROOT)/sim/neon -ffp-contract=off
+endif
+
+SIM_DIR = $(ROOT)/sim
+# the helpers of the benches
+BENCH_UTIL = $(SIM_DIR)/bench_util.h
+SIM_BUILD_DIR = $(OUTPUT_DIR)/sim$(if $(NEON_SIM),_neon)
+
+AES_RTL_DIR = $(ROOT)/rtl/AXI_aes_core_1_0
+AES_RTL_FILES = $(wildcard $(AES_RTL_DIR)/hdl/*.v) \
+				$(addprefix $(AES_RTL_DIR)/src/,aes_cipher_top.v aes_inv_cipher_top.v aes_key_expand_128.v \
+				aes_sbox.v aes_inv_sbox.v aes_rcon.v)
+AES_RTL_TOP = AXI_aes_core_v1_0
+
+# the driver and what it depends on, compiled for the host
+AES_COSIM_APP_FILES = aes.cpp util.cpp cma_budget.cpp aes_soft.cpp aes_core_backend.cpp aes_core_model.cpp dma_copy.cpp
+AES_COSIM_FILES = $(SIM_DIR)/aes_cosim.cpp $(SIM_DIR)/aes_rtl_sim.cpp \
+				  $(addprefix $(ROOT)/app/,$(AES_COSIM_APP_FILES))
+AES_COSIM_CXXFLAGS = -std=c++17 -I$(SIM_DIR) -I$(ROOT)/app -I$(ROOT)/libaxidma/include
+
+AES_COSIM = $(SIM_BUILD_DIR)/aes_cosim
+
+AXIDMA_IOV_BENCH = $(SIM_BUILD_DIR)/axidma_iov_bench
+AXIDMA_QUEUE_BENCH = $(SIM_BUILD_DIR)/axidma_queue_bench
+AXIDMA_THREAD_BENCH = $(SIM_BUILD_DIR)/axidma_thread_bench
+AXIDMA_LATENCY_BENCH = $(SIM_BUILD_DIR)/axidma_latency_bench
+DMA_COPY_BENCH = $(SIM_BUILD_DIR)/dma_copy_bench
+DMA_COPY_BENCH_LIB ?= libaxidma_sim.o
+I2S_STREAM_BENCH = $(SIM_BUILD_DIR)/i2s_stream_bench
+I2S_STREAM_BENCH_FILES = $(SIM_DIR)/i2s_stream_bench.cpp $(SIM_DIR)/axidma_sim_transforms.cpp \
+						 $(addprefix $(ROOT)/app/,i2s_stream.cpp gain_stage.cpp crossfade_mixer.cpp dma_copy.cpp cma_budget.cpp \
+						 aes_soft.cpp util.cpp)
+PLAYBACK_SOURCE_BENCH = $(SIM_BUILD_DIR)/playback_source_bench
+RESAMPLER_BENCH = $(SIM_BUILD_DIR)/resampler_bench
+SAMPLE_CONVERT_BENCH = $(SIM_BUILD_DIR)/sample_convert_bench
+GAIN_STAGE_BENCH = $(SIM_BUILD_DIR)/gain_stage_bench
+LOUDNESS_BENCH = $(SIM_BUILD_DIR)/loudness_bench
+CROSSFADE_MIXER_BENCH = $(SIM_BUILD_DIR)/crossfade_mixer_bench
+CMA_BUDGET_BENCH = $(SIM_BUILD_DIR)/cma_budget_bench
+AXIDMA_QUEUE_BENCH_FILES = $(SIM_DIR)/axidma_queue_bench.cpp $(SIM_DIR)/axidma_sim_transforms.cpp $(ROOT)/app/aes_soft.cpp
+
+################################################################################
+# Targets
+################################################################################
+
+.PHONY: aes_cosim aes_cosim-clean axidma_iov_bench axidma_queue_bench axidma_thread_bench axidma_latency_bench dma_copy_bench i2s_stream_bench \
+		playback_source_bench resampler_bench sample_convert_bench gain_stage_bench loudness_bench \
+		crossfade_mixer_bench cma_budget_bench
+
+aes_cosim: $(AES_COSIM)
+	$(AES_COSIM) $(COSIM_ARGS)
+
+# libaxidma is C, it is linked as an object as verilator builds the user sources as C++
+$(SIM_BUILD_DIR)/libaxidma.o: $(ROOT)/libaxidma/libaxidma.c
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CC) -c $(SIM_CFLAGS) -Wno-missing-field-initializers -I$(ROOT)/libaxidma/include $< -o $@
+
+# the statistics report is shared by libaxidma and the simulated libaxidma
+$(SIM_BUILD_DIR)/libaxidma_stats.o: $(ROOT)/libaxidma/libaxidma_stats.c $(ROOT)/libaxidma/include/libaxidma.h
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CC) -c $(SIM_CFLAGS) -I$(ROOT)/libaxidma/include $< -o $@
+
+$(AES_COSIM): $(AES_RTL_FILES) $(AES_COSIM_FILES) $(SIM_DIR)/aes_rtl_sim.h $(SIM_BUILD_DIR)/libaxidma.o \
+			  $(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(VERILATOR) --cc --exe --build -j 0 -O2 --top-module $(AES_RTL_TOP) --public-flat-rw \
+		-Wno-fatal -Wno-STMTDLY -Wno-WIDTH -I$(AES_RTL_DIR)/src \
+		--Mdir $(SIM_BUILD_DIR)/obj_dir -MAKEFLAGS "CXX=$(HOST_CXX)" \
+		-CFLAGS "$(AES_COSIM_CXXFLAGS)" -LDFLAGS "$(abspath $(SIM_BUILD_DIR)/libaxidma.o) $(abspath $(SIM_BUILD_DIR)/libaxidma_stats.o) -pthread" \
+		-o $(abspath $@) $(AES_RTL_FILES) $(AES_COSIM_FILES)
+
+axidma_iov_bench: $(AXIDMA_IOV_BENCH)
+	$(AXIDMA_IOV_BENCH) $(BENCH_ARGS)
+
+$(SIM_BUILD_DIR)/libaxidma_sim.o: $(ROOT)/libaxidma/libaxidma_sim.c $(ROOT)/libaxidma/include/libaxidma_sim.h
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CC) -c $(SIM_CFLAGS) -Wno-missing-field-initializers -I$(ROOT)/libaxidma/include $< -o $@
+
+$(AXIDMA_IOV_BENCH): $(SIM_DIR)/axidma_iov_bench.cpp $(BENCH_UTIL) $(SIM_BUILD_DIR)/libaxidma_sim.o \
+			$(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+axidma_queue_bench: $(AXIDMA_QUEUE_BENCH)
+	$(AXIDMA_QUEUE_BENCH) $(BENCH_ARGS)
+
+$(AXIDMA_QUEUE_BENCH): $(AXIDMA_QUEUE_BENCH_FILES) $(SIM_DIR)/axidma_sim_transforms.h $(BENCH_UTIL) $(SIM_BUILD_DIR)/libaxidma_sim.o \
+					   $(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(SIM_DIR) -I$(ROOT)/app -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+axidma_thread_bench: $(AXIDMA_THREAD_BENCH)
+	$(AXIDMA_THREAD_BENCH) $(BENCH_ARGS)
+
+$(AXIDMA_THREAD_BENCH): $(SIM_DIR)/axidma_thread_bench.cpp $(BENCH_UTIL) $(SIM_BUILD_DIR)/libaxidma_sim.o \
+			$(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+axidma_latency_bench: $(AXIDMA_LATENCY_BENCH)
+	$(AXIDMA_LATENCY_BENCH) $(BENCH_ARGS)
+
+$(AXIDMA_LATENCY_BENCH): $(SIM_DIR)/axidma_latency_bench.cpp $(BENCH_UTIL) $(SIM_BUILD_DIR)/libaxidma_sim.o \
+			$(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+dma_copy_bench: $(DMA_COPY_BENCH)
+	$(DMA_COPY_BENCH) $(BENCH_ARGS)
+
+$(DMA_COPY_BENCH): $(SIM_DIR)/dma_copy_bench.cpp $(ROOT)/app/dma_copy.cpp $(ROOT)/app/dma_copy.h $(ROOT)/app/simd.h \
+				   $(BENCH_UTIL) $(SIM_BUILD_DIR)/$(DMA_COPY_BENCH_LIB) $(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+i2s_stream_bench: $(I2S_STREAM_BENCH)
+	$(I2S_STREAM_BENCH) $(BENCH_ARGS)
+
+$(I2S_STREAM_BENCH): $(I2S_STREAM_BENCH_FILES) $(SIM_DIR)/axidma_sim_transforms.h $(ROOT)/app/i2s_stream.h $(ROOT)/app/simd.h \
+					 $(BENCH_UTIL) $(SIM_BUILD_DIR)/libaxidma_sim.o $(SIM_BUILD_DIR)/libaxidma_stats.o
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(SIM_DIR) -I$(ROOT)/app -I$(ROOT)/libaxidma/include $(filter-out %.h,$^) -pthread -o $@
+
+playback_source_bench: $(PLAYBACK_SOURCE_BENCH)
+	$(PLAYBACK_SOURCE_BENCH) $(BENCH_ARGS)
+
+$(PLAYBACK_SOURCE_BENCH): $(SIM_DIR)/playback_source_bench.cpp $(ROOT)/app/playback_source.cpp \
+						  $(ROOT)/app/playback_source.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app $(filter %.cpp,$^) -o $@
+
+resampler_bench: $(RESAMPLER_BENCH)
+	$(RESAMPLER_BENCH) $(BENCH_ARGS)
+
+$(RESAMPLER_BENCH): $(SIM_DIR)/resampler_bench.cpp $(ROOT)/app/resampler.cpp $(ROOT)/app/resampler.h \
+					$(ROOT)/app/i2s_stream.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app -I$(ROOT)/libaxidma/include $(filter %.cpp,$^) -o $@
+
+sample_convert_bench: $(SAMPLE_CONVERT_BENCH)
+	$(SAMPLE_CONVERT_BENCH) $(BENCH_ARGS)
+
+$(SAMPLE_CONVERT_BENCH): $(SIM_DIR)/sample_convert_bench.cpp $(ROOT)/app/sample_convert.cpp $(ROOT)/app/sample_convert.h \
+						 $(ROOT)/app/simd.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app $(filter %.cpp,$^) -o $@
+
+gain_stage_bench: $(GAIN_STAGE_BENCH)
+	$(GAIN_STAGE_BENCH) $(BENCH_ARGS)
+
+$(GAIN_STAGE_BENCH): $(SIM_DIR)/gain_stage_bench.cpp $(ROOT)/app/gain_stage.cpp $(ROOT)/app/gain_stage.h \
+					 $(ROOT)/app/simd.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app $(filter %.cpp,$^) -o $@
+
+loudness_bench: $(LOUDNESS_BENCH)
+	$(LOUDNESS_BENCH) $(BENCH_ARGS)
+
+$(LOUDNESS_BENCH): $(SIM_DIR)/loudness_bench.cpp $(ROOT)/app/loudness.cpp $(ROOT)/app/loudness.h \
+				   $(ROOT)/app/gain_stage.cpp $(ROOT)/app/simd.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app $(filter %.cpp,$^) -o $@
+
+crossfade_mixer_bench: $(CROSSFADE_MIXER_BENCH)
+	$(CROSSFADE_MIXER_BENCH) $(BENCH_ARGS)
+
+$(CROSSFADE_MIXER_BENCH): $(SIM_DIR)/crossfade_mixer_bench.cpp $(ROOT)/app/crossfade_mixer.cpp \
+						  $(ROOT)/app/crossfade_mixer.h $(ROOT)/app/i2s_stream.h $(ROOT)/app/simd.h \
+						  $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app -I$(ROOT)/libaxidma/include $(filter %.cpp,$^) -o $@
+
+cma_budget_bench: $(CMA_BUDGET_BENCH)
+	$(CMA_BUDGET_BENCH) $(BENCH_ARGS)
+
+$(CMA_BUDGET_BENCH): $(SIM_DIR)/cma_budget_bench.cpp $(ROOT)/app/cma_budget.cpp $(ROOT)/app/cma_budget.h $(BENCH_UTIL)
+	@mkdir -p $(SIM_BUILD_DIR)
+	$(HOST_CXX) $(SIM_CXXFLAGS) -I$(ROOT)/app $(filter %.cpp,$^) -pthread -o $@
+
+aes_cosim-clean:
+	rm -rf $(SIM_BUILD_DIR)
+
+endif # SIM_MAKEFILE_